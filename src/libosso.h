@@ -51,8 +51,10 @@ typedef enum {
   OSSO_RPC_ERROR = -4, /**< Osso RPC method returned an error. */
   OSSO_ERROR_NAME = -3,
   OSSO_ERROR_NO_STATE = -5, /**< No state file found to read. */
-  OSSO_ERROR_STATE_SIZE = -6 /**< The size of the given structure is
+  OSSO_ERROR_STATE_SIZE = -6, /**< The size of the given structure is
 			    * different from the saved size */
+  OSSO_RPC_PENDING = -7 /**< The reply to an RPC is sent later, see
+                         * #osso_rpc_defer_reply. */
 } osso_return_t;
 
 
@@ -93,6 +95,40 @@ osso_context_t * osso_initialize(const gchar *application,
 				 gboolean activation,
 				 GMainContext *context);
 
+/**
+ * Flags for #osso_initialize_with_flags.
+ */
+typedef enum {
+    /** Same as #osso_initialize. */
+    OSSO_INIT_DEFAULT = 0,
+    /** Connect to the system bus only when a function that needs it is
+     * called for the first time. That call then waits for the
+     * connection. */
+    OSSO_INIT_LAZY_SYSTEM_BUS = 1 << 0,
+    /** Like #OSSO_INIT_LAZY_SYSTEM_BUS, but also connect to the system bus
+     * when the main loop is idle for the first time after the
+     * initialization. */
+    OSSO_INIT_IDLE_SYSTEM_BUS = 1 << 1
+} osso_init_flags_t;
+
+/**
+ * This function is like #osso_initialize, but the connection to the
+ * system bus can be delayed to speed up the start of the application.
+ * The session bus is always connected before this function returns.
+ * @param application The name of the application, see #osso_initialize.
+ * @param version The version string of the application. It must be
+ * comparable with strcmp().
+ * @param flags A bitwise OR of #osso_init_flags_t values.
+ * @param context The GLib main loop context to connect to, or NULL for
+ * the default context.
+ * @return A context to use in later calls to this library. NULL is
+ * returned if an error happened.
+ */
+osso_context_t * osso_initialize_with_flags(const gchar *application,
+                                            const gchar *version,
+                                            osso_init_flags_t flags,
+                                            GMainContext *context);
+
 /**
  * This function initializes the library, using the D-Bus connections passed
  * as arguments. Notice that dbus_connection_setup_with_g_main is not called
@@ -131,6 +167,35 @@ osso_context_t *osso_initialize_with_connections(const gchar *application,
  */
 void osso_deinitialize(osso_context_t *osso);
 
+/**
+ * When the messages that the library sends are written to the bus, see
+ * #osso_set_flush_policy.
+ */
+typedef enum {
+    /** Write each message before the function sending it returns. This
+     * is the default. */
+    OSSO_FLUSH_IMMEDIATE = 0,
+    /** Write the replies of the RPC callbacks once all the messages
+     * received so far have been handled, so that a burst of calls is
+     * answered with few writes. Messages sent outside the callbacks are
+     * written immediately. */
+    OSSO_FLUSH_END_OF_DISPATCH,
+    /** Write the messages when the main loop is idle. This batches the
+     * most, but a busy main loop delays the messages. */
+    OSSO_FLUSH_IDLE
+} osso_flush_policy_t;
+
+/**
+ * Sets when the messages sent by the library, such as the replies of the
+ * RPC callbacks, are written to the bus. Messages that are waiting to be
+ * written are written when the policy is changed.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param policy The new flush policy.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid.
+ */
+osso_return_t osso_set_flush_policy(osso_context_t *osso,
+                                    osso_flush_policy_t policy);
+
 /* @} */
 /************************************************************************/
 /**
@@ -140,6 +205,8 @@ void osso_deinitialize(osso_context_t *osso);
  */
 /* @{*/
 
+typedef struct _osso_rpc_array_t osso_rpc_array_t;
+
 /**
  * The argument element used in the generic RPC functions is a GArray of 
  * these #osso_rpc_t structures.
@@ -152,10 +219,106 @@ typedef struct {
     gboolean b; /**<Type is DBUS_TYPE_BOOLEAN */
     gdouble d; /**<Type is DBUS_TYPE_DOUBLE */
     gchar *s; /**<Type is DBUS_TYPE_STRING */
+    osso_rpc_array_t *a; /**<Type is DBUS_TYPE_ARRAY */
+                         /* A received DBUS_TYPE_UNIX_FD is in i; it is
+                          * closed by #osso_rpc_free_val */
   } value; /**<The way the param is interpreted depends on the #type field.*/
 }
 osso_rpc_t;
 
+/**
+ * An entry of a dictionary, which is an #osso_rpc_array_t of elem_type
+ * DBUS_TYPE_DICT_ENTRY. On D-Bus the dictionary is of the type a{sv}.
+ */
+typedef struct {
+  const gchar *key; /**<The key */
+  osso_rpc_t value; /**<The value, of any type that #osso_rpc_t has */
+} osso_rpc_dict_entry_t;
+
+/**
+ * The value of an #osso_rpc_t of type DBUS_TYPE_ARRAY. Byte arrays are
+ * arrays with elem_type DBUS_TYPE_BYTE.
+ *
+ * The arrays in the arguments of an #osso_rpc_cb_f and in the return
+ * value given to an #osso_rpc_async_f are views into the D-Bus message:
+ * borrowed is TRUE, and the elements are valid only until the callback
+ * returns. Copy what is needed after that. The arrays returned by the
+ * blocking RPC functions are copies.
+ */
+struct _osso_rpc_array_t {
+  int elem_type; /**<DBUS_TYPE_BYTE, DBUS_TYPE_BOOLEAN, DBUS_TYPE_INT16,
+                  * DBUS_TYPE_UINT16, DBUS_TYPE_INT32, DBUS_TYPE_UINT32,
+                  * DBUS_TYPE_INT64, DBUS_TYPE_UINT64, DBUS_TYPE_DOUBLE,
+                  * DBUS_TYPE_STRING or DBUS_TYPE_DICT_ENTRY */
+  guint len; /**<The number of elements */
+  gconstpointer data; /**<The elements: a C array of the D-Bus type
+                       * (dbus_bool_t for booleans), of const gchar
+                       * pointers for strings, or of
+                       * #osso_rpc_dict_entry_t for dictionaries */
+  gboolean borrowed; /**<TRUE if the elements belong to a D-Bus
+                      * message */
+};
+
+/**
+ * This function sets val to a copy of an array. The copy is freed by
+ * #osso_rpc_free_val, so val can be used as the retval of an
+ * #osso_rpc_cb_f that is registered with #osso_rpc_free_val as the
+ * retval_free function.
+ * @param val The value to set.
+ * @param elem_type The type of the elements, see #osso_rpc_array_t.
+ * @param elems The elements, see #osso_rpc_array_t. The strings and the
+ * dictionary entries are copied too.
+ * @param len The number of elements.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid.
+ */
+osso_return_t osso_rpc_set_array(osso_rpc_t *val, int elem_type,
+                                 gconstpointer elems, guint len);
+
+/**
+ * This function is #osso_rpc_set_array for a byte array.
+ */
+osso_return_t osso_rpc_set_byte_array(osso_rpc_t *val, const guchar *bytes,
+                                      guint len);
+
+/**
+ * The type of bulk data in the variable arguments of the RPC functions.
+ * It is followed by a pointer to an #osso_rpc_bulk_t. Large data is
+ * passed in a sealed memfd when the connection can pass file
+ * descriptors, so that it is not copied through the bus daemon, and
+ * inline as a byte array otherwise. The receiver gets a
+ * DBUS_TYPE_UNIX_FD or a DBUS_TYPE_ARRAY argument, and reads it with
+ * #osso_rpc_bulk_map in either case.
+ */
+#define OSSO_RPC_TYPE_BULK ((int) 'B')
+
+/**
+ * Bulk data that is sent or received with #OSSO_RPC_TYPE_BULK.
+ */
+typedef struct {
+  gconstpointer data; /**<The data */
+  gsize len; /**<The length of the data */
+  gboolean mapped; /**<Set by #osso_rpc_bulk_map, for internal use */
+} osso_rpc_bulk_t;
+
+/**
+ * This function gives the data of a received bulk argument. Data passed
+ * in a memfd is mapped read-only, and the mapping stays valid until
+ * #osso_rpc_bulk_unmap, even after arg is freed. Data that was sent
+ * inline is not copied, so it is valid only as long as arg.
+ * @param arg A DBUS_TYPE_UNIX_FD argument, or a DBUS_TYPE_ARRAY of bytes.
+ * @param bulk Returns the data.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid,
+ * and #OSSO_ERROR if the file descriptor could not be mapped.
+ */
+osso_return_t osso_rpc_bulk_map(const osso_rpc_t *arg,
+                                osso_rpc_bulk_t *bulk);
+
+/**
+ * This function releases the data returned by #osso_rpc_bulk_map.
+ * @param bulk The data.
+ */
+void osso_rpc_bulk_unmap(osso_rpc_bulk_t *bulk);
+
 /**
  * This function frees the contents of the #osso_rpc_t structure
  * pointed to by rpc.  (It does not free the structure itself.)  You
@@ -163,7 +326,9 @@ osso_rpc_t;
  * related functions.
  *
  * This function will call g_free to free the memory pointed to by
- * rpc->value.s when rpc->type is #DBUS_TYPE_STRING.  This guarantee
+ * rpc->value.s when rpc->type is #DBUS_TYPE_STRING. Arrays are freed
+ * with their elements, except for the elements that are borrowed from a
+ * D-Bus message.  This guarantee
  * allows you to use this function as the retval_free parameter for
  * #osso_rpc_set_cb_f, etc, when you get that string from #g_strdup,
  * #g_strdup_printf, etc.
@@ -189,11 +354,58 @@ void osso_rpc_free_val (osso_rpc_t *rpc);
  * DBUS_TYPE_INVALID for no reply. #OSSO_ERROR, if an error occured, a
  * dbus_error will be returned, and the retval should be of type
  * DBUS_TYPE_STRING with an error message string as value.
+ * #OSSO_RPC_PENDING if the function called #osso_rpc_defer_reply and
+ * the reply is sent later; retval is ignored.
  */
 typedef gint (osso_rpc_cb_f)(const gchar *interface, const gchar *method,
 			     GArray *arguments, gpointer data,
 			     osso_rpc_t *retval);
 
+/**
+ * An opaque handle to the reply of an RPC whose handler returned
+ * #OSSO_RPC_PENDING.
+ */
+typedef struct _osso_rpc_reply_token_t osso_rpc_reply_token_t;
+
+/**
+ * This function can be called by an #osso_rpc_cb_f to send its reply
+ * later, for example after some I/O has completed. The callback must then
+ * return #OSSO_RPC_PENDING, and the reply must be sent with
+ * #osso_rpc_complete_reply or #osso_rpc_complete_error. The token keeps
+ * the D-Bus connection and the method call it belongs to, so it stays
+ * valid even if the context is deinitialized. It must only be used in the
+ * thread running the main loop.
+ * @param osso The library context as returned by #osso_initialize.
+ * @return The reply token, or NULL if not called from an #osso_rpc_cb_f
+ * or if memory could not be allocated.
+ */
+osso_rpc_reply_token_t *osso_rpc_defer_reply(osso_context_t *osso);
+
+/**
+ * Sends the reply of a deferred RPC and frees the token. Nothing is sent
+ * if the caller did not want a reply. The reply is flushed according to
+ * the #osso_set_flush_policy of the context.
+ * @param token The token returned by #osso_rpc_defer_reply.
+ * @param retval The return value, or NULL or DBUS_TYPE_INVALID for a
+ * reply without a value. It is not freed.
+ * @return #OSSO_OK on success, #OSSO_INVALID if token is NULL, and
+ * #OSSO_ERROR if the reply could not be sent.
+ */
+osso_return_t osso_rpc_complete_reply(osso_rpc_reply_token_t *token,
+                                      const osso_rpc_t *retval);
+
+/**
+ * Sends an error as the reply of a deferred RPC and frees the token. The
+ * error is named like the errors of #osso_rpc_cb_f functions that return
+ * #OSSO_ERROR.
+ * @param token The token returned by #osso_rpc_defer_reply.
+ * @param message The error message, may be NULL.
+ * @return #OSSO_OK on success, #OSSO_INVALID if token is NULL, and
+ * #OSSO_ERROR if the reply could not be sent.
+ */
+osso_return_t osso_rpc_complete_error(osso_rpc_reply_token_t *token,
+                                      const gchar *message);
+
 /**
  * This is the type for the asyncronous RPC return value callback
  * function.  This function is called when the asynchronous function
@@ -229,6 +441,10 @@ typedef void (osso_rpc_async_f)(const gchar *interface,
  *    - The value is a float.
  *  - DBUS_TYPE_STRING
  *    - The value is a pointer to a string.
+ *  - DBUS_TYPE_ARRAY
+ *    - The value is a pointer to an #osso_rpc_array_t.
+ *  - #OSSO_RPC_TYPE_BULK
+ *    - The value is a pointer to an #osso_rpc_bulk_t.
  * @param osso The library context as returned by #osso_initialize.
  * @param service The service name of the remote service,
  * e.g. com.nokia.application.
@@ -452,6 +668,267 @@ osso_return_t osso_rpc_async_run_with_defaults (osso_context_t * osso,
                                                 gpointer data,
                                                 int argument_type, ...);
 
+/**
+ * An opaque handle to a pending RPC call, see #osso_rpc_async_call.
+ */
+typedef struct _osso_rpc_call_t osso_rpc_call_t;
+
+/**
+ * This function is like #osso_rpc_async_run, but it has a timeout of its
+ * own and returns a handle with which the call can be cancelled.
+ *
+ * @param osso The library context as returned by #osso_initialize.
+ * @param service The service name of the other application.
+ * @param object_path The object path of the target object.
+ * @param interface The interface that the RPC function belongs to.
+ * @param method The RPC function to call.
+ * @param timeout The timeout of this call in milliseconds, or -1 for the
+ * RPC timeout of the context. If it passes, async_cb is called with an
+ * error generated by the D-BUS library.
+ * @param async_cb The function to call with the return value. It must not
+ * be NULL.
+ * @param data Arbitrary application specific pointer that will be passed
+ * to async_cb.
+ * @param data_destroy A function that frees data, or NULL. It is called
+ * after async_cb, or when the call is cancelled.
+ * @param argument_type The type of the first argument.
+ * @param ... The first argument value, and then a type-value list of other
+ * arguments. The list must be terminated with DBUS_TYPE_INVALID type.
+ * @return The handle of the call, or NULL if the call could not be made.
+ * The handle stays valid until it is released with
+ * #osso_rpc_call_cancel, which must be done also after async_cb has been
+ * called.
+ */
+osso_rpc_call_t *osso_rpc_async_call(osso_context_t *osso,
+                                     const gchar *service,
+                                     const gchar *object_path,
+                                     const gchar *interface,
+                                     const gchar *method,
+                                     gint timeout,
+                                     osso_rpc_async_f *async_cb,
+                                     gpointer data,
+                                     GDestroyNotify data_destroy,
+                                     int argument_type, ...);
+
+/**
+ * This function is like #osso_rpc_async_call, but the arguments are
+ * appended by argfill, see #osso_rpc_async_run_with_argfill.
+ */
+osso_rpc_call_t *osso_rpc_async_call_with_argfill(osso_context_t *osso,
+                                                  const gchar *service,
+                                                  const gchar *object_path,
+                                                  const gchar *interface,
+                                                  const gchar *method,
+                                                  gint timeout,
+                                                  osso_rpc_async_f *async_cb,
+                                                  gpointer data,
+                                                  GDestroyNotify data_destroy,
+                                                  osso_rpc_argfill *argfill,
+                                                  gpointer argfill_data);
+
+/**
+ * This function cancels a call made with #osso_rpc_async_call and
+ * releases its handle. If the reply has not arrived yet, it is ignored
+ * when it arrives, the callback is not called, and the data of the call
+ * is freed with its data_destroy function before this function returns.
+ * If the callback has already been called, only the handle is released.
+ * It must not be called from the callback, and only once per handle.
+ * @param call The handle of the call.
+ */
+void osso_rpc_call_cancel(osso_rpc_call_t *call);
+
+/**
+ * An opaque method call that is prepared once and sent many times, see
+ * #osso_rpc_template_new.
+ */
+typedef struct _osso_rpc_template_t osso_rpc_template_t;
+
+/**
+ * This function prepares a method call for repeated sending. The names
+ * are validated and the message header is composed once; each call made
+ * with #osso_rpc_template_run or #osso_rpc_template_async_run copies the
+ * header and only appends the arguments.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param service The service name of the remote service.
+ * @param object_path The object path of the remote service.
+ * @param interface The interface of the method.
+ * @param method The method to call.
+ * @param use_system_bus TRUE to call on the system bus, FALSE for the
+ * session bus.
+ * @return The template, or NULL if a parameter is invalid or an error
+ * occurred. It is freed with #osso_rpc_template_free, which must be done
+ * before the context is deinitialized.
+ */
+osso_rpc_template_t *osso_rpc_template_new(osso_context_t *osso,
+                                           const gchar *service,
+                                           const gchar *object_path,
+                                           const gchar *interface,
+                                           const gchar *method,
+                                           gboolean use_system_bus);
+
+/**
+ * This function calls the method of the template and waits for the
+ * reply, like #osso_rpc_run.
+ * @param tmpl The template returned by #osso_rpc_template_new.
+ * @param retval A pointer to a structure where the return value can be
+ * stored, as with #osso_rpc_run. If NULL, the reply is not waited for.
+ * @param argument_type The type of the first argument.
+ * @param ... The first argument value, and then a type-value list of other
+ * arguments. The list must be terminated with DBUS_TYPE_INVALID type.
+ * @return The same as #osso_rpc_run.
+ */
+osso_return_t osso_rpc_template_run(const osso_rpc_template_t *tmpl,
+                                    osso_rpc_t *retval,
+                                    int argument_type, ...);
+
+/**
+ * This function calls the method of the template without waiting for
+ * the reply, like #osso_rpc_async_run.
+ * @param tmpl The template returned by #osso_rpc_template_new.
+ * @param async_cb The function to call with the return value, or NULL.
+ * @param data Arbitrary application specific pointer that will be passed
+ * to async_cb.
+ * @param argument_type The type of the first argument.
+ * @param ... The first argument value, and then a type-value list of other
+ * arguments. The list must be terminated with DBUS_TYPE_INVALID type.
+ * @return The same as #osso_rpc_async_run.
+ */
+osso_return_t osso_rpc_template_async_run(const osso_rpc_template_t *tmpl,
+                                          osso_rpc_async_f *async_cb,
+                                          gpointer data,
+                                          int argument_type, ...);
+
+/**
+ * This function frees a template.
+ * @param tmpl The template returned by #osso_rpc_template_new.
+ */
+void osso_rpc_template_free(osso_rpc_template_t *tmpl);
+
+/**
+ * An opaque batch of RPC calls that are sent back to back and whose
+ * replies are collected together. See #osso_rpc_batch_new.
+ */
+typedef struct _osso_rpc_batch_t osso_rpc_batch_t;
+
+/**
+ * The result of one call of a batch.
+ */
+typedef struct {
+    /** #OSSO_OK if the call returned, #OSSO_RPC_ERROR if it returned an
+     * error or timed out, #OSSO_ERROR if it could not be sent, and
+     * #OSSO_RPC_PENDING if the reply has not arrived yet. */
+    osso_return_t status;
+    /** The return value of the call, or the error message as a string if
+     * the status is not #OSSO_OK. */
+    osso_rpc_t retval;
+} osso_rpc_batch_result_t;
+
+/**
+ * The type of the function called when all the calls of a batch have
+ * returned, see #osso_rpc_batch_send.
+ * @param batch The batch. It may be freed in this function.
+ * @param results The results, in the order the calls were added.
+ * @param n_results The number of results.
+ * @param data The data that was given to #osso_rpc_batch_send.
+ */
+typedef void (osso_rpc_batch_f)(osso_rpc_batch_t *batch,
+                                const osso_rpc_batch_result_t *results,
+                                guint n_results, gpointer data);
+
+/**
+ * This function creates an empty batch of RPC calls on the session bus.
+ * The calls are added with #osso_rpc_batch_add and sent all at once
+ * with #osso_rpc_batch_send or #osso_rpc_batch_wait, which costs less
+ * than calling #osso_rpc_async_run for each of them.
+ * @param osso The library context as returned by #osso_initialize.
+ * @return The new batch, or NULL on error. It must be freed with
+ * #osso_rpc_batch_free.
+ */
+osso_rpc_batch_t *osso_rpc_batch_new(osso_context_t *osso);
+
+/**
+ * This function adds a call to a batch that has not been sent yet. The
+ * arguments are as for #osso_rpc_async_run.
+ * @param batch The batch.
+ * @param service The service name of the other application.
+ * @param object_path The object path of the target object.
+ * @param interface The interface that the RPC function belongs to.
+ * @param method The RPC function to call.
+ * @param argument_type The type of the first argument.
+ * @param ... The first argument value, and then a type-value list of other
+ * arguments. The list must be terminated with DBUS_TYPE_INVALID type.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid
+ * or the batch was already sent, and #OSSO_ERROR if an error occurred.
+ */
+osso_return_t osso_rpc_batch_add(osso_rpc_batch_t *batch,
+                                 const gchar *service,
+                                 const gchar *object_path,
+                                 const gchar *interface,
+                                 const gchar *method,
+                                 int argument_type, ...);
+
+/**
+ * This function is like #osso_rpc_batch_add, but the arguments are
+ * appended by argfill, see #osso_rpc_async_run_with_argfill. argfill is
+ * called before this function returns.
+ */
+osso_return_t osso_rpc_batch_add_with_argfill(osso_rpc_batch_t *batch,
+                                              const gchar *service,
+                                              const gchar *object_path,
+                                              const gchar *interface,
+                                              const gchar *method,
+                                              osso_rpc_argfill *argfill,
+                                              gpointer argfill_data);
+
+/**
+ * This function sends the calls of a batch and returns without waiting
+ * for the replies. When every call has returned, failed or timed out
+ * with the RPC timeout of the context, batch_cb is called once with all
+ * the results.
+ * @param batch The batch, with at least one call.
+ * @param batch_cb The function to call with the results, or NULL.
+ * @param data Arbitrary application specific pointer that will be passed
+ * to batch_cb.
+ * @return #OSSO_OK if at least one call was sent, #OSSO_INVALID if a
+ * parameter is invalid or the batch was already sent, and #OSSO_ERROR if
+ * none of the calls could be sent.
+ */
+osso_return_t osso_rpc_batch_send(osso_rpc_batch_t *batch,
+                                  osso_rpc_batch_f *batch_cb,
+                                  gpointer data);
+
+/**
+ * This function sends the calls of a batch and blocks until all of them
+ * have returned or the timeout has passed. The timeout covers the whole
+ * batch, not each call. The results are then available with
+ * #osso_rpc_batch_get_results.
+ * @param batch The batch, with at least one call.
+ * @param timeout The timeout in milliseconds, or -1 for the RPC timeout
+ * of the context.
+ * @return #OSSO_OK if every call returned successfully, #OSSO_RPC_ERROR
+ * if some returned an error or timed out, #OSSO_INVALID if a parameter
+ * is invalid or the batch was already sent, and #OSSO_ERROR if some
+ * call could not be sent.
+ */
+osso_return_t osso_rpc_batch_wait(osso_rpc_batch_t *batch, gint timeout);
+
+/**
+ * This function returns the results of a batch that was sent.
+ * @param batch The batch.
+ * @param n_results Where to return the number of results, may be NULL.
+ * @return The results in the order the calls were added, owned by the
+ * batch, or NULL if the batch was not sent.
+ */
+const osso_rpc_batch_result_t *
+osso_rpc_batch_get_results(osso_rpc_batch_t *batch, guint *n_results);
+
+/**
+ * This function frees a batch. The calls that have not returned yet are
+ * cancelled, and the callback of the batch is not called.
+ * @param batch The batch.
+ */
+void osso_rpc_batch_free(osso_rpc_batch_t *batch);
+
 /**
  * The type for functions that free the contents of a #osso_rpc_t
  * structure that is used as a retval with an RPC callback.  See
@@ -546,6 +1023,68 @@ osso_return_t osso_rpc_unset_cb_f (osso_context_t * osso,
 osso_return_t osso_rpc_unset_default_cb_f (osso_context_t * osso,
                                            osso_rpc_cb_f * cb, gpointer data);
 
+/**
+ * The type for RPC functions that are given their arguments without
+ * copying them out of the message.  The arguments are kept on the stack
+ * when there are only a few of them, so for basic types a call does not
+ * allocate any memory.
+ * @param interface The interface that the method is called on.
+ * @param method The method that is called.
+ * @param args The arguments of the method.  The strings and arrays in them
+ * point into the D-Bus message, so args and everything it points to is
+ * only valid until the callback returns.  Copy what you need to keep.
+ * @param n_args The number of elements in args.
+ * @param data An application specific pointer.
+ * @param retval The return value of the method, as for #osso_rpc_cb_f.
+ * @return As for #osso_rpc_cb_f.
+ */
+typedef gint (osso_rpc_borrowed_cb_f)(const gchar *interface,
+                                      const gchar *method,
+                                      const osso_rpc_t *args, guint n_args,
+                                      gpointer data, osso_rpc_t *retval);
+
+/**
+ * This function registers an #osso_rpc_borrowed_cb_f for handling RPC
+ * calls to a given object of a service.  It is otherwise like
+ * #osso_rpc_set_cb_f_with_free.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param service The service name to set up, e.g. com.nokia.application.
+ * @param object_path The object path that this object has.
+ * @param interface The interface that this object implements.
+ * @param cb The function to register.
+ * @param data Arbitrary application specific pointer that will be passed
+ * to the callback and ignored by Libosso.
+ * @param retval_free As for #osso_rpc_set_cb_f_with_free.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is
+ * invalid, and #OSSO_ERROR if an error occurred.
+ */
+osso_return_t osso_rpc_set_borrowed_cb_f(osso_context_t *osso,
+                                         const gchar *service,
+                                         const gchar *object_path,
+                                         const gchar *interface,
+                                         osso_rpc_borrowed_cb_f *cb,
+                                         gpointer data,
+                                         osso_rpc_retval_free_f *retval_free);
+
+/**
+ * This function unregisters an #osso_rpc_borrowed_cb_f.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param service The service name to unregister.
+ * @param object_path The object path that this object has.
+ * @param interface The interface that this object implements.
+ * @param cb The function that was registered.
+ * @param data The same pointer that was used with the
+ * #osso_rpc_set_borrowed_cb_f call.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a
+ * parameter is invalid, and #OSSO_ERROR if an error occurred.
+ */
+osso_return_t osso_rpc_unset_borrowed_cb_f(osso_context_t *osso,
+                                           const gchar *service,
+                                           const gchar *object_path,
+                                           const gchar *interface,
+                                           osso_rpc_borrowed_cb_f *cb,
+                                           gpointer data);
+
 /**
  * Sets the timeout value used by the RPC functions.
  * @param osso The library context as returned by #osso_initialize.
@@ -562,6 +1101,169 @@ osso_return_t osso_rpc_get_timeout (osso_context_t * osso, gint * timeout);
  */
 osso_return_t osso_rpc_set_timeout(osso_context_t * osso, gint timeout);
 
+/**
+ * This function lets other libosso processes connect directly to this
+ * one. It opens a private D-Bus server on an abstract unix socket, whose
+ * address is given over the session bus to those that call
+ * #osso_rpc_peer_connect. The RPC calls that come through the direct
+ * connections are handled by the same callbacks as the calls from the
+ * bus. Only processes of the same user can connect.
+ * @param osso The library context as returned by #osso_initialize.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid,
+ * and #OSSO_ERROR if the server could not be opened.
+ */
+osso_return_t osso_rpc_peer_listen(osso_context_t *osso);
+
+/**
+ * This function connects directly to the process that owns a service on
+ * the session bus, if that process has called #osso_rpc_peer_listen.
+ * After that, #osso_rpc_run, #osso_rpc_async_run and the related
+ * functions send the calls to that service over the direct connection
+ * instead of through the D-Bus daemon. If the connection is closed, the
+ * calls go through the bus again.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param service The service to connect to.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid,
+ * and #OSSO_ERROR if the service does not accept direct connections.
+ * The calls still work through the bus in that case.
+ */
+osso_return_t osso_rpc_peer_connect(osso_context_t *osso,
+                                    const gchar *service);
+
+/**
+ * This function closes a connection opened by #osso_rpc_peer_connect.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param service The service.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid
+ * or there is no direct connection to the service.
+ */
+osso_return_t osso_rpc_peer_disconnect(osso_context_t *osso,
+                                       const gchar *service);
+
+/**
+ * Opaque type of a reply cache, see #osso_rpc_cache_new.
+ */
+typedef struct _osso_rpc_cache_t osso_rpc_cache_t;
+
+/**
+ * This function starts caching the replies of a method that only returns
+ * state, such as a getter. After this, #osso_rpc_run and the related
+ * synchronous functions return a successful reply to the same call with
+ * the same arguments from memory, without sending the call, until the
+ * reply expires or the cache is invalidated by one of the signals given
+ * to #osso_rpc_cache_invalidate_on. Error replies are not cached, and
+ * neither are calls that pass file descriptors.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param service The service of the method.
+ * @param object_path The object path of the method.
+ * @param interface The interface of the method.
+ * @param method The name of the method.
+ * @param ttl The time in milliseconds that a reply is kept, or 0 to keep
+ * it until invalidation.
+ * @param use_system_bus TRUE for the calls made on the system bus, FALSE
+ * for the session bus.
+ * @return The new cache, or NULL if a parameter is invalid, the method is
+ * already cached or an error occurred. The cache is freed with
+ * #osso_rpc_cache_free or #osso_deinitialize.
+ */
+osso_rpc_cache_t *osso_rpc_cache_new(osso_context_t *osso,
+                                     const gchar *service,
+                                     const gchar *object_path,
+                                     const gchar *interface,
+                                     const gchar *method,
+                                     guint ttl,
+                                     gboolean use_system_bus);
+
+/**
+ * This function makes a signal drop all the replies of the cache. It can
+ * be called several times for different signals. The signal is received
+ * from the same bus as the cached method is called on.
+ * @param cache The cache returned by #osso_rpc_cache_new.
+ * @param object_path The object path of the signal.
+ * @param interface The interface of the signal.
+ * @param signal The name of the signal.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid,
+ * and #OSSO_ERROR if an error occurred.
+ */
+osso_return_t osso_rpc_cache_invalidate_on(osso_rpc_cache_t *cache,
+                                           const gchar *object_path,
+                                           const gchar *interface,
+                                           const gchar *signal);
+
+/**
+ * This function drops all the replies of the cache.
+ * @param cache The cache returned by #osso_rpc_cache_new.
+ */
+void osso_rpc_cache_clear(osso_rpc_cache_t *cache);
+
+/**
+ * This function returns the number of calls that were answered from the
+ * cache and the number of those that were sent.
+ * @param cache The cache returned by #osso_rpc_cache_new.
+ * @param hits A pointer where to return the number of hits, or NULL.
+ * @param misses A pointer where to return the number of misses, or NULL.
+ */
+void osso_rpc_cache_get_stats(const osso_rpc_cache_t *cache, guint *hits,
+                              guint *misses);
+
+/**
+ * This function stops caching the method and frees the cache.
+ * @param cache The cache returned by #osso_rpc_cache_new.
+ */
+void osso_rpc_cache_free(osso_rpc_cache_t *cache);
+
+/**
+ * This function starts watching the owner of a D-Bus name, so that
+ * #osso_name_has_owner and #osso_name_get_owner can answer without
+ * asking the D-Bus daemon. The owner is asked once, and then followed
+ * from the NameOwnerChanged signals. Watches are counted, each call must
+ * be paired with #osso_name_unwatch.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param name The well-known or unique name to watch.
+ * @param system_bus TRUE to watch the name on the system bus, FALSE for
+ * the session bus.
+ * @return #OSSO_OK on success, #OSSO_INVALID if a parameter is invalid,
+ * and #OSSO_ERROR if an error occurred.
+ */
+osso_return_t osso_name_watch(osso_context_t *osso, const gchar *name,
+                              gboolean system_bus);
+
+/**
+ * This function stops a watch started with #osso_name_watch.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param name The watched name.
+ * @param system_bus The bus given to #osso_name_watch.
+ * @return #OSSO_OK on success, #OSSO_INVALID if the name is not watched.
+ */
+osso_return_t osso_name_unwatch(osso_context_t *osso, const gchar *name,
+                                gboolean system_bus);
+
+/**
+ * This function tells whether a D-Bus name has an owner. For a watched
+ * name the answer comes from the cache of the context; only the first
+ * query after #osso_name_watch may wait for the D-Bus daemon. Other
+ * names are asked from the daemon.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param name The name.
+ * @param system_bus TRUE for the system bus, FALSE for the session bus.
+ * @return TRUE if the name has an owner, FALSE if not or on error.
+ */
+gboolean osso_name_has_owner(osso_context_t *osso, const gchar *name,
+                             gboolean system_bus);
+
+/**
+ * This function returns the unique name of the owner of a watched D-Bus
+ * name.
+ * @param osso The library context as returned by #osso_initialize.
+ * @param name The name, which must be watched with #osso_name_watch.
+ * @param system_bus TRUE for the system bus, FALSE for the session bus.
+ * @return The unique name of the owner, or NULL if the name has no owner
+ * or is not watched. The string belongs to the context and may change
+ * when the main loop runs.
+ */
+const gchar *osso_name_get_owner(osso_context_t *osso, const gchar *name,
+                                 gboolean system_bus);
+
 /* @}*/
 /**********************************************************************/
 /**
@@ -1328,6 +2030,38 @@ osso_return_t osso_hw_set_event_cb(osso_context_t *osso,
 osso_return_t osso_hw_unset_event_cb(osso_context_t *osso,
 				     osso_hw_state_t *state);
 
+/**
+ * This function adds a device state callback. Unlike with
+ * #osso_hw_set_event_cb, which keeps one callback for each state, any
+ * number of callbacks can be added for the same states, each with its
+ * own mask. The signals are decoded once and the new state is passed to
+ * all the callbacks of the states that it changes. Like with
+ * #osso_hw_set_event_cb, the callback may be called immediately.
+ *
+ * @param osso The library context as returned by #osso_initialize.
+ * @param state The states the callback is interested in, or NULL for all
+ * of them.
+ * @param cb The callback function.
+ * @param data Arbitrary application specific pointer that will be passed
+ * to the callback and ignored by Libosso.
+ * @return An id for #osso_hw_remove_event_cb, which is never reused in
+ * the context, or 0 if an error occurred or some parameter is invalid.
+ */
+guint osso_hw_add_event_cb(osso_context_t *osso,
+                           const osso_hw_state_t *state,
+                           osso_hw_cb_f *cb, gpointer data);
+
+/**
+ * This function removes a device state callback added with
+ * #osso_hw_add_event_cb. It can be called from a device state callback.
+ *
+ * @param osso The library context as returned by #osso_initialize.
+ * @param id The id returned by #osso_hw_add_event_cb.
+ * @return #OSSO_OK if all goes well, or #OSSO_INVALID if some parameter
+ * is invalid or there is no callback with the id.
+ */
+osso_return_t osso_hw_remove_event_cb(osso_context_t *osso, guint id);
+
 
 typedef enum {
   OSSO_DISPLAY_ON,
@@ -1353,6 +2087,135 @@ osso_return_t osso_hw_set_display_event_cb(osso_context_t *osso,
 					   osso_display_event_cb_f *cb,
 					   gpointer data);
 
+/**
+ * This function makes the calling process the publisher of the shared
+ * device state segment. The segment is a small file in $XDG_RUNTIME_DIR,
+ * or in /dev/shm if it is not set, one for each user, that holds the device mode, the display state and the
+ * shutdown, low memory and inactivity indications. The publisher keeps
+ * the segment up to date from the D-Bus signals of the system, and other
+ * processes read it with #osso_hw_state_read without using D-Bus.
+ * Only one process can publish the segment at a time; it stops
+ * publishing when the context is deinitialized.
+ *
+ * @param osso The library context as returned by #osso_initialize.
+ * @return #OSSO_OK if all goes well, #OSSO_ERROR if another process
+ * publishes the segment or an error occurred, or #OSSO_INVALID if the
+ * context is not valid.
+ */
+osso_return_t osso_hw_state_publish(osso_context_t *osso);
+
+/**
+ * This function reads the current device state from the shared device
+ * state segment (see #osso_hw_state_publish). Once the segment has been
+ * mapped, reading it makes no system calls, except that it checks with
+ * one call at most every half a second that the publisher is still
+ * running; the state of a publisher that has died is not returned. The
+ * save_unsaved_data_ind member of the state is always FALSE, since that
+ * signal has no state.
+ *
+ * @param osso The library context as returned by #osso_initialize.
+ * @param state The device state is stored here, or NULL.
+ * @param display The display state is stored here, or NULL.
+ * @return #OSSO_OK if all goes well, #OSSO_ERROR if no process publishes
+ * the segment, or #OSSO_INVALID if some parameter is invalid.
+ */
+osso_return_t osso_hw_state_read(osso_context_t *osso,
+                                 osso_hw_state_t *state,
+                                 osso_display_state_t *display);
+
+/**
+ * The fields of #osso_hw_snapshot_t. save_unsaved_data_ind has no
+ * state, so it has no field.
+ */
+typedef enum {
+  OSSO_HW_FIELD_SHUTDOWN = 0,
+  OSSO_HW_FIELD_MEMORY_LOW,
+  OSSO_HW_FIELD_INACTIVITY,
+  OSSO_HW_FIELD_DEVICE_MODE,
+  OSSO_HW_FIELD_DISPLAY,
+  OSSO_HW_N_FIELDS
+} osso_hw_field_t;
+
+/**
+ * This structure tells how fresh a field of #osso_hw_snapshot_t is.
+ */
+typedef struct {
+  gint64 updated; /**<The CLOCK_MONOTONIC time in microseconds when the
+                      value was last received, or 0 if it is not known */
+  gboolean live;  /**<The value is kept current by a signal subscription.
+                      Otherwise it is the result of an earlier query and
+                      may be out of date. */
+} osso_hw_field_info_t;
+
+/**
+ * This structure is a snapshot of the device state.
+ */
+typedef struct {
+  osso_hw_state_t state; /**<The device state; save_unsaved_data_ind
+                             is always FALSE */
+  osso_display_state_t display; /**<The display state */
+  osso_hw_field_info_t info[OSSO_HW_N_FIELDS]; /**<The freshness of each
+                                                   field, indexed by
+                                                   #osso_hw_field_t */
+} osso_hw_snapshot_t;
+
+/**
+ * This function returns the device state that Libosso already knows,
+ * without D-Bus calls or waiting. The state is kept current by the
+ * callbacks of #osso_hw_set_event_cb, #osso_hw_add_event_cb and
+ * #osso_hw_set_display_event_cb, and by the queries made when they are
+ * registered. The fields that no callback keeps current are taken from
+ * the shared device state segment if #osso_hw_state_read has mapped it
+ * and its publisher is still running. Their updated time is when the
+ * publisher was last seen running, at most half a second before the
+ * call.
+ *
+ * @param osso The library context as returned by #osso_initialize.
+ * @param snapshot The snapshot is stored here.
+ * @return #OSSO_OK if all goes well, or #OSSO_INVALID if some parameter
+ * is invalid.
+ */
+osso_return_t osso_hw_get_state_snapshot(osso_context_t *osso,
+                                         osso_hw_snapshot_t *snapshot);
+
+/**
+ * The coalescing policies of #osso_hw_set_coalescing.
+ */
+typedef enum {
+  OSSO_COALESCE_NONE = 0,  /**<The callbacks are called for every signal.
+                               This is the default. */
+  OSSO_COALESCE_ON_CHANGE, /**<The callbacks are called on the next main
+                               loop iteration, and only if the value is
+                               not the one they were last given */
+  OSSO_COALESCE_LATEST     /**<Like #OSSO_COALESCE_ON_CHANGE, but the
+                               callbacks are called when the window has
+                               passed since the first signal, so a burst
+                               of signals gives one call with the latest
+                               value */
+} osso_coalesce_policy_t;
+
+/**
+ * This function sets how the signals of a device state field are passed
+ * to the callbacks of #osso_hw_set_event_cb, #osso_hw_add_event_cb and
+ * (for #OSSO_HW_FIELD_DISPLAY) #osso_hw_set_display_event_cb. MCE can
+ * send bursts of display and inactivity signals; with coalescing, the
+ * callbacks are called at most once per main loop iteration, or per
+ * window, and not for a value they already have. The state tracked by
+ * Libosso (see #osso_hw_get_state_snapshot) is still updated for every
+ * signal.
+ *
+ * @param osso The library context as returned by #osso_initialize.
+ * @param field The field of the device state.
+ * @param policy The coalescing policy.
+ * @param window_ms The window of #OSSO_COALESCE_LATEST in milliseconds.
+ * @return #OSSO_OK if all goes well, #OSSO_ERROR if memory could not be
+ * allocated, or #OSSO_INVALID if some parameter is invalid.
+ */
+osso_return_t osso_hw_set_coalescing(osso_context_t *osso,
+                                     osso_hw_field_t field,
+                                     osso_coalesce_policy_t policy,
+                                     guint window_ms);
+
 /*@}*/
 /**********************************************************************/
 /**
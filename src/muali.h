@@ -79,6 +79,12 @@ typedef struct {
 #define MUALI_TYPE_DOUBLE       5
 #define MUALI_TYPE_STRING       6
 #define MUALI_TYPE_DATA         7
+/* Bulk data. When sending, it is given like MUALI_TYPE_DATA, and it is
+ * passed in a sealed memfd if the connection can pass file descriptors.
+ * When received, value.i is the file descriptor, which is closed after
+ * the handler returns; use #muali_bulk_map to read the data. Bulk data
+ * that was sent inline is received as MUALI_TYPE_DATA. */
+#define MUALI_TYPE_BULK         8
 
 typedef enum {
         MUALI_BUS_IRRELEVANT = 0,
@@ -270,6 +276,54 @@ muali_error_t muali_send_varargs(muali_context_t *context,
                                  const char *message_name,
                                  int arg_type, ...);
 
+/* A method call prepared once for repeated sending */
+typedef struct _muali_template_t muali_template_t;
+
+/**
+ * This function prepares a method call for repeated sending with
+ * #muali_send_template. The service, object path and interface are made
+ * from the destination like in #muali_send_varargs, with the prefix that
+ * is in use now, and the names are validated once.
+ *
+ * @param context Muali context.
+ * @param bus_type #MUALI_BUS_SESSION or #MUALI_BUS_SYSTEM.
+ * @param destination The destination, as for #muali_send_varargs.
+ * @param message_name The name of the method.
+ *
+ * @return The template, or NULL on error. It must be freed with
+ *         #muali_template_free before the context is destroyed.
+ */
+muali_template_t *muali_template_new(muali_context_t *context,
+                                     muali_bus_type bus_type,
+                                     const char *destination,
+                                     const char *message_name);
+
+/**
+ * This function sends the method call of a template. Only the arguments
+ * are appended to a copy of the prepared message.
+ *
+ * @param tmpl The template returned by #muali_template_new.
+ * @param reply_handler The handler of the reply, as for
+ *                      #muali_send_varargs, or NULL.
+ * @param user_data The user data given to reply_handler.
+ * @param arg_type The type of the first argument, followed by its value
+ *                 and other type-value pairs, terminated by
+ *                 #MUALI_TYPE_INVALID.
+ *
+ * @return #MUALI_ERROR_SUCCESS on success.
+ */
+muali_error_t muali_send_template(const muali_template_t *tmpl,
+                                  muali_handler_t *reply_handler,
+                                  const void *user_data,
+                                  int arg_type, ...);
+
+/**
+ * This function frees a template.
+ *
+ * @param tmpl The template returned by #muali_template_new.
+ */
+void muali_template_free(muali_template_t *tmpl);
+
 /* blocking */
 muali_error_t muali_send_string_and_wait(muali_context_t *context,
                                          muali_event_info_t *reply,
@@ -329,6 +383,35 @@ muali_error_t muali_reply_varargs(muali_context_t *context,
                                   const char *message_id,
                                   int arg_type, ...);
 
+/**************************/
+/* receiving bulk data    */
+/**************************/
+
+/**
+ * This function maps the data of a received MUALI_TYPE_BULK argument
+ * read-only to memory. For a MUALI_TYPE_DATA argument it returns the
+ * data as is, so that the receiver does not need to care how the data
+ * was sent. The mapping stays valid after the handler returns, until
+ * #muali_bulk_unmap is called.
+ *
+ * @param arg The argument.
+ * @param data Returns the data.
+ * @param len Returns the length of the data.
+ *
+ * @return #MUALI_ERROR_SUCCESS on success.
+ */
+muali_error_t muali_bulk_map(const muali_arg_t *arg, const void **data,
+                             int *len);
+
+/**
+ * This function unmaps data returned by #muali_bulk_map.
+ *
+ * @param arg The argument that was given to #muali_bulk_map.
+ * @param data The data.
+ * @param len The length of the data.
+ */
+void muali_bulk_unmap(const muali_arg_t *arg, const void *data, int len);
+
 muali_error_t muali_reply_error(muali_context_t *context,
                                 const char *message_id,
                                 const char *error_name,
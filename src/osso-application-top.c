@@ -36,8 +36,9 @@ static guint dummy_serial;
 #define LOADING_SCREEN_METHOD           "LaunchApplication"
 
 static gboolean
-osso_app_top_show_animation (DBusConnection *con, const char *service)
+osso_app_top_show_animation (osso_context_t *osso, const char *service)
 {
+        DBusConnection *con = osso->conn;
         DBusMessage *msg;
         gboolean     success = FALSE;
 
@@ -52,7 +53,7 @@ osso_app_top_show_animation (DBusConnection *con, const char *service)
                         if (dbus_connection_send (con, msg, NULL) == TRUE) {
                                 dprint ("Sent message to service: '%s'",
                                         LOADING_SCREEN_SERVICE);
-                                dbus_connection_flush (con);
+                                _osso_flush (osso, con);
                                 success = TRUE;
                         } else
                             dprint ("Couldn't send message to service: '%s'",
@@ -75,7 +76,7 @@ osso_return_t osso_application_top(osso_context_t *osso,
                                    const gchar *application,
                                    const gchar *arguments)
 {
-    char service[MAX_SVC_LEN], path[MAX_OP_LEN], interface[MAX_IF_LEN];
+    const _osso_default_names_t *names;
     DBusMessage *msg = NULL;
     const char *arg = "";
 
@@ -87,14 +88,15 @@ osso_return_t osso_application_top(osso_context_t *osso,
     ULOG_DEBUG_F("Topping application (service) '%s' with args '%s'",
 	         application, arguments);
 
-    make_default_service(application, service);
-    make_default_object_path(application, path);
-    make_default_interface(application, interface);
+    names = _osso_default_names(osso, application);
+    if (names == NULL) {
+        return OSSO_ERROR;
+    }
 
-    ULOG_DEBUG_F("New method: %s:%s:%s:" OSSO_BUS_TOP, service, path,
-                 interface);
-    msg = dbus_message_new_method_call(service, path, interface,
-				       OSSO_BUS_TOP);
+    ULOG_DEBUG_F("New method: %s:%s:%s:" OSSO_BUS_TOP, names->service,
+                 names->path, names->interface);
+    msg = dbus_message_new_method_call(names->service, names->path,
+                                       names->interface, OSSO_BUS_TOP);
     if (msg == NULL) {
         ULOG_ERR_F("dbus_message_new_method_call() failed");
         return OSSO_ERROR;
@@ -121,7 +123,7 @@ osso_return_t osso_application_top(osso_context_t *osso,
     else {
 	dbus_message_unref(msg);
 
-	osso_app_top_show_animation(osso->conn, service);
+	osso_app_top_show_animation(osso, names->service);
 	return OSSO_OK;
     }
 }
@@ -0,0 +1,232 @@
+/**
+ * @file osso-bulk.c
+ * This file implements the bulk data transfer of the RPC and Muali
+ * functions. A large payload is written to a sealed memfd and only the
+ * file descriptor is sent, so the data is not copied through the bus
+ * daemon. When the connection cannot pass file descriptors, the payload
+ * is sent inline as an array of bytes.
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2006 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "osso-internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* payloads smaller than this are cheaper to copy than to map */
+#define BULK_FD_THRESHOLD 4096
+
+#if defined(F_ADD_SEALS) && defined(F_GET_SEALS)
+# define BULK_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+#endif
+
+/* Returns a sealed memfd with a copy of data, or -1 if memfds are not
+ * available. */
+static int bulk_memfd(const void *data, gsize len)
+{
+#if defined(HAVE_MEMFD_CREATE) && defined(BULK_SEALS)
+    const char *p = data;
+    int fd;
+
+    fd = memfd_create("libosso-bulk", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        ULOG_WARN_F("memfd_create failed: %s", strerror(errno));
+        return -1;
+    }
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ULOG_ERR_F("write failed: %s", strerror(errno));
+            close(fd);
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, BULK_SEALS | F_SEAL_SEAL) != 0) {
+        ULOG_ERR_F("sealing the memfd failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+gboolean __attribute__ ((visibility("hidden")))
+_osso_bulk_append(DBusMessageIter *iter, DBusConnection *conn,
+                  const void *data, gsize len)
+{
+    DBusMessageIter sub;
+    dbus_bool_t ret;
+
+    if (len >= BULK_FD_THRESHOLD && conn != NULL
+        && dbus_connection_can_send_type(conn, DBUS_TYPE_UNIX_FD)) {
+        int fd = bulk_memfd(data, len);
+
+        if (fd >= 0) {
+            /* the message keeps a duplicate of the fd */
+            ret = dbus_message_iter_append_basic(iter, DBUS_TYPE_UNIX_FD,
+                                                 &fd);
+            close(fd);
+            return ret;
+        }
+    }
+
+    if (!dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+                                          DBUS_TYPE_BYTE_AS_STRING, &sub)) {
+        return FALSE;
+    }
+    ret = dbus_message_iter_append_fixed_array(&sub, DBUS_TYPE_BYTE, &data,
+                                               len);
+    return dbus_message_iter_close_container(iter, &sub) && ret;
+}
+
+gboolean __attribute__ ((visibility("hidden")))
+_osso_bulk_map(int fd, const void **data, gsize *len)
+{
+#ifdef BULK_SEALS
+    struct stat st;
+    void *p;
+    int seals;
+
+    /* an unsealed file could be truncated under the mapping */
+    seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & BULK_SEALS) != BULK_SEALS) {
+        ULOG_ERR_F("fd %d is not a sealed memfd", fd);
+        return FALSE;
+    }
+    if (fstat(fd, &st) != 0) {
+        ULOG_ERR_F("fstat failed: %s", strerror(errno));
+        return FALSE;
+    }
+
+    if (st.st_size == 0) {
+        *data = NULL;
+        *len = 0;
+        return TRUE;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        ULOG_ERR_F("mmap failed: %s", strerror(errno));
+        return FALSE;
+    }
+    *data = p;
+    *len = st.st_size;
+    return TRUE;
+#else
+    ULOG_ERR_F("memfd seals are not supported");
+    return FALSE;
+#endif
+}
+
+void __attribute__ ((visibility("hidden")))
+_osso_bulk_unmap(const void *data, gsize len)
+{
+    if (data != NULL && len > 0) {
+        munmap((void*)data, len);
+    }
+}
+
+/************************************************************************/
+
+osso_return_t osso_rpc_bulk_map(const osso_rpc_t *arg,
+                                osso_rpc_bulk_t *bulk)
+{
+    if (arg == NULL || bulk == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    bulk->mapped = FALSE;
+    if (arg->type == DBUS_TYPE_UNIX_FD) {
+        if (!_osso_bulk_map(arg->value.i, &bulk->data, &bulk->len)) {
+            return OSSO_ERROR;
+        }
+        bulk->mapped = TRUE;
+    } else if (arg->type == DBUS_TYPE_ARRAY && arg->value.a != NULL
+               && arg->value.a->elem_type == DBUS_TYPE_BYTE) {
+        /* sent inline */
+        bulk->data = arg->value.a->data;
+        bulk->len = arg->value.a->len;
+    } else {
+        ULOG_ERR_F("the argument is not bulk data");
+        return OSSO_INVALID;
+    }
+    return OSSO_OK;
+}
+
+void osso_rpc_bulk_unmap(osso_rpc_bulk_t *bulk)
+{
+    if (bulk != NULL && bulk->mapped) {
+        _osso_bulk_unmap(bulk->data, bulk->len);
+        bulk->data = NULL;
+        bulk->len = 0;
+        bulk->mapped = FALSE;
+    }
+}
+
+muali_error_t muali_bulk_map(const muali_arg_t *arg, const void **data,
+                             int *len)
+{
+        gsize size;
+
+        if (arg == NULL || data == NULL || len == NULL) {
+                ULOG_ERR_F("invalid arguments");
+                return MUALI_ERROR_INVALID;
+        }
+
+        if (arg->type == MUALI_TYPE_DATA) {
+                /* sent inline */
+                *data = arg->value.data;
+                *len = arg->data_len;
+                return MUALI_ERROR_SUCCESS;
+        } else if (arg->type != MUALI_TYPE_BULK) {
+                ULOG_ERR_F("the argument is not bulk data");
+                return MUALI_ERROR_INVALID;
+        }
+
+        if (!_osso_bulk_map(arg->value.i, data, &size)) {
+                return MUALI_ERROR;
+        }
+        if (size > G_MAXINT) {
+                _osso_bulk_unmap(*data, size);
+                ULOG_ERR_F("%lu bytes is too much", (unsigned long)size);
+                return MUALI_ERROR;
+        }
+        *len = size;
+        return MUALI_ERROR_SUCCESS;
+}
+
+void muali_bulk_unmap(const muali_arg_t *arg, const void *data, int len)
+{
+        if (arg != NULL && arg->type == MUALI_TYPE_BULK) {
+                _osso_bulk_unmap(data, len);
+        }
+}
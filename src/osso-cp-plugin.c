@@ -40,22 +40,11 @@ static gboolean
 is_applet_running_in_cp (osso_context_t *osso,
                          const char *filename)
 {
-  DBusError *error = NULL;
-  gboolean cp_running;
   osso_return_t ret;
   osso_rpc_t retval;
 
-  cp_running = dbus_bus_name_has_owner (osso->conn,
-                                        HCP_SERVICE,
-                                        error);
-  if (error)
-    {
-      ULOG_ERR_F("Error in dbus_bus_name_has_owner: %s", error->message);
-      dbus_error_free (error);
-      return FALSE;
-    }
-
-  if (!cp_running)
+  /* answered from the name owner cache after the first time */
+  if (!_osso_name_has_owner (osso, osso->conn, HCP_SERVICE))
     return FALSE;
 
 
@@ -32,27 +32,37 @@
   "type='signal',interface='" MCE_SIGNAL_IF "',"\
   "member='" MCE_DISPLAY_SIG "'"
 
-static osso_display_state_t get_display_state(osso_context_t *osso)
+/* Sets state from the display status string of MCE. Returns FALSE if
+ * the string is not known. */
+gboolean _osso_parse_display_state(const char *s, osso_display_state_t *state)
+{
+        if (strncmp(s, MCE_DISPLAY_ON_STRING,
+                    strlen(MCE_DISPLAY_ON_STRING) + 1) == 0) {
+                *state = OSSO_DISPLAY_ON;
+        } else if (strncmp(s, MCE_DISPLAY_DIM_STRING,
+                           strlen(MCE_DISPLAY_DIM_STRING) + 1) == 0) {
+                *state = OSSO_DISPLAY_DIMMED;
+        } else if (strncmp(s, MCE_DISPLAY_OFF_STRING,
+                           strlen(MCE_DISPLAY_OFF_STRING) + 1) == 0) {
+                *state = OSSO_DISPLAY_OFF;
+        } else {
+                return FALSE;
+        }
+        return TRUE;
+}
+
+osso_display_state_t _osso_get_display_state(osso_context_t *osso)
 {
         DBusMessageIter iter;
         DBusMessage* m = NULL, *r = NULL;
         DBusError err;
-        dbus_bool_t ret = FALSE;
         char *s = NULL;
         osso_display_state_t new_state;
 
         assert(osso->sys_conn != NULL);
-        dbus_error_init(&err);
 
-        ret = dbus_bus_name_has_owner(osso->sys_conn, MCE_SERVICE, &err);
-        if (!ret) {
-                if (dbus_error_is_set(&err)) {
-                        ULOG_ERR_F("error: %s", err.message);
-                        dbus_error_free(&err);
-                } else {
-                        ULOG_ERR_F("service %s does not exist",
-                                   MCE_SERVICE);
-                }
+        if (!_osso_name_has_owner(osso, osso->sys_conn, MCE_SERVICE)) {
+                ULOG_ERR_F("service %s does not exist", MCE_SERVICE);
                 return OSSO_DISPLAY_ON; /* wild guess */
         }
         m = dbus_message_new_method_call(MCE_SERVICE, MCE_REQUEST_PATH,
@@ -78,16 +88,7 @@ static osso_display_state_t get_display_state(osso_context_t *osso)
                 return OSSO_DISPLAY_ON;
         }
 
-        if (strncmp(s, MCE_DISPLAY_ON_STRING,
-                    strlen(MCE_DISPLAY_ON_STRING) + 1) == 0) {
-                new_state = OSSO_DISPLAY_ON;
-        } else if (strncmp(s, MCE_DISPLAY_DIM_STRING,
-                           strlen(MCE_DISPLAY_DIM_STRING) + 1) == 0) {
-                new_state = OSSO_DISPLAY_DIMMED;
-        } else if (strncmp(s, MCE_DISPLAY_OFF_STRING,
-                           strlen(MCE_DISPLAY_OFF_STRING) + 1) == 0) {
-                new_state = OSSO_DISPLAY_OFF;
-        } else {
+        if (!_osso_parse_display_state(s, &new_state)) {
                 ULOG_ERR_F("Unknown argument: %s", s);
                 new_state = OSSO_DISPLAY_ON;
         }
@@ -108,14 +109,13 @@ osso_return_t osso_hw_set_display_event_cb(osso_context_t *osso,
                                            gpointer data) 
 {
   _osso_callback_data_t *ot;
-  DBusError error;
   osso_display_state_t state;
 
   if (osso == NULL || cb == NULL) {
       ULOG_ERR_F("invalid arguments");
       return OSSO_INVALID;
   }
-  if (osso->sys_conn == NULL) {
+  if (_osso_get_sys_conn(osso) == NULL) {
       ULOG_ERR_F("no D-Bus system bus connection");
       return OSSO_INVALID;
   }
@@ -126,11 +126,7 @@ osso_return_t osso_hw_set_display_event_cb(osso_context_t *osso,
       return OSSO_ERROR;
   }
 
-  dbus_error_init(&error);
-  dbus_bus_add_match(osso->sys_conn, MATCH_RULE, &error);
-  if (dbus_error_is_set(&error)) {
-      ULOG_ERR_F("dbus_bus_add_match() failed: %s", error.message);
-      dbus_error_free(&error);
+  if (!_osso_match_add(osso, osso->sys_conn, MATCH_RULE)) {
       free(ot);
       return OSSO_ERROR;
   }
@@ -139,14 +135,22 @@ osso_return_t osso_hw_set_display_event_cb(osso_context_t *osso,
   ot->user_data = data;
   ot->data = MCE_DISPLAY_SIG;
 
-  _msg_handler_set_cb_f_free_data(osso,
-                                  NULL,
-                                  MCE_SIGNAL_PATH,
-                                  MCE_SIGNAL_IF,
-                                  _display_state_handler, ot, FALSE);
-
-  /* call the callback now so that the current state is known */
-  state = get_display_state(osso);
+  _msg_handler_set_member_cb_f_free_data(osso,
+                                         NULL,
+                                         MCE_SIGNAL_PATH,
+                                         MCE_SIGNAL_IF,
+                                         MCE_DISPLAY_SIG,
+                                         _display_state_handler, ot, FALSE);
+  osso->hw_cbs.display_cbs = g_slist_append(osso->hw_cbs.display_cbs, ot);
+
+  /* call the callback now so that the current state is known; the
+   * shared device state segment saves the call to MCE if it is there */
+  if (osso_hw_state_read(osso, NULL, &state) != OSSO_OK) {
+      state = _osso_get_display_state(osso);
+  }
+  osso->display_state = state;
+  osso->display_live = TRUE;
+  _osso_hw_touch(osso, OSSO_HW_FIELD_DISPLAY);
   (*cb)(state, data);
 
   return OSSO_OK;
@@ -176,20 +180,31 @@ static void _display_state_handler(osso_context_t *osso,
             return;
         }
 
-        if (strncmp(tmp, MCE_DISPLAY_ON_STRING,
-                    strlen(MCE_DISPLAY_ON_STRING) + 1) == 0) {
-            new_state = OSSO_DISPLAY_ON;
-        } else if (strncmp(tmp, MCE_DISPLAY_DIM_STRING,
-                           strlen(MCE_DISPLAY_DIM_STRING) + 1) == 0) {
-            new_state = OSSO_DISPLAY_DIMMED;
-        } else if (strncmp(tmp, MCE_DISPLAY_OFF_STRING,
-                           strlen(MCE_DISPLAY_OFF_STRING) + 1) == 0) {
-            new_state = OSSO_DISPLAY_OFF;
-        } else {
+        if (!_osso_parse_display_state(tmp, &new_state)) {
             ULOG_ERR_F("Unknown argument: %s", tmp);
             return;
         }
+        osso->display_state = new_state;
+        _osso_hw_touch(osso, OSSO_HW_FIELD_DISPLAY);
+        if (_osso_hw_coalesce(osso, OSSO_HW_FIELD_DISPLAY)) {
+            /* _osso_display_notify is called later */
+            return;
+        }
 
         (*handler)(new_state, ot->user_data);
     }
 }
+
+/* Calls all the display callbacks with the current state. This is used
+ * when the signals are coalesced, see osso_hw_set_coalescing. */
+void _osso_display_notify(osso_context_t *osso)
+{
+    GSList *l;
+
+    for (l = osso->hw_cbs.display_cbs; l != NULL; l = l->next) {
+        _osso_callback_data_t *ot = l->data;
+        osso_display_event_cb_f *handler = ot->user_cb;
+
+        (*handler)(osso->display_state, ot->user_data);
+    }
+}
@@ -30,6 +30,11 @@
 #include <mce/dbus-names.h>
 #include <mce/mode-names.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 /* user lowmem signal */
 #define USER_LOWMEM_OFF_SIGNAL_SVC "com.nokia.ke_recv"
@@ -74,7 +79,7 @@ osso_return_t osso_display_state_on(osso_context_t *osso)
     return OSSO_INVALID;
   }
   
-  if (osso->sys_conn == NULL) {
+  if (_osso_get_sys_conn(osso) == NULL) {
     ULOG_ERR_F("error: no system bus connection");
     return OSSO_ERROR;
   }
@@ -91,7 +96,7 @@ osso_return_t osso_display_state_on(osso_context_t *osso)
     dbus_message_unref(msg);
     return OSSO_ERROR;
   }
-  dbus_connection_flush(osso->sys_conn);
+  _osso_flush(osso, osso->sys_conn);
   dbus_message_unref(msg);
   return OSSO_OK;
 }
@@ -105,7 +110,7 @@ osso_return_t osso_display_blanking_pause(osso_context_t *osso)
     return OSSO_INVALID;
   }
   
-  if (osso->sys_conn == NULL) {
+  if (_osso_get_sys_conn(osso) == NULL) {
     ULOG_ERR_F("error: no sys D-BUS connection!");
     return OSSO_ERROR;
   }
@@ -122,63 +127,324 @@ osso_return_t osso_display_blanking_pause(osso_context_t *osso)
     dbus_message_unref(msg);
     return OSSO_ERROR;
   }
-  dbus_connection_flush(osso->sys_conn);
+  _osso_flush(osso, osso->sys_conn);
   dbus_message_unref(msg);
   return OSSO_OK;
 }
 
+/* signal_handler is registered separately for each signal it handles,
+ * so that it is not called for other MCE and DSME signals */
+static void set_signal_handlers(osso_context_t *osso)
+{
+    _msg_handler_set_member_cb_f(osso, MCE_SERVICE, MCE_SIGNAL_PATH,
+                                 MCE_SIGNAL_IF, MCE_INACTIVITY_SIG,
+                                 signal_handler, NULL, FALSE);
+    _msg_handler_set_member_cb_f(osso, MCE_SERVICE, MCE_SIGNAL_PATH,
+                                 MCE_SIGNAL_IF, MCE_DEVICE_MODE_SIG,
+                                 signal_handler, NULL, FALSE);
+    _msg_handler_set_member_cb_f(osso, DSME_SIGNAL_SVC, DSME_SIGNAL_OP,
+                                 DSME_SIGNAL_IF, SHUTDOWN_SIGNAL_NAME,
+                                 signal_handler, NULL, FALSE);
+    _msg_handler_set_member_cb_f(osso, DSME_SIGNAL_SVC, DSME_SIGNAL_OP,
+                                 DSME_SIGNAL_IF, DATASAVE_SIGNAL_NAME,
+                                 signal_handler, NULL, FALSE);
+}
+
+static void unset_signal_handlers(osso_context_t *osso)
+{
+    _msg_handler_rm_member_cb_f(osso, MCE_SERVICE, MCE_SIGNAL_PATH,
+                                MCE_SIGNAL_IF, MCE_INACTIVITY_SIG,
+                                (const _osso_handler_f*)signal_handler,
+                                NULL, FALSE);
+    _msg_handler_rm_member_cb_f(osso, MCE_SERVICE, MCE_SIGNAL_PATH,
+                                MCE_SIGNAL_IF, MCE_DEVICE_MODE_SIG,
+                                (const _osso_handler_f*)signal_handler,
+                                NULL, FALSE);
+    _msg_handler_rm_member_cb_f(osso, DSME_SIGNAL_SVC, DSME_SIGNAL_OP,
+                                DSME_SIGNAL_IF, SHUTDOWN_SIGNAL_NAME,
+                                (const _osso_handler_f*)signal_handler,
+                                NULL, FALSE);
+    _msg_handler_rm_member_cb_f(osso, DSME_SIGNAL_SVC, DSME_SIGNAL_OP,
+                                DSME_SIGNAL_IF, DATASAVE_SIGNAL_NAME,
+                                (const _osso_handler_f*)signal_handler,
+                                NULL, FALSE);
+}
+
+/* The indicators in the order of osso_hw_state_t, with their match
+ * rules */
+#define N_INDICATORS 5
+
+static const char *const indicator_matches[N_INDICATORS][2] = {
+    {SHUTDOWN_IND_MATCH, NULL},
+    {SAVE_UNSAVED_DATA_IND_MATCH, NULL},
+    {MEMORY_LOW_OFF_MATCH, MEMORY_LOW_ON_MATCH},
+    {SYSTEM_INACTIVITY_IND_MATCH, NULL},
+    {SIG_DEVICE_MODE_IND_MATCH, NULL}
+};
+
+static _osso_hw_cb_data_t *indicator(osso_context_t *osso, int i)
+{
+    _osso_hw_cb_data_t *inds[N_INDICATORS] = {
+        &osso->hw_cbs.shutdown_ind,
+        &osso->hw_cbs.save_unsaved_data_ind,
+        &osso->hw_cbs.memory_low_ind,
+        &osso->hw_cbs.system_inactivity_ind,
+        &osso->hw_cbs.sig_device_mode_ind
+    };
+
+    return inds[i];
+}
+
+static gboolean in_mask(const osso_hw_state_t *mask, int i)
+{
+    switch (i) {
+        case 0:
+            return mask->shutdown_ind;
+        case 1:
+            return mask->save_unsaved_data_ind;
+        case 2:
+            return mask->memory_low_ind;
+        case 3:
+            return mask->system_inactivity_ind;
+        default:
+            return mask->sig_device_mode_ind;
+    }
+}
+
+static gboolean add_matches(osso_context_t *osso, const osso_hw_state_t *mask)
+{
+    int i, j;
+
+    for (i = 0; i < N_INDICATORS; ++i) {
+        if (!in_mask(mask, i)) {
+            continue;
+        }
+        for (j = 0; j < 2 && indicator_matches[i][j] != NULL; ++j) {
+            if (!_osso_match_add(osso, osso->sys_conn,
+                                 indicator_matches[i][j])) {
+                goto rollback;
+            }
+        }
+    }
+    return TRUE;
+
+rollback:
+    /* drop the rules added so far */
+    while (j-- > 0) {
+        _osso_match_remove(osso, osso->sys_conn, indicator_matches[i][j]);
+    }
+    while (i-- > 0) {
+        if (!in_mask(mask, i)) {
+            continue;
+        }
+        for (j = 0; j < 2 && indicator_matches[i][j] != NULL; ++j) {
+            _osso_match_remove(osso, osso->sys_conn,
+                               indicator_matches[i][j]);
+        }
+    }
+    return FALSE;
+}
+
+static void remove_matches(osso_context_t *osso, const osso_hw_state_t *mask)
+{
+    int i, j;
+
+    for (i = 0; i < N_INDICATORS; ++i) {
+        if (!in_mask(mask, i)) {
+            continue;
+        }
+        for (j = 0; j < 2 && indicator_matches[i][j] != NULL; ++j) {
+            _osso_match_remove(osso, osso->sys_conn,
+                               indicator_matches[i][j]);
+        }
+    }
+}
+
+static void unlink_subscriber(osso_context_t *osso,
+                              _osso_hw_subscriber_t *s)
+{
+    int i;
+
+    for (i = 0; i < N_INDICATORS; ++i) {
+        if (in_mask(&s->mask, i)) {
+            _osso_hw_cb_data_t *ind = indicator(osso, i);
+
+            ind->subscribers = g_slist_remove(ind->subscribers, s);
+        }
+    }
+}
+
+static void update_signal_handlers(osso_context_t *osso);
+
+/* frees the subscribers that were removed while callbacks were called */
+static void sweep_subscribers(osso_context_t *osso)
+{
+    GSList *l;
+
+    for (l = osso->hw_cbs.removed; l != NULL; l = l->next) {
+        unlink_subscriber(osso, l->data);
+        free(l->data);
+    }
+    g_slist_free(osso->hw_cbs.removed);
+    osso->hw_cbs.removed = NULL;
+    update_signal_handlers(osso);
+}
+
+static void set_lowmem_handlers(osso_context_t *osso)
+{
+    _msg_handler_set_member_cb_f(osso, USER_LOWMEM_OFF_SIGNAL_SVC,
+                                 USER_LOWMEM_OFF_SIGNAL_OP,
+                                 USER_LOWMEM_OFF_SIGNAL_IF,
+                                 USER_LOWMEM_OFF_SIGNAL_NAME,
+                                 lowmem_signal_handler, NULL, FALSE);
+    _msg_handler_set_member_cb_f(osso, USER_LOWMEM_ON_SIGNAL_SVC,
+                                 USER_LOWMEM_ON_SIGNAL_OP,
+                                 USER_LOWMEM_ON_SIGNAL_IF,
+                                 USER_LOWMEM_ON_SIGNAL_NAME,
+                                 lowmem_signal_handler, NULL, FALSE);
+}
+
+static void unset_lowmem_handlers(osso_context_t *osso)
+{
+    _msg_handler_rm_member_cb_f(osso, USER_LOWMEM_OFF_SIGNAL_SVC,
+                                USER_LOWMEM_OFF_SIGNAL_OP,
+                                USER_LOWMEM_OFF_SIGNAL_IF,
+                                USER_LOWMEM_OFF_SIGNAL_NAME,
+                                (const _osso_handler_f*)lowmem_signal_handler,
+                                NULL, FALSE);
+    _msg_handler_rm_member_cb_f(osso, USER_LOWMEM_ON_SIGNAL_SVC,
+                                USER_LOWMEM_ON_SIGNAL_OP,
+                                USER_LOWMEM_ON_SIGNAL_IF,
+                                USER_LOWMEM_ON_SIGNAL_NAME,
+                                (const _osso_handler_f*)lowmem_signal_handler,
+                                NULL, FALSE);
+}
+
+/* Installs the signal handlers when an indicator they serve gets its
+ * first callback, and removes them when the last callback is gone.
+ * Each handler is installed once, however many callbacks there are. */
+static void update_signal_handlers(osso_context_t *osso)
+{
+    gboolean needed = _is_listened(shutdown_ind)
+                      || _is_listened(save_unsaved_data_ind)
+                      || _is_listened(system_inactivity_ind)
+                      || _is_listened(sig_device_mode_ind);
+
+    if (needed && !osso->hw_cbs.handlers_set) {
+        set_signal_handlers(osso);
+    } else if (!needed && osso->hw_cbs.handlers_set) {
+        unset_signal_handlers(osso);
+    }
+    osso->hw_cbs.handlers_set = needed;
+
+    needed = _is_listened(memory_low_ind);
+    if (needed && !osso->hw_cbs.lowmem_handlers_set) {
+        set_lowmem_handlers(osso);
+    } else if (!needed && osso->hw_cbs.lowmem_handlers_set) {
+        unset_lowmem_handlers(osso);
+    }
+    osso->hw_cbs.lowmem_handlers_set = needed;
+}
+
+/* Reads the device state when the first callback is registered. The
+ * published state is stored in published, and have_published tells if
+ * there was one. */
+static osso_return_t init_hw_state(osso_context_t *osso,
+                                   osso_hw_state_t *published,
+                                   gboolean *have_published)
+{
+    if (first_hw_set_cb_call) {
+        /* uid is used for naming the device mode cache file, avoiding
+         * permission issues */
+        int ret = snprintf(cache_file_name, MAX_CACHE_FILE_NAME, "%s-%d",
+                           OSSO_DEVSTATE_MODE_FILE, geteuid());
+        if (ret < 0) {
+            ULOG_ERR_F("snprintf failed");
+            return OSSO_ERROR;
+        }
+    }
+    /* the shared device state segment, if someone publishes it, knows
+     * the current state without asking anybody */
+    *have_published = osso_hw_state_read(osso, published, NULL) == OSSO_OK;
+    if (first_hw_set_cb_call) {
+        if (*have_published) {
+            osso->hw_state.shutdown_ind = published->shutdown_ind;
+            osso->hw_state.system_inactivity_ind =
+                published->system_inactivity_ind;
+            osso->hw_state.sig_device_mode_ind =
+                published->sig_device_mode_ind;
+            _osso_hw_touch(osso, OSSO_HW_FIELD_SHUTDOWN);
+            _osso_hw_touch(osso, OSSO_HW_FIELD_INACTIVITY);
+        } else {
+            read_device_state_from_file(osso);
+        }
+        _osso_hw_touch(osso, OSSO_HW_FIELD_DEVICE_MODE);
+    }
+    return OSSO_OK;
+}
+
+/* Calls the callbacks of an indicator after its state has changed.
+ * Subscribers removed meanwhile are only marked, and are freed when
+ * the outermost call returns. */
+static void notify(osso_context_t *osso, _osso_hw_cb_data_t *ind)
+{
+    GSList *l;
+
+    ++osso->hw_cbs.dispatching;
+    if (ind->set) {
+        (ind->cb)(&osso->hw_state, ind->data);
+    }
+    for (l = ind->subscribers; l != NULL; l = l->next) {
+        _osso_hw_subscriber_t *s = l->data;
+
+        if (s->cb != NULL) {
+            (s->cb)(&osso->hw_state, s->data);
+        }
+    }
+    if (--osso->hw_cbs.dispatching == 0 && osso->hw_cbs.removed != NULL) {
+        sweep_subscribers(osso);
+    }
+}
+
 osso_return_t osso_hw_set_event_cb(osso_context_t *osso,
                                    osso_hw_state_t *state,
                                    osso_hw_cb_f *cb,
                                    gpointer data)
 {
     static const osso_hw_state_t default_mask = {TRUE,TRUE,TRUE,TRUE,1};
+    osso_hw_state_t published;
+    gboolean have_published;
     gboolean call_cb = FALSE;
-    gboolean install_mce_handler = FALSE;
-    DBusError error;
+    osso_return_t ret;
 
     ULOG_DEBUG_F("entered");
     if (osso == NULL || cb == NULL) {
 	ULOG_ERR_F("invalid parameters");
 	return OSSO_INVALID;
     }
-    if (osso->sys_conn == NULL) {
+    if (_osso_get_sys_conn(osso) == NULL) {
 	ULOG_ERR_F("error: no system bus connection");
 	return OSSO_INVALID;
     }
 
-    if (first_hw_set_cb_call) {
-        /* uid is used for naming the device mode cache file, avoiding
-         * permission issues */
-        int ret = snprintf(cache_file_name, MAX_CACHE_FILE_NAME, "%s-%d",
-                           OSSO_DEVSTATE_MODE_FILE, geteuid());
-        if (ret < 0) {
-            ULOG_ERR_F("snprintf failed");
-            return OSSO_ERROR;
-        }
-        read_device_state_from_file(osso);
+    ret = init_hw_state(osso, &published, &have_published);
+    if (ret != OSSO_OK) {
+        return ret;
     }
 
     if (state == NULL) {
 	state = (osso_hw_state_t*) &default_mask;
     }
 
-    dbus_error_init(&error);
-
     if (state->shutdown_ind) {
         osso->hw_cbs.shutdown_ind.cb = cb;
         osso->hw_cbs.shutdown_ind.data = data;
         if (!osso->hw_cbs.shutdown_ind.set) {
             /* if callback was not previously registered, add match */
-            dbus_bus_add_match(osso->sys_conn, "type='signal',interface='"
-                SHUTDOWN_SIGNAL_IF "',member='"
-                SHUTDOWN_SIGNAL_NAME "'", &error);
-            if (dbus_error_is_set(&error)) {
-                ULOG_ERR_F("dbus_bus_add_match failed: %s", error.message);
-                dbus_error_free(&error);
+            if (!_osso_match_add(osso, osso->sys_conn,
+                                 SHUTDOWN_IND_MATCH)) {
                 return OSSO_ERROR;
             }
-            install_mce_handler = TRUE;
         }
 	if (osso->hw_state.shutdown_ind) {
             call_cb = TRUE;
@@ -189,47 +455,32 @@ osso_return_t osso_hw_set_event_cb(osso_context_t *osso,
         osso->hw_cbs.memory_low_ind.cb = cb;
         osso->hw_cbs.memory_low_ind.data = data;
         if (!osso->hw_cbs.memory_low_ind.set) {
-            dbus_bus_add_match(osso->sys_conn, "type='signal',interface='"
-                USER_LOWMEM_OFF_SIGNAL_IF "'", &error);
-            if (dbus_error_is_set(&error)) {
-                ULOG_ERR_F("dbus_bus_add_match failed: %s", error.message);
-                dbus_error_free(&error);
+            if (!_osso_match_add(osso, osso->sys_conn,
+                                 MEMORY_LOW_OFF_MATCH)) {
                 return OSSO_ERROR;
             }
-            dbus_bus_add_match(osso->sys_conn, "type='signal',interface='"
-                USER_LOWMEM_ON_SIGNAL_IF "'", &error);
-            if (dbus_error_is_set(&error)) {
-                ULOG_ERR_F("dbus_bus_add_match failed: %s", error.message);
-                dbus_error_free(&error);
+            if (!_osso_match_add(osso, osso->sys_conn,
+                                 MEMORY_LOW_ON_MATCH)) {
+                _osso_match_remove(osso, osso->sys_conn,
+                                   MEMORY_LOW_OFF_MATCH);
                 return OSSO_ERROR;
             }
-            _msg_handler_set_cb_f(osso, USER_LOWMEM_OFF_SIGNAL_SVC,
-                                  USER_LOWMEM_OFF_SIGNAL_OP,
-                                  USER_LOWMEM_OFF_SIGNAL_IF,
-                                  lowmem_signal_handler, NULL, FALSE);
-            _msg_handler_set_cb_f(osso, USER_LOWMEM_ON_SIGNAL_SVC,
-                                  USER_LOWMEM_ON_SIGNAL_OP,
-                                  USER_LOWMEM_ON_SIGNAL_IF,
-                                  lowmem_signal_handler, NULL, FALSE);
         }
         osso->hw_cbs.memory_low_ind.set = TRUE;
 
-        osso->hw_state.memory_low_ind = osso_mem_in_lowmem_state();
+        osso->hw_state.memory_low_ind = have_published
+            ? published.memory_low_ind : osso_mem_in_lowmem_state();
+        _osso_hw_touch(osso, OSSO_HW_FIELD_MEMORY_LOW);
         call_cb = TRUE;
     }
     if (state->save_unsaved_data_ind) {
         osso->hw_cbs.save_unsaved_data_ind.cb = cb;
         osso->hw_cbs.save_unsaved_data_ind.data = data;
         if (!osso->hw_cbs.save_unsaved_data_ind.set) {
-            dbus_bus_add_match(osso->sys_conn, "type='signal',interface='"
-                DATASAVE_SIGNAL_IF "',member='"
-                DATASAVE_SIGNAL_NAME "'", &error);
-            if (dbus_error_is_set(&error)) {
-                ULOG_ERR_F("dbus_bus_add_match failed: %s", error.message);
-                dbus_error_free(&error);
+            if (!_osso_match_add(osso, osso->sys_conn,
+                                 SAVE_UNSAVED_DATA_IND_MATCH)) {
                 return OSSO_ERROR;
             }
-            install_mce_handler = TRUE;
         }
 	/* This signal is stateless: It makes no sense to call the
 	 * application callback */
@@ -239,14 +490,10 @@ osso_return_t osso_hw_set_event_cb(osso_context_t *osso,
         osso->hw_cbs.system_inactivity_ind.cb = cb;
         osso->hw_cbs.system_inactivity_ind.data = data;
         if (!osso->hw_cbs.system_inactivity_ind.set) {
-            dbus_bus_add_match(osso->sys_conn, "type='signal',interface='"
-                MCE_SIGNAL_IF "',member='" MCE_INACTIVITY_SIG "'", &error);
-            if (dbus_error_is_set(&error)) {
-                ULOG_ERR_F("dbus_bus_add_match failed: %s", error.message);
-                dbus_error_free(&error);
+            if (!_osso_match_add(osso, osso->sys_conn,
+                                 SYSTEM_INACTIVITY_IND_MATCH)) {
                 return OSSO_ERROR;
             }
-            install_mce_handler = TRUE;
         }
 	if (osso->hw_state.system_inactivity_ind) {
             call_cb = TRUE;
@@ -257,14 +504,10 @@ osso_return_t osso_hw_set_event_cb(osso_context_t *osso,
         osso->hw_cbs.sig_device_mode_ind.cb = cb;
         osso->hw_cbs.sig_device_mode_ind.data = data;
         if (!osso->hw_cbs.sig_device_mode_ind.set) {
-            dbus_bus_add_match(osso->sys_conn, "type='signal',interface='"
-                MCE_SIGNAL_IF "',member='" MCE_DEVICE_MODE_SIG "'", &error);
-            if (dbus_error_is_set(&error)) {
-                ULOG_ERR_F("dbus_bus_add_match failed: %s", error.message);
-                dbus_error_free(&error);
+            if (!_osso_match_add(osso, osso->sys_conn,
+                                 SIG_DEVICE_MODE_IND_MATCH)) {
                 return OSSO_ERROR;
             }
-            install_mce_handler = TRUE;
         }
 	if (osso->hw_state.sig_device_mode_ind != OSSO_DEVMODE_NORMAL) {
             call_cb = TRUE;
@@ -272,20 +515,7 @@ osso_return_t osso_hw_set_event_cb(osso_context_t *osso,
         osso->hw_cbs.sig_device_mode_ind.set = TRUE;
     }
 
-    if (install_mce_handler) {
-        _msg_handler_set_cb_f(osso,
-                              MCE_SERVICE,
-                              MCE_SIGNAL_PATH,
-                              MCE_SIGNAL_IF,
-                              signal_handler,
-                              NULL, FALSE);
-        _msg_handler_set_cb_f(osso,
-                              DSME_SIGNAL_SVC,
-                              DSME_SIGNAL_OP,
-                              DSME_SIGNAL_IF,
-                              signal_handler,
-                              NULL, FALSE);
-    }
+    update_signal_handlers(osso);
     first_hw_set_cb_call = FALSE;  /* set before calling callbacks */
     if (call_cb) {
         ULOG_DEBUG_F("calling application callback");
@@ -295,8 +525,6 @@ osso_return_t osso_hw_set_event_cb(osso_context_t *osso,
     return OSSO_OK;    
 }
 
-/* TODO: needs additional function that allows several handlers
- * for the same signal */
 osso_return_t osso_hw_unset_event_cb(osso_context_t *osso,
 				     osso_hw_state_t *state)
 {
@@ -306,7 +534,7 @@ osso_return_t osso_hw_unset_event_cb(osso_context_t *osso,
 	ULOG_ERR_F("invalid parameters");
 	return OSSO_INVALID;
     }
-    if (osso->sys_conn == NULL) {
+    if (_osso_get_sys_conn(osso) == NULL) {
 	ULOG_ERR_F("error: no system bus connection");
 	return OSSO_INVALID;
     }
@@ -319,43 +547,390 @@ osso_return_t osso_hw_unset_event_cb(osso_context_t *osso,
 	state = (osso_hw_state_t*) &default_mask;
     }
 
-    _unset_state_cb(shutdown_ind);
+    _unset_state_cb(shutdown_ind, SHUTDOWN_IND_MATCH);
     if (state->memory_low_ind && osso->hw_cbs.memory_low_ind.set) {
         osso->hw_cbs.memory_low_ind.cb = NULL;
         osso->hw_cbs.memory_low_ind.data = NULL;
         osso->hw_cbs.memory_low_ind.set = FALSE;
-        dbus_bus_remove_match(osso->sys_conn, "type='signal',interface='"
-                USER_LOWMEM_OFF_SIGNAL_IF "'", NULL);
-        dbus_bus_remove_match(osso->sys_conn, "type='signal',interface='"
-                USER_LOWMEM_ON_SIGNAL_IF "'", NULL);
-        _msg_handler_rm_cb_f(osso, USER_LOWMEM_OFF_SIGNAL_SVC,
-                             USER_LOWMEM_OFF_SIGNAL_OP,
-                             USER_LOWMEM_OFF_SIGNAL_IF,
-                             (const _osso_handler_f*)lowmem_signal_handler,
-                             NULL, FALSE);
-        _msg_handler_rm_cb_f(osso, USER_LOWMEM_ON_SIGNAL_SVC,
-                             USER_LOWMEM_ON_SIGNAL_OP,
-                             USER_LOWMEM_ON_SIGNAL_IF,
-                             (const _osso_handler_f*)lowmem_signal_handler,
-                             NULL, FALSE);
-    }
-    _unset_state_cb(save_unsaved_data_ind);
-    _unset_state_cb(system_inactivity_ind);
-    _unset_state_cb(sig_device_mode_ind);
-
-    if (_state_is_unset()) {
-	_msg_handler_rm_cb_f(osso, MCE_SERVICE,
-                             MCE_SIGNAL_PATH, MCE_SIGNAL_IF,
-                             (const _osso_handler_f*)signal_handler,
-                             NULL, FALSE);
-	_msg_handler_rm_cb_f(osso, DSME_SIGNAL_SVC,
-                             DSME_SIGNAL_OP, DSME_SIGNAL_IF,
-                             (const _osso_handler_f*)signal_handler,
-                             NULL, FALSE);
+        _osso_match_remove(osso, osso->sys_conn, MEMORY_LOW_OFF_MATCH);
+        _osso_match_remove(osso, osso->sys_conn, MEMORY_LOW_ON_MATCH);
     }
+    _unset_state_cb(save_unsaved_data_ind, SAVE_UNSAVED_DATA_IND_MATCH);
+    _unset_state_cb(system_inactivity_ind, SYSTEM_INACTIVITY_IND_MATCH);
+    _unset_state_cb(sig_device_mode_ind, SIG_DEVICE_MODE_IND_MATCH);
+
+    update_signal_handlers(osso);
     return OSSO_OK;    
 }
 
+guint osso_hw_add_event_cb(osso_context_t *osso,
+                           const osso_hw_state_t *state,
+                           osso_hw_cb_f *cb,
+                           gpointer data)
+{
+    static const osso_hw_state_t default_mask = {TRUE,TRUE,TRUE,TRUE,1};
+    _osso_hw_subscriber_t *s;
+    osso_hw_state_t published;
+    gboolean have_published;
+    gboolean call_cb = FALSE;
+    guint id;
+    int i;
+
+    ULOG_DEBUG_F("entered");
+    if (osso == NULL || cb == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return 0;
+    }
+    if (_osso_get_sys_conn(osso) == NULL) {
+        ULOG_ERR_F("error: no system bus connection");
+        return 0;
+    }
+    if (init_hw_state(osso, &published, &have_published) != OSSO_OK) {
+        return 0;
+    }
+    first_hw_set_cb_call = FALSE;
+
+    if (state == NULL) {
+        state = &default_mask;
+    }
+
+    s = calloc(1, sizeof(_osso_hw_subscriber_t));
+    if (s == NULL) {
+        ULOG_ERR_F("calloc failed");
+        return 0;
+    }
+    if (!add_matches(osso, state)) {
+        free(s);
+        return 0;
+    }
+    s->id = id = ++osso->hw_cbs.last_id;
+    s->mask = *state;
+    s->cb = cb;
+    s->data = data;
+
+    for (i = 0; i < N_INDICATORS; ++i) {
+        if (in_mask(state, i)) {
+            _osso_hw_cb_data_t *ind = indicator(osso, i);
+
+            ind->subscribers = g_slist_append(ind->subscribers, s);
+        }
+    }
+    osso->hw_cbs.subscribers = g_slist_prepend(osso->hw_cbs.subscribers, s);
+    update_signal_handlers(osso);
+
+    /* call the callback now if the state is interesting, like
+     * osso_hw_set_event_cb does */
+    if (state->memory_low_ind) {
+        osso->hw_state.memory_low_ind = have_published
+            ? published.memory_low_ind : osso_mem_in_lowmem_state();
+        _osso_hw_touch(osso, OSSO_HW_FIELD_MEMORY_LOW);
+        call_cb = TRUE;
+    }
+    if ((state->shutdown_ind && osso->hw_state.shutdown_ind)
+        || (state->system_inactivity_ind
+            && osso->hw_state.system_inactivity_ind)
+        || (state->sig_device_mode_ind
+            && osso->hw_state.sig_device_mode_ind != OSSO_DEVMODE_NORMAL)) {
+        call_cb = TRUE;
+    }
+    if (call_cb) {
+        ULOG_DEBUG_F("calling application callback");
+        (*cb)(&osso->hw_state, data);
+    }
+
+    return id;
+}
+
+osso_return_t osso_hw_remove_event_cb(osso_context_t *osso, guint id)
+{
+    _osso_hw_subscriber_t *s = NULL;
+    GSList *l;
+
+    ULOG_DEBUG_F("entered");
+    if (osso == NULL || id == 0) {
+        ULOG_ERR_F("invalid parameters");
+        return OSSO_INVALID;
+    }
+
+    for (l = osso->hw_cbs.subscribers; l != NULL; l = l->next) {
+        if (((_osso_hw_subscriber_t*)l->data)->id == id) {
+            s = l->data;
+            break;
+        }
+    }
+    if (s == NULL) {
+        ULOG_WARN_F("no device state callback with id %u", id);
+        return OSSO_INVALID;
+    }
+
+    osso->hw_cbs.subscribers = g_slist_delete_link(osso->hw_cbs.subscribers,
+                                                   l);
+    remove_matches(osso, &s->mask);
+    if (osso->hw_cbs.dispatching > 0) {
+        /* notify is walking the lists, see sweep_subscribers */
+        s->cb = NULL;
+        osso->hw_cbs.removed = g_slist_prepend(osso->hw_cbs.removed, s);
+        return OSSO_OK;
+    }
+    unlink_subscriber(osso, s);
+    free(s);
+    update_signal_handlers(osso);
+    return OSSO_OK;
+}
+
+static void free_subscriber(gpointer data, gpointer user_data)
+{
+    free(data);
+}
+
+void _osso_hw_cbs_deinit(osso_context_t *osso)
+{
+    int i;
+
+    for (i = 0; i < N_INDICATORS; ++i) {
+        _osso_hw_cb_data_t *ind = indicator(osso, i);
+
+        g_slist_free(ind->subscribers);
+        ind->subscribers = NULL;
+    }
+    g_slist_foreach(osso->hw_cbs.subscribers, free_subscriber, NULL);
+    g_slist_free(osso->hw_cbs.subscribers);
+    osso->hw_cbs.subscribers = NULL;
+    g_slist_foreach(osso->hw_cbs.removed, free_subscriber, NULL);
+    g_slist_free(osso->hw_cbs.removed);
+    osso->hw_cbs.removed = NULL;
+    g_slist_free(osso->hw_cbs.display_cbs);
+    osso->hw_cbs.display_cbs = NULL;
+
+    if (osso->hw_cbs.coalesce != NULL) {
+        for (i = 0; i < OSSO_HW_N_FIELDS; ++i) {
+            _osso_hw_coalesce_t *c = &osso->hw_cbs.coalesce[i];
+
+            if (c->source != NULL) {
+                g_source_destroy(c->source);
+                g_source_unref(c->source);
+            }
+        }
+        free(osso->hw_cbs.coalesce);
+        osso->hw_cbs.coalesce = NULL;
+    }
+}
+
+static gint64 now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* records that a field of the device state was received */
+void _osso_hw_touch(osso_context_t *osso, osso_hw_field_t field)
+{
+    osso->hw_updated[field] = now_usec();
+}
+
+static gint field_value(osso_context_t *osso, osso_hw_field_t field)
+{
+    switch (field) {
+        case OSSO_HW_FIELD_SHUTDOWN:
+            return osso->hw_state.shutdown_ind;
+        case OSSO_HW_FIELD_MEMORY_LOW:
+            return osso->hw_state.memory_low_ind;
+        case OSSO_HW_FIELD_INACTIVITY:
+            return osso->hw_state.system_inactivity_ind;
+        case OSSO_HW_FIELD_DEVICE_MODE:
+            return osso->hw_state.sig_device_mode_ind;
+        default:
+            return osso->display_state;
+    }
+}
+
+/* calls the callbacks of a field with its current value */
+static void deliver(osso_context_t *osso, osso_hw_field_t field)
+{
+    switch (field) {
+        case OSSO_HW_FIELD_SHUTDOWN:
+            notify(osso, &osso->hw_cbs.shutdown_ind);
+            break;
+        case OSSO_HW_FIELD_MEMORY_LOW:
+            notify(osso, &osso->hw_cbs.memory_low_ind);
+            break;
+        case OSSO_HW_FIELD_INACTIVITY:
+            notify(osso, &osso->hw_cbs.system_inactivity_ind);
+            break;
+        case OSSO_HW_FIELD_DEVICE_MODE:
+            notify(osso, &osso->hw_cbs.sig_device_mode_ind);
+            break;
+        default:
+            _osso_display_notify(osso);
+            break;
+    }
+}
+
+static gboolean coalesce_timeout(gpointer data)
+{
+    _osso_hw_coalesce_t *c = data;
+    gint value = field_value(c->osso, c->field);
+
+    g_source_destroy(c->source);
+    g_source_unref(c->source);
+    c->source = NULL;
+
+    if (value != c->delivered) {
+        c->delivered = value;
+        deliver(c->osso, c->field);
+    }
+    return FALSE;
+}
+
+/* Called when a signal has changed a field. Returns TRUE if the
+ * callbacks are called later by coalesce_timeout, or FALSE if the caller
+ * is to call them now. */
+gboolean _osso_hw_coalesce(osso_context_t *osso, osso_hw_field_t field)
+{
+    _osso_hw_coalesce_t *c;
+
+    if (osso->hw_cbs.coalesce == NULL) {
+        return FALSE;
+    }
+    c = &osso->hw_cbs.coalesce[field];
+    if (c->policy == OSSO_COALESCE_NONE) {
+        return FALSE;
+    }
+
+    if (c->source == NULL) {
+        if (c->policy == OSSO_COALESCE_LATEST && c->window > 0) {
+            c->source = g_timeout_source_new(c->window);
+        } else {
+            c->source = g_idle_source_new();
+        }
+        g_source_set_callback(c->source, coalesce_timeout, c, NULL);
+        g_source_attach(c->source, osso->main_context);
+    }
+    return TRUE;
+}
+
+/* passes a changed field to the callbacks, now or later */
+static void changed(osso_context_t *osso, osso_hw_field_t field)
+{
+    if (!_osso_hw_coalesce(osso, field)) {
+        deliver(osso, field);
+    }
+}
+
+osso_return_t osso_hw_set_coalescing(osso_context_t *osso,
+                                     osso_hw_field_t field,
+                                     osso_coalesce_policy_t policy,
+                                     guint window_ms)
+{
+    _osso_hw_coalesce_t *c;
+
+    if (osso == NULL || field < 0 || field >= OSSO_HW_N_FIELDS
+        || policy < OSSO_COALESCE_NONE || policy > OSSO_COALESCE_LATEST) {
+        ULOG_ERR_F("invalid parameters");
+        return OSSO_INVALID;
+    }
+
+    if (osso->hw_cbs.coalesce == NULL) {
+        int i;
+
+        if (policy == OSSO_COALESCE_NONE) {
+            return OSSO_OK;
+        }
+        osso->hw_cbs.coalesce = calloc(OSSO_HW_N_FIELDS,
+                                       sizeof(_osso_hw_coalesce_t));
+        if (osso->hw_cbs.coalesce == NULL) {
+            ULOG_ERR_F("calloc failed");
+            return OSSO_ERROR;
+        }
+        for (i = 0; i < OSSO_HW_N_FIELDS; ++i) {
+            osso->hw_cbs.coalesce[i].osso = osso;
+            osso->hw_cbs.coalesce[i].field = i;
+        }
+    }
+
+    c = &osso->hw_cbs.coalesce[field];
+    if (c->policy == OSSO_COALESCE_NONE) {
+        /* the callbacks have had every value so far */
+        c->delivered = field_value(osso, field);
+    }
+    /* a pending delivery still happens */
+    c->policy = policy;
+    c->window = window_ms;
+    return OSSO_OK;
+}
+
+/* Returns TRUE if the field is to be taken from the shared device state
+ * segment, and marks it live, since the publisher keeps it current. It
+ * is as fresh as the last check that the publisher holds the segment. */
+static gboolean use_published(osso_hw_field_info_t *info, gint64 checked)
+{
+    if (info->live) {
+        return FALSE;
+    }
+    info->updated = checked;
+    info->live = TRUE;
+    return TRUE;
+}
+
+osso_return_t osso_hw_get_state_snapshot(osso_context_t *osso,
+                                         osso_hw_snapshot_t *snapshot)
+{
+    osso_hw_state_t published;
+    osso_display_state_t display;
+    gint64 checked;
+    int i;
+
+    if (osso == NULL || snapshot == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return OSSO_INVALID;
+    }
+
+    snapshot->state = osso->hw_state;
+    snapshot->state.save_unsaved_data_ind = FALSE;
+    snapshot->display = osso->display_state;
+    for (i = 0; i < OSSO_HW_N_FIELDS; ++i) {
+        snapshot->info[i].updated = osso->hw_updated[i];
+    }
+    snapshot->info[OSSO_HW_FIELD_SHUTDOWN].live = _is_listened(shutdown_ind);
+    snapshot->info[OSSO_HW_FIELD_MEMORY_LOW].live =
+        _is_listened(memory_low_ind);
+    snapshot->info[OSSO_HW_FIELD_INACTIVITY].live =
+        _is_listened(system_inactivity_ind);
+    snapshot->info[OSSO_HW_FIELD_DEVICE_MODE].live =
+        _is_listened(sig_device_mode_ind);
+    snapshot->info[OSSO_HW_FIELD_DISPLAY].live = osso->display_live;
+
+    /* only a segment that is already mapped is used, so that this
+     * makes no system calls other than the periodic check of the
+     * publisher, which drops the segment if the publisher has gone */
+    if (osso->hw_segment == NULL
+        || osso_hw_state_read(osso, &published, &display) != OSSO_OK) {
+        return OSSO_OK;
+    }
+    checked = osso->hw_segment_writer ? now_usec()
+                                      : osso->hw_segment_checked;
+    if (use_published(&snapshot->info[OSSO_HW_FIELD_SHUTDOWN], checked)) {
+        snapshot->state.shutdown_ind = published.shutdown_ind;
+    }
+    if (use_published(&snapshot->info[OSSO_HW_FIELD_MEMORY_LOW], checked)) {
+        snapshot->state.memory_low_ind = published.memory_low_ind;
+    }
+    if (use_published(&snapshot->info[OSSO_HW_FIELD_INACTIVITY], checked)) {
+        snapshot->state.system_inactivity_ind =
+            published.system_inactivity_ind;
+    }
+    if (use_published(&snapshot->info[OSSO_HW_FIELD_DEVICE_MODE],
+                      checked)) {
+        snapshot->state.sig_device_mode_ind = published.sig_device_mode_ind;
+    }
+    if (use_published(&snapshot->info[OSSO_HW_FIELD_DISPLAY], checked)) {
+        snapshot->display = display;
+    }
+    return OSSO_OK;
+}
+
 
 static void write_device_state_to_file(const char* s)
 {
@@ -441,17 +1016,13 @@ static void lowmem_signal_handler(osso_context_t *osso,
     if (dbus_message_is_signal(msg, USER_LOWMEM_ON_SIGNAL_IF,
                                USER_LOWMEM_ON_SIGNAL_NAME)) {
         osso->hw_state.memory_low_ind = TRUE;
-        if (osso->hw_cbs.memory_low_ind.set) {
-            (osso->hw_cbs.memory_low_ind.cb)(&osso->hw_state,
-                osso->hw_cbs.memory_low_ind.data);
-        } 
+        _osso_hw_touch(osso, OSSO_HW_FIELD_MEMORY_LOW);
+        changed(osso, OSSO_HW_FIELD_MEMORY_LOW);
     } else if (dbus_message_is_signal(msg, USER_LOWMEM_OFF_SIGNAL_IF,
                                USER_LOWMEM_OFF_SIGNAL_NAME)) {
         osso->hw_state.memory_low_ind = FALSE;
-        if (osso->hw_cbs.memory_low_ind.set) {
-            (osso->hw_cbs.memory_low_ind.cb)(&osso->hw_state,
-                osso->hw_cbs.memory_low_ind.data);
-        } 
+        _osso_hw_touch(osso, OSSO_HW_FIELD_MEMORY_LOW);
+        changed(osso, OSSO_HW_FIELD_MEMORY_LOW);
     } else {
         ULOG_WARN_F("unknown signal received");
     }
@@ -510,18 +1081,59 @@ static void _get_byte_array(DBusMessageIter *iter, muali_arg_t *arg)
                                       &(arg->data_len));
 }
 
-muali_arg_t* _get_muali_args(DBusMessageIter *iter)
+/* Returns n zeroed elements from the argument arena of the context, or
+ * NULL if it cannot hold them. The arena is used like a stack: when a
+ * handler causes more events to be delivered, their arrays are above
+ * those of the outer events, and each array is released by
+ * _free_muali_args after its handler has returned. So after the first
+ * events, delivering an event allocates nothing. */
+static muali_arg_t *arena_alloc(osso_context_t *osso, int n)
 {
-    int type, idx = 0;
+    muali_arg_t *args;
+
+    if (osso->arg_arena_used + n > osso->arg_arena_size) {
+        int size = MAX(n, 2 * osso->arg_arena_size);
+
+        if (osso->arg_arena_used > 0) {
+            /* the arrays of the outer events must not move */
+            return NULL;
+        }
+        args = realloc(osso->arg_arena, size * sizeof(muali_arg_t));
+        if (args == NULL) {
+            return NULL;
+        }
+        osso->arg_arena = args;
+        osso->arg_arena_size = size;
+    }
+
+    args = osso->arg_arena + osso->arg_arena_used;
+    osso->arg_arena_used += n;
+    memset(args, 0, n * sizeof(muali_arg_t));
+    return args;
+}
+
+muali_arg_t* _get_muali_args(osso_context_t *osso, DBusMessageIter *iter)
+{
+    int type, idx = 0, n = 0;
     muali_arg_t *arg_array;
+    DBusMessageIter count_iter = *iter;
 
-    arg_array = calloc(1, sizeof(muali_arg_t) * (MUALI_MAX_ARGS + 1));
+    while (dbus_message_iter_get_arg_type(&count_iter) != DBUS_TYPE_INVALID
+           && n < MUALI_MAX_ARGS) {
+            ++n;
+            dbus_message_iter_next(&count_iter);
+    }
+
+    arg_array = arena_alloc(osso, n + 1);
     if (arg_array == NULL) {
-            ULOG_ERR_F("calloc() failed: %s", strerror(errno));
-            return NULL;
+            arg_array = calloc(n + 1, sizeof(muali_arg_t));
+            if (arg_array == NULL) {
+                    ULOG_ERR_F("calloc() failed: %s", strerror(errno));
+                    return NULL;
+            }
     }
 
-    while ((type = dbus_message_iter_get_arg_type(iter))
+    while (idx < n && (type = dbus_message_iter_get_arg_type(iter))
            != DBUS_TYPE_INVALID) {
 
             int i;
@@ -579,6 +1191,13 @@ muali_arg_t* _get_muali_args(DBusMessageIter *iter)
                                     dbus_message_iter_get_element_type(iter));
                             }
                             break;
+                    case DBUS_TYPE_UNIX_FD:
+                            /* the fd is ours, see _free_muali_args */
+                            arg_array[idx].type = MUALI_TYPE_BULK;
+                            dbus_message_iter_get_basic(iter, &i);
+                            arg_array[idx].value.i = i;
+                            ++idx;
+                            break;
                     default:
                             ULOG_ERR_F("type %d not supported", type);
                             break;
@@ -592,6 +1211,29 @@ muali_arg_t* _get_muali_args(DBusMessageIter *iter)
     return arg_array;
 }
 
+void __attribute__ ((visibility("hidden")))
+_free_muali_args(osso_context_t *osso, muali_arg_t *args)
+{
+    int i;
+
+    if (args == NULL) {
+            return;
+    }
+    for (i = 0; args[i].type != MUALI_TYPE_INVALID; ++i) {
+            if (args[i].type == MUALI_TYPE_BULK) {
+                    close(args[i].value.i);
+            }
+    }
+
+    if (args >= osso->arg_arena
+        && args < osso->arg_arena + osso->arg_arena_size) {
+            /* this and the arrays above it are free again */
+            osso->arg_arena_used = args - osso->arg_arena;
+    } else {
+            free(args);
+    }
+}
+
 static void generic_signal_handler(osso_context_t *osso,
                                    DBusMessage *msg,
                                    _osso_callback_data_t *data,
@@ -650,14 +1292,14 @@ static void generic_signal_handler(osso_context_t *osso,
     }
 
     if (dbus_message_iter_init(msg, &iter)) {
-            info.args = _get_muali_args(&iter);
+            info.args = _get_muali_args(osso, &iter);
     }
 
     cb = data->user_cb;
     (*cb)((muali_context_t*)osso, &info, data->user_data);
 
     if (info.args != NULL) {
-            free(info.args);
+            _free_muali_args(osso, info.args);
             info.args = NULL;
     }
 }
@@ -672,17 +1314,14 @@ static void signal_handler(osso_context_t *osso,
 
     if (dbus_message_is_signal(msg, SHUTDOWN_SIGNAL_IF, SHUTDOWN_SIGNAL_NAME)) {
         osso->hw_state.shutdown_ind = TRUE;
-        if (osso->hw_cbs.shutdown_ind.set) {
-            (osso->hw_cbs.shutdown_ind.cb)(&osso->hw_state,
-                osso->hw_cbs.shutdown_ind.data);
-        } 
+        _osso_hw_touch(osso, OSSO_HW_FIELD_SHUTDOWN);
+        changed(osso, OSSO_HW_FIELD_SHUTDOWN);
     } else if (dbus_message_is_signal(msg, DATASAVE_SIGNAL_IF,
                                       DATASAVE_SIGNAL_NAME)) {
-        if (osso->hw_cbs.save_unsaved_data_ind.set) {
+        if (_is_listened(save_unsaved_data_ind)) {
             /* stateless signal, the value only tells the signal came */
             osso->hw_state.save_unsaved_data_ind = TRUE;
-            (osso->hw_cbs.save_unsaved_data_ind.cb)(&osso->hw_state,
-                osso->hw_cbs.save_unsaved_data_ind.data);
+            notify(osso, &osso->hw_cbs.save_unsaved_data_ind);
             osso->hw_state.save_unsaved_data_ind = FALSE;
             if (osso->autosave.func != NULL) {
 	        /* call force autosave function */
@@ -703,12 +1342,10 @@ static void signal_handler(osso_context_t *osso,
         }
 
         dbus_message_iter_get_basic (&i, &new_state);
+        _osso_hw_touch(osso, OSSO_HW_FIELD_INACTIVITY);
         if (osso->hw_state.system_inactivity_ind != new_state) {
             osso->hw_state.system_inactivity_ind = new_state;
-            if (osso->hw_cbs.system_inactivity_ind.set) {
-                (osso->hw_cbs.system_inactivity_ind.cb)(&osso->hw_state,
-                    osso->hw_cbs.system_inactivity_ind.data);
-            }
+            changed(osso, OSSO_HW_FIELD_INACTIVITY);
         }
     } else if (dbus_message_is_signal(msg, MCE_SIGNAL_IF,
                                       MCE_DEVICE_MODE_SIG)) {
@@ -744,13 +1381,518 @@ static void signal_handler(osso_context_t *osso,
             return;
         }
 
-        if (osso->hw_cbs.sig_device_mode_ind.set) {
-            (osso->hw_cbs.sig_device_mode_ind.cb)(&osso->hw_state,
-                osso->hw_cbs.sig_device_mode_ind.data);
+        _osso_hw_touch(osso, OSSO_HW_FIELD_DEVICE_MODE);
+        changed(osso, OSSO_HW_FIELD_DEVICE_MODE);
+    } else {
+        ULOG_WARN_F("received unknown signal");
+    }
+}
+
+/* The shared device state segment. The publisher maps the file of the
+ * segment read-write and holds a write lock on it for as long as it
+ * publishes; readers map it read-only after checking that the lock is
+ * held, and keep the file open. The file is never removed, so a new
+ * publisher reuses the mappings of the readers. If the publisher dies
+ * without deinitializing, HW_SEGMENT_VALID stays set but the lock is
+ * released, so a reader tests the lock again when it has not done so
+ * for HW_SEGMENT_CHECK_INTERVAL, and drops the segment when the lock is
+ * free. Readers only test the lock with F_GETLK and never take it, so
+ * that they cannot make a new publisher fail.
+ *
+ * The file is in $XDG_RUNTIME_DIR, or else in world-writable /dev/shm,
+ * so it is opened without following symbolic links and only used if it
+ * is a regular file of the user that nobody else can write. */
+
+#define HW_SEGMENT_MAX_TRIES 1000
+#define MAX_SEGMENT_FILE_NAME 256
+
+/* open file description locks are not released when the publisher
+ * closes another descriptor of the file */
+#ifdef F_OFD_GETLK
+# define SEGMENT_SETLK F_OFD_SETLK
+# define SEGMENT_GETLK F_OFD_GETLK
+#else
+# define SEGMENT_SETLK F_SETLK
+# define SEGMENT_GETLK F_GETLK
+#endif
+
+static const struct {
+    const char *service, *path, *interface, *member, *match;
+} segment_signals[] = {
+    {DSME_SIGNAL_SVC, DSME_SIGNAL_OP, DSME_SIGNAL_IF, SHUTDOWN_SIGNAL_NAME,
+     SHUTDOWN_IND_MATCH},
+    {USER_LOWMEM_ON_SIGNAL_SVC, USER_LOWMEM_ON_SIGNAL_OP,
+     USER_LOWMEM_ON_SIGNAL_IF, USER_LOWMEM_ON_SIGNAL_NAME,
+     MEMORY_LOW_ON_MATCH},
+    {USER_LOWMEM_OFF_SIGNAL_SVC, USER_LOWMEM_OFF_SIGNAL_OP,
+     USER_LOWMEM_OFF_SIGNAL_IF, USER_LOWMEM_OFF_SIGNAL_NAME,
+     MEMORY_LOW_OFF_MATCH},
+    {MCE_SERVICE, MCE_SIGNAL_PATH, MCE_SIGNAL_IF, MCE_INACTIVITY_SIG,
+     SYSTEM_INACTIVITY_IND_MATCH},
+    {MCE_SERVICE, MCE_SIGNAL_PATH, MCE_SIGNAL_IF, MCE_DEVICE_MODE_SIG,
+     SIG_DEVICE_MODE_IND_MATCH},
+    {NULL, MCE_SIGNAL_PATH, MCE_SIGNAL_IF, MCE_DISPLAY_SIG,
+     DISPLAY_STATUS_MATCH}
+};
+
+#define N_SEGMENT_SIGNALS \
+    (sizeof(segment_signals) / sizeof(segment_signals[0]))
+
+static int open_segment_file(int flags)
+{
+    char name[MAX_SEGMENT_FILE_NAME];
+    const char *dir;
+    struct stat st;
+    int fd;
+
+    dir = getenv("XDG_RUNTIME_DIR");
+    if (dir == NULL || dir[0] != '/') {
+        dir = OSSO_HW_SEGMENT_DIR;
+    }
+    if (snprintf(name, MAX_SEGMENT_FILE_NAME, "%s/%s-%d", dir,
+                 OSSO_HW_SEGMENT_FILE, geteuid())
+        >= MAX_SEGMENT_FILE_NAME) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    /* O_NONBLOCK, so that a planted FIFO does not block the open */
+    fd = open(name, flags | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return -1;
+    }
+    /* a file planted by another user, or a link to a file of ours */
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)
+        || st.st_uid != geteuid() || st.st_nlink != 1
+        || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        ULOG_ERR_F("'%s' is not a private file, not using it", name);
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+    return fd;
+}
+
+/* Returns 1 if the write lock on the segment file is held by another
+ * open file, 0 if it is not, and -1 on error. */
+static int segment_locked(int fd)
+{
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_RDLCK;
+    fl.l_whence = SEEK_SET;
+    if (fcntl(fd, SEGMENT_GETLK, &fl) == -1) {
+        ULOG_ERR_F("fcntl failed: %s", strerror(errno));
+        return -1;
+    }
+    return fl.l_type != F_UNLCK;
+}
+
+/* only the publisher calls this */
+static void segment_store(_osso_hw_segment_t *seg, guint32 flags,
+                          gint32 device_mode, gint32 display_state)
+{
+    guint32 seq = seg->seq;
+
+    __atomic_store_n(&seg->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&seg->flags, flags, __ATOMIC_RELAXED);
+    __atomic_store_n(&seg->device_mode, device_mode, __ATOMIC_RELAXED);
+    __atomic_store_n(&seg->display_state, display_state, __ATOMIC_RELAXED);
+    __atomic_store_n(&seg->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Returns FALSE if the publisher stayed in the middle of an update for
+ * HW_SEGMENT_MAX_TRIES reads */
+static gboolean segment_load(const _osso_hw_segment_t *seg, guint32 *flags,
+                             gint32 *device_mode, gint32 *display_state)
+{
+    int i;
+
+    for (i = 0; i < HW_SEGMENT_MAX_TRIES; ++i) {
+        guint32 seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+
+        if (seq & 1) {
+            continue;
+        }
+        *flags = __atomic_load_n(&seg->flags, __ATOMIC_RELAXED);
+        *device_mode = __atomic_load_n(&seg->device_mode, __ATOMIC_RELAXED);
+        *display_state = __atomic_load_n(&seg->display_state,
+                                         __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == seq) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static gboolean parse_device_mode(const char *s, osso_devmode_t *mode)
+{
+    if (strcmp(s, MCE_NORMAL_MODE) == 0) {
+        *mode = OSSO_DEVMODE_NORMAL;
+    } else if (strcmp(s, MCE_FLIGHT_MODE) == 0) {
+        *mode = OSSO_DEVMODE_FLIGHT;
+    } else if (strcmp(s, MCE_OFFLINE_MODE) == 0) {
+        *mode = OSSO_DEVMODE_OFFLINE;
+    } else if (strcmp(s, MCE_INVALID_MODE) == 0) {
+        *mode = OSSO_DEVMODE_INVALID;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Calls a method of MCE that returns one argument. Returns the reply
+ * with iter at the argument, or NULL if it is not of the given type. */
+static DBusMessage *mce_get(osso_context_t *osso, const char *method,
+                            int type, DBusMessageIter *iter)
+{
+    DBusMessage *msg, *reply;
+    DBusError err;
+
+    if (!_osso_name_has_owner(osso, osso->sys_conn, MCE_SERVICE)) {
+        ULOG_WARN_F("service %s does not exist", MCE_SERVICE);
+        return NULL;
+    }
+    msg = dbus_message_new_method_call(MCE_SERVICE, MCE_REQUEST_PATH,
+                                       MCE_REQUEST_IF, method);
+    if (msg == NULL) {
+        ULOG_ERR_F("could not create message");
+        return NULL;
+    }
+    dbus_error_init(&err);
+    reply = dbus_connection_send_with_reply_and_block(osso->sys_conn, msg,
+                                                      -1, &err);
+    dbus_message_unref(msg);
+    if (reply == NULL) {
+        ULOG_ERR_F("%s failed: %s", method, err.message);
+        dbus_error_free(&err);
+        return NULL;
+    }
+    if (!dbus_message_iter_init(reply, iter)
+        || dbus_message_iter_get_arg_type(iter) != type) {
+        ULOG_ERR_F("invalid reply to %s", method);
+        dbus_message_unref(reply);
+        return NULL;
+    }
+    return reply;
+}
+
+static void segment_signal_handler(osso_context_t *osso,
+                                   DBusMessage *msg,
+                                   _osso_callback_data_t *data,
+                                   muali_bus_type dbus_type)
+{
+    _osso_hw_segment_t *seg = osso->hw_segment;
+    guint32 flags = seg->flags;
+    osso_devmode_t mode = seg->device_mode;
+    osso_display_state_t display = seg->display_state;
+    DBusMessageIter iter;
+    int type = DBUS_TYPE_INVALID;
+    dbus_bool_t b;
+    char *s;
+
+    if (dbus_message_iter_init(msg, &iter)) {
+        type = dbus_message_iter_get_arg_type(&iter);
+    }
+
+    if (dbus_message_is_signal(msg, SHUTDOWN_SIGNAL_IF,
+                               SHUTDOWN_SIGNAL_NAME)) {
+        flags |= HW_SEGMENT_SHUTDOWN;
+    } else if (dbus_message_is_signal(msg, USER_LOWMEM_ON_SIGNAL_IF,
+                                      USER_LOWMEM_ON_SIGNAL_NAME)) {
+        flags |= HW_SEGMENT_MEMORY_LOW;
+    } else if (dbus_message_is_signal(msg, USER_LOWMEM_OFF_SIGNAL_IF,
+                                      USER_LOWMEM_OFF_SIGNAL_NAME)) {
+        flags &= ~HW_SEGMENT_MEMORY_LOW;
+    } else if (dbus_message_is_signal(msg, MCE_SIGNAL_IF,
+                                      MCE_INACTIVITY_SIG)
+               && type == DBUS_TYPE_BOOLEAN) {
+        dbus_message_iter_get_basic(&iter, &b);
+        flags = b ? flags | HW_SEGMENT_INACTIVE
+                  : flags & ~HW_SEGMENT_INACTIVE;
+    } else if (dbus_message_is_signal(msg, MCE_SIGNAL_IF,
+                                      MCE_DEVICE_MODE_SIG)
+               && type == DBUS_TYPE_STRING) {
+        dbus_message_iter_get_basic(&iter, &s);
+        if (!parse_device_mode(s, &mode)) {
+            ULOG_WARN_F("invalid device mode '%s'", s);
+            return;
+        }
+    } else if (dbus_message_is_signal(msg, MCE_SIGNAL_IF, MCE_DISPLAY_SIG)
+               && type == DBUS_TYPE_STRING) {
+        dbus_message_iter_get_basic(&iter, &s);
+        if (!_osso_parse_display_state(s, &display)) {
+            ULOG_WARN_F("invalid display state '%s'", s);
+            return;
         }
     } else {
         ULOG_WARN_F("received unknown signal");
+        return;
+    }
+
+    segment_store(seg, flags, mode, display);
+}
+
+osso_return_t osso_hw_state_publish(osso_context_t *osso)
+{
+    _osso_hw_segment_t *seg;
+    osso_devmode_t mode = OSSO_DEVMODE_NORMAL;
+    osso_display_state_t display;
+    guint32 flags = HW_SEGMENT_VALID;
+    DBusMessageIter iter;
+    DBusMessage *reply;
+    struct flock fl;
+    unsigned int i;
+    int fd;
+
+    if (osso == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return OSSO_INVALID;
+    }
+    if (_osso_get_sys_conn(osso) == NULL) {
+        ULOG_ERR_F("error: no system bus connection");
+        return OSSO_INVALID;
+    }
+    if (osso->hw_segment_writer) {
+        return OSSO_OK;
+    }
+
+    fd = open_segment_file(O_RDWR | O_CREAT);
+    if (fd == -1) {
+        ULOG_ERR_F("could not open the device state segment: %s",
+                   strerror(errno));
+        return OSSO_ERROR;
+    }
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    if (fcntl(fd, SEGMENT_SETLK, &fl) == -1) {
+        ULOG_WARN_F("the device state segment is already published");
+        close(fd);
+        return OSSO_ERROR;
+    }
+    if (ftruncate(fd, sizeof(_osso_hw_segment_t)) == -1) {
+        ULOG_ERR_F("ftruncate failed: %s", strerror(errno));
+        close(fd);
+        return OSSO_ERROR;
+    }
+    seg = mmap(NULL, sizeof(_osso_hw_segment_t), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED) {
+        ULOG_ERR_F("mmap failed: %s", strerror(errno));
+        close(fd);
+        return OSSO_ERROR;
+    }
+
+    /* subscribe before asking for the current state, so that no change
+     * is missed */
+    for (i = 0; i < N_SEGMENT_SIGNALS; ++i) {
+        if (!_osso_match_add(osso, osso->sys_conn,
+                             segment_signals[i].match)) {
+            while (i-- > 0) {
+                _osso_match_remove(osso, osso->sys_conn,
+                                   segment_signals[i].match);
+            }
+            munmap(seg, sizeof(_osso_hw_segment_t));
+            close(fd);
+            return OSSO_ERROR;
+        }
+    }
+
+    reply = mce_get(osso, MCE_DEVICE_MODE_GET, DBUS_TYPE_STRING, &iter);
+    if (reply != NULL) {
+        char *s;
+
+        dbus_message_iter_get_basic(&iter, &s);
+        if (!parse_device_mode(s, &mode)) {
+            ULOG_WARN_F("invalid device mode '%s'", s);
+        }
+        dbus_message_unref(reply);
+    }
+    reply = mce_get(osso, MCE_INACTIVITY_STATUS_GET, DBUS_TYPE_BOOLEAN,
+                    &iter);
+    if (reply != NULL) {
+        dbus_bool_t b;
+
+        dbus_message_iter_get_basic(&iter, &b);
+        if (b) {
+            flags |= HW_SEGMENT_INACTIVE;
+        }
+        dbus_message_unref(reply);
+    }
+    if (osso_mem_in_lowmem_state()) {
+        flags |= HW_SEGMENT_MEMORY_LOW;
+    }
+    if (osso->hw_state.shutdown_ind) {
+        flags |= HW_SEGMENT_SHUTDOWN;
+    }
+    display = _osso_get_display_state(osso);
+
+    /* the readers check magic and version last */
+    segment_store(seg, flags, mode, display);
+    seg->version = OSSO_HW_SEGMENT_VERSION;
+    __atomic_store_n(&seg->magic, OSSO_HW_SEGMENT_MAGIC, __ATOMIC_RELEASE);
+
+    if (osso->hw_segment != NULL) {
+        /* it was mapped for reading */
+        _osso_hw_segment_deinit(osso);
+    }
+    osso->hw_segment = seg;
+    osso->hw_segment_fd = fd;
+    osso->hw_segment_writer = TRUE;
+
+    for (i = 0; i < N_SEGMENT_SIGNALS; ++i) {
+        _msg_handler_set_member_cb_f(osso, segment_signals[i].service,
+                                     segment_signals[i].path,
+                                     segment_signals[i].interface,
+                                     segment_signals[i].member,
+                                     segment_signal_handler, NULL, FALSE);
+    }
+    return OSSO_OK;
+}
+
+/* Returns FALSE if the publisher no longer holds the segment. This makes
+ * one system call, at most once in HW_SEGMENT_CHECK_INTERVAL. */
+static gboolean segment_published(osso_context_t *osso)
+{
+    gint64 now;
+
+    if (osso->hw_segment_writer) {
+        return TRUE;
     }
+    now = now_usec();
+    if (now - osso->hw_segment_checked < HW_SEGMENT_CHECK_INTERVAL) {
+        return TRUE;
+    }
+    if (segment_locked(osso->hw_segment_fd) != 1) {
+        ULOG_WARN_F("the publisher of the device state segment has gone");
+        return FALSE;
+    }
+    osso->hw_segment_checked = now;
+    return TRUE;
+}
+
+/* Maps the segment if a publisher holds it. This makes a few system
+ * calls, and is only done again after the publisher has gone. */
+static gboolean map_segment(osso_context_t *osso)
+{
+    _osso_hw_segment_t *seg;
+    struct stat st;
+    int fd;
+
+    fd = open_segment_file(O_RDONLY);
+    if (fd == -1) {
+        return FALSE;
+    }
+    if (segment_locked(fd) != 1) {
+        /* nobody publishes it */
+        close(fd);
+        return FALSE;
+    }
+    if (fstat(fd, &st) == -1
+        || st.st_size < (off_t)sizeof(_osso_hw_segment_t)) {
+        close(fd);
+        return FALSE;
+    }
+    seg = mmap(NULL, sizeof(_osso_hw_segment_t), PROT_READ, MAP_SHARED,
+               fd, 0);
+    if (seg == MAP_FAILED) {
+        ULOG_ERR_F("mmap failed: %s", strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+    if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE)
+        != OSSO_HW_SEGMENT_MAGIC
+        || seg->version != OSSO_HW_SEGMENT_VERSION) {
+        ULOG_WARN_F("the device state segment is not valid");
+        munmap(seg, sizeof(_osso_hw_segment_t));
+        close(fd);
+        return FALSE;
+    }
+    /* the file is kept open to probe the lock, see segment_published */
+    osso->hw_segment = seg;
+    osso->hw_segment_fd = fd;
+    osso->hw_segment_checked = now_usec();
+    return TRUE;
+}
+
+osso_return_t osso_hw_state_read(osso_context_t *osso,
+                                 osso_hw_state_t *state,
+                                 osso_display_state_t *display)
+{
+    guint32 flags;
+    gint32 mode, display_state;
+
+    if (osso == NULL || (state == NULL && display == NULL)) {
+        ULOG_ERR_F("invalid parameters");
+        return OSSO_INVALID;
+    }
+    if (osso->hw_segment == NULL && !map_segment(osso)) {
+        return OSSO_ERROR;
+    }
+    if (!segment_published(osso)) {
+        /* map it again when there is a new publisher */
+        _osso_hw_segment_deinit(osso);
+        return OSSO_ERROR;
+    }
+
+    if (!segment_load(osso->hw_segment, &flags, &mode, &display_state)) {
+        ULOG_WARN_F("the device state segment is being updated");
+        return OSSO_ERROR;
+    }
+    if (!(flags & HW_SEGMENT_VALID)) {
+        /* the publisher has gone; map it again when there is a new one */
+        _osso_hw_segment_deinit(osso);
+        return OSSO_ERROR;
+    }
+
+    if (state != NULL) {
+        state->shutdown_ind = (flags & HW_SEGMENT_SHUTDOWN) != 0;
+        state->save_unsaved_data_ind = FALSE;
+        state->memory_low_ind = (flags & HW_SEGMENT_MEMORY_LOW) != 0;
+        state->system_inactivity_ind = (flags & HW_SEGMENT_INACTIVE) != 0;
+        state->sig_device_mode_ind = mode;
+    }
+    if (display != NULL) {
+        *display = display_state;
+    }
+    return OSSO_OK;
+}
+
+void _osso_hw_segment_deinit(osso_context_t *osso)
+{
+    _osso_hw_segment_t *seg = osso->hw_segment;
+
+    if (seg == NULL) {
+        return;
+    }
+    if (osso->hw_segment_writer) {
+        unsigned int i;
+
+        /* no more signals are stored in the segment */
+        for (i = 0; i < N_SEGMENT_SIGNALS; ++i) {
+            _msg_handler_rm_member_cb_f(osso, segment_signals[i].service,
+                                        segment_signals[i].path,
+                                        segment_signals[i].interface,
+                                        segment_signals[i].member,
+                                        (const _osso_handler_f*)
+                                        segment_signal_handler,
+                                        NULL, FALSE);
+            if (osso->sys_conn != NULL) {
+                _osso_match_remove(osso, osso->sys_conn,
+                                   segment_signals[i].match);
+            }
+        }
+        /* tell the readers; closing the file releases the lock */
+        segment_store(seg, seg->flags & ~HW_SEGMENT_VALID,
+                      seg->device_mode, seg->display_state);
+        osso->hw_segment_writer = FALSE;
+    }
+    close(osso->hw_segment_fd);
+    munmap(seg, sizeof(_osso_hw_segment_t));
+    osso->hw_segment = NULL;
 }
 
 /******************************************************
@@ -778,14 +1920,14 @@ inline static void _muali_call_cb(osso_context_t *osso,
         info.bus_type = dbus_type;
 
         if (dbus_message_iter_init(msg, &iter)) {
-                info.args = _get_muali_args(&iter);
+                info.args = _get_muali_args(osso, &iter);
         }
 
         cb = data->user_cb;
         (*cb)((muali_context_t*)osso, &info, data->user_data);
 
         if (info.args != NULL) {
-                free(info.args);
+                _free_muali_args(osso, info.args);
                 info.args = NULL;
         }
 }
@@ -960,9 +2102,13 @@ inline static muali_error_t _set_handler(muali_context_t *context,
                                          gboolean call_once_per_handler_id,
                                          muali_bus_type bus_type)
 {
-        DBusError error;
         _osso_callback_data_t *cb_data;
 
+        if (match == NULL) {
+                /* a custom handler for the system bus only */
+                match = sys_match;
+        }
+
         cb_data = calloc(1, sizeof(_osso_callback_data_t));
         if (cb_data == NULL) {
                 ULOG_ERR_F("calloc failed");
@@ -1001,20 +2147,14 @@ inline static muali_error_t _set_handler(muali_context_t *context,
                 }
         }
 
-        dbus_error_init(&error);
-
         if (bus_type == MUALI_BUS_SYSTEM || bus_type == MUALI_BUS_BOTH) {
                 if (!dbus_connection_get_is_connected(context->sys_conn)) {
                         ULOG_ERR_F("connection to system bus is not open");
                         goto _set_handler_failed_match;
                 }
 
-                dbus_bus_add_match(context->sys_conn, match, &error);
-
-                if (dbus_error_is_set(&error)) {
-                        ULOG_ERR_F("dbus_bus_add_match failed: %s",
-                                   error.message);
-                        dbus_error_free(&error);
+                if (!_osso_match_add((osso_context_t*)context,
+                                     context->sys_conn, match)) {
                         goto _set_handler_failed_match;
                 }
         }
@@ -1025,18 +2165,12 @@ inline static muali_error_t _set_handler(muali_context_t *context,
                         goto _set_handler_failed_match;
                 }
 
-                dbus_bus_add_match(context->conn, match, &error);
-
-                if (dbus_error_is_set(&error)) {
-                        ULOG_ERR_F("dbus_bus_add_match failed: %s",
-                                   error.message);
-                        dbus_error_free(&error);
-
+                if (!_osso_match_add((osso_context_t*)context,
+                                     context->conn, match)) {
                         if (bus_type == MUALI_BUS_BOTH) {
-                                dbus_bus_remove_match(context->sys_conn,
-                                                      match, NULL);
+                                _osso_match_remove((osso_context_t*)context,
+                                                   context->sys_conn, match);
                         }
-
                         goto _set_handler_failed_match;
                 }
         }
@@ -1068,6 +2202,24 @@ _set_handler_failed_match:
         return MUALI_ERROR;
 }
 
+/* The reply of the bus daemon to AddMatch is not waited for, so the
+ * names given by the caller are checked here instead. */
+static muali_error_t validate_info(const muali_event_info_t *info)
+{
+        if ((info->service != NULL
+             && !dbus_validate_bus_name(info->service, NULL))
+            || (info->path != NULL
+                && !dbus_validate_path(info->path, NULL))
+            || (info->interface != NULL
+                && !dbus_validate_interface(info->interface, NULL))
+            || (info->name != NULL
+                && !dbus_validate_member(info->name, NULL))) {
+                ULOG_ERR_F("invalid name in the event info");
+                return MUALI_ERROR_INVALID;
+        }
+        return MUALI_ERROR_SUCCESS;
+}
+
 static muali_error_t compose_match(const muali_event_info_t *info,
                                    char **_match)
 {
@@ -1356,6 +2508,14 @@ muali_error_t muali_set_event_handler_custom(muali_context_t *context,
                 return MUALI_ERROR_INVALID;
         }
 
+        error = validate_info(info);
+        if (error != MUALI_ERROR_SUCCESS) {
+                if (handler_id != NULL) {
+                        *handler_id = 0;
+                }
+                return error;
+        }
+
         if (info->bus_type == MUALI_BUS_IRRELEVANT) {
                 bus_type = MUALI_BUS_BOTH;
         } else {
@@ -32,23 +32,64 @@
 #define STORED_LEN 10
 #define OSSO_DEVSTATE_MODE_FILE "/tmp/.libosso_device_mode_cache"
 
-#define _unset_state_cb(hwstate) do {\
+/* match rules of the osso_hw_state_t members */
+#define SHUTDOWN_IND_MATCH "type='signal',interface='" \
+    SHUTDOWN_SIGNAL_IF "',member='" SHUTDOWN_SIGNAL_NAME "'"
+#define MEMORY_LOW_OFF_MATCH "type='signal',interface='" \
+    USER_LOWMEM_OFF_SIGNAL_IF "'"
+#define MEMORY_LOW_ON_MATCH "type='signal',interface='" \
+    USER_LOWMEM_ON_SIGNAL_IF "'"
+#define SAVE_UNSAVED_DATA_IND_MATCH "type='signal',interface='" \
+    DATASAVE_SIGNAL_IF "',member='" DATASAVE_SIGNAL_NAME "'"
+#define SYSTEM_INACTIVITY_IND_MATCH "type='signal',interface='" \
+    MCE_SIGNAL_IF "',member='" MCE_INACTIVITY_SIG "'"
+#define SIG_DEVICE_MODE_IND_MATCH "type='signal',interface='" \
+    MCE_SIGNAL_IF "',member='" MCE_DEVICE_MODE_SIG "'"
+#define DISPLAY_STATUS_MATCH "type='signal',interface='" \
+    MCE_SIGNAL_IF "',member='" MCE_DISPLAY_SIG "'"
+
+/* the shared device state segment, see osso_hw_state_publish */
+#define OSSO_HW_SEGMENT_DIR "/dev/shm" /* without $XDG_RUNTIME_DIR */
+#define OSSO_HW_SEGMENT_FILE ".libosso_hw_state"
+#define OSSO_HW_SEGMENT_MAGIC 0x4f534857 /* "OSHW" */
+#define OSSO_HW_SEGMENT_VERSION 1
+/* microseconds after which a reader checks again that the publisher
+ * still holds the segment */
+#define HW_SEGMENT_CHECK_INTERVAL 500000
+
+/* bits of _osso_hw_segment_t.flags */
+#define HW_SEGMENT_VALID      (1 << 0) /* a publisher keeps it up to date */
+#define HW_SEGMENT_SHUTDOWN   (1 << 1)
+#define HW_SEGMENT_MEMORY_LOW (1 << 2)
+#define HW_SEGMENT_INACTIVE   (1 << 3)
+
+/* The publisher makes seq odd before it changes the other members and
+ * even again after that, so a reader retries when seq was odd or changed
+ * during the read (a sequence lock). */
+typedef struct _osso_hw_segment_t {
+    guint32 magic;
+    guint32 version;
+    guint32 seq;
+    guint32 flags;
+    gint32 device_mode;     /* osso_devmode_t */
+    gint32 display_state;   /* osso_display_state_t */
+} _osso_hw_segment_t;
+
+#define _unset_state_cb(hwstate, match) do {\
     if((state->hwstate) && (osso->hw_cbs.hwstate.set)) { \
 	dprint("Unsetting handler for signal %s"\
 		   ,#hwstate); \
 	osso->hw_cbs.hwstate.cb = NULL; \
 	osso->hw_cbs.hwstate.data = NULL; \
 	osso->hw_cbs.hwstate.set = FALSE; \
-	dbus_bus_remove_match(osso->sys_conn, "type='signal',interface='" \
-			      MCE_SIGNAL_IF "',member='"#hwstate"'"\
-			      , NULL); \
+	_osso_match_remove(osso, osso->sys_conn, match); \
     } \
 }while(0)
 
-#define _state_is_unset() ( (!osso->hw_cbs.shutdown_ind.set) && \
-                            (!osso->hw_cbs.save_unsaved_data_ind.set) && \
-                            (!osso->hw_cbs.system_inactivity_ind.set) && \
-                            (!osso->hw_cbs.sig_device_mode_ind.set) )
+/* TRUE if the indicator has a callback of osso_hw_set_event_cb or of
+ * osso_hw_add_event_cb */
+#define _is_listened(hwstate) (osso->hw_cbs.hwstate.set || \
+                               osso->hw_cbs.hwstate.subscribers != NULL)
 
 static void read_device_state_from_file(osso_context_t *osso);
 
@@ -51,26 +51,45 @@ compose_hash_key(const char *service, const char *object_path,
     }
 }
 
-static const char *opm_match_all_key = MUALI_PATH_MATCH_ALL
-                                       MUALI_MEMBER_MATCH_ALL;
-
+/* Interns the object path and member of a muali handler. NULL means
+ * any object path or member. */
 inline static void
 compose_opm_hash_key(const char *object_path, const char *member,
-                     char *key)
+                     _muali_opm_key_t *key)
 {
-    key[0] = '\0';
-    if (object_path == NULL && member == NULL) {
-        strncat(key, opm_match_all_key, MAX_OP_LEN + MAX_MEMBER_LEN);
-    } else if (object_path == NULL) {
-        strncat(key, MUALI_PATH_MATCH_ALL, MAX_OP_LEN);
-        strncat(key, member, MAX_MEMBER_LEN);
-    } else if (member == NULL) {
-        strncat(key, object_path, MAX_OP_LEN);
-        strncat(key, MUALI_MEMBER_MATCH_ALL, MAX_MEMBER_LEN);
-    } else {
-        strncat(key, object_path, MAX_OP_LEN);
-        strncat(key, member, MAX_MEMBER_LEN);
-    }
+    key->path = g_quark_from_string(object_path != NULL ? object_path
+                                    : MUALI_PATH_MATCH_ALL);
+    key->member = g_quark_from_string(member != NULL ? member
+                                      : MUALI_MEMBER_MATCH_ALL);
+}
+
+static guint ipm_key_hash(gconstpointer key)
+{
+    const _osso_ipm_key_t *k = key;
+
+    return (k->interface * 31 + k->path) * 31 + k->member;
+}
+
+static gboolean ipm_key_equal(gconstpointer a, gconstpointer b)
+{
+    const _osso_ipm_key_t *ka = a, *kb = b;
+
+    return ka->interface == kb->interface && ka->path == kb->path
+           && ka->member == kb->member;
+}
+
+static guint opm_key_hash(gconstpointer key)
+{
+    const _muali_opm_key_t *k = key;
+
+    return k->path * 31 + k->member;
+}
+
+static gboolean opm_key_equal(gconstpointer a, gconstpointer b)
+{
+    const _muali_opm_key_t *ka = a, *kb = b;
+
+    return ka->path == kb->path && ka->member == kb->member;
 }
 
 gboolean __attribute__ ((visibility("hidden")))
@@ -101,6 +120,58 @@ osso_context_t * osso_initialize(const gchar *application,
 				 const gchar *version,
 				 gboolean activation,
 				 GMainContext *context)
+{
+    if (activation) {
+        ULOG_WARN_F("connecting to both D-BUS busses, 'activation' "
+                    "argument does not have any effect");
+    }
+    return osso_initialize_with_flags(application, version,
+                                      OSSO_INIT_DEFAULT, context);
+}
+
+static gboolean _sys_conn_idle(gpointer data)
+{
+    osso_context_t *osso = data;
+
+    /* the source is destroyed when this returns */
+    g_source_unref(osso->sys_conn_source);
+    osso->sys_conn_source = NULL;
+
+    _osso_get_sys_conn(osso);
+    return FALSE;
+}
+
+/* Returns the system bus connection, connecting first if the context was
+ * initialized with a lazy system bus. NULL is returned if the connection
+ * could not be made. */
+__attribute__ ((visibility("hidden"))) DBusConnection *
+_osso_get_sys_conn(osso_context_t *osso)
+{
+    if (osso->sys_conn != NULL || !osso->sys_conn_lazy) {
+        return osso->sys_conn;
+    }
+
+    if (osso->sys_conn_source != NULL) {
+        g_source_destroy(osso->sys_conn_source);
+        g_source_unref(osso->sys_conn_source);
+        osso->sys_conn_source = NULL;
+    }
+
+    dprint("connecting to the system bus");
+    osso->sys_conn = _dbus_connect_and_setup(osso, DBUS_BUS_SYSTEM,
+                                             osso->main_context);
+    if (osso->sys_conn == NULL) {
+        ULOG_ERR_F("connecting to the system bus failed");
+    } else {
+        osso->sys_conn_lazy = FALSE;
+    }
+    return osso->sys_conn;
+}
+
+osso_context_t * osso_initialize_with_flags(const gchar *application,
+                                            const gchar *version,
+                                            osso_init_flags_t flags,
+                                            GMainContext *context)
 {
     osso_context_t *osso;
     ULOG_DEBUG_F("application '%s', version '%s'", application, version);
@@ -121,9 +192,8 @@ osso_context_t * osso_initialize(const gchar *application,
 					   (gpointer)application);
 #endif
 
-    if (activation) {
-        ULOG_WARN_F("connecting to both D-BUS busses, 'activation' "
-                    "argument does not have any effect");
+    if (context != NULL) {
+        osso->main_context = g_main_context_ref(context);
     }
     dprint("connecting to the session bus");
     osso->conn = _dbus_connect_and_setup(osso, DBUS_BUS_SESSION, context);
@@ -133,6 +203,21 @@ osso_context_t * osso_initialize(const gchar *application,
         _deinit(osso);
         return NULL;
     }
+
+    if (flags & (OSSO_INIT_LAZY_SYSTEM_BUS | OSSO_INIT_IDLE_SYSTEM_BUS)) {
+        dprint("connecting to the system bus on first use");
+        osso->sys_conn_lazy = TRUE;
+        if (flags & OSSO_INIT_IDLE_SYSTEM_BUS) {
+            osso->sys_conn_source = g_idle_source_new();
+            g_source_set_priority(osso->sys_conn_source, G_PRIORITY_LOW);
+            g_source_set_callback(osso->sys_conn_source, _sys_conn_idle,
+                                  osso, NULL);
+            g_source_attach(osso->sys_conn_source, osso->main_context);
+        }
+        osso->cur_conn = NULL;
+        return osso;
+    }
+
     dprint("connecting to the system bus");
     osso->sys_conn = _dbus_connect_and_setup(osso, DBUS_BUS_SYSTEM, context);
     if (osso->sys_conn == NULL) {
@@ -216,6 +301,9 @@ muali_context_t *muali_init(const char *program_name,
         ULOG_CRIT_F("initialisation failed: out of memory");
         return NULL;
     }
+    if (context != NULL) {
+        osso->main_context = g_main_context_ref(context);
+    }
 
     osso->conn = _muali_dbus_setup(osso, DBUS_BUS_SESSION, context);
     if (osso->conn == NULL) {
@@ -239,6 +327,8 @@ void osso_deinitialize(osso_context_t *osso)
 {
     if (osso == NULL) return;
     
+    _deinit_bus_users(osso);
+    flush_pending(osso);
     _dbus_disconnect(osso, FALSE);
     _dbus_disconnect(osso, TRUE);
     
@@ -332,6 +422,50 @@ make_default_object_path(const char *application, char *path)
     }
 }
 
+/* an application that is called often stays in the table, the table is
+ * emptied when it would grow past this */
+#define DEFAULT_NAMES_MAX 32
+
+/* Returns the default service, object path and interface of the
+ * application. They are made once and kept in the context; the returned
+ * names are valid until the next call. Returns NULL if out of memory. */
+__attribute__ ((visibility("hidden"))) const _osso_default_names_t *
+_osso_default_names(osso_context_t *osso, const char *application)
+{
+    _osso_default_names_t *names;
+    char *key;
+
+    assert(osso != NULL && application != NULL);
+
+    if (osso->default_names == NULL) {
+        osso->default_names = g_hash_table_new_full(g_str_hash,
+                                                    g_str_equal,
+                                                    free, free);
+    } else {
+        names = g_hash_table_lookup(osso->default_names, application);
+        if (names != NULL) {
+            return names;
+        }
+        if (g_hash_table_size(osso->default_names) >= DEFAULT_NAMES_MAX) {
+            g_hash_table_remove_all(osso->default_names);
+        }
+    }
+
+    names = calloc(1, sizeof(_osso_default_names_t));
+    key = strdup(application);
+    if (names == NULL || key == NULL) {
+        ULOG_ERR_F("out of memory");
+        free(names);
+        free(key);
+        return NULL;
+    }
+    make_default_service(application, names->service);
+    make_default_object_path(application, names->path);
+    make_default_interface(application, names->interface);
+    g_hash_table_insert(osso->default_names, key, names);
+    return names;
+}
+
 /************************************************************************/
 
 static void free_handler(gpointer data, gpointer user_data)
@@ -352,11 +486,12 @@ static void free_uniq_hash_value(gpointer data)
     _osso_hash_value_t *elem = data;
 
     if (elem != NULL) {
-        if (elem->handlers != NULL) {
-            g_slist_foreach(elem->handlers, free_handler, NULL);
-            g_slist_free(elem->handlers);
-            elem->handlers = NULL;
+        guint i;
+
+        for (i = 0; i < elem->len; ++i) {
+            free_handler(elem->handlers[i], NULL);
         }
+        free(elem->handlers);
         free(elem);
     }
 }
@@ -366,14 +501,297 @@ static void free_if_hash_value(gpointer data)
     _osso_hash_value_t *elem = data;
 
     if (elem != NULL) {
-        if (elem->handlers != NULL) {
-            g_slist_free(elem->handlers);
-            elem->handlers = NULL;
-        }
+        /* the handlers themselves are owned by uniq_hash */
+        free(elem->handlers);
         free(elem);
     }
 }
 
+static void free_reply_hash_value(gpointer data)
+{
+    free_handler(data, NULL);
+}
+
+static void free_opm_hash_value(gpointer data)
+{
+    _muali_opm_entry_t *entry = data;
+
+    if (entry != NULL) {
+        /* the handlers themselves are owned by id_hash */
+        free(entry->value.handlers);
+        free(entry);
+    }
+}
+
+/************************************************************************/
+
+/* A handler is in two vectors: the one owning it (uniq_hash or id_hash)
+ * and the dispatch index (if_hash, ipm_hash or opm_hash). It knows its
+ * slot in both. */
+static inline guint *handler_slot(_osso_handler_t *handler, gboolean owner)
+{
+    return owner ? &handler->owner_slot : &handler->index_slot;
+}
+
+/* Appends the handler to the vector in O(1) amortized time. */
+static gboolean handler_vec_append(_osso_hash_value_t *vec,
+                                   _osso_handler_t *handler,
+                                   gboolean owner)
+{
+    if (vec->len == vec->size) {
+        _osso_handler_t **handlers;
+        guint size = vec->size > 0 ? vec->size * 2 : 4;
+
+        handlers = realloc(vec->handlers, size * sizeof(handlers[0]));
+        if (handlers == NULL) {
+            ULOG_ERR_F("realloc() failed");
+            return FALSE;
+        }
+        vec->handlers = handlers;
+        vec->size = size;
+    }
+
+    *handler_slot(handler, owner) = vec->len;
+    vec->handlers[vec->len++] = handler;
+    return TRUE;
+}
+
+/* Removes the NULL slots, keeping the order of the handlers. */
+static void handler_vec_compact(_osso_hash_value_t *vec, gboolean owner)
+{
+    guint i, j;
+
+    if (vec->removed == 0) {
+        return;
+    }
+
+    for (i = 0, j = 0; i < vec->len; ++i) {
+        _osso_handler_t *h = vec->handlers[i];
+
+        if (h != NULL) {
+            *handler_slot(h, owner) = j;
+            vec->handlers[j++] = h;
+        }
+    }
+    vec->len = j;
+    vec->removed = 0;
+}
+
+/* Clears the slot of the handler in O(1) time. Returns TRUE if the
+ * vector became empty and should be removed from its hash table. */
+static gboolean handler_vec_remove(osso_context_t *osso,
+                                   _osso_hash_value_t *vec,
+                                   _osso_handler_t *handler,
+                                   gboolean owner)
+{
+    guint slot = *handler_slot(handler, owner);
+
+    if (slot >= vec->len || vec->handlers[slot] != handler) {
+        ULOG_ERR_F("handler %p is not in slot %u", handler, slot);
+        return FALSE;
+    }
+
+    vec->handlers[slot] = NULL;
+    vec->removed++;
+
+    if (osso->dispatch_depth > 0) {
+        /* the dispatch may be walking this vector, it is compacted
+         * after the dispatch */
+        osso->handlers_dirty = TRUE;
+        return FALSE;
+    }
+
+    if (vec->removed == vec->len) {
+        return TRUE;
+    }
+    if (vec->removed * 2 > vec->len) {
+        handler_vec_compact(vec, owner);
+    }
+    return FALSE;
+}
+
+static gboolean compact_owner_entry(gpointer key, gpointer value,
+                                    gpointer user_data)
+{
+    _osso_hash_value_t *vec = value;
+
+    handler_vec_compact(vec, TRUE);
+    return vec->len == 0;
+}
+
+static gboolean compact_index_entry(gpointer key, gpointer value,
+                                    gpointer user_data)
+{
+    _osso_hash_value_t *vec = value;
+
+    handler_vec_compact(vec, FALSE);
+    return vec->len == 0;
+}
+
+static gboolean compact_opm_entry(gpointer key, gpointer value,
+                                  gpointer user_data)
+{
+    _muali_opm_entry_t *entry = value;
+
+    handler_vec_compact(&entry->value, FALSE);
+    return entry->value.len == 0;
+}
+
+static void compact_hash(GHashTable *hash, GHRFunc func)
+{
+    if (hash != NULL) {
+        g_hash_table_foreach_remove(hash, func, NULL);
+    }
+}
+
+/* Writes out the connections that have messages waiting because of the
+ * flush policy. */
+static void flush_pending(osso_context_t *osso)
+{
+    if (osso->flush_source != NULL) {
+        g_source_destroy(osso->flush_source);
+        g_source_unref(osso->flush_source);
+        osso->flush_source = NULL;
+    }
+    if (osso->flush_pending && osso->conn != NULL) {
+        dbus_connection_flush(osso->conn);
+    }
+    if (osso->sys_flush_pending && osso->sys_conn != NULL) {
+        dbus_connection_flush(osso->sys_conn);
+    }
+    osso->flush_pending = FALSE;
+    osso->sys_flush_pending = FALSE;
+}
+
+static gboolean flush_idle(gpointer data)
+{
+    flush_pending(data);
+    return FALSE;
+}
+
+static void schedule_flush(osso_context_t *osso)
+{
+    if (osso->flush_source == NULL) {
+        osso->flush_source = g_idle_source_new();
+        g_source_set_priority(osso->flush_source, G_PRIORITY_DEFAULT_IDLE);
+        g_source_set_callback(osso->flush_source, flush_idle, osso, NULL);
+        g_source_attach(osso->flush_source, osso->main_context);
+    }
+}
+
+/* Called after sending a message on conn instead of
+ * dbus_connection_flush(). Depending on the flush policy of the context
+ * the connection is flushed now, at the end of the dispatch or when the
+ * main loop is idle. */
+void __attribute__ ((visibility("hidden")))
+_osso_flush(osso_context_t *osso, DBusConnection *conn)
+{
+    gboolean *pending;
+
+    if (conn == osso->conn) {
+        pending = &osso->flush_pending;
+    } else if (conn == osso->sys_conn) {
+        pending = &osso->sys_flush_pending;
+    } else {
+        pending = NULL;
+    }
+
+    if (pending == NULL || osso->flush_policy == OSSO_FLUSH_IMMEDIATE
+        || (osso->flush_policy == OSSO_FLUSH_END_OF_DISPATCH
+            && osso->dispatch_depth == 0)) {
+        dbus_connection_flush(conn);
+        return;
+    }
+
+    *pending = TRUE;
+    if (osso->flush_policy == OSSO_FLUSH_IDLE) {
+        schedule_flush(osso);
+    }
+}
+
+/* Flushes a connection at the end of the dispatch if no more messages are
+ * waiting to be dispatched on it. Otherwise the flush is left to the
+ * dispatch of the last message, and the idle source makes sure that it
+ * happens even if that message is not seen by the filters. */
+static void flush_dispatched(osso_context_t *osso, DBusConnection *conn,
+                             gboolean *pending)
+{
+    if (!*pending) {
+        return;
+    }
+    if (dbus_connection_get_dispatch_status(conn)
+        == DBUS_DISPATCH_DATA_REMAINS) {
+        schedule_flush(osso);
+    } else {
+        *pending = FALSE;
+        dbus_connection_flush(conn);
+    }
+}
+
+osso_return_t osso_set_flush_policy(osso_context_t *osso,
+                                    osso_flush_policy_t policy)
+{
+    if (osso == NULL || policy < OSSO_FLUSH_IMMEDIATE
+        || policy > OSSO_FLUSH_IDLE) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    flush_pending(osso);
+    osso->flush_policy = policy;
+    return OSSO_OK;
+}
+
+/* Must be called by the message filters before calling any handlers.
+ * Returns the generation of the handlers that the dispatch may call;
+ * the handlers set during the dispatch are newer. */
+static guint begin_dispatch(osso_context_t *osso)
+{
+    osso->dispatch_depth++;
+    return osso->generation;
+}
+
+/* Must be called by the message filters after calling the handlers. The
+ * outermost dispatch cleans up after the handlers removed during it. */
+static void end_dispatch(osso_context_t *osso)
+{
+    if (--osso->dispatch_depth > 0) {
+        return;
+    }
+
+    if (osso->flush_policy == OSSO_FLUSH_END_OF_DISPATCH) {
+        flush_dispatched(osso, osso->conn, &osso->flush_pending);
+        flush_dispatched(osso, osso->sys_conn, &osso->sys_flush_pending);
+    }
+
+    if (osso->handlers_dirty) {
+        compact_hash(osso->uniq_hash, compact_owner_entry);
+        compact_hash(osso->id_hash, compact_owner_entry);
+        compact_hash(osso->if_hash, compact_index_entry);
+        compact_hash(osso->ipm_hash, compact_index_entry);
+        compact_hash(osso->opm_hash, compact_opm_entry);
+        osso->handlers_dirty = FALSE;
+    }
+
+    if (osso->removed_handlers != NULL) {
+        g_slist_foreach(osso->removed_handlers, free_handler, NULL);
+        g_slist_free(osso->removed_handlers);
+        osso->removed_handlers = NULL;
+    }
+}
+
+/* Frees the handler, or after the dispatch if one is ongoing, because
+ * the handler may be the one being called. */
+static void release_handler(osso_context_t *osso, _osso_handler_t *handler)
+{
+    if (osso->dispatch_depth > 0) {
+        osso->removed_handlers = g_slist_prepend(osso->removed_handlers,
+                                                 handler);
+    } else {
+        free_handler(handler, NULL);
+    }
+}
+
 static osso_context_t *_init(const gchar *application,
                              const gchar *version)
 {
@@ -400,10 +818,12 @@ static osso_context_t *_init(const gchar *application,
                                             free, free_uniq_hash_value);
     osso->if_hash = g_hash_table_new_full(g_str_hash, g_str_equal,
                                           free, free_if_hash_value);
+    osso->ipm_hash = g_hash_table_new_full(ipm_key_hash, ipm_key_equal,
+                                           free, free_if_hash_value);
     osso->id_hash = g_hash_table_new_full(g_int_hash, g_int_equal,
                                           NULL, free_uniq_hash_value);
     if (osso->uniq_hash == NULL || osso->if_hash == NULL
-        || osso->id_hash == NULL) {
+        || osso->ipm_hash == NULL || osso->id_hash == NULL) {
         ULOG_ERR_F("g_hash_table_new_full failed");
         free(osso);
         return NULL;
@@ -436,15 +856,24 @@ static osso_context_t *_muali_init(const char *application,
     make_default_service((const char*)application, osso->service);
     make_default_object_path((const char*)application, osso->object_path);
 
-    osso->opm_hash = g_hash_table_new_full(g_str_hash, g_str_equal,
-                                          free, free_if_hash_value);
+    osso->opm_hash = g_hash_table_new_full(opm_key_hash, opm_key_equal,
+                                           NULL, free_opm_hash_value);
     osso->id_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal,
                                           NULL, free_uniq_hash_value);
-    if (osso->id_hash == NULL || osso->opm_hash == NULL) {
+    osso->reply_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                             NULL, free_reply_hash_value);
+    osso->sys_reply_hash = g_hash_table_new_full(g_direct_hash,
+                                                 g_direct_equal, NULL,
+                                                 free_reply_hash_value);
+    if (osso->id_hash == NULL || osso->opm_hash == NULL
+        || osso->reply_hash == NULL || osso->sys_reply_hash == NULL) {
         ULOG_ERR_F("g_hash_table_new_full failed");
         free(osso);
         return NULL;
     }
+    osso->path_match_all = g_quark_from_static_string(MUALI_PATH_MATCH_ALL);
+    osso->member_match_all =
+        g_quark_from_static_string(MUALI_MEMBER_MATCH_ALL);
     osso->cp_plugins = g_hash_table_new(g_str_hash, g_str_equal);
     osso->rpc_timeout = -1;
     osso->next_handler_id = 1;
@@ -453,6 +882,18 @@ static osso_context_t *_muali_init(const char *application,
 
 /*************************************************************************/
 
+static void _deinit_bus_users(osso_context_t *osso)
+{
+    _osso_hw_cbs_deinit(osso);
+    _osso_hw_segment_deinit(osso);
+    _osso_rpc_caches_deinit(osso);
+    _osso_rpc_tokens_deinit(osso);
+    _osso_peers_deinit(osso);
+    _osso_names_deinit(osso);
+    /* last, so that the rules removed above are sent */
+    _osso_match_deinit(osso);
+}
+
 static void _deinit(osso_context_t *osso)
 {
     if (osso == NULL) {
@@ -464,12 +905,38 @@ static void _deinit(osso_context_t *osso)
     if (osso->if_hash != NULL) {
         g_hash_table_destroy(osso->if_hash);
     }
+    if (osso->ipm_hash != NULL) {
+        g_hash_table_destroy(osso->ipm_hash);
+    }
     if (osso->opm_hash != NULL) {
         g_hash_table_destroy(osso->opm_hash);
     }
     if (osso->id_hash != NULL) {
         g_hash_table_destroy(osso->id_hash);
     }
+    if (osso->reply_hash != NULL) {
+        g_hash_table_destroy(osso->reply_hash);
+    }
+    if (osso->sys_reply_hash != NULL) {
+        g_hash_table_destroy(osso->sys_reply_hash);
+    }
+    if (osso->removed_handlers != NULL) {
+        g_slist_foreach(osso->removed_handlers, free_handler, NULL);
+        g_slist_free(osso->removed_handlers);
+    }
+    if (osso->default_names != NULL) {
+        g_hash_table_destroy(osso->default_names);
+    }
+    free(osso->arg_arena);
+    _deinit_bus_users(osso);
+    flush_pending(osso);
+    if (osso->sys_conn_source != NULL) {
+        g_source_destroy(osso->sys_conn_source);
+        g_source_unref(osso->sys_conn_source);
+    }
+    if (osso->main_context != NULL) {
+        g_main_context_unref(osso->main_context);
+    }
     if (osso->cp_plugins != NULL) {
         g_hash_table_destroy(osso->cp_plugins);
     }
@@ -614,6 +1081,10 @@ static void _dbus_disconnect(osso_context_t *osso, gboolean sys)
         conn = osso->conn;
         osso->conn = NULL;
     }
+    if (conn == NULL) {
+        /* lazy system bus that was never connected */
+        return;
+    }
     dbus_connection_remove_filter(conn, _msg_handler, osso);
     if (osso->muali_filters_setup) {
         dbus_connection_remove_filter(conn, _muali_filter_session, osso);
@@ -631,16 +1102,50 @@ static void _dbus_disconnect(osso_context_t *osso, gboolean sys)
 
 /*************************************************************************/
 
+/* Calls the handlers in the vector that are of the right kind (method or
+ * signal handler) and older than the dispatch. Returns TRUE if one was
+ * called. */
+static gboolean call_handlers(osso_context_t *osso,
+                              _osso_hash_value_t *elem,
+                              DBusMessage *msg,
+                              gboolean is_method,
+                              guint generation)
+{
+    guint i;
+    gboolean found = FALSE;
+
+    /* the handlers may set and unset handlers, so the vector is indexed
+     * anew on every round */
+    for (i = 0; i < elem->len; ++i) {
+        _osso_handler_t *handler;
+
+        handler = elem->handlers[i];
+        if (handler == NULL || handler->generation >= generation) {
+            /* unset or set during this dispatch */
+            continue;
+        }
+
+        if (handler->method == is_method) {
+            ULOG_DEBUG_F("before calling the handler");
+            ULOG_DEBUG_F(" handler = %p", handler->handler);
+            ULOG_DEBUG_F(" data = %p", handler->data);
+            (*handler->handler)(osso, msg, handler->data, 0);
+            ULOG_DEBUG_F("after calling the handler");
+            found = TRUE;
+        }
+    }
+    return found;
+}
+
 DBusHandlerResult __attribute__ ((visibility("hidden")))
 _msg_handler(DBusConnection *conn, DBusMessage *msg, void *data)
 {
     osso_context_t *osso;
     _osso_hash_value_t *elem;
     gboolean is_method;
-    const char *interface;
-#ifdef OSSOLOG_COMPILE
-    gboolean found = FALSE;
-#endif
+    const char *interface, *path, *member;
+    gboolean found = FALSE, saved_deferred, deferred;
+    guint generation;
 
     osso = data;
 
@@ -653,8 +1158,6 @@ _msg_handler(DBusConnection *conn, DBusMessage *msg, void *data)
     else
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    /* FIXME: this is kind of brain-damaged: only interface is considered
-     * (would require new API to fix, to keep backwards compatibility) */
     interface = dbus_message_get_interface(msg);
 
     if (interface == NULL) {
@@ -662,39 +1165,70 @@ _msg_handler(DBusConnection *conn, DBusMessage *msg, void *data)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
-    ULOG_DEBUG_F("key = '%s'", interface);
-    elem = g_hash_table_lookup(osso->if_hash, interface);
+    path = dbus_message_get_path(msg);
+    member = dbus_message_get_member(msg);
 
-    if (elem != NULL) {
-        GSList *list;
+    /* the hash table values are not freed before end_dispatch */
+    generation = begin_dispatch(osso);
+    saved_deferred = osso->reply_deferred;
+    osso->reply_deferred = FALSE;
 
-        osso->cur_conn = conn;
+    /* handlers registered for this interface and member, first those
+     * for this exact object path and then those for any path */
+    if (member != NULL && g_hash_table_size(osso->ipm_hash) > 0) {
+        _osso_ipm_key_t key;
 
-        list = elem->handlers;
-        while (list != NULL) {
-            _osso_handler_t *handler;
+        /* a string that has not been interned cannot have handlers */
+        key.interface = g_quark_try_string(interface);
+        key.member = g_quark_try_string(member);
 
-            handler = list->data;
+        if (key.interface != 0 && key.member != 0) {
+            key.path = path != NULL ? g_quark_try_string(path) : 0;
+            if (key.path != 0) {
+                elem = g_hash_table_lookup(osso->ipm_hash, &key);
+                if (elem != NULL) {
+                    osso->cur_conn = conn;
+                    found = call_handlers(osso, elem, msg, is_method,
+                                          generation);
+                }
+            }
 
-            if (handler->method == is_method) {
-                ULOG_DEBUG_F("before calling the handler");
-                ULOG_DEBUG_F(" handler = %p", handler->handler);
-                ULOG_DEBUG_F(" data = %p", handler->data);
-                (*handler->handler)(osso, msg, handler->data, 0);
-                ULOG_DEBUG_F("after calling the handler");
-#ifdef OSSOLOG_COMPILE
-                found = TRUE;
-#endif
+            key.path = 0;
+            elem = g_hash_table_lookup(osso->ipm_hash, &key);
+            if (elem != NULL) {
+                osso->cur_conn = conn;
+                if (call_handlers(osso, elem, msg, is_method, generation)) {
+                    found = TRUE;
+                }
             }
+        }
+    }
 
-            list = g_slist_next(list);
+    /* handlers for any member of the interface (the old osso API does
+     * not consider the object path and member) */
+    ULOG_DEBUG_F("key = '%s'", interface);
+    elem = g_hash_table_lookup(osso->if_hash, interface);
+
+    if (elem != NULL) {
+        osso->cur_conn = conn;
+        if (call_handlers(osso, elem, msg, is_method, generation)) {
+            found = TRUE;
         }
-    } 
-#ifdef OSSOLOG_COMPILE
+    }
+
+    deferred = osso->reply_deferred;
+    osso->reply_deferred = saved_deferred;
+    end_dispatch(osso);
+
     if (!found) {
         ULOG_DEBUG_F("suitable handler not found from the hash table");
     }
-#endif
+
+    /* otherwise libdbus answers the call with an unknown method error
+     * before the deferred reply is sent */
+    if (deferred) {
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
 
 #if 0
     for(i=0; i<osso->ifs->len; i++) {
@@ -797,50 +1331,107 @@ _muali_filter_system(DBusConnection *conn, DBusMessage *msg, void *data)
     return _muali_filter(conn, msg, data, MUALI_BUS_SYSTEM);
 }
 
-inline static void opm_match_helper(const char *object_path,
-                                    const char *member,
-                                    char *key)
+/* Looks up the dispatch index entries for the object path and member
+ * and stores them to 'entries', which must have room for four entries.
+ * Returns the number of entries found. Does not allocate memory. */
+inline static int opm_match(osso_context_t *muali,
+                            const char *path,
+                            const char *member,
+                            _muali_opm_entry_t **entries)
 {
-    key[0] = '\0';
-    strncat(key, object_path, MAX_OP_LEN);
-    strncat(key, member, MAX_MEMBER_LEN);
-}
+    _muali_opm_key_t key;
+    _muali_opm_entry_t *entry;
+    GQuark path_q = 0, member_q = 0;
+    int n = 0;
 
-/* Returns a GSList of _osso_hash_value_t pointers */
-inline static GSList *opm_match(osso_context_t *muali,
-                                const char *path,
-                                const char *member)
-{
-    GSList *list = NULL;
-    _osso_hash_value_t *elem;
-    char opm_key[MAX_OPM_HASH_KEY_LEN + 1];
+    /* a string that has not been interned cannot have handlers */
+    if (path != NULL) {
+        path_q = g_quark_try_string(path);
+    }
+    if (member != NULL) {
+        member_q = g_quark_try_string(member);
+    }
+
+    if (path_q != 0) {
+        /* path + any member? */
+        key.path = path_q;
+        key.member = muali->member_match_all;
+        entry = g_hash_table_lookup(muali->opm_hash, &key);
+        if (entry != NULL) entries[n++] = entry;
+    }
+
+    if (member_q != 0) {
+        /* any path + member? */
+        key.path = muali->path_match_all;
+        key.member = member_q;
+        entry = g_hash_table_lookup(muali->opm_hash, &key);
+        if (entry != NULL) entries[n++] = entry;
+    }
 
-    if (path != NULL && member != NULL) {
+    /* match-'em-all handlers */
+    key.path = muali->path_match_all;
+    key.member = muali->member_match_all;
+    entry = g_hash_table_lookup(muali->opm_hash, &key);
+    if (entry != NULL) entries[n++] = entry;
+
+    if (path_q != 0 && member_q != 0) {
         /* direct match? */
-        opm_match_helper(path, member, opm_key);
-        elem = g_hash_table_lookup(muali->opm_hash, opm_key);
-        if (elem != NULL) list = g_slist_prepend(list, elem);
+        key.path = path_q;
+        key.member = member_q;
+        entry = g_hash_table_lookup(muali->opm_hash, &key);
+        if (entry != NULL) entries[n++] = entry;
     }
 
-    /* return list of match-'em-all handlers */
-    elem = g_hash_table_lookup(muali->opm_hash, opm_match_all_key);
-    if (elem != NULL) list = g_slist_prepend(list, elem);
+    return n;
+}
 
-    if (member != NULL) {
-        /* any path + member? */
-        opm_match_helper(MUALI_PATH_MATCH_ALL, member, opm_key);
-        elem = g_hash_table_lookup(muali->opm_hash, opm_key);
-        if (elem != NULL) list = g_slist_prepend(list, elem);
+inline static GHashTable *reply_hash_for_bus(osso_context_t *muali,
+                                             muali_bus_type bus_type)
+{
+    switch (bus_type) {
+        case MUALI_BUS_SESSION:
+            return muali->reply_hash;
+        case MUALI_BUS_SYSTEM:
+            return muali->sys_reply_hash;
+        default:
+            return NULL;
     }
+}
 
-    if (path != NULL) {
-        /* path + any member? */
-        opm_match_helper(path, MUALI_MEMBER_MATCH_ALL, opm_key);
-        elem = g_hash_table_lookup(muali->opm_hash, opm_key);
-        if (elem != NULL) list = g_slist_prepend(list, elem);
+/* Calls and removes the one-shot handler waiting for this reply or
+ * error, if any. Replies are never matched against opm_hash, because
+ * only the handlers set by _muali_set_reply_handler are interested in
+ * them. */
+static void _muali_dispatch_reply(osso_context_t *muali, DBusMessage *msg,
+                                  muali_bus_type dbus_type)
+{
+    GHashTable *hash;
+    _osso_handler_t *handler;
+    gpointer key;
+
+    hash = reply_hash_for_bus(muali, dbus_type);
+    if (hash == NULL) {
+        return;
+    }
+
+    key = GUINT_TO_POINTER(dbus_message_get_reply_serial(msg));
+    handler = g_hash_table_lookup(hash, key);
+    if (handler == NULL) {
+        ULOG_DEBUG_F("no pending reply handler for serial %u",
+                     dbus_message_get_reply_serial(msg));
+        return;
     }
 
-    return list;
+    /* take it out of the table before the call, so that the handler
+     * can safely send new messages */
+    g_hash_table_steal(hash, key);
+
+    ULOG_DEBUG_F("calling one-shot handler at %p, data=%p",
+                 handler->handler, handler->data);
+    (*handler->handler)(muali, msg, handler->data, dbus_type);
+    ULOG_DEBUG_F("after calling handler at %p", handler->handler);
+
+    free_handler(handler, NULL);
 }
 
 /* filter function for muali API */
@@ -849,8 +1440,12 @@ _muali_filter(DBusConnection *conn, DBusMessage *msg, void *data,
               muali_bus_type dbus_type)
 {
     osso_context_t *muali;
-    GSList *elem_list, *elem_list_p, *rm_list = NULL, *rm_list_p;
-    int msgtype, reply_to;
+    _muali_opm_entry_t *entries[4];
+    const char *interface;
+    GQuark interface_q = 0;
+    int msgtype, n_entries, e;
+    gboolean match_sender = TRUE;
+    guint generation;
 #ifdef OSSOLOG_COMPILE
     gboolean found = FALSE;
 #endif
@@ -863,142 +1458,93 @@ _muali_filter(DBusConnection *conn, DBusMessage *msg, void *data,
     if (msgtype == MUALI_EVENT_NONE) {
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
-    reply_to = dbus_message_get_reply_serial(msg);
-
-    elem_list = opm_match(muali, dbus_message_get_path(msg),
-                          dbus_message_get_member(msg));
 
-    elem_list_p = elem_list;
-    while (elem_list_p != NULL) {
-        _osso_hash_value_t *elem;
-
-        elem = elem_list_p->data;
+    if (msgtype == MUALI_EVENT_REPLY || msgtype == MUALI_EVENT_ERROR) {
+        _muali_dispatch_reply(muali, msg, dbus_type);
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
 
-        if (elem != NULL) {
-            GSList *list;
-            int last_id = 0;
+    n_entries = opm_match(muali, dbus_message_get_path(msg),
+                          dbus_message_get_member(msg), entries);
+    if (n_entries == 0) {
+        ULOG_DEBUG_F("no handlers for '%s%s'", dbus_message_get_path(msg),
+                     dbus_message_get_member(msg));
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
 
-            list = elem->handlers;
-            while (list != NULL) {
-                _osso_handler_t *handler;
-                _osso_callback_data_t *cb_data;
-                gboolean match_sender = TRUE;
+    interface = dbus_message_get_interface(msg);
+    if (interface != NULL) {
+        interface_q = g_quark_try_string(interface);
+    }
 
-                handler = list->data;
+    if (msgtype == MUALI_EVENT_SIGNAL) {
+        /* does not make sense to match sender in case
+         * of a D-Bus signal, because D-Bus uses the
+         * (practically random) unique bus name as the
+         * sender */
+        match_sender = FALSE;
+    }
 
-                /*
-                if (handler) {
-                        ULOG_DEBUG_F("found handler");
-                        if (handler->data != NULL) {
-                                ULOG_DEBUG_F("s/p/n: %s/%s/%s",
-                                    handler->data->service,
-                                    handler->data->path,
-                                    handler->data->name);
+    /* handlers may be unset (and set) by the callbacks, so the vectors
+     * are only cleared and not shrunk while we are walking them */
+    generation = begin_dispatch(muali);
 
-                                ULOG_DEBUG_F("s/p/n: %s/%s/%s",
-                                    dbus_message_get_sender(msg),
-                                    dbus_message_get_path(msg),
-                                    dbus_message_get_member(msg));
+    for (e = 0; e < n_entries; ++e) {
+        _osso_hash_value_t *vec = &entries[e]->value;
+        guint i;
+        int last_id = 0;
 
-                                ULOG_DEBUG_F("types: %d %d",
-                                    handler->data->event_type, msgtype);
-                        }
-                }
-                */
-
-                /* Note: this relies on the fact that the handlers with the
-                 * same id are adjacent in the list */
-                if (handler->call_once_per_handler_id
-                    && handler->handler_id == last_id) {
-                        /* do not call the callback this time, workaround for
-                         * MUALI_EVENT_MESSAGE_OR_SIGNAL etc. implementation */
-                        list = g_slist_next(list);
-                        continue;
-                }
+        for (i = 0; i < vec->len; ++i) {
+            _osso_handler_t *handler;
+            _osso_callback_data_t *cb_data;
+            int handler_id;
 
-                cb_data = handler->data;
-
-                if (cb_data != NULL && cb_data->message_id != 0
-                    && cb_data->message_id == reply_to) {
-                        /* this (one-shot) handler was created for this
-                         * (reply) message */
-                        ULOG_DEBUG_F("calling one-shot handler at %p,"
-                                     " data=%p", handler->handler, cb_data);
-                        (*handler->handler)(muali, msg, cb_data, dbus_type);
-                        ULOG_DEBUG_F("after calling handler at %p",
-                                     handler->handler);
-#ifdef OSSOLOG_COMPILE
-                        found = TRUE;
-#endif
-                        /* The handler is one-shot (because the serial is
-                         * supposed to be unique). Add it to list to remove
-                         * it later safely outside this loop. */
-                        rm_list = g_slist_prepend(rm_list,
-                                      GINT_TO_POINTER(handler->handler_id));
-
-                        list = g_slist_next(list);
-                        continue;
-                }
+            handler = vec->handlers[i];
+            if (handler == NULL || handler->generation >= generation) {
+                /* unset or set during this dispatch */
+                continue;
+            }
+            handler_id = handler->handler_id;
+
+            /* Note: this relies on the fact that the handlers with the
+             * same id are adjacent in the vector */
+            if (handler->call_once_per_handler_id
+                && handler_id == last_id) {
+                    /* do not call the callback this time, workaround for
+                     * MUALI_EVENT_MESSAGE_OR_SIGNAL etc. implementation */
+                    continue;
+            }
 
-                if (cb_data != NULL && cb_data->bus_type != MUALI_BUS_BOTH
-                    && cb_data->bus_type != dbus_type) {
-                        /* handler is not for this bus type */
-                        list = g_slist_next(list);
-                        continue;
-                }
+            cb_data = handler->data;
 
-                if (msgtype == MUALI_EVENT_SIGNAL) {
-                        /* does not make sense to match sender in case
-                         * of a D-Bus signal, because D-Bus uses the
-                         * (practically random) unique bus name as the
-                         * sender */
-                        match_sender = FALSE;
-                }
+            if (cb_data != NULL && cb_data->bus_type != MUALI_BUS_BOTH
+                && cb_data->bus_type != dbus_type) {
+                    /* handler is not for this bus type */
+                    continue;
+            }
 
-                if (cb_data != NULL &&
-                    types_match(cb_data->event_type, msgtype) &&
-                    (!match_sender || str_match(cb_data->service,
-                                          dbus_message_get_sender(msg))) &&
-                    str_match(cb_data->interface,
-                              dbus_message_get_interface(msg))) {
-                    /* object path and member have matched already */
-
-                    ULOG_DEBUG_F("before calling the handler at %p, data=%p",
-                                 handler->handler, cb_data);
-                    (*handler->handler)(muali, msg, cb_data, dbus_type);
-                    ULOG_DEBUG_F("after calling handler at %p",
-                                 handler->handler);
+            if (cb_data != NULL &&
+                types_match(cb_data->event_type, msgtype) &&
+                (!match_sender || str_match(cb_data->service,
+                                      dbus_message_get_sender(msg))) &&
+                (handler->interface == 0 || interface == NULL
+                 || handler->interface == interface_q)) {
+                /* object path and member have matched already */
+
+                ULOG_DEBUG_F("before calling the handler at %p, data=%p",
+                             handler->handler, cb_data);
+                (*handler->handler)(muali, msg, cb_data, dbus_type);
+                ULOG_DEBUG_F("after calling handler id %d", handler_id);
 #ifdef OSSOLOG_COMPILE
-                    found = TRUE;
+                found = TRUE;
 #endif
-                }
-
-                last_id = handler->handler_id;
-                list = g_slist_next(list);
             }
-        }
 
-        elem_list_p = g_slist_next(elem_list_p);
-    }
-    
-    if (elem_list != NULL) {
-        g_slist_free(elem_list);
+            last_id = handler_id;
+        }
     }
 
-    if (rm_list != NULL) {
-        rm_list_p = rm_list;
-        do {
-            gboolean ret;
-            int handler_id = GPOINTER_TO_INT(rm_list_p->data);
-
-            assert(handler_id != 0);
-            ret = _muali_unset_handler(muali, handler_id);
-            assert(ret);
-
-            rm_list_p = g_slist_next(rm_list_p);
-        } while (rm_list_p != NULL);
-        g_slist_free(rm_list);
-    }
+    end_dispatch(muali);
 
 #ifdef OSSOLOG_COMPILE
     if (!found) {
@@ -1021,8 +1567,7 @@ static gboolean add_to_if_hash(osso_context_t *osso,
 
     old = g_hash_table_lookup(osso->if_hash, interface);
     if (old != NULL) {
-        old->handlers = g_slist_append(old->handlers,
-                                       (_osso_handler_t*)handler);
+        return handler_vec_append(old, (_osso_handler_t*)handler, FALSE);
     } else {
         _osso_hash_value_t *new_elem;
         char *new_key;
@@ -1034,14 +1579,18 @@ static gboolean add_to_if_hash(osso_context_t *osso,
             return FALSE;
         }
 
-        new_key = strdup(interface);
-        if (new_key == NULL) {
-            ULOG_ERR_F("calloc() failed");
+        if (!handler_vec_append(new_elem, (_osso_handler_t*)handler,
+                                FALSE)) {
             free(new_elem);
             return FALSE;
         }
 
-        new_elem->handlers = g_slist_append(NULL, (_osso_handler_t*)handler);
+        new_key = strdup(interface);
+        if (new_key == NULL) {
+            ULOG_ERR_F("strdup() failed");
+            free_if_hash_value(new_elem);
+            return FALSE;
+        }
 
         g_hash_table_insert(osso->if_hash, new_key, new_elem);
     }
@@ -1050,17 +1599,57 @@ static gboolean add_to_if_hash(osso_context_t *osso,
 
 static gboolean add_to_opm_hash(osso_context_t *osso,
                                 const _osso_handler_t *handler,
-                                const char *opm_key)
+                                const _muali_opm_key_t *opm_key)
+{
+    _muali_opm_entry_t *entry;
+
+    entry = g_hash_table_lookup(osso->opm_hash, opm_key);
+    if (entry != NULL) {
+        return handler_vec_append(&entry->value, (_osso_handler_t*)handler,
+                                  FALSE);
+    }
+
+    /* we need to allocate a new hash table element */
+    entry = calloc(1, sizeof(_muali_opm_entry_t));
+    if (entry == NULL) {
+        ULOG_ERR_F("calloc() failed");
+        return FALSE;
+    }
+
+    if (!handler_vec_append(&entry->value, (_osso_handler_t*)handler,
+                            FALSE)) {
+        free(entry);
+        return FALSE;
+    }
+
+    entry->key = *opm_key;
+    g_hash_table_insert(osso->opm_hash, &entry->key, entry);
+    return TRUE;
+}
+
+/* object_path NULL means any object path */
+static void compose_ipm_hash_key(const char *interface,
+                                 const char *object_path,
+                                 const char *member,
+                                 _osso_ipm_key_t *key)
+{
+    key->interface = g_quark_from_string(interface);
+    key->path = object_path != NULL ? g_quark_from_string(object_path) : 0;
+    key->member = g_quark_from_string(member);
+}
+
+static gboolean add_to_ipm_hash(osso_context_t *osso,
+                                const _osso_handler_t *handler,
+                                const _osso_ipm_key_t *ipm_key)
 {
     _osso_hash_value_t *old;
 
-    old = g_hash_table_lookup(osso->opm_hash, opm_key);
+    old = g_hash_table_lookup(osso->ipm_hash, ipm_key);
     if (old != NULL) {
-        old->handlers = g_slist_append(old->handlers,
-                                       (_osso_handler_t*)handler);
+        return handler_vec_append(old, (_osso_handler_t*)handler, FALSE);
     } else {
         _osso_hash_value_t *new_elem;
-        char *new_key;
+        _osso_ipm_key_t *new_key;
 
         /* we need to allocate a new hash table element */
         new_elem = calloc(1, sizeof(_osso_hash_value_t));
@@ -1069,16 +1658,21 @@ static gboolean add_to_opm_hash(osso_context_t *osso,
             return FALSE;
         }
 
-        new_key = strdup(opm_key);
-        if (new_key == NULL) {
-            ULOG_ERR_F("calloc() failed");
+        if (!handler_vec_append(new_elem, (_osso_handler_t*)handler,
+                                FALSE)) {
             free(new_elem);
             return FALSE;
         }
 
-        new_elem->handlers = g_slist_append(NULL, (_osso_handler_t*)handler);
+        new_key = malloc(sizeof(_osso_ipm_key_t));
+        if (new_key == NULL) {
+            ULOG_ERR_F("malloc() failed");
+            free_if_hash_value(new_elem);
+            return FALSE;
+        }
+        *new_key = *ipm_key;
 
-        g_hash_table_insert(osso->opm_hash, new_key, new_elem);
+        g_hash_table_insert(osso->ipm_hash, new_key, new_elem);
     }
     return TRUE;
 }
@@ -1087,6 +1681,8 @@ static int set_handler_helper(osso_context_t *osso,
                                    const char *service,
                                    const char *object_path,
                                    const char *interface,
+                                   const char *member,
+                                   gboolean exact_path,
                                    _osso_handler_f *cb,
                                    _osso_callback_data_t *data, 
                                    gboolean method,
@@ -1109,6 +1705,7 @@ static int set_handler_helper(osso_context_t *osso,
     handler->method = method;
     handler->can_free_data = can_free_data;
     handler->handler_id = osso->next_handler_id++;
+    handler->generation = osso->generation++;
 
     /* warn about the old element if it exists */
     old = g_hash_table_lookup(osso->uniq_hash, uniq_key);
@@ -1120,7 +1717,10 @@ static int set_handler_helper(osso_context_t *osso,
         ULOG_WARN_F(" interface: %s", interface);
 
         /* add it to the list of handlers */
-        old->handlers = g_slist_append(old->handlers, handler);
+        if (!handler_vec_append(old, handler, TRUE)) {
+            free(handler);
+            return 0;
+        }
 
     } else {
         _osso_hash_value_t *new_elem;
@@ -1134,19 +1734,38 @@ static int set_handler_helper(osso_context_t *osso,
             return 0;
         }
 
+        if (!handler_vec_append(new_elem, handler, TRUE)) {
+            free(handler);
+            free(new_elem);
+            return 0;
+        }
+
         new_key = strdup(uniq_key);
         if (new_key == NULL) {
             ULOG_ERR_F("strdup() failed");
             free(handler);
+            free(new_elem->handlers);
             free(new_elem);
             return 0;
         }
 
-        new_elem->handlers = g_slist_append(NULL, handler);
-
         g_hash_table_insert(osso->uniq_hash, new_key, new_elem);
     }
 
+    if (member != NULL) {
+        _osso_ipm_key_t ipm_key;
+
+        compose_ipm_hash_key(interface, exact_path ? object_path : NULL,
+                             member, &ipm_key);
+        handler->path = ipm_key.path;
+        handler->member = ipm_key.member;
+        if (add_to_ipm_hash(osso, handler, &ipm_key)) {
+            return handler->handler_id;
+        } else {
+            return 0;
+        }
+    }
+
     if (add_to_if_hash(osso, handler, interface)) {
         return handler->handler_id;
     } else {
@@ -1169,10 +1788,50 @@ _msg_handler_set_cb_f(osso_context_t *osso,
 	return;
     }
 
-    set_handler_helper(osso, service, object_path, interface,
+    set_handler_helper(osso, service, object_path, interface, NULL, FALSE,
                        cb, data, method, FALSE);
 }
 
+void __attribute__ ((visibility("hidden")))
+_msg_handler_set_member_cb_f(osso_context_t *osso,
+                             const char *service,
+                             const char *object_path,
+                             const char *interface,
+                             const char *member,
+                             _osso_handler_f *cb,
+                             _osso_callback_data_t *data,
+                             gboolean method)
+{
+    if (osso == NULL || object_path == NULL || interface == NULL
+        || member == NULL || cb == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return;
+    }
+
+    set_handler_helper(osso, service, object_path, interface, member,
+                       FALSE, cb, data, method, FALSE);
+}
+
+void __attribute__ ((visibility("hidden")))
+_msg_handler_set_exact_cb_f(osso_context_t *osso,
+                            const char *service,
+                            const char *object_path,
+                            const char *interface,
+                            const char *member,
+                            _osso_handler_f *cb,
+                            _osso_callback_data_t *data,
+                            gboolean method)
+{
+    if (osso == NULL || object_path == NULL || interface == NULL
+        || member == NULL || cb == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return;
+    }
+
+    set_handler_helper(osso, service, object_path, interface, member,
+                       TRUE, cb, data, method, FALSE);
+}
+
 gboolean __attribute__ ((visibility("hidden")))
 _muali_set_handler(_muali_context_t *context,
                    _osso_handler_f *handler,
@@ -1180,14 +1839,14 @@ _muali_set_handler(_muali_context_t *context,
                    int handler_id,
                    gboolean call_once_per_handler_id)
 {   
-    char opm_key[MAX_OPM_HASH_KEY_LEN + 1];
+    _muali_opm_key_t opm_key;
     _osso_hash_value_t *old;
     _osso_handler_t *elem;
 
     assert(context != NULL && handler != NULL && data != NULL);
     assert(handler_id != 0);
 
-    compose_opm_hash_key(data->path, data->name, opm_key);
+    compose_opm_hash_key(data->path, data->name, &opm_key);
 
     elem = calloc(1, sizeof(_osso_handler_t));
     if (elem == NULL) {
@@ -1199,6 +1858,10 @@ _muali_set_handler(_muali_context_t *context,
     elem->data = data;
     elem->handler_id = handler_id;
     elem->call_once_per_handler_id = call_once_per_handler_id;
+    elem->generation = context->generation++;
+    if (data->interface != NULL) {
+        elem->interface = g_quark_from_string(data->interface);
+    }
     /* other members are not used and left zero */
 
     old = g_hash_table_lookup(context->id_hash, GINT_TO_POINTER(handler_id));
@@ -1206,7 +1869,10 @@ _muali_set_handler(_muali_context_t *context,
         ULOG_DEBUG_F("registering another handler for id %d", handler_id);
 
         /* add it to the list of handlers */
-        old->handlers = g_slist_append(old->handlers, elem);
+        if (!handler_vec_append(old, elem, TRUE)) {
+            free(elem);
+            return FALSE;
+        }
 
     } else {
         _osso_hash_value_t *new_elem;
@@ -1221,46 +1887,35 @@ _muali_set_handler(_muali_context_t *context,
             return FALSE;
         }
 
-        new_elem->handlers = g_slist_append(NULL, elem);
+        if (!handler_vec_append(new_elem, elem, TRUE)) {
+            free(elem);
+            free(new_elem);
+            return FALSE;
+        }
 
         g_hash_table_insert(context->id_hash, GINT_TO_POINTER(handler_id),
                             new_elem);
     }
 
-    return add_to_opm_hash(context, elem, opm_key);
+    return add_to_opm_hash(context, elem, &opm_key);
 }
 
 static void remove_from_opm_hash(_muali_context_t *context,
-                                 int handler_id,
-                                 const char *opm_key)
+                                 _osso_handler_t *handler,
+                                 const _muali_opm_key_t *opm_key)
 {
-    _osso_hash_value_t *elem;
-
-    elem = g_hash_table_lookup(context->opm_hash, opm_key);
-    if (elem != NULL) {
-        GSList *list;
-
-        list = elem->handlers;
-        while (list != NULL) {
-            _osso_handler_t *h = list->data;
-            GSList *next_elem;
+    _muali_opm_entry_t *entry;
 
-            next_elem = g_slist_next(list);
-
-            if (h->handler_id == handler_id) {
-                ULOG_DEBUG_F("found handler_id %d from if_hash", handler_id);
-                elem->handlers = g_slist_remove_link(elem->handlers, list);
-                g_slist_free_1(list); /* free the removed link */
+    entry = g_hash_table_lookup(context->opm_hash, opm_key);
+    if (entry == NULL) {
+        return;
+    }
 
-                /* if this was the last element in the list, free the
-                 * list and the hash element */
-                if (g_slist_length(elem->handlers) == 0) {
-                    g_hash_table_remove(context->opm_hash, opm_key);
-                    return;
-                }
-            }
-            list = next_elem;
-        }
+    ULOG_DEBUG_F("removing handler_id %d from opm_hash",
+                 handler->handler_id);
+    if (handler_vec_remove(context, &entry->value, handler, FALSE)) {
+        /* this was the last handler, free the hash element */
+        g_hash_table_remove(context->opm_hash, opm_key);
     }
 }
 
@@ -1268,7 +1923,7 @@ gboolean __attribute__ ((visibility("hidden")))
 _muali_unset_handler(_muali_context_t *context, int handler_id)
 {
     _osso_hash_value_t *elem;
-    GSList *list;
+    guint i;
 
     ULOG_DEBUG_F("context=%p", context);
     elem = g_hash_table_lookup(context->id_hash, GINT_TO_POINTER(handler_id));
@@ -1277,39 +1932,27 @@ _muali_unset_handler(_muali_context_t *context, int handler_id)
         return FALSE;
     }
 
-    /* remove handlers from the interface hash */
-    list = elem->handlers;
-    while (list != NULL) {
-        char opm_key[MAX_OPM_HASH_KEY_LEN + 1];
-        DBusError err;
-        _osso_handler_t *h = list->data;
+    /* remove handlers from the dispatch index */
+    for (i = 0; i < elem->len; ++i) {
+        _muali_opm_key_t opm_key;
+        _osso_handler_t *h = elem->handlers[i];
 
-        compose_opm_hash_key(h->data->path, h->data->name, opm_key);
-        remove_from_opm_hash(context, handler_id, opm_key);
+        if (h == NULL) {
+            continue;
+        }
 
-        dbus_error_init(&err);
+        compose_opm_hash_key(h->data->path, h->data->name, &opm_key);
+        remove_from_opm_hash(context, h, &opm_key);
 
         if (h->data->match_rule && (h->data->bus_type == MUALI_BUS_SYSTEM
             || h->data->bus_type == MUALI_BUS_BOTH)) {
-            dbus_bus_remove_match(context->sys_conn, h->data->match_rule,
-                                  &err);
-            if (dbus_error_is_set(&err)) {
-                ULOG_WARN_F("dbus_bus_remove_match failed for %s: %s",
-                            h->data->match_rule, err.message);
-                dbus_error_free(&err);
-                dbus_error_init(&err);
-            }
+            _osso_match_remove(context, context->sys_conn,
+                               h->data->match_rule);
         }
 
         if (h->data->match_rule && (h->data->bus_type == MUALI_BUS_SESSION
             || h->data->bus_type == MUALI_BUS_BOTH)) {
-            dbus_bus_remove_match(context->conn, h->data->match_rule,
-                                  &err);
-            if (dbus_error_is_set(&err)) {
-                ULOG_WARN_F("dbus_bus_remove_match failed for %s: %s",
-                            h->data->match_rule, err.message);
-                dbus_error_free(&err);
-            }
+            _osso_match_remove(context, context->conn, h->data->match_rule);
         }
 
         free(h->data->service); h->data->service = NULL;
@@ -1324,7 +1967,11 @@ _muali_unset_handler(_muali_context_t *context, int handler_id)
         }
         free(h->data); h->data = NULL;
 
-        list = g_slist_next(list);
+        if (context->dispatch_depth > 0) {
+            /* the handler may be the one being called */
+            elem->handlers[i] = NULL;
+            release_handler(context, h);
+        }
     }
 
     if (!g_hash_table_remove(context->id_hash, GINT_TO_POINTER(handler_id))) {
@@ -1335,6 +1982,41 @@ _muali_unset_handler(_muali_context_t *context, int handler_id)
     return TRUE;
 }
 
+gboolean __attribute__ ((visibility("hidden")))
+_muali_set_reply_handler(_muali_context_t *context,
+                         _osso_handler_f *handler,
+                         _osso_callback_data_t *data,
+                         muali_bus_type bus_type,
+                         dbus_uint32_t serial)
+{
+    GHashTable *hash;
+    _osso_handler_t *elem;
+
+    assert(context != NULL && handler != NULL && data != NULL);
+    assert(serial != 0);
+
+    hash = reply_hash_for_bus(context, bus_type);
+    if (hash == NULL) {
+        ULOG_ERR_F("invalid bus type %d", bus_type);
+        return FALSE;
+    }
+
+    elem = calloc(1, sizeof(_osso_handler_t));
+    if (elem == NULL) {
+        ULOG_ERR_F("calloc() failed");
+        return FALSE;
+    }
+
+    elem->handler = handler;
+    elem->data = data;
+    /* the data is owned by the table from now on */
+    elem->can_free_data = TRUE;
+    /* other members are not used and left zero */
+
+    g_hash_table_insert(hash, GUINT_TO_POINTER(serial), elem);
+    return TRUE;
+}
+
 void __attribute__ ((visibility("hidden")))
 _msg_handler_set_cb_f_free_data(osso_context_t *osso,
                                 const gchar *service,
@@ -1350,10 +2032,50 @@ _msg_handler_set_cb_f_free_data(osso_context_t *osso,
 	return;
     }
 
-    set_handler_helper(osso, service, object_path, interface,
+    set_handler_helper(osso, service, object_path, interface, NULL, FALSE,
                        cb, data, method, TRUE);
 }
 
+void __attribute__ ((visibility("hidden")))
+_msg_handler_set_member_cb_f_free_data(osso_context_t *osso,
+                                       const gchar *service,
+                                       const gchar *object_path,
+                                       const gchar *interface,
+                                       const gchar *member,
+                                       _osso_handler_f *cb,
+                                       _osso_callback_data_t *data,
+                                       gboolean method)
+{
+    if (osso == NULL || object_path == NULL || interface == NULL
+        || member == NULL || cb == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return;
+    }
+
+    set_handler_helper(osso, service, object_path, interface, member,
+                       FALSE, cb, data, method, TRUE);
+}
+
+void __attribute__ ((visibility("hidden")))
+_msg_handler_set_exact_cb_f_free_data(osso_context_t *osso,
+                                      const gchar *service,
+                                      const gchar *object_path,
+                                      const gchar *interface,
+                                      const gchar *member,
+                                      _osso_handler_f *cb,
+                                      _osso_callback_data_t *data,
+                                      gboolean method)
+{
+    if (osso == NULL || object_path == NULL || interface == NULL
+        || member == NULL || cb == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return;
+    }
+
+    set_handler_helper(osso, service, object_path, interface, member,
+                       TRUE, cb, data, method, TRUE);
+}
+
 static inline gboolean data_matches(const _osso_handler_t *handler,
                                     const _osso_callback_data_t *data)
 {
@@ -1372,107 +2094,132 @@ static inline gboolean data_matches(const _osso_handler_t *handler,
 }
 
 /************************************************************************/
-gboolean __attribute__ ((visibility("hidden")))
-_msg_handler_rm_cb_f(osso_context_t *osso,
-                     const gchar *service,
-                     const gchar *object_path,
-                     const gchar *interface,
-                     const _osso_handler_f *cb,
-                     const _osso_callback_data_t *data,
-                     gboolean method)
-{   
+static gboolean rm_handler_helper(osso_context_t *osso,
+                                  const gchar *service,
+                                  const gchar *object_path,
+                                  const gchar *interface,
+                                  const gchar *member,
+                                  const _osso_handler_f *cb,
+                                  const _osso_callback_data_t *data,
+                                  gboolean method)
+{
     char uniq_key[MAX_HASH_KEY_LEN + 1];
     _osso_hash_value_t *elem;
-    const _osso_handler_t *matched_handler = NULL;
-    gboolean ret = FALSE;
-
-    if (osso == NULL || object_path == NULL || interface == NULL
-        || cb == NULL) {
-        ULOG_DEBUG_F("invalid parameters");
-	return FALSE;
-    }
+    _osso_handler_t *matched_handler = NULL;
+    GQuark member_q = 0;
 
     compose_hash_key(service, object_path, interface, uniq_key);
 
+    if (member != NULL) {
+        member_q = g_quark_try_string(member);
+        if (member_q == 0) {
+            /* never registered */
+            goto not_found;
+        }
+    }
+
     elem = g_hash_table_lookup(osso->uniq_hash, uniq_key);
     if (elem != NULL) {
-        GSList *list;
+        guint i;
 
-        list = elem->handlers;
-        while (list != NULL) {
+        for (i = 0; i < elem->len; ++i) {
             _osso_handler_t *handler;
 
-            handler = list->data;
-
-            if (handler->method == method && handler->handler == cb) {
-                if (data_matches(handler, data)) {
-                    ULOG_DEBUG_F("found from uniq_hash");
-                    ret = TRUE;
-
-                    elem->handlers = g_slist_remove_link(elem->handlers,
-                                                         list);
-                    free_handler(handler, NULL);
-                    g_slist_free_1(list); /* free the removed link */
-
-                    /* if this was the last element in the list, free the
-                     * list and the hash element */
-                    if (g_slist_length(elem->handlers) == 0) {
-                        g_hash_table_remove(osso->uniq_hash, interface);
-                    }
-                    matched_handler = handler;
-                    break;
-                }
+            handler = elem->handlers[i];
+
+            if (handler != NULL && handler->method == method
+                && handler->handler == cb && handler->member == member_q
+                && data_matches(handler, data)) {
+                ULOG_DEBUG_F("found from uniq_hash");
+                matched_handler = handler;
+                break;
             }
-            list = g_slist_next(list);
         }
     }
 
-    if (matched_handler != NULL) {
-        elem = g_hash_table_lookup(osso->if_hash, interface);
-        if (elem != NULL) {
-            GSList *list;
-
-            list = elem->handlers;
-            while (list != NULL) {
-                if (list->data == matched_handler) {
-                    ULOG_DEBUG_F("found from if_hash");
-                    elem->handlers = g_slist_remove_link(elem->handlers,
-                                                         list);
-                    g_slist_free_1(list); /* free the removed link */
-
-                    /* if this was the last element in the list, free the
-                     * list and the hash element */
-                    if (g_slist_length(elem->handlers) == 0) {
-                        g_hash_table_remove(osso->if_hash, interface);
-                    }
-                    return TRUE;
-                }
-                list = g_slist_next(list);
+    if (matched_handler == NULL) {
+        goto not_found;
+    }
+
+    if (member != NULL) {
+        _osso_ipm_key_t ipm_key;
+        _osso_hash_value_t *index;
+
+        compose_ipm_hash_key(interface, object_path, member, &ipm_key);
+        ipm_key.path = matched_handler->path;
+        index = g_hash_table_lookup(osso->ipm_hash, &ipm_key);
+        if (index != NULL) {
+            ULOG_DEBUG_F("found from ipm_hash");
+            if (handler_vec_remove(osso, index, matched_handler, FALSE)) {
+                g_hash_table_remove(osso->ipm_hash, &ipm_key);
+            }
+        }
+    } else {
+        _osso_hash_value_t *index;
+
+        index = g_hash_table_lookup(osso->if_hash, interface);
+        if (index != NULL) {
+            ULOG_DEBUG_F("found from if_hash");
+            if (handler_vec_remove(osso, index, matched_handler, FALSE)) {
+                g_hash_table_remove(osso->if_hash, interface);
             }
         }
     }
 
-#if 0
-    for(i = 0; i < osso->ifs->len; i++) {
-	_osso_interface_t *intf;
-	intf = &g_array_index(osso->ifs, _osso_interface_t, i);
-	if( (intf->handler == cb) &&
-	    (strcmp(intf->interface, interface)==0) &&
-	    (intf->method == method) ) {
-	    gpointer ret;
-	    ret = intf->data;
-	    g_free(intf->interface);
-	    g_array_remove_index_fast(osso->ifs, i);
-	    return ret;
-	}
+    /* if this was the last handler, free the hash element */
+    if (handler_vec_remove(osso, elem, matched_handler, TRUE)) {
+        g_hash_table_remove(osso->uniq_hash, uniq_key);
     }
-#endif
 
+    release_handler(osso, matched_handler);
+    return TRUE;
+
+not_found:
     ULOG_DEBUG_F("WARNING: tried to remove non-existent handler for:");
     ULOG_DEBUG_F(" service: %s", service);
     ULOG_DEBUG_F(" obj. path: %s", object_path);
     ULOG_DEBUG_F(" interface: %s", interface);
-    return ret;
+    ULOG_DEBUG_F(" member: %s", member != NULL ? member : "(any)");
+    return FALSE;
+}
+
+gboolean __attribute__ ((visibility("hidden")))
+_msg_handler_rm_cb_f(osso_context_t *osso,
+                     const gchar *service,
+                     const gchar *object_path,
+                     const gchar *interface,
+                     const _osso_handler_f *cb,
+                     const _osso_callback_data_t *data,
+                     gboolean method)
+{
+    if (osso == NULL || object_path == NULL || interface == NULL
+        || cb == NULL) {
+        ULOG_DEBUG_F("invalid parameters");
+        return FALSE;
+    }
+
+    return rm_handler_helper(osso, service, object_path, interface, NULL,
+                             cb, data, method);
+}
+
+gboolean __attribute__ ((visibility("hidden")))
+_msg_handler_rm_member_cb_f(osso_context_t *osso,
+                            const gchar *service,
+                            const gchar *object_path,
+                            const gchar *interface,
+                            const gchar *member,
+                            const _osso_handler_f *cb,
+                            const _osso_callback_data_t *data,
+                            gboolean method)
+{
+    if (osso == NULL || object_path == NULL || interface == NULL
+        || member == NULL || cb == NULL) {
+        ULOG_DEBUG_F("invalid parameters");
+        return FALSE;
+    }
+
+    return rm_handler_helper(osso, service, object_path, interface, member,
+                             cb, data, method);
 }
 
 
@@ -1585,5 +2332,5 @@ gpointer osso_get_dbus_connection(osso_context_t *osso)
 
 gpointer osso_get_sys_dbus_connection(osso_context_t *osso)
 {
-  return (gpointer) osso->sys_conn;
+  return (gpointer) _osso_get_sys_conn(osso);
 }
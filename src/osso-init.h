@@ -60,6 +60,14 @@ static osso_context_t *_muali_init(const char *application,
  */
 static void _deinit(osso_context_t *osso);
 
+/**
+ * This function frees the parts of the context that still use the D-BUS
+ * connections, e.g. to remove their match rules. It is called before
+ * the connections are dropped, and again from _deinit.
+ * @param osso The #osso_context_t to clean up.
+ */
+static void _deinit_bus_users(osso_context_t *osso);
+
 /**
  * This function connect to the given D-BUS bus and registers itself with the
  * D-BUS daemon.
@@ -84,6 +92,13 @@ static DBusConnection *_muali_dbus_setup(osso_context_t *osso,
  */
 static void _dbus_disconnect(osso_context_t *osso, gboolean sys);
 
+/**
+ * This function flushes the D-BUS connections that have messages waiting
+ * because of the flush policy of the context.
+ * @param osso The #osso_context_t of the connections.
+ */
+static void flush_pending(osso_context_t *osso);
+
 #ifdef LIBOSSO_DEBUG
 
 /**
@@ -80,18 +80,45 @@
 #define MUALI_MAX_ARGS 256
 #define MUALI_MAX_MATCH_SIZE 256
 
+typedef struct {
+    guint id;
+    osso_hw_state_t mask;
+    osso_hw_cb_f *cb;    /* NULL after it has been removed */
+    gpointer data;
+}_osso_hw_subscriber_t;
+
 typedef struct {
     osso_hw_cb_f *cb;
     gpointer data;
     gboolean set;
+    GSList *subscribers; /* _osso_hw_subscriber_t, see osso_hw_add_event_cb */
 }_osso_hw_cb_data_t;
 
+typedef struct {
+    osso_context_t *osso;
+    osso_hw_field_t field;
+    osso_coalesce_policy_t policy;
+    guint window;           /* milliseconds */
+    gint delivered;         /* value the callbacks were last given */
+    GSource *source;        /* delivers the pending value */
+}_osso_hw_coalesce_t;
+
 typedef struct {
   _osso_hw_cb_data_t shutdown_ind;
   _osso_hw_cb_data_t save_unsaved_data_ind;
   _osso_hw_cb_data_t memory_low_ind;
   _osso_hw_cb_data_t system_inactivity_ind;
   _osso_hw_cb_data_t sig_device_mode_ind;
+  GSList *subscribers;  /* all _osso_hw_subscriber_t, owned */
+  GSList *removed;      /* removed while callbacks were called */
+  int dispatching;      /* depth of the callback calls */
+  guint last_id;        /* of the subscribers */
+  gboolean handlers_set;        /* signal_handler is installed */
+  gboolean lowmem_handlers_set; /* lowmem_signal_handler is installed */
+  _osso_hw_coalesce_t *coalesce; /* OSSO_HW_N_FIELDS elements, NULL until
+                                    osso_hw_set_coalescing is called */
+  GSList *display_cbs;  /* _osso_callback_data_t of the display
+                           callbacks, owned by their handlers */
 }_osso_hw_cb_t;
 
 /**
@@ -133,12 +160,78 @@ typedef struct {
     gboolean can_free_data;
     gboolean call_once_per_handler_id;
     int handler_id;
+    GQuark interface;   /* interned data->interface or 0 (muali only) */
+    GQuark path;        /* interned object path for exact dispatch, or 0
+                           for any path */
+    GQuark member;      /* interned member for member dispatch or 0 */
+    guint owner_slot;   /* index in the uniq_hash or id_hash vector */
+    guint index_slot;   /* index in the if_hash, ipm_hash or opm_hash
+                           vector */
+    guint generation;   /* value of the context's generation when the
+                           handler was set */
 } _osso_handler_t;
 
+/* A contiguous vector of handlers. Removed handlers leave a NULL slot
+ * behind, so that the slot indices stored in the handlers stay valid
+ * and a dispatch walking the vector is not disturbed. The NULL slots
+ * are compacted away when they are the majority, or after the dispatch
+ * if the removal happened during one. */
 typedef struct {
-    GSList *handlers;
+    _osso_handler_t **handlers;
+    guint len;      /* number of used slots */
+    guint size;     /* number of allocated slots */
+    guint removed;  /* slots cleared (NULL) but not compacted yet */
 } _osso_hash_value_t;
 
+/* key of the member dispatch index (ipm_hash); path is 0 for the
+ * handlers of any object path */
+typedef struct {
+    GQuark interface;
+    GQuark path;
+    GQuark member;
+} _osso_ipm_key_t;
+
+/* key of the muali dispatch index (opm_hash) */
+typedef struct {
+    GQuark path;
+    GQuark member;
+} _muali_opm_key_t;
+
+/* value of the muali dispatch index: the vector of the handlers
+ * registered for one object path + member pair */
+typedef struct {
+    _muali_opm_key_t key;
+    _osso_hash_value_t value;
+} _muali_opm_entry_t;
+
+/* a D-Bus match rule shared by the handlers of the context (see
+ * osso-match.c) */
+typedef struct {
+    char *rule;
+    DBusConnection *conn;
+    int refcount;        /* number of _osso_match_add calls not removed */
+    gboolean on_bus;     /* AddMatch sent and RemoveMatch not */
+    gboolean queued;     /* in the match_queue of the context */
+} _osso_match_t;
+
+/* a D-Bus name whose owner is cached by the context (see osso-names.c) */
+typedef struct {
+    char *name;
+    gchar *owner;        /* unique name of the owner, NULL if none */
+    int refcount;        /* number of watches */
+    gboolean library_ref; /* one of the watches is the library's own */
+    DBusPendingCall *pending; /* GetNameOwner, until the reply */
+} _osso_name_t;
+
+/* the names made by make_default_service, make_default_object_path and
+ * make_default_interface for an application (see
+ * _osso_default_names) */
+typedef struct {
+    char service[MAX_SVC_LEN];
+    char path[MAX_OP_LEN];
+    char interface[MAX_IF_LEN];
+} _osso_default_names_t;
+
 /**
  * This structure is used to store library specific stuff
  */
@@ -156,8 +249,14 @@ typedef struct osso_af_context_t {
     GHashTable *uniq_hash;  /* handlers hashed by the triplet: service,
                                object path, and interface. */
     GHashTable *if_hash;    /* handlers hashed by interface only */
+    GHashTable *ipm_hash;   /* handlers hashed by interned interface,
+                               object path (or any) and member */
     GHashTable *id_hash;    /* handlers hashed by id (muali API) */
-    GHashTable *opm_hash;   /* handlers hashed by object path + member */
+    GHashTable *opm_hash;   /* muali dispatch index: handler vectors
+                               hashed by interned object path + member */
+    GHashTable *reply_hash; /* pending muali reply handlers on the session
+                               bus, hashed by the reply serial */
+    GHashTable *sys_reply_hash; /* same for the system bus */
     _osso_autosave_t autosave;
 #ifdef LIBOSSO_DEBUG
     guint log_handler;
@@ -170,6 +269,58 @@ typedef struct osso_af_context_t {
                                context */
     const DBusMessage *reply_dummy, *error_dummy;
     gboolean muali_filters_setup;
+    GQuark path_match_all;  /* interned MUALI_PATH_MATCH_ALL */
+    GQuark member_match_all; /* interned MUALI_MEMBER_MATCH_ALL */
+    int dispatch_depth;     /* nesting level of _msg_handler and
+                               _muali_filter */
+    gboolean handlers_dirty; /* handlers were removed during dispatch */
+    GSList *removed_handlers; /* handlers removed during dispatch, freed
+                                 after it */
+    guint generation;       /* stamped on handlers when they are set */
+    GMainContext *main_context; /* the connections are set up with this */
+    GHashTable *match_rules; /* _osso_match_t hashed by rule, session bus */
+    GHashTable *sys_match_rules; /* same for the system bus */
+    GSList *match_queue;    /* match rules with AddMatch/RemoveMatch
+                               pending, in reverse order */
+    GSource *match_source;  /* idle source sending the match_queue */
+    gboolean sys_conn_lazy; /* sys_conn is connected on first use */
+    GSource *sys_conn_source; /* idle source connecting sys_conn */
+    DBusMessage *rpc_msg;   /* method call being handled by an
+                               osso_rpc_cb_f, for osso_rpc_defer_reply */
+    gboolean reply_deferred; /* the reply to the message being
+                                dispatched was deferred */
+    GSList *reply_tokens;   /* deferred replies not completed yet */
+    osso_flush_policy_t flush_policy;
+    gboolean flush_pending; /* conn has messages to flush */
+    gboolean sys_flush_pending; /* same for sys_conn */
+    GSource *flush_source;  /* idle source flushing the connections */
+    GHashTable *name_owners; /* _osso_name_t hashed by name, session
+                                bus */
+    GHashTable *sys_name_owners; /* same for the system bus */
+    gboolean name_handler_set; /* NameOwnerChanged handler is set */
+    DBusServer *peer_server; /* private server for peer connections */
+    GSList *peer_conns;     /* connections accepted by peer_server */
+    GHashTable *peers;      /* connections to the peers, hashed by the
+                               service that is called through them */
+    GHashTable *rpc_caches; /* osso_rpc_cache_t hashed by the bus and
+                               the method */
+    GHashTable *default_names; /* _osso_default_names_t hashed by the
+                                  application */
+    muali_arg_t *arg_arena; /* muali_arg_t arrays of the events being
+                               delivered, see _get_muali_args */
+    int arg_arena_size;     /* number of elements allocated */
+    int arg_arena_used;     /* number of elements in use */
+    struct _osso_hw_segment_t *hw_segment; /* mapped device state
+                                              segment, see osso-hw.c */
+    gboolean hw_segment_writer; /* this context publishes hw_segment */
+    int hw_segment_fd;      /* the segment file, locked by the publisher */
+    gint64 hw_segment_checked; /* when the publisher was last seen
+                                  holding the segment */
+    osso_display_state_t display_state; /* last known display state */
+    gboolean display_live;  /* a display callback keeps it current */
+    gint64 hw_updated[OSSO_HW_N_FIELDS]; /* when the fields of hw_state
+                                            and display_state were last
+                                            received */
 } _osso_af_context_t, _muali_context_t;
 
 typedef struct _muali_context_t {
@@ -186,8 +337,14 @@ typedef struct _muali_context_t {
     GHashTable *uniq_hash;  /* handlers hashed by the triplet: service,
                                object path, and interface. */
     GHashTable *if_hash;    /* handlers hashed by interface only */
+    GHashTable *ipm_hash;   /* handlers hashed by interned interface,
+                               object path (or any) and member */
     GHashTable *id_hash;    /* handlers hashed by id (muali API) */
-    GHashTable *opm_hash;   /* handlers hashed by object path + member */
+    GHashTable *opm_hash;   /* muali dispatch index: handler vectors
+                               hashed by interned object path + member */
+    GHashTable *reply_hash; /* pending muali reply handlers on the session
+                               bus, hashed by the reply serial */
+    GHashTable *sys_reply_hash; /* same for the system bus */
     _osso_autosave_t autosave;
 #ifdef LIBOSSO_DEBUG
     guint log_handler;
@@ -200,6 +357,58 @@ typedef struct _muali_context_t {
                                context */
     const DBusMessage *reply_dummy, *error_dummy;
     gboolean muali_filters_setup;
+    GQuark path_match_all;  /* interned MUALI_PATH_MATCH_ALL */
+    GQuark member_match_all; /* interned MUALI_MEMBER_MATCH_ALL */
+    int dispatch_depth;     /* nesting level of _msg_handler and
+                               _muali_filter */
+    gboolean handlers_dirty; /* handlers were removed during dispatch */
+    GSList *removed_handlers; /* handlers removed during dispatch, freed
+                                 after it */
+    guint generation;       /* stamped on handlers when they are set */
+    GMainContext *main_context; /* the connections are set up with this */
+    GHashTable *match_rules; /* _osso_match_t hashed by rule, session bus */
+    GHashTable *sys_match_rules; /* same for the system bus */
+    GSList *match_queue;    /* match rules with AddMatch/RemoveMatch
+                               pending, in reverse order */
+    GSource *match_source;  /* idle source sending the match_queue */
+    gboolean sys_conn_lazy; /* sys_conn is connected on first use */
+    GSource *sys_conn_source; /* idle source connecting sys_conn */
+    DBusMessage *rpc_msg;   /* method call being handled by an
+                               osso_rpc_cb_f, for osso_rpc_defer_reply */
+    gboolean reply_deferred; /* the reply to the message being
+                                dispatched was deferred */
+    GSList *reply_tokens;   /* deferred replies not completed yet */
+    osso_flush_policy_t flush_policy;
+    gboolean flush_pending; /* conn has messages to flush */
+    gboolean sys_flush_pending; /* same for sys_conn */
+    GSource *flush_source;  /* idle source flushing the connections */
+    GHashTable *name_owners; /* _osso_name_t hashed by name, session
+                                bus */
+    GHashTable *sys_name_owners; /* same for the system bus */
+    gboolean name_handler_set; /* NameOwnerChanged handler is set */
+    DBusServer *peer_server; /* private server for peer connections */
+    GSList *peer_conns;     /* connections accepted by peer_server */
+    GHashTable *peers;      /* connections to the peers, hashed by the
+                               service that is called through them */
+    GHashTable *rpc_caches; /* osso_rpc_cache_t hashed by the bus and
+                               the method */
+    GHashTable *default_names; /* _osso_default_names_t hashed by the
+                                  application */
+    muali_arg_t *arg_arena; /* muali_arg_t arrays of the events being
+                               delivered, see _get_muali_args */
+    int arg_arena_size;     /* number of elements allocated */
+    int arg_arena_used;     /* number of elements in use */
+    struct _osso_hw_segment_t *hw_segment; /* mapped device state
+                                              segment, see osso-hw.c */
+    gboolean hw_segment_writer; /* this context publishes hw_segment */
+    int hw_segment_fd;      /* the segment file, locked by the publisher */
+    gint64 hw_segment_checked; /* when the publisher was last seen
+                                  holding the segment */
+    osso_display_state_t display_state; /* last known display state */
+    gboolean display_live;  /* a display callback keeps it current */
+    gint64 hw_updated[OSSO_HW_N_FIELDS]; /* when the fields of hw_state
+                                            and display_state were last
+                                            received */
 } _muali_this_type_is_not_used_t;
 
 # ifdef LIBOSSO_DEBUG
@@ -212,7 +421,10 @@ typedef struct _muali_context_t {
 inline int __attribute__ ((visibility("hidden")))
 muali_convert_msgtype(int t);
 
-muali_arg_t* _get_muali_args(DBusMessageIter *iter);
+muali_arg_t* _get_muali_args(osso_context_t *osso, DBusMessageIter *iter);
+
+void __attribute__ ((visibility("hidden")))
+_free_muali_args(osso_context_t *osso, muali_arg_t *args);
 
 DBusHandlerResult __attribute__ ((visibility("hidden")))
 _msg_handler(DBusConnection *conn, DBusMessage *msg, void *data);
@@ -241,6 +453,58 @@ _msg_handler_rm_cb_f(osso_context_t *osso,
                      const _osso_handler_f *cb,
                      const _osso_callback_data_t *data,
                      gboolean method);
+
+/* Same as above, but the handler is only called for messages with the
+ * interface and member, on any object path (the handlers set by the
+ * functions above get every message of the interface). The object path
+ * only identifies the handler when it is removed. */
+void __attribute__ ((visibility("hidden")))
+_msg_handler_set_member_cb_f(osso_context_t *osso,
+                             const gchar *service,
+                             const gchar *object_path,
+                             const gchar *interface,
+                             const gchar *member,
+                             _osso_handler_f *cb,
+                             _osso_callback_data_t *data,
+                             gboolean method);
+void __attribute__ ((visibility("hidden")))
+_msg_handler_set_member_cb_f_free_data(osso_context_t *osso,
+                                       const gchar *service,
+                                       const gchar *object_path,
+                                       const gchar *interface,
+                                       const gchar *member,
+                                       _osso_handler_f *cb,
+                                       _osso_callback_data_t *data,
+                                       gboolean method);
+/* Same as above, but the object path has to match too. Removed with
+ * _msg_handler_rm_member_cb_f. */
+void __attribute__ ((visibility("hidden")))
+_msg_handler_set_exact_cb_f(osso_context_t *osso,
+                            const gchar *service,
+                            const gchar *object_path,
+                            const gchar *interface,
+                            const gchar *member,
+                            _osso_handler_f *cb,
+                            _osso_callback_data_t *data,
+                            gboolean method);
+void __attribute__ ((visibility("hidden")))
+_msg_handler_set_exact_cb_f_free_data(osso_context_t *osso,
+                                      const gchar *service,
+                                      const gchar *object_path,
+                                      const gchar *interface,
+                                      const gchar *member,
+                                      _osso_handler_f *cb,
+                                      _osso_callback_data_t *data,
+                                      gboolean method);
+gboolean __attribute__ ((visibility("hidden")))
+_msg_handler_rm_member_cb_f(osso_context_t *osso,
+                            const gchar *service,
+                            const gchar *object_path,
+                            const gchar *interface,
+                            const gchar *member,
+                            const _osso_handler_f *cb,
+                            const _osso_callback_data_t *data,
+                            gboolean method);
 void _msg_handler_set_ret(osso_context_t *osso, gint serial,
 			  osso_rpc_t *retval);
 void _msg_handler_rm_ret(osso_context_t *osso, gint serial);
@@ -258,6 +522,9 @@ void __attribute__ ((visibility("hidden")))
 make_default_error_name(const char *service, const char *name,
                         char *ready_name);
 
+__attribute__ ((visibility("hidden"))) const _osso_default_names_t *
+_osso_default_names(osso_context_t *osso, const char *application);
+
 gboolean __attribute__ ((visibility("hidden")))
 _muali_set_handler(_muali_context_t *context,
                    _osso_handler_f *handler,
@@ -268,6 +535,104 @@ _muali_set_handler(_muali_context_t *context,
 gboolean __attribute__ ((visibility("hidden")))
 _muali_unset_handler(_muali_context_t *context, int handler_id);
 
+gboolean __attribute__ ((visibility("hidden")))
+_muali_set_reply_handler(_muali_context_t *context,
+                         _osso_handler_f *handler,
+                         _osso_callback_data_t *data,
+                         muali_bus_type bus_type,
+                         dbus_uint32_t serial);
+
+gboolean __attribute__ ((visibility("hidden")))
+_osso_match_add(osso_context_t *osso, DBusConnection *conn,
+                const char *rule);
+
+void __attribute__ ((visibility("hidden")))
+_osso_match_remove(osso_context_t *osso, DBusConnection *conn,
+                   const char *rule);
+
+void __attribute__ ((visibility("hidden")))
+_osso_match_flush(osso_context_t *osso);
+
+void __attribute__ ((visibility("hidden")))
+_osso_match_deinit(osso_context_t *osso);
+
+__attribute__ ((visibility("hidden"))) DBusConnection *
+_osso_get_sys_conn(osso_context_t *osso);
+
+void __attribute__ ((visibility("hidden")))
+_osso_flush(osso_context_t *osso, DBusConnection *conn);
+
+__attribute__ ((visibility("hidden"))) _osso_name_t *
+_osso_name_watch(osso_context_t *osso, DBusConnection *conn,
+                 const char *name);
+
+void __attribute__ ((visibility("hidden")))
+_osso_name_unwatch(osso_context_t *osso, DBusConnection *conn,
+                   const char *name);
+
+__attribute__ ((visibility("hidden"))) _osso_name_t *
+_osso_name_lookup(osso_context_t *osso, DBusConnection *conn,
+                  const char *name);
+
+gboolean __attribute__ ((visibility("hidden")))
+_osso_name_has_owner(osso_context_t *osso, DBusConnection *conn,
+                     const char *name);
+
+void __attribute__ ((visibility("hidden")))
+_osso_names_deinit(osso_context_t *osso);
+
+gboolean __attribute__ ((visibility("hidden")))
+_osso_bulk_append(DBusMessageIter *iter, DBusConnection *conn,
+                  const void *data, gsize len);
+
+gboolean __attribute__ ((visibility("hidden")))
+_osso_bulk_map(int fd, const void **data, gsize *len);
+
+void __attribute__ ((visibility("hidden")))
+_osso_bulk_unmap(const void *data, gsize len);
+
+__attribute__ ((visibility("hidden"))) DBusConnection *
+_osso_peer_lookup(osso_context_t *osso, const char *service);
+
+void __attribute__ ((visibility("hidden")))
+_osso_peers_deinit(osso_context_t *osso);
+
+__attribute__ ((visibility("hidden"))) DBusMessage *
+_osso_rpc_cache_lookup(osso_context_t *osso, gboolean system_bus,
+                       DBusMessage *msg, osso_rpc_cache_t **cache,
+                       gchar **key);
+
+void __attribute__ ((visibility("hidden")))
+_osso_rpc_cache_store(osso_rpc_cache_t *cache, gchar *key,
+                      DBusMessage *reply);
+
+void __attribute__ ((visibility("hidden")))
+_osso_rpc_caches_deinit(osso_context_t *osso);
+
+void __attribute__ ((visibility("hidden")))
+_osso_rpc_tokens_deinit(osso_context_t *osso);
+
+void __attribute__ ((visibility("hidden")))
+_osso_hw_segment_deinit(osso_context_t *osso);
+
+void __attribute__ ((visibility("hidden")))
+_osso_hw_cbs_deinit(osso_context_t *osso);
+
+void __attribute__ ((visibility("hidden")))
+_osso_hw_touch(osso_context_t *osso, osso_hw_field_t field);
+
+gboolean __attribute__ ((visibility("hidden")))
+_osso_hw_coalesce(osso_context_t *osso, osso_hw_field_t field);
+
+void __attribute__ ((visibility("hidden")))
+_osso_display_notify(osso_context_t *osso);
+
+gboolean __attribute__ ((visibility("hidden")))
+_osso_parse_display_state(const char *s, osso_display_state_t *state);
+
+osso_display_state_t __attribute__ ((visibility("hidden")))
+_osso_get_display_state(osso_context_t *osso);
+
 /* this is only needed by some unit testing code */
 osso_return_t _test_rpc_set_cb_f(osso_context_t *osso, const gchar *service,
                                 const gchar *object_path,
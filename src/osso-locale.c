@@ -41,13 +41,12 @@ osso_return_t osso_locale_change_set_notification_cb(osso_context_t *osso,
                                             gpointer data) 
 {
   _osso_callback_data_t *ot;
-  DBusError error;
 
   if (osso == NULL || cb == NULL) {
       ULOG_ERR_F("invalid arguments");
       return OSSO_INVALID;
   }
-  if (osso->sys_conn == NULL) {
+  if (_osso_get_sys_conn(osso) == NULL) {
       ULOG_ERR_F("no D-Bus system bus connection");
       return OSSO_INVALID;
   }
@@ -58,11 +57,7 @@ osso_return_t osso_locale_change_set_notification_cb(osso_context_t *osso,
       return OSSO_ERROR;
   }
 
-  dbus_error_init(&error);
-  dbus_bus_add_match(osso->sys_conn, MATCH_RULE, &error);
-  if (dbus_error_is_set(&error)) {
-      ULOG_ERR_F("dbus_bus_add_match() failed: %s", error.message);
-      dbus_error_free(&error);
+  if (!_osso_match_add(osso, osso->sys_conn, MATCH_RULE)) {
       free(ot);
       return OSSO_ERROR;
   }
@@ -71,11 +66,12 @@ osso_return_t osso_locale_change_set_notification_cb(osso_context_t *osso,
   ot->user_data = data;
   ot->data = LOCALE_CHANGED_SIG_NAME;
 
-  _msg_handler_set_cb_f_free_data(osso,
-                                  NULL,
-                                  LOCALE_CHANGED_PATH,
-                                  LOCALE_CHANGED_INTERFACE,
-                                  _locale_change_handler, ot, FALSE);
+  _msg_handler_set_member_cb_f_free_data(osso,
+                                         NULL,
+                                         LOCALE_CHANGED_PATH,
+                                         LOCALE_CHANGED_INTERFACE,
+                                         LOCALE_CHANGED_SIG_NAME,
+                                         _locale_change_handler, ot, FALSE);
   return OSSO_OK;
 }
 
@@ -86,7 +82,7 @@ osso_return_t osso_locale_set(osso_context_t *osso, char *new_locale)
   dbus_bool_t ret = FALSE;
 
   if (NULL == new_locale || osso == NULL
-      || osso->sys_conn == NULL) {
+      || _osso_get_sys_conn(osso) == NULL) {
       ULOG_ERR_F("invalid arguments");
       return OSSO_INVALID;
   }
@@ -107,6 +103,9 @@ osso_return_t osso_locale_set(osso_context_t *osso, char *new_locale)
       return OSSO_ERROR;
   }
 
+  /* so that our own notification callback sees the change */
+  _osso_match_flush(osso);
+
   ret = dbus_connection_send(osso->sys_conn, m, NULL);
   if (!ret) {
       ULOG_ERR_F("dbus_connection_send failed");
@@ -0,0 +1,248 @@
+/**
+ * @file osso-match.c
+ * This file implements the bookkeeping of the D-Bus match rules of the
+ * context. Identical rules are reference counted, so that the bus
+ * daemon sees each rule only once, and AddMatch and RemoveMatch are
+ * sent without waiting for a reply, batched once per main loop
+ * iteration.
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2006 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "osso-internal.h"
+#include <assert.h>
+
+static void free_match(gpointer data)
+{
+    _osso_match_t *m = data;
+
+    if (m != NULL) {
+        free(m->rule);
+        free(m);
+    }
+}
+
+static GHashTable *rules_for_conn(osso_context_t *osso,
+                                  DBusConnection *conn,
+                                  gboolean create)
+{
+    GHashTable **rules;
+
+    if (conn != NULL && conn == osso->conn) {
+        rules = &osso->match_rules;
+    } else if (conn != NULL && conn == osso->sys_conn) {
+        rules = &osso->sys_match_rules;
+    } else {
+        ULOG_ERR_F("unknown connection %p", conn);
+        return NULL;
+    }
+
+    if (*rules == NULL && create) {
+        /* the key is the rule string of the value */
+        *rules = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       NULL, free_match);
+    }
+    return *rules;
+}
+
+/* Sends AddMatch or RemoveMatch without asking for a reply. Errors from
+ * the bus daemon are thus not seen, so the callers validate the names that
+ * they put in the rules with the dbus_validate_* functions. */
+static gboolean send_match_call(DBusConnection *conn,
+                                const char *method,
+                                const char *rule)
+{
+    DBusMessage *msg;
+    dbus_bool_t ret;
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                       DBUS_INTERFACE_DBUS, method);
+    if (msg == NULL) {
+        ULOG_ERR_F("dbus_message_new_method_call failed");
+        return FALSE;
+    }
+
+    if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &rule,
+                                  DBUS_TYPE_INVALID)) {
+        ULOG_ERR_F("dbus_message_append_args failed");
+        dbus_message_unref(msg);
+        return FALSE;
+    }
+
+    dbus_message_set_no_reply(msg, TRUE);
+
+    ret = dbus_connection_send(conn, msg, NULL);
+    dbus_message_unref(msg);
+    if (!ret) {
+        ULOG_ERR_F("dbus_connection_send failed for %s '%s'", method,
+                   rule);
+    }
+    return ret;
+}
+
+static gboolean match_idle(gpointer data)
+{
+    _osso_match_flush(data);
+    return FALSE;
+}
+
+static void queue_match(osso_context_t *osso, _osso_match_t *m)
+{
+    if (!m->queued) {
+        osso->match_queue = g_slist_prepend(osso->match_queue, m);
+        m->queued = TRUE;
+    }
+
+    if (osso->match_source == NULL) {
+        /* high priority, so that the rules are in place before the
+         * main loop gets to the other sources */
+        osso->match_source = g_idle_source_new();
+        g_source_set_priority(osso->match_source, G_PRIORITY_HIGH);
+        g_source_set_callback(osso->match_source, match_idle, osso, NULL);
+        g_source_attach(osso->match_source, osso->main_context);
+    }
+}
+
+/************************************************************************/
+
+/* Adds a reference to the match rule on the connection. The AddMatch
+ * call is sent at the latest on the next main loop iteration, or when
+ * the library sends the next message through the context. */
+gboolean __attribute__ ((visibility("hidden")))
+_osso_match_add(osso_context_t *osso, DBusConnection *conn,
+                const char *rule)
+{
+    GHashTable *rules;
+    _osso_match_t *m;
+
+    assert(osso != NULL && rule != NULL);
+
+    rules = rules_for_conn(osso, conn, TRUE);
+    if (rules == NULL) {
+        return FALSE;
+    }
+
+    m = g_hash_table_lookup(rules, rule);
+    if (m == NULL) {
+        m = calloc(1, sizeof(_osso_match_t));
+        if (m == NULL) {
+            ULOG_ERR_F("calloc failed");
+            return FALSE;
+        }
+        m->rule = strdup(rule);
+        if (m->rule == NULL) {
+            ULOG_ERR_F("strdup failed");
+            free(m);
+            return FALSE;
+        }
+        m->conn = conn;
+        g_hash_table_insert(rules, m->rule, m);
+    }
+
+    if (m->refcount++ == 0) {
+        queue_match(osso, m);
+    }
+    return TRUE;
+}
+
+/* Drops a reference to the match rule on the connection. The
+ * RemoveMatch call is sent when the last reference is dropped, unless
+ * the rule is added again before the queue is sent. */
+void __attribute__ ((visibility("hidden")))
+_osso_match_remove(osso_context_t *osso, DBusConnection *conn,
+                   const char *rule)
+{
+    GHashTable *rules;
+    _osso_match_t *m = NULL;
+
+    assert(osso != NULL && rule != NULL);
+
+    rules = rules_for_conn(osso, conn, FALSE);
+    if (rules != NULL) {
+        m = g_hash_table_lookup(rules, rule);
+    }
+    if (m == NULL || m->refcount == 0) {
+        ULOG_WARN_F("match rule '%s' was not added", rule);
+        return;
+    }
+
+    if (--m->refcount == 0) {
+        queue_match(osso, m);
+    }
+}
+
+/* Sends the pending AddMatch and RemoveMatch calls. A rule that was
+ * added and removed again since the last flush costs nothing. */
+void __attribute__ ((visibility("hidden")))
+_osso_match_flush(osso_context_t *osso)
+{
+    GSList *list, *l;
+
+    if (osso->match_source != NULL) {
+        g_source_destroy(osso->match_source);
+        g_source_unref(osso->match_source);
+        osso->match_source = NULL;
+    }
+
+    if (osso->match_queue == NULL) {
+        return;
+    }
+
+    list = g_slist_reverse(osso->match_queue);
+    osso->match_queue = NULL;
+
+    for (l = list; l != NULL; l = g_slist_next(l)) {
+        _osso_match_t *m = l->data;
+        gboolean wanted = m->refcount > 0;
+
+        m->queued = FALSE;
+
+        if (wanted != m->on_bus) {
+            ULOG_DEBUG_F("%s '%s'", wanted ? "AddMatch" : "RemoveMatch",
+                         m->rule);
+            if (send_match_call(m->conn,
+                                wanted ? "AddMatch" : "RemoveMatch",
+                                m->rule)) {
+                m->on_bus = wanted;
+            }
+        }
+
+        if (m->refcount == 0 && !m->on_bus) {
+            g_hash_table_remove(rules_for_conn(osso, m->conn, FALSE),
+                                m->rule);
+        }
+    }
+    g_slist_free(list);
+}
+
+void __attribute__ ((visibility("hidden")))
+_osso_match_deinit(osso_context_t *osso)
+{
+    /* the connections are shared, so what was asked is sent */
+    _osso_match_flush(osso);
+
+    if (osso->match_rules != NULL) {
+        g_hash_table_destroy(osso->match_rules);
+        osso->match_rules = NULL;
+    }
+    if (osso->sys_match_rules != NULL) {
+        g_hash_table_destroy(osso->sys_match_rules);
+        osso->sys_match_rules = NULL;
+    }
+}
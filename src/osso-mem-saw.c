@@ -0,0 +1,310 @@
+/* ========================================================================= *
+ * File: osso-mem-saw.c
+ *
+ * The allocation interposer of the Simple Allocation Watchdog (SAW). It is
+ * built as libosso-saw.so and preloaded into the process to be watched:
+ *
+ *    LD_PRELOAD=libosso-saw.so.0 application
+ *
+ * The interposer counts the bytes allocated through malloc and friends
+ * from the start of the process, and osso_mem_saw_enable sets the limit.
+ * Each thread counts in a thread-local variable and adds its count to the
+ * shared one only when it has grown past SAW_SYNC_BYTES, so allocations
+ * take no locks and rarely touch shared memory. The shared count may thus
+ * lag behind by up to SAW_SYNC_BYTES per thread.
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2009 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* ========================================================================= *
+ * Includes
+ * ========================================================================= */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "osso-mem-saw.h"
+
+
+/* ========================================================================= *
+ * Definitions.
+ * ========================================================================= */
+
+/* Thread-local counts are added to the shared one past this many bytes */
+#define SAW_SYNC_BYTES     (64 << 10)
+
+/* Thread-local variables of a preloaded library must not be allocated */
+/* lazily, since that would call malloc                                  */
+#define SAW_TLS            __thread __attribute__ ((tls_model("initial-exec")))
+
+#define SAW_EXPORT         __attribute__ ((visibility("default")))
+
+/* The allocator of glibc */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void  __libc_free(void* ptr);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void* __libc_valloc(size_t size);
+extern void* __libc_pvalloc(size_t size);
+
+
+/* ========================================================================= *
+ * Local data.
+ * ========================================================================= */
+
+/* Bytes allocated by all threads, without the local counts */
+static ssize_t saw_heap;
+
+/* Parameters of the latest osso_mem_saw_enable call. They are only read */
+/* when saw_enabled is set, and written with saw_enabled cleared.        */
+static int                     saw_enabled;
+static size_t                  saw_max_heap_size;
+static size_t                  saw_max_block_size;
+static osso_mem_saw_oom_func_t saw_user_oom_func;
+static void*                   saw_user_context;
+static int                     (*saw_lowmem)(void);
+static pthread_mutex_t         saw_config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Flushes the local count of an exiting thread */
+static pthread_key_t saw_thread_key;
+static int           saw_thread_key_ok;
+
+/* Per-thread state */
+static SAW_TLS ssize_t saw_local;      /* bytes not yet in saw_heap      */
+static SAW_TLS int     saw_registered; /* saw_thread_key is set          */
+static SAW_TLS int     saw_busy;       /* in oom_func or lowmem          */
+
+
+/* ========================================================================= *
+ * Local methods.
+ * ========================================================================= */
+
+/* ------------------------------------------------------------------------- *
+ * saw_sync -- adds the local count of the thread to the shared one.
+ * ------------------------------------------------------------------------- */
+static void saw_sync(void)
+{
+   __atomic_add_fetch(&saw_heap, saw_local, __ATOMIC_RELAXED);
+   saw_local = 0;
+
+   if (!saw_registered && saw_thread_key_ok)
+   {
+      /* The value only has to be non-NULL for the destructor to run */
+      saw_registered = 1;
+      pthread_setspecific(saw_thread_key, &saw_registered);
+   }
+} /* saw_sync */
+
+/* ------------------------------------------------------------------------- *
+ * saw_thread_exit -- pthread key destructor, keeps the count of an exiting
+ * thread.
+ * ------------------------------------------------------------------------- */
+static void saw_thread_exit(void* data)
+{
+   (void)data;
+   saw_sync();
+} /* saw_thread_exit */
+
+/* ------------------------------------------------------------------------- *
+ * saw_account -- counts allocated (positive) or freed (negative) bytes.
+ * ------------------------------------------------------------------------- */
+static inline void saw_account(ssize_t delta)
+{
+   saw_local += delta;
+   if (saw_local >= SAW_SYNC_BYTES || saw_local <= -SAW_SYNC_BYTES)
+      saw_sync();
+} /* saw_account */
+
+/* ------------------------------------------------------------------------- *
+ * saw_heap_size -- returns the bytes allocated by the process, as far as
+ * the calling thread can tell.
+ * ------------------------------------------------------------------------- */
+static size_t saw_heap_size(void)
+{
+   const ssize_t heap = __atomic_load_n(&saw_heap, __ATOMIC_RELAXED) + saw_local;
+
+   /* Other threads may have freed what they have not synced yet */
+   return (heap > 0 ? (size_t)heap : 0);
+} /* saw_heap_size */
+
+/* ------------------------------------------------------------------------- *
+ * saw_allow -- checks an allocation of size bytes when SAW is enabled.
+ * Returns 0 and calls the user OOM function if it must fail.
+ * ------------------------------------------------------------------------- */
+static int saw_allow(size_t size)
+{
+   size_t heap;
+   int    lowmem;
+
+   /* Allocations made by oom_func and lowmem themselves always pass */
+   if (!__atomic_load_n(&saw_enabled, __ATOMIC_ACQUIRE) || saw_busy)
+      return 1;
+
+   heap = saw_heap_size() + size;
+   if (heap < saw_max_heap_size && size < saw_max_block_size)
+      return 1;
+
+   saw_busy = 1;
+   lowmem = (heap >= saw_max_heap_size || (saw_lowmem && saw_lowmem()));
+   if (lowmem && saw_user_oom_func)
+      saw_user_oom_func(heap, saw_max_heap_size, saw_user_context);
+   saw_busy = 0;
+
+   if (lowmem)
+      errno = ENOMEM;
+   return !lowmem;
+} /* saw_allow */
+
+/* ------------------------------------------------------------------------- *
+ * saw_counted -- counts a block returned by the glibc allocator.
+ * ------------------------------------------------------------------------- */
+static inline void* saw_counted(void* ptr)
+{
+   if (ptr)
+      saw_account((ssize_t)malloc_usable_size(ptr));
+   return ptr;
+} /* saw_counted */
+
+/* ------------------------------------------------------------------------- *
+ * saw_enable, saw_disable -- the osso_mem_saw_interposer_t methods.
+ * ------------------------------------------------------------------------- */
+static void saw_enable(size_t max_heap, size_t max_block,
+                       osso_mem_saw_oom_func_t oom_func, void* context,
+                       int (*lowmem)(void))
+{
+   pthread_mutex_lock(&saw_config_lock);
+
+   /* Nobody reads the parameters while they are changed */
+   __atomic_store_n(&saw_enabled, 0, __ATOMIC_RELEASE);
+   saw_max_heap_size  = max_heap;
+   saw_max_block_size = max_block;
+   saw_user_oom_func  = oom_func;
+   saw_user_context   = context;
+   saw_lowmem         = lowmem;
+   __atomic_store_n(&saw_enabled, 1, __ATOMIC_RELEASE);
+
+   pthread_mutex_unlock(&saw_config_lock);
+} /* saw_enable */
+
+static void saw_disable(void)
+{
+   __atomic_store_n(&saw_enabled, 0, __ATOMIC_RELEASE);
+} /* saw_disable */
+
+/* ------------------------------------------------------------------------- *
+ * saw_init -- library constructor.
+ * ------------------------------------------------------------------------- */
+static void __attribute__ ((constructor)) saw_init(void)
+{
+   saw_thread_key_ok = (0 == pthread_key_create(&saw_thread_key, saw_thread_exit));
+} /* saw_init */
+
+
+/* ========================================================================= *
+ * Exported interface.
+ * ========================================================================= */
+
+SAW_EXPORT const osso_mem_saw_interposer_t osso_mem_saw_interposer =
+{
+   OSSO_MEM_SAW_VERSION,
+   saw_heap_size,
+   saw_enable,
+   saw_disable
+};
+
+SAW_EXPORT void* malloc(size_t size)
+{
+   return (saw_allow(size) ? saw_counted(__libc_malloc(size)) : NULL);
+} /* malloc */
+
+SAW_EXPORT void* calloc(size_t nmemb, size_t size)
+{
+   /* An overflowing request fails in glibc, it only has to pass here */
+   const size_t total = (size && nmemb > SIZE_MAX / size ? SIZE_MAX : nmemb * size);
+
+   return (saw_allow(total) ? saw_counted(__libc_calloc(nmemb, size)) : NULL);
+} /* calloc */
+
+SAW_EXPORT void* realloc(void* ptr, size_t size)
+{
+   const size_t old = (ptr ? malloc_usable_size(ptr) : 0);
+   void* res;
+
+   /* Only the growth is checked */
+   if (size > old && !saw_allow(size - old))
+      return NULL;
+
+   res = __libc_realloc(ptr, size);
+   if (res)
+      saw_account((ssize_t)malloc_usable_size(res) - (ssize_t)old);
+   else if (ptr && !size)
+      saw_account(-(ssize_t)old);   /* realloc(ptr, 0) freed the block */
+
+   return res;
+} /* realloc */
+
+SAW_EXPORT void free(void* ptr)
+{
+   if (ptr)
+   {
+      saw_account(-(ssize_t)malloc_usable_size(ptr));
+      __libc_free(ptr);
+   }
+} /* free */
+
+SAW_EXPORT void* memalign(size_t alignment, size_t size)
+{
+   return (saw_allow(size) ? saw_counted(__libc_memalign(alignment, size)) : NULL);
+} /* memalign */
+
+SAW_EXPORT void* aligned_alloc(size_t alignment, size_t size)
+{
+   return memalign(alignment, size);
+} /* aligned_alloc */
+
+SAW_EXPORT int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+   void* ptr;
+
+   /* The alignment must be a power of two multiple of sizeof(void*) */
+   if (!alignment || (alignment & (alignment - 1)) || alignment % sizeof(void*))
+      return EINVAL;
+
+   ptr = memalign(alignment, size);
+   if (!ptr)
+      return ENOMEM;
+
+   *memptr = ptr;
+   return 0;
+} /* posix_memalign */
+
+SAW_EXPORT void* valloc(size_t size)
+{
+   return (saw_allow(size) ? saw_counted(__libc_valloc(size)) : NULL);
+} /* valloc */
+
+SAW_EXPORT void* pvalloc(size_t size)
+{
+   return (saw_allow(size) ? saw_counted(__libc_pvalloc(size)) : NULL);
+} /* pvalloc */
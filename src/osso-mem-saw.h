@@ -0,0 +1,56 @@
+/* ========================================================================= *
+ * File: osso-mem-saw.h
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2009 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef OSSO_MEM_SAW_H
+#define OSSO_MEM_SAW_H
+
+/* ========================================================================= *
+ * Interface between osso_mem_saw_enable and the allocation interposer
+ * libosso-saw.so, which has to be preloaded (LD_PRELOAD) for SAW to work.
+ * The interposer exports one object under OSSO_MEM_SAW_INTERPOSER, which
+ * libosso finds with dlsym.
+ * ========================================================================= */
+
+#include "osso-mem.h"
+
+#define OSSO_MEM_SAW_INTERPOSER  "osso_mem_saw_interposer"
+#define OSSO_MEM_SAW_VERSION     1
+
+typedef struct
+{
+   int      version;   /* OSSO_MEM_SAW_VERSION */
+
+   /* Returns the number of bytes currently allocated through malloc */
+   size_t   (*heap_size)(void);
+
+   /* Starts (or updates) watching: allocations that would take the heap  */
+   /* over max_heap fail, and so do the ones of max_block bytes or more   */
+   /* while lowmem returns non-zero. oom_func is called for each failure. */
+   void     (*enable)(size_t max_heap, size_t max_block,
+                      osso_mem_saw_oom_func_t oom_func, void* context,
+                      int (*lowmem)(void));
+
+   /* Stops watching, the allocations are still counted */
+   void     (*disable)(void);
+} osso_mem_saw_interposer_t;
+
+#endif /* OSSO_MEM_SAW_H */
@@ -33,12 +33,13 @@
 #include <unistd.h>
 #include <malloc.h>
 #include <errno.h>
-#include <pthread.h>
+#include <dlfcn.h>
 #include <string.h>
 #include <inttypes.h>
 #include <time.h>
 
 #include "osso-mem.h"
+#include "osso-mem-saw.h"
 
 
 /* ========================================================================= *
@@ -53,8 +54,6 @@
 
 #define NSIZE        ((size_t)(-1))
 
-typedef void* (*malloc_hook_t)(size_t, const void*);
-
 
 /* ========================================================================= *
  * Meminfo related strings.
@@ -121,22 +120,6 @@ static size_t sys_avail_memory = NSIZE;
 static size_t sys_deny_limit   = NSIZE;
 static size_t sys_lowmem_limit = NSIZE;
 
-/* SAW-related */
-static pthread_mutex_t saw_lock = PTHREAD_MUTEX_INITIALIZER;
-
-#define THREAD_LOCK()      pthread_mutex_lock(&saw_lock)
-#define THREAD_UNLOCK()    pthread_mutex_unlock(&saw_lock)
-
-/* Parameters of the latest SAW setup call */
-static size_t saw_max_block_size;      /* If allocation is greater - make a test       */
-static size_t saw_max_heap_size;       /* If heap is greater that specified - call OOM */
-
-/* This function shall be called when OOM occurs or close */
-static osso_mem_saw_oom_func_t saw_user_oom_func = NULL;
-static void*  saw_user_context;        /* Extra data for user OOM function */
-
-/* Original malloc hook which may be NULL */
-static malloc_hook_t saw_old_malloc_hook = NULL;
 
 
 /* ========================================================================= *
@@ -288,57 +271,15 @@ static void setup_sys_values(void)
 
 
 /* ------------------------------------------------------------------------- *
- * saw_malloc_hook - Malloc hook. Executed when osso_mem_saw_active is in
- * place. Thread-safe (= slow in some cases).
+ * saw_interposer - returns the allocation interposer (libosso-saw.so) if it
+ * is preloaded, NULL otherwise.
  * ------------------------------------------------------------------------- */
-static void* saw_malloc_hook(size_t size, const void* caller)
+static const osso_mem_saw_interposer_t* saw_interposer(void)
 {
-#if 0
-   static unsigned count = 0; /* Validation count per number of allocations */
-   void* ptr;       /* Allocated pointer, NULL means OOM situation happened */
-
-   THREAD_LOCK();
-
-   /* Restore the real malloc hook */
-   __malloc_hook = saw_old_malloc_hook;
-
-   /* Check for OOM-potential situation by size or allocated blocks counter */
-   if (size >= saw_max_block_size || !count)
-   {
-      /* We must test amount of memory to predict future */
-      const struct mallinfo mi = mallinfo();
-      ptr = (mi.arena + mi.hblkhd + size >= saw_max_heap_size || osso_mem_in_lowmem_state() ? NULL : malloc(size));
-      count = 1024;
-   }
-   else
-   {
-      ptr = malloc(size);
-      count--;
-   }
-
-   /* Restore malloc hook to self */
-   __malloc_hook = saw_malloc_hook;
+   const osso_mem_saw_interposer_t* saw = dlsym(RTLD_DEFAULT, OSSO_MEM_SAW_INTERPOSER);
 
-   /* Test allocation, call OOM function if necessary  */
-   /* Note: SAW may be removed but that is safe for us */
-   if ( !ptr )
-   {
-      count = 0;  /* force the next validation */
-      if (saw_user_oom_func)
-         saw_user_oom_func(saw_max_heap_size + size, saw_max_heap_size, saw_user_context);
-   }
-
-   THREAD_UNLOCK();
-
-#ifdef LIBOSSO_DEBUG
-   /* Printing from the critical section is a bad idea, try to do it now */
-   if ( !ptr )
-      ULOG_INFO_F("SAW: OOM for %u allocation", size);
-#endif
-
-   return ptr;
-#endif
-} /* saw_malloc_hook */
+   return (saw && OSSO_MEM_SAW_VERSION == saw->version ? saw : NULL);
+} /* saw_interposer */
 
 
 /* ========================================================================= *
@@ -537,14 +478,19 @@ int osso_mem_in_lowmem_state(void)
 /* ------------------------------------------------------------------------- *
  * osso_mem_saw_enable - enables Simple Allocation Watchdog.
  * 1. Calculates the possible growth of process' heap based on the
- *    current heap stats, adjusted to the threshold
- * 2. sets up the hook on malloc function; if the particular allocatuion
- *    whose size is bigger than watchblock could violate the limit,
- *    oom_func with user-specified context is called and malloc returns 0
+ *    current heap size, adjusted to the threshold
+ * 2. sets up the limit in the allocation interposer; if the particular
+ *    allocation could violate the limit, or is bigger than watchblock while
+ *    the system is in low memory state, oom_func with user-specified
+ *    context is called and malloc returns 0
+ *
+ * The interposer is the libosso-saw.so library, which has to be preloaded
+ * (LD_PRELOAD) into the process; it counts the allocations without locks.
  *
  * Parameters:
  * - threshold - amount of memory that shall be free in system.
- *   If you pass 0 than maximum available should be set (according to lowmem_high_limit)
+ *   If you pass 0 than maximum available is set (according to lowmem_high_limit);
+ *   this used to fail with -EINVAL.
  * - watchblock - if allocation size more than specified the amount of
  *   available memory must be tested. If 0 passed this parameter should be
  *   set to page size.
@@ -553,7 +499,8 @@ int osso_mem_in_lowmem_state(void)
  *   May be NULL.
  * - context - additional parameter that shall be passed into oom_func.
  *
- * Returns: 0 on success, negative on error
+ * Returns: 0 on success, -ENOSYS if the interposer is not preloaded,
+ * -EINVAL if the usage can not be read or is above the threshold
  *
  * Note: can be safely called several times.
  *
@@ -565,10 +512,16 @@ int osso_mem_saw_enable(size_t threshold,
                   void* context
             )
 {
-#if 0
+   const osso_mem_saw_interposer_t* saw = saw_interposer();
    osso_mem_usage_t current;
    size_t           available;
 
+   if ( !saw )
+   {
+      ULOG_WARN_F("SAW: libosso-saw.so is not preloaded");
+      return -ENOSYS;
+   }
+
    /* Validate passed parameters. */
    if ( !watchblock )
       watchblock = sysconf(_SC_PAGESIZE);
@@ -584,55 +537,41 @@ int osso_mem_saw_enable(size_t threshold,
    available = (sys_avail_ram < current.usable ? sys_avail_ram : current.usable);
 
    /* If we're below the threshold, don't make things worse */
-   if(threshold > 0 && available > threshold)
+   if(available > threshold)
    {
-      const struct mallinfo mi = mallinfo();
+      const size_t max_heap_size = saw->heap_size() + available - threshold;
 
-      THREAD_LOCK();
+      saw->enable(max_heap_size, watchblock, oom_func, context,
+                  osso_mem_in_lowmem_state);
 
-      saw_user_oom_func  = oom_func;
-      saw_max_heap_size  = mi.arena + mi.hblkhd + available - threshold;
-      saw_max_block_size = watchblock;
-      saw_user_context   = context;
-      if(saw_malloc_hook != __malloc_hook)
-      {
-         /* SAW hook is not set */
-         saw_old_malloc_hook = __malloc_hook;
-         __malloc_hook = saw_malloc_hook;
-      }
-
-      THREAD_UNLOCK();
-
-      ULOG_INFO_F("SAW hook installed: block size %u, maxheap %u (threshold %u)",
-                  saw_max_block_size, saw_max_heap_size, threshold);
+      ULOG_INFO_F("SAW installed: block size %zu, maxheap %zu (threshold %zu)",
+                  watchblock, max_heap_size, threshold);
 
       return 0;
    }
    else
    {
-      ULOG_WARN_F("SAW: OOM: available(%u) <= threshold(%u)",
+      ULOG_WARN_F("SAW: OOM: available(%zu) <= threshold(%zu)",
                   available, threshold);
       return -EINVAL;
    }
-#endif
 } /* osso_mem_saw_enable */
 
 /* ------------------------------------------------------------------------- *
- * osso_mem_saw_disable - disables Simple Allocation Watchdog and restore
- * default malloc hook.
+ * osso_mem_saw_disable - disables Simple Allocation Watchdog. The
+ * interposer keeps counting the allocations, but lets all of them pass.
  *
  * Note: can be safely called several times.
  * ------------------------------------------------------------------------- */
 void osso_mem_saw_disable(void)
 {
-#if 0
-   THREAD_LOCK();
-   if(saw_malloc_hook == __malloc_hook)
-      __malloc_hook = saw_old_malloc_hook;
-   THREAD_UNLOCK();
-
-   ULOG_INFO_F("SAW hook removed!");
-#endif
+   const osso_mem_saw_interposer_t* saw = saw_interposer();
+
+   if ( saw )
+   {
+      saw->disable();
+      ULOG_INFO_F("SAW removed!");
+   }
 } /* osso_mem_saw_disable */
 
 
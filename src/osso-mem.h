@@ -128,14 +128,19 @@ int osso_mem_in_lowmem_state(void);
 /* ------------------------------------------------------------------------- *
  * osso_mem_saw_enable - enables Simple Allocation Watchdog.
  * 1. Calculates the possible growth of the process' heap based on the
- *    current heap stats, adjusted to the threshold.
- * 2. Sets up the hook on malloc function; if the particular allocation,
- *    whose size is bigger than watchblock_sz, could violate the limit,
- *    oom_func with user-specified context is called and malloc returns 0.
+ *    current heap size, adjusted to the threshold.
+ * 2. Sets up the limit in the allocation interposer; if the particular
+ *    allocation could violate the limit, or is bigger than watchblock_sz
+ *    while the system is in low memory state, oom_func with
+ *    user-specified context is called and malloc returns 0.
+ *
+ * SAW needs the allocation interposer libosso-saw.so to be preloaded into
+ * the process (LD_PRELOAD=libosso-saw.so.0).
  *
  * Parameters:
- * - threshold - amount of memory used in system. If you pass 0, then maximum
- *   available should be set (according to lowmem_high_limit)
+ * - threshold - amount of memory that shall stay free in the system. If you
+ *   pass 0, the heap may grow by all the memory available (according to
+ *   lowmem_high_limit). Older versions returned -EINVAL for 0.
  * - watchblock - if allocation size is more than this, the amount of
  *   available memory is (re)checked. If 0 is passed, this parameter will be
  *   set to the page size.
@@ -144,7 +149,8 @@ int osso_mem_in_lowmem_state(void);
  *   May be NULL.
  * - context - additional parameter that shall be passed into oom_func.
  *
- * Returns: 0 on success, negative on error
+ * Returns: 0 on success, -ENOSYS if libosso-saw.so is not preloaded,
+ * -EINVAL if less than threshold memory is available
  *
  * Note: can be safely called several times.
  *
@@ -157,8 +163,8 @@ int osso_mem_saw_enable(size_t threshold,
             );
 
 /* ------------------------------------------------------------------------- *
- * osso_mem_saw_disable - disables Simple Allocation Watchdog and restore
- * the default malloc hook. If no watchdog was set up, do nothing.
+ * osso_mem_saw_disable - disables Simple Allocation Watchdog. If no
+ * watchdog was set up, do nothing.
  * ------------------------------------------------------------------------- */
 void osso_mem_saw_disable(void);
 
@@ -0,0 +1,421 @@
+/**
+ * @file osso-names.c
+ * This file implements the cache of D-Bus name owners of the context.
+ * The owner of a watched name is asked once, and then kept up to date
+ * from the NameOwnerChanged signals of the bus daemon, so that the
+ * queries are answered without a round trip to the daemon.
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2006 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "osso-internal.h"
+#include <assert.h>
+
+#define NAME_OWNER_CHANGED "NameOwnerChanged"
+#define NAME_OWNER_CHANGED_MATCH \
+    "type='signal',sender='" DBUS_SERVICE_DBUS "',interface='" \
+    DBUS_INTERFACE_DBUS "',member='" NAME_OWNER_CHANGED "',arg0='%s'"
+
+static void free_name(gpointer data)
+{
+    _osso_name_t *n = data;
+
+    if (n != NULL) {
+        if (n->pending != NULL) {
+            dbus_pending_call_cancel(n->pending);
+            dbus_pending_call_unref(n->pending);
+        }
+        g_free(n->owner);
+        free(n->name);
+        free(n);
+    }
+}
+
+static GHashTable *names_for_conn(osso_context_t *osso,
+                                  DBusConnection *conn,
+                                  gboolean create)
+{
+    GHashTable **names;
+
+    if (conn != NULL && conn == osso->conn) {
+        names = &osso->name_owners;
+    } else if (conn != NULL && conn == osso->sys_conn) {
+        names = &osso->sys_name_owners;
+    } else {
+        ULOG_ERR_F("unknown connection %p", conn);
+        return NULL;
+    }
+
+    if (*names == NULL && create) {
+        /* the key is the name of the value */
+        *names = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       NULL, free_name);
+    }
+    return *names;
+}
+
+static void set_owner(_osso_name_t *n, const char *owner)
+{
+    g_free(n->owner);
+    n->owner = (owner != NULL && owner[0] != '\0') ? g_strdup(owner) : NULL;
+}
+
+static void get_name_owner_reply(DBusPendingCall *pending, void *data)
+{
+    _osso_name_t *n = data;
+    DBusMessage *reply;
+    const char *owner = NULL;
+
+    reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(n->pending);
+    n->pending = NULL;
+
+    if (reply == NULL) {
+        return;
+    }
+    /* an error reply means that the name has no owner */
+    if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN
+        && dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &owner,
+                                 DBUS_TYPE_INVALID)) {
+        set_owner(n, owner);
+    }
+    dbus_message_unref(reply);
+}
+
+static void name_owner_changed(osso_context_t *osso,
+                               DBusMessage *msg,
+                               _osso_callback_data_t *data,
+                               muali_bus_type bus_type)
+{
+    GHashTable *names;
+    _osso_name_t *n;
+    const char *name, *old_owner, *new_owner, *sender;
+
+    sender = dbus_message_get_sender(msg);
+    if (sender == NULL || strcmp(sender, DBUS_SERVICE_DBUS) != 0) {
+        return;
+    }
+    if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &name,
+                               DBUS_TYPE_STRING, &old_owner,
+                               DBUS_TYPE_STRING, &new_owner,
+                               DBUS_TYPE_INVALID)) {
+        ULOG_WARN_F("invalid " NAME_OWNER_CHANGED " signal");
+        return;
+    }
+
+    names = names_for_conn(osso, osso->cur_conn, FALSE);
+    if (names == NULL) {
+        return;
+    }
+    n = g_hash_table_lookup(names, name);
+    if (n == NULL) {
+        return;
+    }
+
+    if (n->pending != NULL) {
+        /* the signal is newer than the state the reply will tell */
+        dbus_pending_call_cancel(n->pending);
+        dbus_pending_call_unref(n->pending);
+        n->pending = NULL;
+    }
+    ULOG_DEBUG_F("'%s': '%s' -> '%s'", name, old_owner, new_owner);
+    set_owner(n, new_owner);
+}
+
+/************************************************************************/
+
+/* Starts watching the name on the connection, or adds a reference to the
+ * watch. The current owner is asked asynchronously. */
+__attribute__ ((visibility("hidden"))) _osso_name_t *
+_osso_name_watch(osso_context_t *osso, DBusConnection *conn,
+                 const char *name)
+{
+    GHashTable *names;
+    _osso_name_t *n;
+    DBusMessage *msg;
+    gchar *rule;
+
+    assert(osso != NULL && name != NULL);
+
+    /* the name goes into a match rule */
+    if (!dbus_validate_bus_name(name, NULL)) {
+        ULOG_ERR_F("invalid bus name '%s'", name);
+        return NULL;
+    }
+
+    names = names_for_conn(osso, conn, TRUE);
+    if (names == NULL) {
+        return NULL;
+    }
+
+    n = g_hash_table_lookup(names, name);
+    if (n != NULL) {
+        n->refcount++;
+        return n;
+    }
+
+    if (!osso->name_handler_set) {
+        _osso_callback_data_t *data;
+
+        data = calloc(1, sizeof(_osso_callback_data_t));
+        if (data == NULL) {
+            ULOG_ERR_F("calloc failed");
+            return NULL;
+        }
+        /* the handler gets the signal from both busses */
+        _msg_handler_set_exact_cb_f_free_data(osso, NULL, DBUS_PATH_DBUS,
+                                              DBUS_INTERFACE_DBUS,
+                                              NAME_OWNER_CHANGED,
+                                              name_owner_changed, data,
+                                              FALSE);
+        osso->name_handler_set = TRUE;
+    }
+
+    n = calloc(1, sizeof(_osso_name_t));
+    if (n == NULL) {
+        ULOG_ERR_F("calloc failed");
+        return NULL;
+    }
+    n->name = strdup(name);
+    if (n->name == NULL) {
+        ULOG_ERR_F("strdup failed");
+        free(n);
+        return NULL;
+    }
+    n->refcount = 1;
+
+    rule = g_strdup_printf(NAME_OWNER_CHANGED_MATCH, name);
+    if (!_osso_match_add(osso, conn, rule)) {
+        g_free(rule);
+        free_name(n);
+        return NULL;
+    }
+    g_free(rule);
+    g_hash_table_insert(names, n->name, n);
+
+    /* the rule must be in place before the owner is asked, so that no
+     * change is missed in between */
+    _osso_match_flush(osso);
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                       DBUS_INTERFACE_DBUS, "GetNameOwner");
+    if (msg == NULL
+        || !dbus_message_append_args(msg, DBUS_TYPE_STRING, &name,
+                                     DBUS_TYPE_INVALID)
+        || !dbus_connection_send_with_reply(conn, msg, &n->pending, -1)
+        || n->pending == NULL) {
+        ULOG_ERR_F("could not ask the owner of '%s'", name);
+        n->pending = NULL;
+    } else {
+        dbus_pending_call_set_notify(n->pending, get_name_owner_reply, n,
+                                     NULL);
+    }
+    if (msg != NULL) {
+        dbus_message_unref(msg);
+    }
+    return n;
+}
+
+/* Drops a reference to the watch of the name on the connection. */
+void __attribute__ ((visibility("hidden")))
+_osso_name_unwatch(osso_context_t *osso, DBusConnection *conn,
+                   const char *name)
+{
+    GHashTable *names;
+    _osso_name_t *n = NULL;
+    gchar *rule;
+
+    assert(osso != NULL && name != NULL);
+
+    names = names_for_conn(osso, conn, FALSE);
+    if (names != NULL) {
+        n = g_hash_table_lookup(names, name);
+    }
+    if (n == NULL) {
+        ULOG_WARN_F("name '%s' is not watched", name);
+        return;
+    }
+    if (--n->refcount > 0) {
+        return;
+    }
+
+    rule = g_strdup_printf(NAME_OWNER_CHANGED_MATCH, name);
+    _osso_match_remove(osso, conn, rule);
+    g_free(rule);
+    g_hash_table_remove(names, name);
+}
+
+/* Returns the cache entry of the name, with the owner known, or NULL if
+ * the name is not watched. */
+__attribute__ ((visibility("hidden"))) _osso_name_t *
+_osso_name_lookup(osso_context_t *osso, DBusConnection *conn,
+                  const char *name)
+{
+    GHashTable *names;
+    _osso_name_t *n;
+
+    names = names_for_conn(osso, conn, FALSE);
+    if (names == NULL) {
+        return NULL;
+    }
+    n = g_hash_table_lookup(names, name);
+    if (n != NULL && n->pending != NULL) {
+        /* asked just now, wait for the answer */
+        DBusPendingCall *pending = dbus_pending_call_ref(n->pending);
+
+        dbus_pending_call_block(pending);
+        dbus_pending_call_unref(pending);
+    }
+    return n;
+}
+
+/* For the library itself: the name is watched from the first query on
+ * until the context is deinitialized. */
+gboolean __attribute__ ((visibility("hidden")))
+_osso_name_has_owner(osso_context_t *osso, DBusConnection *conn,
+                     const char *name)
+{
+    _osso_name_t *n;
+
+    n = _osso_name_lookup(osso, conn, name);
+    if (n == NULL || !n->library_ref) {
+        n = _osso_name_watch(osso, conn, name);
+        if (n == NULL) {
+            /* could not watch, ask the daemon */
+            return dbus_bus_name_has_owner(conn, name, NULL);
+        }
+        n->library_ref = TRUE;
+        n = _osso_name_lookup(osso, conn, name);
+    }
+    return n->owner != NULL;
+}
+
+void __attribute__ ((visibility("hidden")))
+_osso_names_deinit(osso_context_t *osso)
+{
+    if (osso->name_owners != NULL) {
+        g_hash_table_destroy(osso->name_owners);
+        osso->name_owners = NULL;
+    }
+    if (osso->sys_name_owners != NULL) {
+        g_hash_table_destroy(osso->sys_name_owners);
+        osso->sys_name_owners = NULL;
+    }
+}
+
+/************************************************************************/
+
+static DBusConnection *names_conn(osso_context_t *osso, gboolean system_bus)
+{
+    if (system_bus) {
+        return _osso_get_sys_conn(osso);
+    }
+    return osso->conn;
+}
+
+osso_return_t osso_name_watch(osso_context_t *osso, const gchar *name,
+                              gboolean system_bus)
+{
+    DBusConnection *conn;
+
+    if (osso == NULL || name == NULL || name[0] == '\0') {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+    conn = names_conn(osso, system_bus);
+    if (conn == NULL) {
+        ULOG_ERR_F("no D-Bus connection");
+        return OSSO_INVALID;
+    }
+
+    if (_osso_name_watch(osso, conn, name) == NULL) {
+        return OSSO_ERROR;
+    }
+    return OSSO_OK;
+}
+
+osso_return_t osso_name_unwatch(osso_context_t *osso, const gchar *name,
+                                gboolean system_bus)
+{
+    DBusConnection *conn;
+    _osso_name_t *n;
+
+    if (osso == NULL || name == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+    conn = system_bus ? osso->sys_conn : osso->conn;
+    if (conn == NULL) {
+        return OSSO_INVALID;
+    }
+
+    n = _osso_name_lookup(osso, conn, name);
+    if (n == NULL || n->refcount == (n->library_ref ? 1 : 0)) {
+        /* not watched by the application */
+        return OSSO_INVALID;
+    }
+    _osso_name_unwatch(osso, conn, name);
+    return OSSO_OK;
+}
+
+gboolean osso_name_has_owner(osso_context_t *osso, const gchar *name,
+                             gboolean system_bus)
+{
+    DBusConnection *conn;
+    _osso_name_t *n;
+
+    if (osso == NULL || name == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return FALSE;
+    }
+    conn = names_conn(osso, system_bus);
+    if (conn == NULL) {
+        return FALSE;
+    }
+
+    n = _osso_name_lookup(osso, conn, name);
+    if (n == NULL) {
+        ULOG_WARN_F("'%s' is not watched, asking the daemon", name);
+        return dbus_bus_name_has_owner(conn, name, NULL);
+    }
+    return n->owner != NULL;
+}
+
+const gchar *osso_name_get_owner(osso_context_t *osso, const gchar *name,
+                                 gboolean system_bus)
+{
+    DBusConnection *conn;
+    _osso_name_t *n;
+
+    if (osso == NULL || name == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return NULL;
+    }
+    conn = names_conn(osso, system_bus);
+    if (conn == NULL) {
+        return NULL;
+    }
+
+    n = _osso_name_lookup(osso, conn, name);
+    if (n == NULL) {
+        ULOG_ERR_F("'%s' is not watched", name);
+        return NULL;
+    }
+    return n->owner;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file osso-peer.c
+ * This file implements the direct connections between libosso processes.
+ * A process that listens answers a GetAddress call on the bus with the
+ * address of its private DBusServer, and a process that connects to it
+ * sends its later RPC calls to that service over the private connection,
+ * without the bus daemon in between. The calls that come over a peer
+ * connection are dispatched to the same handlers as those from the bus.
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2006 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "osso-internal.h"
+#include <dbus/dbus-glib-lowlevel.h>
+
+#define PEER_PATH        "/com/nokia/libosso/peer"
+#define PEER_INTERFACE   "com.nokia.libosso.peer"
+#define PEER_GET_ADDRESS "GetAddress"
+
+/* on Linux, the socket is in the abstract namespace with a random name */
+#define PEER_LISTEN_ADDRESS "unix:tmpdir=/tmp"
+
+static DBusHandlerResult peer_filter(DBusConnection *conn, DBusMessage *msg,
+                                     void *data);
+
+static void close_peer(osso_context_t *osso, DBusConnection *conn)
+{
+    dbus_connection_remove_filter(conn, peer_filter, osso);
+    dbus_connection_remove_filter(conn, _msg_handler, osso);
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+}
+
+static gboolean peer_has_conn(gpointer key, gpointer value, gpointer data)
+{
+    return value == data;
+}
+
+static DBusHandlerResult peer_filter(DBusConnection *conn, DBusMessage *msg,
+                                     void *data)
+{
+    osso_context_t *osso = data;
+
+    if (!dbus_message_is_signal(msg, DBUS_INTERFACE_LOCAL, "Disconnected")) {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    ULOG_DEBUG_F("peer connection %p closed", conn);
+    if (osso->peers != NULL
+        && g_hash_table_foreach_remove(osso->peers, peer_has_conn,
+                                       conn) > 0) {
+        /* the later calls go through the bus again */
+        close_peer(osso, conn);
+    } else if (g_slist_find(osso->peer_conns, conn) != NULL) {
+        osso->peer_conns = g_slist_remove(osso->peer_conns, conn);
+        close_peer(osso, conn);
+    }
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static gboolean setup_peer(osso_context_t *osso, DBusConnection *conn)
+{
+    dbus_connection_set_exit_on_disconnect(conn, FALSE);
+    dbus_connection_setup_with_g_main(conn, osso->main_context);
+
+    if (!dbus_connection_add_filter(conn, peer_filter, osso, NULL)) {
+        ULOG_ERR_F("dbus_connection_add_filter failed");
+        return FALSE;
+    }
+    if (!dbus_connection_add_filter(conn, _msg_handler, osso, NULL)) {
+        ULOG_ERR_F("dbus_connection_add_filter failed");
+        dbus_connection_remove_filter(conn, peer_filter, osso);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void new_peer(DBusServer *server, DBusConnection *conn, void *data)
+{
+    osso_context_t *osso = data;
+
+    ULOG_DEBUG_F("new peer connection %p", conn);
+    if (setup_peer(osso, conn)) {
+        /* the connection is dropped if it is not referenced here */
+        osso->peer_conns = g_slist_prepend(osso->peer_conns,
+                                           dbus_connection_ref(conn));
+    }
+}
+
+static void get_address_handler(osso_context_t *osso, DBusMessage *msg,
+                                _osso_callback_data_t *data,
+                                muali_bus_type bus_type)
+{
+    DBusMessage *reply;
+    char *address;
+
+    if (osso->peer_server == NULL || dbus_message_get_no_reply(msg)) {
+        return;
+    }
+
+    address = dbus_server_get_address(osso->peer_server);
+    if (address == NULL) {
+        ULOG_ERR_F("dbus_server_get_address failed");
+        return;
+    }
+    reply = dbus_message_new_method_return(msg);
+    if (reply == NULL || !dbus_message_append_args(reply,
+                                 DBUS_TYPE_STRING, &address,
+                                 DBUS_TYPE_INVALID)) {
+        ULOG_ERR_F("could not create the reply");
+    } else if (!dbus_connection_send(osso->cur_conn, reply, NULL)) {
+        ULOG_ERR_F("dbus_connection_send failed");
+    } else {
+        _osso_flush(osso, osso->cur_conn);
+    }
+    if (reply != NULL) {
+        dbus_message_unref(reply);
+    }
+    dbus_free(address);
+}
+
+__attribute__ ((visibility("hidden"))) DBusConnection *
+_osso_peer_lookup(osso_context_t *osso, const char *service)
+{
+    if (osso->peers == NULL || service == NULL) {
+        return NULL;
+    }
+    return g_hash_table_lookup(osso->peers, service);
+}
+
+static void close_peer_value(gpointer key, gpointer value, gpointer data)
+{
+    close_peer(data, value);
+}
+
+void __attribute__ ((visibility("hidden")))
+_osso_peers_deinit(osso_context_t *osso)
+{
+    GSList *l;
+
+    if (osso->peers != NULL) {
+        g_hash_table_foreach(osso->peers, close_peer_value, osso);
+        g_hash_table_destroy(osso->peers);
+        osso->peers = NULL;
+    }
+    for (l = osso->peer_conns; l != NULL; l = l->next) {
+        close_peer(osso, l->data);
+    }
+    g_slist_free(osso->peer_conns);
+    osso->peer_conns = NULL;
+
+    if (osso->peer_server != NULL) {
+        dbus_server_disconnect(osso->peer_server);
+        dbus_server_unref(osso->peer_server);
+        osso->peer_server = NULL;
+    }
+}
+
+/************************************************************************/
+
+osso_return_t osso_rpc_peer_listen(osso_context_t *osso)
+{
+    DBusError err;
+
+    if (osso == NULL || osso->conn == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+    if (osso->peer_server != NULL) {
+        return OSSO_OK;
+    }
+
+    dbus_error_init(&err);
+    osso->peer_server = dbus_server_listen(PEER_LISTEN_ADDRESS, &err);
+    if (osso->peer_server == NULL) {
+        ULOG_ERR_F("dbus_server_listen failed: %s", err.message);
+        dbus_error_free(&err);
+        return OSSO_ERROR;
+    }
+    dbus_server_set_new_connection_function(osso->peer_server, new_peer,
+                                            osso, NULL);
+    dbus_server_setup_with_g_main(osso->peer_server, osso->main_context);
+
+    _msg_handler_set_exact_cb_f(osso, osso->service, PEER_PATH,
+                                PEER_INTERFACE, PEER_GET_ADDRESS,
+                                get_address_handler, NULL, TRUE);
+    return OSSO_OK;
+}
+
+osso_return_t osso_rpc_peer_connect(osso_context_t *osso,
+                                    const gchar *service)
+{
+    DBusMessage *msg, *reply;
+    DBusConnection *conn;
+    const char *address;
+    DBusError err;
+
+    if (osso == NULL || service == NULL || osso->conn == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+    if (_osso_peer_lookup(osso, service) != NULL) {
+        return OSSO_OK;
+    }
+
+    msg = dbus_message_new_method_call(service, PEER_PATH, PEER_INTERFACE,
+                                       PEER_GET_ADDRESS);
+    if (msg == NULL) {
+        ULOG_ERR_F("dbus_message_new_method_call failed");
+        return OSSO_ERROR;
+    }
+    dbus_error_init(&err);
+    reply = dbus_connection_send_with_reply_and_block(osso->conn, msg,
+                                                      osso->rpc_timeout,
+                                                      &err);
+    dbus_message_unref(msg);
+    if (reply == NULL) {
+        /* e.g. the service does not listen */
+        ULOG_WARN_F("'%s' gave no peer address: %s", service, err.message);
+        dbus_error_free(&err);
+        return OSSO_ERROR;
+    }
+    if (!dbus_message_get_args(reply, &err, DBUS_TYPE_STRING, &address,
+                               DBUS_TYPE_INVALID)) {
+        ULOG_ERR_F("invalid reply from '%s': %s", service, err.message);
+        dbus_error_free(&err);
+        dbus_message_unref(reply);
+        return OSSO_ERROR;
+    }
+
+    conn = dbus_connection_open_private(address, &err);
+    dbus_message_unref(reply);
+    if (conn == NULL) {
+        ULOG_ERR_F("could not connect to '%s': %s", service, err.message);
+        dbus_error_free(&err);
+        return OSSO_ERROR;
+    }
+    if (!setup_peer(osso, conn)) {
+        dbus_connection_close(conn);
+        dbus_connection_unref(conn);
+        return OSSO_ERROR;
+    }
+
+    if (osso->peers == NULL) {
+        /* the connections are closed with close_peer */
+        osso->peers = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, NULL);
+    }
+    g_hash_table_insert(osso->peers, g_strdup(service), conn);
+    return OSSO_OK;
+}
+
+osso_return_t osso_rpc_peer_disconnect(osso_context_t *osso,
+                                       const gchar *service)
+{
+    DBusConnection *conn;
+
+    if (osso == NULL || service == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+    conn = _osso_peer_lookup(osso, service);
+    if (conn == NULL) {
+        return OSSO_INVALID;
+    }
+    g_hash_table_remove(osso->peers, service);
+    close_peer(osso, conn);
+    return OSSO_OK;
+}
@@ -0,0 +1,413 @@
+/**
+ * @file osso-rpc-cache.c
+ * This file implements the reply cache of the synchronous RPC functions.
+ * The replies of a method that only reads state are kept, one for each
+ * distinct set of arguments, until one of the signals that announce a
+ * change of that state arrives or the time to live of the reply ends.
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2006 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "osso-internal.h"
+#include <time.h>
+
+/* the replies of a cache are dropped when there would be more */
+#define RPC_CACHE_MAX_REPLIES 32
+
+#define RPC_CACHE_SIGNAL_MATCH \
+    "type='signal',path='%s',interface='%s',member='%s'"
+
+typedef struct {
+    DBusMessage *reply;
+    gint64 expires;         /* in monotonic microseconds, 0 for never */
+} _osso_rpc_cache_reply_t;
+
+typedef struct {
+    gchar *path;
+    gchar *interface;
+    gchar *member;
+    gchar *rule;
+} _osso_rpc_cache_signal_t;
+
+struct _osso_rpc_cache_t {
+    osso_context_t *osso;
+    gchar *id;              /* the key in osso->rpc_caches */
+    gboolean system_bus;
+    guint ttl;              /* in milliseconds, 0 for no limit */
+    GHashTable *replies;    /* _osso_rpc_cache_reply_t hashed by the
+                               arguments of the call */
+    GSList *signals;        /* _osso_rpc_cache_signal_t */
+    guint hits;
+    guint misses;
+};
+
+static gchar *cache_id(gboolean system_bus, const char *service,
+                       const char *object_path, const char *interface,
+                       const char *method)
+{
+    return g_strdup_printf("%c %s %s %s.%s", system_bus ? 'y' : 's',
+                           service, object_path, interface, method);
+}
+
+static gint64 now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void free_reply(gpointer data)
+{
+    _osso_rpc_cache_reply_t *r = data;
+
+    dbus_message_unref(r->reply);
+    free(r);
+}
+
+/* Appends the type and the value of each argument to the key, as text
+ * because the key is hashed as a string. Returns FALSE if the arguments
+ * cannot be compared, in which case the call is not cached. */
+static gboolean append_key(GString *key, DBusMessageIter *iter)
+{
+    int type;
+
+    while ((type = dbus_message_iter_get_arg_type(iter))
+           != DBUS_TYPE_INVALID) {
+        g_string_append_c(key, type);
+
+        if (type == DBUS_TYPE_UNIX_FD) {
+            /* a different fd can have the same content, and the
+             * same fd different content */
+            return FALSE;
+        } else if (type == DBUS_TYPE_STRING
+                   || type == DBUS_TYPE_OBJECT_PATH
+                   || type == DBUS_TYPE_SIGNATURE) {
+            const char *s;
+
+            dbus_message_iter_get_basic(iter, &s);
+            g_string_append_printf(key, "%u:%s", (guint)strlen(s), s);
+        } else if (dbus_type_is_basic(type)) {
+            DBusBasicValue v;
+
+            /* the smaller types leave the rest of the union zero */
+            memset(&v, 0, sizeof(v));
+            dbus_message_iter_get_basic(iter, &v);
+            g_string_append_printf(key, "%" G_GINT64_MODIFIER "x;",
+                                   (guint64)v.u64);
+        } else {
+            /* tells apart the empty arrays of different types */
+            char *sig = dbus_message_iter_get_signature(iter);
+            DBusMessageIter sub;
+
+            g_string_append_printf(key, "%u:%s", (guint)strlen(sig), sig);
+            dbus_free(sig);
+            dbus_message_iter_recurse(iter, &sub);
+            if (!append_key(key, &sub)) {
+                return FALSE;
+            }
+            g_string_append_c(key, ')');
+        }
+        dbus_message_iter_next(iter);
+    }
+    return TRUE;
+}
+
+static void cache_signal_handler(osso_context_t *osso, DBusMessage *msg,
+                                 _osso_callback_data_t *data,
+                                 muali_bus_type bus_type)
+{
+    osso_rpc_cache_t *cache = data->user_data;
+
+    ULOG_DEBUG_F("'%s' invalidates '%s'", dbus_message_get_member(msg),
+                 cache->id);
+    g_hash_table_remove_all(cache->replies);
+}
+
+static void free_signal(osso_rpc_cache_t *cache,
+                        _osso_rpc_cache_signal_t *s, gboolean unregister)
+{
+    if (unregister) {
+        osso_context_t *osso = cache->osso;
+        _osso_callback_data_t match;
+        DBusConnection *conn;
+
+        memset(&match, 0, sizeof(match));
+        match.user_data = cache;
+        _msg_handler_rm_member_cb_f(osso, NULL, s->path, s->interface,
+                s->member, (const _osso_handler_f*)cache_signal_handler,
+                &match, FALSE);
+        conn = cache->system_bus ? osso->sys_conn : osso->conn;
+        if (conn != NULL) {
+            _osso_match_remove(osso, conn, s->rule);
+        }
+    }
+    g_free(s->path);
+    g_free(s->interface);
+    g_free(s->member);
+    g_free(s->rule);
+    free(s);
+}
+
+/* Frees the cache. The handlers and the match rules are only removed if
+ * unregister is set; they go with the connections on deinitialization. */
+static void free_cache(osso_rpc_cache_t *cache, gboolean unregister)
+{
+    GSList *l;
+
+    for (l = cache->signals; l != NULL; l = l->next) {
+        free_signal(cache, l->data, unregister);
+    }
+    g_slist_free(cache->signals);
+    g_hash_table_destroy(cache->replies);
+    g_free(cache->id);
+    free(cache);
+}
+
+/* Returns a new reference to the cached reply to the call, if there is
+ * one. Otherwise, if the method is cached, the cache and the key that
+ * _osso_rpc_cache_store needs are returned. */
+__attribute__ ((visibility("hidden"))) DBusMessage *
+_osso_rpc_cache_lookup(osso_context_t *osso, gboolean system_bus,
+                       DBusMessage *msg, osso_rpc_cache_t **cache,
+                       gchar **key)
+{
+    osso_rpc_cache_t *c;
+    _osso_rpc_cache_reply_t *r;
+    DBusMessageIter iter;
+    GString *args;
+    gchar *id;
+
+    *cache = NULL;
+    *key = NULL;
+    if (osso->rpc_caches == NULL) {
+        return NULL;
+    }
+
+    id = cache_id(system_bus, dbus_message_get_destination(msg),
+                  dbus_message_get_path(msg),
+                  dbus_message_get_interface(msg),
+                  dbus_message_get_member(msg));
+    c = g_hash_table_lookup(osso->rpc_caches, id);
+    g_free(id);
+    if (c == NULL) {
+        return NULL;
+    }
+
+    args = g_string_new(NULL);
+    dbus_message_iter_init(msg, &iter);
+    if (!append_key(args, &iter)) {
+        g_string_free(args, TRUE);
+        return NULL;
+    }
+
+    r = g_hash_table_lookup(c->replies, args->str);
+    if (r != NULL && r->expires != 0 && r->expires <= now_usec()) {
+        g_hash_table_remove(c->replies, args->str);
+        r = NULL;
+    }
+    if (r != NULL) {
+        ++c->hits;
+        g_string_free(args, TRUE);
+        return dbus_message_ref(r->reply);
+    }
+
+    ++c->misses;
+    *cache = c;
+    *key = g_string_free(args, FALSE);
+    return NULL;
+}
+
+/* Keeps the reply to the call of the key, which is taken over. */
+void __attribute__ ((visibility("hidden")))
+_osso_rpc_cache_store(osso_rpc_cache_t *cache, gchar *key,
+                      DBusMessage *reply)
+{
+    _osso_rpc_cache_reply_t *r;
+
+    r = calloc(1, sizeof(_osso_rpc_cache_reply_t));
+    if (r == NULL) {
+        ULOG_ERR_F("calloc failed");
+        g_free(key);
+        return;
+    }
+    r->reply = dbus_message_ref(reply);
+    if (cache->ttl > 0) {
+        r->expires = now_usec() + (gint64)cache->ttl * 1000;
+    }
+
+    if (g_hash_table_size(cache->replies) >= RPC_CACHE_MAX_REPLIES) {
+        g_hash_table_remove_all(cache->replies);
+    }
+    g_hash_table_replace(cache->replies, key, r);
+}
+
+static void free_cache_value(gpointer key, gpointer value, gpointer data)
+{
+    free_cache(value, FALSE);
+}
+
+void __attribute__ ((visibility("hidden")))
+_osso_rpc_caches_deinit(osso_context_t *osso)
+{
+    if (osso->rpc_caches != NULL) {
+        g_hash_table_foreach(osso->rpc_caches, free_cache_value, NULL);
+        g_hash_table_destroy(osso->rpc_caches);
+        osso->rpc_caches = NULL;
+    }
+}
+
+/************************************************************************/
+
+osso_rpc_cache_t *osso_rpc_cache_new(osso_context_t *osso,
+                                     const gchar *service,
+                                     const gchar *object_path,
+                                     const gchar *interface,
+                                     const gchar *method,
+                                     guint ttl,
+                                     gboolean use_system_bus)
+{
+    osso_rpc_cache_t *cache;
+    gchar *id;
+
+    if (osso == NULL || service == NULL || object_path == NULL
+        || interface == NULL || method == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return NULL;
+    }
+
+    id = cache_id(use_system_bus, service, object_path, interface, method);
+    if (osso->rpc_caches != NULL
+        && g_hash_table_lookup(osso->rpc_caches, id) != NULL) {
+        ULOG_ERR_F("'%s' is already cached", id);
+        g_free(id);
+        return NULL;
+    }
+
+    cache = calloc(1, sizeof(osso_rpc_cache_t));
+    if (cache == NULL) {
+        ULOG_ERR_F("calloc failed");
+        g_free(id);
+        return NULL;
+    }
+    cache->osso = osso;
+    cache->id = id;
+    cache->system_bus = use_system_bus;
+    cache->ttl = ttl;
+    cache->replies = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, free_reply);
+
+    if (osso->rpc_caches == NULL) {
+        /* the caches are freed with free_cache */
+        osso->rpc_caches = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+    g_hash_table_insert(osso->rpc_caches, cache->id, cache);
+    return cache;
+}
+
+osso_return_t osso_rpc_cache_invalidate_on(osso_rpc_cache_t *cache,
+                                           const gchar *object_path,
+                                           const gchar *interface,
+                                           const gchar *signal)
+{
+    _osso_rpc_cache_signal_t *s;
+    _osso_callback_data_t *data;
+    DBusConnection *conn;
+    osso_context_t *osso;
+
+    if (cache == NULL || object_path == NULL || interface == NULL
+        || signal == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+    /* the names go into a match rule */
+    if (!dbus_validate_path(object_path, NULL)
+        || !dbus_validate_interface(interface, NULL)
+        || !dbus_validate_member(signal, NULL)) {
+        ULOG_ERR_F("invalid signal %s %s.%s", object_path, interface,
+                   signal);
+        return OSSO_INVALID;
+    }
+    osso = cache->osso;
+
+    conn = cache->system_bus ? _osso_get_sys_conn(osso) : osso->conn;
+    if (conn == NULL) {
+        ULOG_ERR_F("not connected to the %s bus",
+                   cache->system_bus ? "system" : "session");
+        return OSSO_ERROR;
+    }
+
+    s = calloc(1, sizeof(_osso_rpc_cache_signal_t));
+    data = calloc(1, sizeof(_osso_callback_data_t));
+    if (s == NULL || data == NULL) {
+        ULOG_ERR_F("calloc failed");
+        free(s);
+        free(data);
+        return OSSO_ERROR;
+    }
+    s->path = g_strdup(object_path);
+    s->interface = g_strdup(interface);
+    s->member = g_strdup(signal);
+    s->rule = g_strdup_printf(RPC_CACHE_SIGNAL_MATCH, object_path,
+                              interface, signal);
+
+    if (!_osso_match_add(osso, conn, s->rule)) {
+        free(data);
+        free_signal(cache, s, FALSE);
+        return OSSO_ERROR;
+    }
+    data->user_data = cache;
+    _msg_handler_set_exact_cb_f_free_data(osso, NULL, object_path,
+                                          interface, signal,
+                                          cache_signal_handler, data,
+                                          FALSE);
+    cache->signals = g_slist_prepend(cache->signals, s);
+    return OSSO_OK;
+}
+
+void osso_rpc_cache_clear(osso_rpc_cache_t *cache)
+{
+    if (cache != NULL) {
+        g_hash_table_remove_all(cache->replies);
+    }
+}
+
+void osso_rpc_cache_get_stats(const osso_rpc_cache_t *cache, guint *hits,
+                              guint *misses)
+{
+    if (cache == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return;
+    }
+    if (hits != NULL) {
+        *hits = cache->hits;
+    }
+    if (misses != NULL) {
+        *misses = cache->misses;
+    }
+}
+
+void osso_rpc_cache_free(osso_rpc_cache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+    g_hash_table_remove(cache->osso->rpc_caches, cache->id);
+    free_cache(cache, TRUE);
+}
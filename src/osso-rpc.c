@@ -26,20 +26,32 @@
 #include "osso-internal.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #define HILDON_DESKTOP_SERVICE "com.nokia.hildon-desktop"
 #define HDWM_STARTUP_NOTIFICATION_IFACE "com.nokia.hildon.hdwm.startupnotification"
 #define HDWM_OBJECT_PATH                "/com/nokia/hildon/hdwm"
 #define HDWM_STARTUP_NOTIFICATION_STARTING  "starting"
 
+/* arguments of an osso_rpc_borrowed_cb_f that are kept on the stack */
+#define RPC_STACK_ARGS 8
+
 
 static void _rpc_handler (osso_context_t * osso,
                           DBusMessage * msg,
                           _osso_callback_data_t *data,
                           muali_bus_type dbus_type);
-static void _append_args(DBusMessage *msg, int type, va_list var_args);
+static void _rpc_borrowed_handler (osso_context_t * osso,
+                                   DBusMessage * msg,
+                                   _osso_callback_data_t *data,
+                                   muali_bus_type dbus_type);
+static void _append_args(DBusMessage *msg, DBusConnection *conn, int type,
+                         va_list var_args);
 static void _append_arg (DBusMessage * msg, osso_rpc_t * arg);
-static void _get_arg (DBusMessageIter * iter, osso_rpc_t * retval);
+static void _get_arg (DBusMessageIter * iter, osso_rpc_t * retval,
+                      gboolean borrow);
+static void _get_value (DBusMessageIter * iter, osso_rpc_t * val,
+                        gboolean borrow, gboolean nested);
 static void _async_return_handler (DBusPendingCall * pending, void *data);
 static osso_return_t _rpc_run_with_argfill (osso_context_t *osso,
 					    DBusConnection *conn,
@@ -50,26 +62,235 @@ static osso_return_t _rpc_run_with_argfill (osso_context_t *osso,
 					    osso_rpc_t *retval, 
 					    osso_rpc_argfill *argfill,
 					    void *argfill_data);
-
-typedef struct {
+static osso_return_t _rpc_run_msg(osso_context_t *osso,
+                                  DBusConnection *conn,
+                                  const gchar *service, DBusMessage *msg,
+                                  osso_rpc_t *retval,
+                                  osso_rpc_argfill *argfill,
+                                  void *argfill_data);
+
+typedef struct _osso_rpc_call_t {
     osso_rpc_async_f *func;
     gpointer data;
+    GDestroyNotify data_destroy; /* called on data when freed */
     gchar *interface;
     gchar *method;
+    DBusPendingCall *pending;   /* until the reply has been handled */
+    gint refcount;  /* one for the pending call, one for the handle
+                       returned by osso_rpc_async_call */
 }_osso_rpc_async_t;
 
+typedef struct {
+    osso_rpc_batch_t *batch;
+    guint index;            /* of the result */
+    DBusMessage *msg;       /* the call, until it is sent */
+    DBusPendingCall *pending; /* until the reply arrives */
+} _osso_rpc_batch_call_t;
+
+struct _osso_rpc_batch_t {
+    osso_context_t *osso;
+    GPtrArray *calls;       /* _osso_rpc_batch_call_t, in adding order */
+    osso_rpc_batch_result_t *results; /* allocated when sent */
+    guint outstanding;      /* calls waiting for the reply */
+    gboolean sent;
+    osso_rpc_batch_f *func;
+    gpointer data;
+    gboolean in_callback;   /* func is being called */
+    gboolean freed;         /* osso_rpc_batch_free was called from func */
+};
+
+struct _osso_rpc_template_t {
+    osso_context_t *osso;
+    DBusMessage *msg;       /* the method call without arguments */
+    gchar *service;
+    gchar *interface;
+    gchar *method;
+    gboolean system_bus;
+};
+
+struct _osso_rpc_reply_token_t {
+    osso_context_t *osso;   /* NULL after the context is deinitialized */
+    DBusConnection *conn;   /* the connection the call came from */
+    DBusMessage *msg;       /* the method call */
+};
+
+
+static void _free_value(osso_rpc_t *val, gboolean borrowed);
+
+static void _free_array(osso_rpc_array_t *a)
+{
+    guint i;
+
+    if (a == NULL) {
+        return;
+    }
+
+    /* the containers are always allocated, only the leaves are
+     * borrowed from the message */
+    if (a->elem_type == DBUS_TYPE_STRING) {
+        gchar **strs = (gchar**)a->data;
+
+        if (!a->borrowed) {
+            for (i = 0; i < a->len; ++i) {
+                g_free(strs[i]);
+            }
+        }
+        g_free(strs);
+    } else if (a->elem_type == DBUS_TYPE_DICT_ENTRY) {
+        osso_rpc_dict_entry_t *entries = (osso_rpc_dict_entry_t*)a->data;
+
+        for (i = 0; i < a->len; ++i) {
+            if (!a->borrowed) {
+                g_free((gchar*)entries[i].key);
+            }
+            _free_value(&entries[i].value, a->borrowed);
+        }
+        g_free(entries);
+    } else if (!a->borrowed) {
+        g_free((gpointer)a->data);
+    }
+    g_free(a);
+}
+
+static void _free_value(osso_rpc_t *val, gboolean borrowed)
+{
+    if (val->type == DBUS_TYPE_STRING) {
+        if (!borrowed) {
+            g_free(val->value.s);
+        }
+    } else if (val->type == DBUS_TYPE_ARRAY) {
+        _free_array(val->value.a);
+    } else if (val->type == DBUS_TYPE_UNIX_FD) {
+        /* received fds are always duplicates */
+        close(val->value.i);
+    }
+    val->type = DBUS_TYPE_INVALID;
+}
 
 void osso_rpc_free_val (osso_rpc_t *rpc)
 {
-  if (rpc->type == DBUS_TYPE_STRING)
-	  g_free (rpc->value.s);
-  rpc->type = DBUS_TYPE_INVALID;
+  _free_value(rpc, FALSE);
+}
+
+/* Returns the size of an element of an array of the type, or 0 if the
+ * elements are not of a fixed size. */
+static gsize _fixed_size(int type)
+{
+    switch (type) {
+      case DBUS_TYPE_BYTE:
+        return 1;
+      case DBUS_TYPE_INT16:
+      case DBUS_TYPE_UINT16:
+        return 2;
+      case DBUS_TYPE_BOOLEAN:
+        return sizeof(dbus_bool_t);
+      case DBUS_TYPE_INT32:
+      case DBUS_TYPE_UINT32:
+        return 4;
+      case DBUS_TYPE_INT64:
+      case DBUS_TYPE_UINT64:
+      case DBUS_TYPE_DOUBLE:
+        return 8;
+      default:
+        return 0;
+    }
+}
+
+static osso_rpc_array_t *_copy_array(int elem_type, gconstpointer elems,
+                                     guint len);
+
+static void _copy_value(osso_rpc_t *dst, const osso_rpc_t *src)
+{
+    *dst = *src;
+    if (src->type == DBUS_TYPE_STRING) {
+        dst->value.s = g_strdup(src->value.s);
+    } else if (src->type == DBUS_TYPE_ARRAY) {
+        dst->value.a = _copy_array(src->value.a->elem_type,
+                                   src->value.a->data, src->value.a->len);
+        if (dst->value.a == NULL) {
+            dst->type = DBUS_TYPE_INVALID;
+        }
+    } else if (src->type == DBUS_TYPE_UNIX_FD) {
+        dst->value.i = dup(src->value.i);
+        if (dst->value.i < 0) {
+            dst->type = DBUS_TYPE_INVALID;
+        }
+    }
+}
+
+static osso_rpc_array_t *_copy_array(int elem_type, gconstpointer elems,
+                                     guint len)
+{
+    osso_rpc_array_t *a;
+    gsize size = _fixed_size(elem_type);
+    guint i;
+
+    if (size == 0 && elem_type != DBUS_TYPE_STRING
+        && elem_type != DBUS_TYPE_DICT_ENTRY) {
+        ULOG_ERR_F("unsupported element type '%c'", elem_type);
+        return NULL;
+    }
+
+    a = g_new0(osso_rpc_array_t, 1);
+    a->elem_type = elem_type;
+    a->len = len;
+
+    if (elem_type == DBUS_TYPE_STRING) {
+        const gchar * const *src = elems;
+        gchar **strs = g_new0(gchar*, len);
+
+        for (i = 0; i < len; ++i) {
+            strs[i] = g_strdup(src[i]);
+        }
+        a->data = strs;
+    } else if (elem_type == DBUS_TYPE_DICT_ENTRY) {
+        const osso_rpc_dict_entry_t *src = elems;
+        osso_rpc_dict_entry_t *entries = g_new0(osso_rpc_dict_entry_t, len);
+
+        for (i = 0; i < len; ++i) {
+            entries[i].key = g_strdup(src[i].key);
+            _copy_value(&entries[i].value, &src[i].value);
+        }
+        a->data = entries;
+    } else if (len > 0) {
+        gpointer data = g_malloc(len * size);
+
+        memcpy(data, elems, len * size);
+        a->data = data;
+    }
+    return a;
+}
+
+osso_return_t osso_rpc_set_array(osso_rpc_t *val, int elem_type,
+                                 gconstpointer elems, guint len)
+{
+    osso_rpc_array_t *a;
+
+    if (val == NULL || (elems == NULL && len > 0)) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    a = _copy_array(elem_type, elems, len);
+    if (a == NULL) {
+        return OSSO_INVALID;
+    }
+    val->type = DBUS_TYPE_ARRAY;
+    val->value.a = a;
+    return OSSO_OK;
+}
+
+osso_return_t osso_rpc_set_byte_array(osso_rpc_t *val, const guchar *bytes,
+                                      guint len)
+{
+    return osso_rpc_set_array(val, DBUS_TYPE_BYTE, bytes, len);
 }
 
 /************************************************************************/
 typedef struct {
   int argument_type;
   va_list arg_list;
+  DBusConnection *conn; /* decides how bulk data is sent */
 } fill_from_va_list_data;
 
 static void
@@ -78,6 +299,11 @@ startup_notify (osso_context_t *osso, const gchar *service)
     DBusMessage *msg;
     dbus_bool_t succ;
 
+    if (_osso_peer_lookup(osso, service) != NULL) {
+        /* the service is running, it is connected to */
+        return;
+    }
+
     msg = dbus_message_new_method_call(HILDON_DESKTOP_SERVICE,
                                        HDWM_OBJECT_PATH,
 				       HDWM_STARTUP_NOTIFICATION_IFACE,
@@ -107,7 +333,7 @@ fill_from_va_list (DBusMessage *msg, void *raw)
   fill_from_va_list_data *data = (fill_from_va_list_data *)raw;
 
   if (data->argument_type != DBUS_TYPE_INVALID) {
-    _append_args(msg, data->argument_type, data->arg_list);
+    _append_args(msg, data->conn, data->argument_type, data->arg_list);
   }
 }
 
@@ -125,6 +351,7 @@ osso_return_t osso_rpc_run(osso_context_t *osso, const gchar *service,
 	return OSSO_INVALID;
 
     data.argument_type = argument_type;
+    data.conn = osso->conn;
     va_start(data.arg_list, argument_type);
     
     ret = _rpc_run_with_argfill (osso, osso->conn,
@@ -167,10 +394,12 @@ osso_return_t osso_rpc_run_system(osso_context_t *osso, const gchar *service,
     fill_from_va_list_data data;
     
     if( (osso == NULL) || (service == NULL) || (object_path == NULL) ||
-	(interface == NULL) || (method == NULL) || (osso->sys_conn == NULL))
+	(interface == NULL) || (method == NULL) ||
+	(_osso_get_sys_conn(osso) == NULL))
 	return OSSO_INVALID;
 
     data.argument_type = argument_type;
+    data.conn = osso->sys_conn;
     va_start(data.arg_list, argument_type);
     
     ret = _rpc_run_with_argfill (osso, osso->sys_conn,
@@ -193,7 +422,8 @@ osso_return_t osso_rpc_run_system_with_argfill (osso_context_t *osso,
 						void *argfill_data)
 {
     if( (osso == NULL) || (service == NULL) || (object_path == NULL) ||
-	(interface == NULL) || (method == NULL) || (osso->sys_conn == NULL))
+	(interface == NULL) || (method == NULL) ||
+	(_osso_get_sys_conn(osso) == NULL))
 	return OSSO_INVALID;
 
     return _rpc_run_with_argfill (osso, osso->sys_conn,
@@ -212,14 +442,13 @@ _rpc_run_with_argfill (osso_context_t *osso, DBusConnection *conn,
 		       void *argfill_data)
 {
     DBusMessage *msg;
-    dbus_bool_t b;
     
     dprint("");
     if (conn == NULL) {
         ULOG_ERR_F("invalid arguments");
 	return OSSO_INVALID;
     }
-    
+
     dprint("New method: %s:%s:%s:%s",service,object_path,interface,method);
     msg = dbus_message_new_method_call(service, object_path,
 				       interface, method);
@@ -228,9 +457,54 @@ _rpc_run_with_argfill (osso_context_t *osso, DBusConnection *conn,
 	return OSSO_ERROR;
     }
 
+    return _rpc_run_msg(osso, conn, service, msg, retval,
+                        argfill, argfill_data);
+}
+
+/* Fills in the arguments of the method call, which has none yet, and
+ * sends it. The message is unreferenced. */
+static osso_return_t _rpc_run_msg(osso_context_t *osso,
+                                  DBusConnection *conn,
+                                  const gchar *service, DBusMessage *msg,
+                                  osso_rpc_t *retval,
+                                  osso_rpc_argfill *argfill,
+                                  void *argfill_data)
+{
+    DBusConnection *peer;
+    osso_rpc_cache_t *cache = NULL;
+    gchar *cache_key = NULL;
+    gboolean system_bus;
+    dbus_bool_t b;
+
+    system_bus = (conn == osso->sys_conn);
+    if (conn == osso->conn
+        && (peer = _osso_peer_lookup(osso, service)) != NULL) {
+        conn = peer;
+    }
+
     argfill (msg, argfill_data);
 
+    if (retval != NULL) {
+        DBusMessage *reply;
+
+        reply = _osso_rpc_cache_lookup(osso, system_bus, msg, &cache,
+                                       &cache_key);
+        if (reply != NULL) {
+            DBusMessageIter iter;
+
+            dbus_message_unref(msg);
+            dbus_message_iter_init(reply, &iter);
+            _get_arg(&iter, retval, FALSE);
+            dbus_message_unref(reply);
+            return OSSO_OK;
+        }
+    }
+
     dbus_message_set_auto_start(msg, TRUE);
+
+    /* the match rules go before the call, so that the signals it
+     * causes are not missed */
+    _osso_match_flush(osso);
     
     if (retval == NULL) {
 	dbus_message_set_no_reply(msg, TRUE);
@@ -255,6 +529,14 @@ _rpc_run_with_argfill (osso_context_t *osso, DBusConnection *conn,
         dbus_message_unref(msg);
         startup_notify(osso, service);
 
+        if (cache != NULL && reply != NULL
+            && dbus_message_get_type(reply)
+               == DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+            _osso_rpc_cache_store(cache, cache_key, reply);
+        } else {
+            g_free(cache_key);
+        }
+
         if (reply == NULL) {
             ULOG_ERR_F("dbus_connection_send_with_reply_and_block error: %s",
                        err.message);
@@ -278,7 +560,7 @@ _rpc_run_with_argfill (osso_context_t *osso, DBusConnection *conn,
 		dprint("message return");
 		dbus_message_iter_init(reply, &iter);
 	    
-		_get_arg(&iter, retval);
+		_get_arg(&iter, retval, FALSE);
 	    
 		dbus_message_unref(reply);
                 return OSSO_OK;
@@ -302,7 +584,7 @@ osso_return_t osso_rpc_run_with_defaults(osso_context_t *osso,
 					 int argument_type,
 					 ...)
 {
-    char service[MAX_SVC_LEN], path[MAX_OP_LEN], interface[MAX_IF_LEN];
+    const _osso_default_names_t *names;
     fill_from_va_list_data data;
     osso_return_t ret;
 
@@ -310,15 +592,17 @@ osso_return_t osso_rpc_run_with_defaults(osso_context_t *osso,
         || (osso->conn == NULL) )
 	return OSSO_INVALID;
 
-    make_default_service(application, service);
-    make_default_object_path(application, path);
-    make_default_interface(application, interface);
+    names = _osso_default_names(osso, application);
+    if (names == NULL) {
+        return OSSO_ERROR;
+    }
     
     data.argument_type = argument_type;
+    data.conn = osso->conn;
     va_start(data.arg_list, argument_type);
 
-    ret = _rpc_run_with_argfill (osso, osso->conn, service,
-                                 path, interface,
+    ret = _rpc_run_with_argfill (osso, osso->conn, names->service,
+                                 names->path, names->interface,
                                  method, retval,
 				 fill_from_va_list, &data);
     
@@ -327,9 +611,22 @@ osso_return_t osso_rpc_run_with_defaults(osso_context_t *osso,
     return ret;
 }
 
+/* Releases the pending call and the data, and drops a reference. */
 static void free_osso_rpc_async_t(_osso_rpc_async_t *rpc)
 {
     if (rpc != NULL) {
+        if (rpc->pending != NULL) {
+            dbus_pending_call_unref(rpc->pending);
+            rpc->pending = NULL;
+        }
+        if (rpc->data_destroy != NULL) {
+            (*rpc->data_destroy)(rpc->data);
+            rpc->data_destroy = NULL;
+        }
+        if (--rpc->refcount > 0) {
+            /* the handle is still held */
+            return;
+        }
         if (rpc->interface != NULL) {
             g_free(rpc->interface);
             rpc->interface = NULL;
@@ -342,27 +639,37 @@ static void free_osso_rpc_async_t(_osso_rpc_async_t *rpc)
     }
 }
 
-/************************************************************************/
-osso_return_t osso_rpc_async_run_with_argfill (osso_context_t *osso,
-						  const gchar *service,
-						  const gchar *object_path,
-						  const gchar *interface,
-						  const gchar *method,
-						  osso_rpc_async_f *async_cb,
-						  gpointer data,
-						  osso_rpc_argfill *argfill,
-						  void *argfill_data)
+static osso_return_t _rpc_async_send_msg(osso_context_t *osso,
+                                         DBusConnection *conn,
+                                         const gchar *service,
+                                         const gchar *interface,
+                                         const gchar *method,
+                                         DBusMessage *msg,
+                                         gint timeout,
+                                         osso_rpc_async_f *async_cb,
+                                         gpointer data,
+                                         GDestroyNotify data_destroy,
+                                         osso_rpc_argfill *argfill,
+                                         void *argfill_data,
+                                         _osso_rpc_async_t **call_out);
+
+/* Sends the method call. If async_cb is not NULL, the call is returned
+ * in *call_out when that is not NULL, and it is freed once async_cb has
+ * been called and the handle released, or when it is cancelled. */
+static osso_return_t _rpc_async_send(osso_context_t *osso,
+                                     const gchar *service,
+                                     const gchar *object_path,
+                                     const gchar *interface,
+                                     const gchar *method,
+                                     gint timeout,
+                                     osso_rpc_async_f *async_cb,
+                                     gpointer data,
+                                     GDestroyNotify data_destroy,
+                                     osso_rpc_argfill *argfill,
+                                     void *argfill_data,
+                                     _osso_rpc_async_t **call_out)
 {
-    DBusMessage *msg = NULL;
-    DBusPendingCall *pending = NULL;
-    dbus_bool_t succ = FALSE;
-    _osso_rpc_async_t *rpc = NULL;
-   
-    if (osso == NULL || service == NULL || object_path == NULL ||
-        interface == NULL || method == NULL) {
-        ULOG_ERR_F("invalid arguments");
-        return OSSO_INVALID;
-    }
+    DBusMessage *msg;
 
     dprint("New method: %s:%s:%s:%s",service,object_path,interface,method);
     msg = dbus_message_new_method_call(service, object_path,
@@ -372,25 +679,61 @@ osso_return_t osso_rpc_async_run_with_argfill (osso_context_t *osso,
         return OSSO_ERROR;
     }
 
+    return _rpc_async_send_msg(osso, osso->conn, service, interface, method,
+                               msg, timeout, async_cb, data, data_destroy,
+                               argfill, argfill_data, call_out);
+}
+
+/* Same as _rpc_async_send, for a method call that has no arguments yet.
+ * The message is unreferenced. */
+static osso_return_t _rpc_async_send_msg(osso_context_t *osso,
+                                         DBusConnection *conn,
+                                         const gchar *service,
+                                         const gchar *interface,
+                                         const gchar *method,
+                                         DBusMessage *msg,
+                                         gint timeout,
+                                         osso_rpc_async_f *async_cb,
+                                         gpointer data,
+                                         GDestroyNotify data_destroy,
+                                         osso_rpc_argfill *argfill,
+                                         void *argfill_data,
+                                         _osso_rpc_async_t **call_out)
+{
+    DBusPendingCall *pending = NULL;
+    DBusConnection *peer;
+    dbus_bool_t succ = FALSE;
+    _osso_rpc_async_t *rpc = NULL;
+
+    if (conn == osso->conn
+        && (peer = _osso_peer_lookup(osso, service)) != NULL) {
+        conn = peer;
+    }
+
     dbus_message_set_auto_start(msg, TRUE);
     
     argfill (msg, argfill_data);
 
+    _osso_match_flush(osso);
+
     if (async_cb == NULL) {
 	dprint("no reply wanted");
 	dbus_message_set_no_reply(msg, TRUE);
-	succ = dbus_connection_send(osso->conn, msg, NULL);
+	succ = dbus_connection_send(conn, msg, NULL);
     }
     else {
 	dprint("caller wants reply");
 	rpc = (_osso_rpc_async_t *)calloc(1, sizeof(_osso_rpc_async_t));
 	if (rpc == NULL) {
             ULOG_ERR_F("calloc failed");
+            dbus_message_unref(msg);
             return OSSO_ERROR;
         }
 	
 	rpc->func = async_cb;
 	rpc->data = data;
+	rpc->data_destroy = data_destroy;
+	rpc->refcount = 1;
 	rpc->interface = g_strdup(interface);
 	rpc->method = g_strdup(method);
 	dprint("rpc = %p",rpc);
@@ -399,21 +742,26 @@ osso_return_t osso_rpc_async_run_with_argfill (osso_context_t *osso,
 	dprint("rpc->interface = '%s'",rpc->interface);
 	dprint("rpc->method = '%s'",rpc->method);
 
-	succ = dbus_connection_send_with_reply(osso->conn, msg, 
-					    &pending, osso->rpc_timeout);
+	succ = dbus_connection_send_with_reply(conn, msg, 
+					    &pending, timeout);
+	if (succ && pending == NULL) {
+	    /* the connection is closed */
+	    succ = FALSE;
+	}
     }
 
     if (succ) {
 	dprint("succ is true");
 	if (async_cb != NULL) {
+	    rpc->pending = pending;
+	    if (call_out != NULL) {
+	        ++rpc->refcount;
+	        *call_out = rpc;
+	    }
 	    dbus_pending_call_set_notify(pending,
 					 _async_return_handler,
 					 rpc, NULL);
 	}
-        else if (rpc != NULL) {
-            free_osso_rpc_async_t(rpc);
-            rpc = NULL;
-        }
 	dbus_message_unref(msg);
         startup_notify(osso, service);
 
@@ -423,6 +771,8 @@ osso_return_t osso_rpc_async_run_with_argfill (osso_context_t *osso,
         ULOG_ERR_F("dbus_connection_send(_with_reply) failed");
         dbus_message_unref(msg);
         if (rpc != NULL) {
+            /* the caller still owns the data */
+            rpc->data_destroy = NULL;
             free_osso_rpc_async_t(rpc);
             rpc = NULL;
         }
@@ -430,6 +780,241 @@ osso_return_t osso_rpc_async_run_with_argfill (osso_context_t *osso,
     }
 }
 
+/************************************************************************/
+osso_return_t osso_rpc_async_run_with_argfill (osso_context_t *osso,
+						  const gchar *service,
+						  const gchar *object_path,
+						  const gchar *interface,
+						  const gchar *method,
+						  osso_rpc_async_f *async_cb,
+						  gpointer data,
+						  osso_rpc_argfill *argfill,
+						  void *argfill_data)
+{
+    if (osso == NULL || service == NULL || object_path == NULL ||
+        interface == NULL || method == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    return _rpc_async_send(osso, service, object_path, interface, method,
+                           osso->rpc_timeout, async_cb, data, NULL,
+                           argfill, argfill_data, NULL);
+}
+
+/************************************************************************/
+osso_rpc_call_t *osso_rpc_async_call_with_argfill(osso_context_t *osso,
+                                                  const gchar *service,
+                                                  const gchar *object_path,
+                                                  const gchar *interface,
+                                                  const gchar *method,
+                                                  gint timeout,
+                                                  osso_rpc_async_f *async_cb,
+                                                  gpointer data,
+                                                  GDestroyNotify data_destroy,
+                                                  osso_rpc_argfill *argfill,
+                                                  gpointer argfill_data)
+{
+    _osso_rpc_async_t *call = NULL;
+
+    if (osso == NULL || service == NULL || object_path == NULL ||
+        interface == NULL || method == NULL || async_cb == NULL ||
+        argfill == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return NULL;
+    }
+
+    if (timeout < 0) {
+        timeout = osso->rpc_timeout;
+    }
+
+    if (_rpc_async_send(osso, service, object_path, interface, method,
+                        timeout, async_cb, data, data_destroy,
+                        argfill, argfill_data, &call) != OSSO_OK) {
+        return NULL;
+    }
+    return call;
+}
+
+osso_rpc_call_t *osso_rpc_async_call(osso_context_t *osso,
+                                     const gchar *service,
+                                     const gchar *object_path,
+                                     const gchar *interface,
+                                     const gchar *method,
+                                     gint timeout,
+                                     osso_rpc_async_f *async_cb,
+                                     gpointer data,
+                                     GDestroyNotify data_destroy,
+                                     int argument_type, ...)
+{
+    fill_from_va_list_data argfill_data;
+    osso_rpc_call_t *call;
+
+    argfill_data.argument_type = argument_type;
+    argfill_data.conn = osso != NULL ? osso->conn : NULL;
+    va_start(argfill_data.arg_list, argument_type);
+
+    call = osso_rpc_async_call_with_argfill(osso, service, object_path,
+                                            interface, method, timeout,
+                                            async_cb, data, data_destroy,
+                                            fill_from_va_list,
+                                            &argfill_data);
+    va_end(argfill_data.arg_list);
+
+    return call;
+}
+
+void osso_rpc_call_cancel(osso_rpc_call_t *call)
+{
+    if (call == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return;
+    }
+
+    if (call->pending != NULL) {
+        /* still waiting: the reply is dropped by libdbus unread, and the
+         * notify function, which would drop its reference, is not called
+         * any more */
+        dbus_pending_call_cancel(call->pending);
+        --call->refcount;
+    }
+    /* otherwise only the handle is released */
+    free_osso_rpc_async_t(call);
+}
+
+/************************************************************************/
+osso_rpc_template_t *osso_rpc_template_new(osso_context_t *osso,
+                                           const gchar *service,
+                                           const gchar *object_path,
+                                           const gchar *interface,
+                                           const gchar *method,
+                                           gboolean use_system_bus)
+{
+    osso_rpc_template_t *tmpl;
+
+    if (osso == NULL || service == NULL || object_path == NULL ||
+        interface == NULL || method == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return NULL;
+    }
+
+    tmpl = calloc(1, sizeof(osso_rpc_template_t));
+    if (tmpl == NULL) {
+        ULOG_ERR_F("calloc failed");
+        return NULL;
+    }
+    /* the names are validated here once, the calls copy the header */
+    tmpl->msg = dbus_message_new_method_call(service, object_path,
+                                             interface, method);
+    if (tmpl->msg == NULL) {
+        ULOG_ERR_F("dbus_message_new_method_call failed");
+        free(tmpl);
+        return NULL;
+    }
+    dbus_message_set_auto_start(tmpl->msg, TRUE);
+
+    tmpl->osso = osso;
+    tmpl->service = g_strdup(service);
+    tmpl->interface = g_strdup(interface);
+    tmpl->method = g_strdup(method);
+    tmpl->system_bus = use_system_bus;
+    return tmpl;
+}
+
+/* Returns a copy of the method call of the template, and the connection
+ * to send it on. */
+static DBusMessage *template_copy(const osso_rpc_template_t *tmpl,
+                                  DBusConnection **conn)
+{
+    DBusMessage *msg;
+
+    if (tmpl->system_bus) {
+        *conn = _osso_get_sys_conn(tmpl->osso);
+    } else {
+        *conn = tmpl->osso->conn;
+    }
+    if (*conn == NULL) {
+        ULOG_ERR_F("not connected to the %s bus",
+                   tmpl->system_bus ? "system" : "session");
+        return NULL;
+    }
+
+    msg = dbus_message_copy(tmpl->msg);
+    if (msg == NULL) {
+        ULOG_ERR_F("dbus_message_copy failed");
+    }
+    return msg;
+}
+
+osso_return_t osso_rpc_template_run(const osso_rpc_template_t *tmpl,
+                                    osso_rpc_t *retval,
+                                    int argument_type, ...)
+{
+    fill_from_va_list_data data;
+    DBusConnection *conn;
+    DBusMessage *msg;
+    osso_return_t ret;
+
+    if (tmpl == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+    msg = template_copy(tmpl, &conn);
+    if (msg == NULL) {
+        return conn == NULL ? OSSO_INVALID : OSSO_ERROR;
+    }
+
+    data.argument_type = argument_type;
+    data.conn = conn;
+    va_start(data.arg_list, argument_type);
+    ret = _rpc_run_msg(tmpl->osso, conn, tmpl->service, msg, retval,
+                       fill_from_va_list, &data);
+    va_end(data.arg_list);
+    return ret;
+}
+
+osso_return_t osso_rpc_template_async_run(const osso_rpc_template_t *tmpl,
+                                          osso_rpc_async_f *async_cb,
+                                          gpointer data,
+                                          int argument_type, ...)
+{
+    fill_from_va_list_data argfill_data;
+    DBusConnection *conn;
+    DBusMessage *msg;
+    osso_return_t ret;
+
+    if (tmpl == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+    msg = template_copy(tmpl, &conn);
+    if (msg == NULL) {
+        return conn == NULL ? OSSO_INVALID : OSSO_ERROR;
+    }
+
+    argfill_data.argument_type = argument_type;
+    argfill_data.conn = conn;
+    va_start(argfill_data.arg_list, argument_type);
+    ret = _rpc_async_send_msg(tmpl->osso, conn, tmpl->service,
+                              tmpl->interface, tmpl->method, msg,
+                              tmpl->osso->rpc_timeout, async_cb, data, NULL,
+                              fill_from_va_list, &argfill_data, NULL);
+    va_end(argfill_data.arg_list);
+    return ret;
+}
+
+void osso_rpc_template_free(osso_rpc_template_t *tmpl)
+{
+    if (tmpl == NULL) {
+        return;
+    }
+    dbus_message_unref(tmpl->msg);
+    g_free(tmpl->service);
+    g_free(tmpl->interface);
+    g_free(tmpl->method);
+    free(tmpl);
+}
+
 /************************************************************************/
 osso_return_t osso_rpc_async_run(osso_context_t *osso,
 				 const gchar *service,
@@ -449,6 +1034,7 @@ osso_return_t osso_rpc_async_run(osso_context_t *osso,
 	return OSSO_INVALID;
 
     argfill_data.argument_type = argument_type;
+    argfill_data.conn = osso->conn;
     va_start(argfill_data.arg_list, argument_type);
 
     ret = osso_rpc_async_run_with_argfill (osso,
@@ -470,22 +1056,25 @@ osso_return_t osso_rpc_async_run_with_defaults(osso_context_t *osso,
 					       gpointer data,
 					       int argument_type, ...)
 {
-    char service[MAX_SVC_LEN], path[MAX_OP_LEN], interface[MAX_IF_LEN];
+    const _osso_default_names_t *names;
     fill_from_va_list_data argfill_data;
     osso_return_t ret;
 
     if( (osso == NULL) || (application == NULL) || (method == NULL) )
 	return OSSO_INVALID;
 
-    make_default_service(application, service);
-    make_default_object_path(application, path);
-    make_default_interface(application, interface);
+    names = _osso_default_names(osso, application);
+    if (names == NULL) {
+        return OSSO_ERROR;
+    }
     
     argfill_data.argument_type = argument_type;
+    argfill_data.conn = osso->conn;
     va_start(argfill_data.arg_list, argument_type);
 
-    ret = osso_rpc_async_run_with_argfill (osso, service, path,
-                                           interface, method,
+    ret = osso_rpc_async_run_with_argfill (osso, names->service,
+                                           names->path, names->interface,
+                                           method,
 				           async_cb, data,
 				           fill_from_va_list, &argfill_data);
     dprint("osso_rpc_async_run_with_argfill returned");
@@ -500,8 +1089,9 @@ static osso_return_t _rpc_set_cb_f(osso_context_t *osso,
                                    const gchar *service,
                                    const gchar *object_path,
                                    const gchar *interface,
-                                   osso_rpc_cb_f *cb, gpointer data,
+                                   gpointer cb, gpointer data,
                                    osso_rpc_retval_free_f *retval_free,
+                                   _osso_handler_f *handler,
                                    gboolean use_system_bus)
 {
     _osso_callback_data_t *rpc;
@@ -510,6 +1100,11 @@ static osso_return_t _rpc_set_cb_f(osso_context_t *osso,
     ULOG_DEBUG_F("s '%s' o '%s' i '%s', %s bus",
                  service, object_path, interface,
                  use_system_bus ? "system" : "session");
+
+    if (use_system_bus && _osso_get_sys_conn(osso) == NULL) {
+        ULOG_ERR_F("no D-Bus system bus connection");
+        return OSSO_INVALID;
+    }
     
     rpc = calloc(1, sizeof(_osso_callback_data_t));
     if (rpc == NULL) {
@@ -564,7 +1159,7 @@ static osso_return_t _rpc_set_cb_f(osso_context_t *osso,
                           service,
                           object_path,
                           interface,
-                          _rpc_handler,
+                          handler,
                           rpc, TRUE);
     return OSSO_OK;
 }
@@ -577,7 +1172,7 @@ osso_return_t _test_rpc_set_cb_f(osso_context_t *osso, const gchar *service,
                                  gboolean use_system_bus)
 {
     return _rpc_set_cb_f(osso, service, object_path, interface,
-                         cb, data, NULL, use_system_bus);
+                         cb, data, NULL, _rpc_handler, use_system_bus);
 }
 
 /************************************************************************/
@@ -592,7 +1187,24 @@ osso_return_t osso_rpc_set_cb_f_with_free (osso_context_t *osso,
 	(interface == NULL) || (cb == NULL))
 	return OSSO_INVALID;
     return _rpc_set_cb_f(osso, service, object_path,
-			 interface,cb, data, retval_free, FALSE);
+			 interface,cb, data, retval_free, _rpc_handler, FALSE);
+}
+
+osso_return_t osso_rpc_set_borrowed_cb_f(osso_context_t *osso,
+                                         const gchar *service,
+                                         const gchar *object_path,
+                                         const gchar *interface,
+                                         osso_rpc_borrowed_cb_f *cb,
+                                         gpointer data,
+                                         osso_rpc_retval_free_f *retval_free)
+{
+    if (osso == NULL || service == NULL || object_path == NULL ||
+        interface == NULL || cb == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return OSSO_INVALID;
+    }
+    return _rpc_set_cb_f(osso, service, object_path, interface, cb, data,
+                         retval_free, _rpc_borrowed_handler, FALSE);
 }
 
 osso_return_t osso_rpc_set_cb_f (osso_context_t *osso,
@@ -668,6 +1280,32 @@ osso_return_t osso_rpc_unset_cb_f(osso_context_t *osso,
     return OSSO_OK;
 }
 
+osso_return_t osso_rpc_unset_borrowed_cb_f(osso_context_t *osso,
+                                           const gchar *service,
+                                           const gchar *object_path,
+                                           const gchar *interface,
+                                           osso_rpc_borrowed_cb_f *cb,
+                                           gpointer data)
+{
+    _osso_callback_data_t user_data;
+
+    if (osso == NULL || service == NULL || object_path == NULL
+        || interface == NULL || cb == NULL || osso->conn == NULL) {
+        ULOG_ERR_F("invalid parameters");
+        return OSSO_INVALID;
+    }
+
+    user_data.user_cb = cb;
+    user_data.user_data = data;
+    user_data.data = NULL;
+
+    _msg_handler_rm_cb_f(osso, service, object_path, interface,
+                         (const _osso_handler_f*)_rpc_borrowed_handler,
+                         &user_data, TRUE);
+
+    return OSSO_OK;
+}
+
 /************************************************************************/
 
 osso_return_t osso_rpc_unset_default_cb_f(osso_context_t *osso,
@@ -711,6 +1349,143 @@ osso_return_t osso_rpc_set_timeout(osso_context_t *osso, gint timeout)
 
 /************************************************************************/
 
+/* Makes the reply to the method call: a method return with the value if
+ * ret is OSSO_OK, otherwise an error with retval->value.s as the
+ * message. */
+static DBusMessage *_rpc_new_reply(DBusMessage *msg, gint ret,
+                                   osso_rpc_t *retval)
+{
+    DBusMessage *reply;
+
+    if (ret == OSSO_OK) {
+        reply = dbus_message_new_method_return(msg);
+        if (reply != NULL) {
+            _append_arg(reply, retval);
+        }
+    } else {
+        gchar err_name[256];
+        g_snprintf(err_name, 255, "%s.error.%s",
+                   dbus_message_get_destination(msg),
+                   dbus_message_get_member(msg));
+        reply = dbus_message_new_error(msg, err_name, retval->value.s);
+    }
+    if (reply == NULL) {
+        ULOG_ERR_F("could not create the reply");
+    }
+    return reply;
+}
+
+osso_rpc_reply_token_t *osso_rpc_defer_reply(osso_context_t *osso)
+{
+    osso_rpc_reply_token_t *token;
+
+    if (osso == NULL || osso->rpc_msg == NULL || osso->cur_conn == NULL) {
+        ULOG_ERR_F("not called from an RPC callback");
+        return NULL;
+    }
+
+    token = calloc(1, sizeof(osso_rpc_reply_token_t));
+    if (token == NULL) {
+        ULOG_ERR_F("calloc failed");
+        return NULL;
+    }
+    token->osso = osso;
+    token->conn = dbus_connection_ref(osso->cur_conn);
+    token->msg = dbus_message_ref(osso->rpc_msg);
+    osso->reply_tokens = g_slist_prepend(osso->reply_tokens, token);
+    osso->reply_deferred = TRUE;
+    return token;
+}
+
+static void _detach_token(gpointer data, gpointer user_data)
+{
+    ((osso_rpc_reply_token_t*)data)->osso = NULL;
+}
+
+/* Called when the context is deinitialized. The tokens stay valid, but
+ * their replies are flushed right away from then on. */
+void __attribute__ ((visibility("hidden")))
+_osso_rpc_tokens_deinit(osso_context_t *osso)
+{
+    g_slist_foreach(osso->reply_tokens, _detach_token, NULL);
+    g_slist_free(osso->reply_tokens);
+    osso->reply_tokens = NULL;
+}
+
+static osso_return_t _rpc_complete(osso_rpc_reply_token_t *token, gint ret,
+                                   osso_rpc_t *retval)
+{
+    osso_return_t result = OSSO_OK;
+
+    if (!dbus_message_get_no_reply(token->msg)) {
+        DBusMessage *reply;
+
+        reply = _rpc_new_reply(token->msg, ret, retval);
+        if (reply == NULL) {
+            result = OSSO_ERROR;
+        } else {
+            if (!dbus_connection_send(token->conn, reply, NULL)) {
+                ULOG_ERR_F("dbus_connection_send failed");
+                result = OSSO_ERROR;
+            }
+            if (token->osso != NULL) {
+                _osso_flush(token->osso, token->conn);
+            } else {
+                dbus_connection_flush(token->conn);
+            }
+            dbus_message_unref(reply);
+        }
+    }
+
+    if (token->osso != NULL) {
+        token->osso->reply_tokens = g_slist_remove(token->osso->reply_tokens,
+                                                   token);
+    }
+    dbus_message_unref(token->msg);
+    dbus_connection_unref(token->conn);
+    free(token);
+    return result;
+}
+
+osso_return_t osso_rpc_complete_reply(osso_rpc_reply_token_t *token,
+                                      const osso_rpc_t *retval)
+{
+    osso_rpc_t val;
+
+    if (token == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    if (retval != NULL) {
+        val = *retval;
+    } else {
+        val.type = DBUS_TYPE_INVALID;
+    }
+    return _rpc_complete(token, OSSO_OK, &val);
+}
+
+osso_return_t osso_rpc_complete_error(osso_rpc_reply_token_t *token,
+                                      const gchar *message)
+{
+    osso_rpc_t val;
+
+    if (token == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    val.type = DBUS_TYPE_STRING;
+    val.value.s = (gchar*)message;
+    return _rpc_complete(token, OSSO_ERROR, &val);
+}
+
+/************************************************************************/
+
+static void _rpc_send_reply(osso_context_t *osso, DBusMessage *msg,
+                            gint ret, osso_rpc_t *retval,
+                            osso_rpc_retval_free_f *retval_free);
+
 static void _rpc_handler(osso_context_t *osso, DBusMessage *msg,
                          _osso_callback_data_t *rpc,
                          muali_bus_type dbus_type)
@@ -722,6 +1497,7 @@ static void _rpc_handler(osso_context_t *osso, DBusMessage *msg,
     int i;
     osso_rpc_cb_f *handler;
     osso_rpc_retval_free_f *retval_free;
+    DBusMessage *saved_msg;
 
     arguments = g_array_new(FALSE, FALSE, sizeof(osso_rpc_t));
 
@@ -729,7 +1505,8 @@ static void _rpc_handler(osso_context_t *osso, DBusMessage *msg,
         while(TRUE) {
 	    osso_rpc_t arg;
 
-	    _get_arg(&iter, &arg);
+	    /* the message outlives the arguments */
+	    _get_arg(&iter, &arg, TRUE);
 	
 	    dprint("appending value");
 	    g_array_append_val(arguments, arg);
@@ -746,9 +1523,13 @@ static void _rpc_handler(osso_context_t *osso, DBusMessage *msg,
 
     dprint("calling handler at %p", handler);
     retval.type = DBUS_TYPE_INVALID;
+    /* for osso_rpc_defer_reply */
+    saved_msg = osso->rpc_msg;
+    osso->rpc_msg = msg;
     ret = (*handler)(dbus_message_get_interface(msg),
         	     dbus_message_get_member(msg), arguments,
                      rpc->user_data, &retval);
+    osso->rpc_msg = saved_msg;
     if (retval.type == DBUS_TYPE_STRING) {
        dprint("handler returned string '%s'", retval.value.s);
     }
@@ -757,48 +1538,239 @@ static void _rpc_handler(osso_context_t *osso, DBusMessage *msg,
         osso_rpc_free_val (&g_array_index (arguments, osso_rpc_t, i));
     g_array_free(arguments, TRUE);
 
-    if(ret == OSSO_INVALID) {
+    _rpc_send_reply(osso, msg, ret, &retval, retval_free);
+}
+
+/* Replies to the method call with the result of the osso_rpc_cb_f, and
+ * frees retval. */
+static void _rpc_send_reply(osso_context_t *osso, DBusMessage *msg,
+                            gint ret, osso_rpc_t *retval,
+                            osso_rpc_retval_free_f *retval_free)
+{
+    if(ret == OSSO_INVALID || ret == OSSO_RPC_PENDING) {
+	/* no reply, or the handler replies with its token later */
 	if (retval_free != NULL)
-	    (*retval_free)(&retval);
+	    (*retval_free)(retval);
 	return;
     }
     
     if(!dbus_message_get_no_reply(msg)) {
-	DBusMessage *reply = NULL;
-	if(ret == OSSO_OK) {
-	    dprint("Callback returnded OSSO_OK");
-	    dprint("callback set retval.type to %d",retval.type);
-	    reply = dbus_message_new_method_return(msg);
-	    if(reply != NULL) {
-                if (retval.type == DBUS_TYPE_STRING) {
-                    dprint("string is still '%s'", retval.value.s);
-                }
-		_append_arg(reply, &retval);
-	    }
-	}
-	else {
-	    gchar err_name[256];
-	    g_snprintf(err_name, 255, "%s.error.%s",
-		       dbus_message_get_destination(msg),
-		       dbus_message_get_member(msg));
-	    reply = dbus_message_new_error(msg, err_name, retval.value.s);
-	}
+	DBusMessage *reply;
+	dprint("callback returned %d, retval.type %d", ret, retval->type);
+	reply = _rpc_new_reply(msg, ret, retval);
 	if(reply != NULL) {
 	    dbus_uint32_t serial;
 	    dprint("sending message to '%s'",
 		   dbus_message_get_destination(reply));
 	    
 	    dbus_connection_send(osso->cur_conn, reply, &serial);
-	    dbus_connection_flush(osso->cur_conn);
+	    _osso_flush(osso, osso->cur_conn);
 	    dbus_message_unref(reply);
 	}
     }
-    if (retval_free)
-        (*retval_free)(&retval);
+    if (retval_free)
+        (*retval_free)(retval);
+}
+
+/* Fills a with a view of the fixed type array at iter. Returns FALSE if
+ * the elements are not of a fixed type. */
+static gboolean _get_fixed_view(DBusMessageIter *iter, osso_rpc_array_t *a)
+{
+    DBusMessageIter sub;
+    int n = 0;
+
+    a->elem_type = dbus_message_iter_get_element_type(iter);
+    if (_fixed_size(a->elem_type) == 0) {
+        return FALSE;
+    }
+    dbus_message_iter_recurse(iter, &sub);
+    a->data = NULL;
+    dbus_message_iter_get_fixed_array(&sub, &a->data, &n);
+    a->len = n;
+    a->borrowed = TRUE;
+    return TRUE;
+}
+
+/* Like _rpc_handler, but for an osso_rpc_borrowed_cb_f: the arguments
+ * point into the message and the first RPC_STACK_ARGS of them are kept
+ * on the stack, so a call with basic arguments allocates nothing. */
+static void _rpc_borrowed_handler(osso_context_t *osso, DBusMessage *msg,
+                                  _osso_callback_data_t *rpc,
+                                  muali_bus_type dbus_type)
+{
+    osso_rpc_t stack_args[RPC_STACK_ARGS];
+    osso_rpc_array_t stack_views[RPC_STACK_ARGS];
+    osso_rpc_t *args = stack_args;
+    guint n_args = 0, size = RPC_STACK_ARGS, i;
+    DBusMessageIter iter;
+    osso_rpc_borrowed_cb_f *handler;
+    osso_rpc_t retval;
+    DBusMessage *saved_msg;
+    gint ret;
+
+    if (dbus_message_iter_init(msg, &iter)) {
+        do {
+            osso_rpc_t *arg;
+
+            if (n_args == size) {
+                /* more arguments than fit on the stack */
+                if (args == stack_args) {
+                    args = g_new(osso_rpc_t, size * 2);
+                    memcpy(args, stack_args, sizeof(stack_args));
+                } else {
+                    args = g_renew(osso_rpc_t, args, size * 2);
+                }
+                size *= 2;
+            }
+            arg = &args[n_args];
+            if (n_args < RPC_STACK_ARGS
+                && dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY
+                && _get_fixed_view(&iter, &stack_views[n_args])) {
+                arg->type = DBUS_TYPE_ARRAY;
+                arg->value.a = &stack_views[n_args];
+            } else {
+                /* the strings are left in the message too */
+                _get_value(&iter, arg, TRUE, TRUE);
+            }
+            ++n_args;
+        } while (dbus_message_iter_next(&iter));
+    }
+
+    handler = rpc->user_cb;
+    retval.type = DBUS_TYPE_INVALID;
+    saved_msg = osso->rpc_msg;
+    osso->rpc_msg = msg;
+    ret = (*handler)(dbus_message_get_interface(msg),
+                     dbus_message_get_member(msg), args, n_args,
+                     rpc->user_data, &retval);
+    osso->rpc_msg = saved_msg;
+
+    for (i = 0; i < n_args; ++i) {
+        if (args[i].type == DBUS_TYPE_ARRAY
+            && (i >= RPC_STACK_ARGS
+                || args[i].value.a != &stack_views[i])) {
+            _free_array(args[i].value.a);
+        } else if (args[i].type == DBUS_TYPE_UNIX_FD) {
+            close(args[i].value.i);
+        }
+    }
+    if (args != stack_args) {
+        g_free(args);
+    }
+
+    _rpc_send_reply(osso, msg, ret, &retval, rpc->data);
+}
+
+/************************************************************************/
+/* Returns the D-Bus signature of the value in sig, or FALSE for
+ * unsupported values. */
+static gboolean _value_signature(const osso_rpc_t *val, char sig[8])
+{
+    if (val->type == DBUS_TYPE_ARRAY) {
+        if (val->value.a->elem_type == DBUS_TYPE_DICT_ENTRY) {
+            strcpy(sig, "a{sv}");
+        } else {
+            sig[0] = DBUS_TYPE_ARRAY;
+            sig[1] = val->value.a->elem_type;
+            sig[2] = '\0';
+        }
+        return TRUE;
+    }
+    switch (val->type) {
+      case DBUS_TYPE_INT32:
+      case DBUS_TYPE_UINT32:
+      case DBUS_TYPE_BOOLEAN:
+      case DBUS_TYPE_DOUBLE:
+      case DBUS_TYPE_STRING:
+      case DBUS_TYPE_UNIX_FD:
+        sig[0] = val->type;
+        sig[1] = '\0';
+        return TRUE;
+      default:
+        return FALSE;
+    }
 }
 
-/************************************************************************/
-static void _append_args(DBusMessage *msg, int type, va_list var_args)
+static void _append_value(DBusMessageIter *iter, const osso_rpc_t *val);
+
+static void _append_array(DBusMessageIter *iter, const osso_rpc_array_t *a)
+{
+    DBusMessageIter sub;
+    char sig[8];
+    guint i;
+
+    if (a->elem_type == DBUS_TYPE_DICT_ENTRY) {
+        const osso_rpc_dict_entry_t *entries = a->data;
+
+        dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}",
+                                         &sub);
+        for (i = 0; i < a->len; ++i) {
+            DBusMessageIter entry, variant;
+            const char *key = entries[i].key != NULL ? entries[i].key : "";
+
+            if (!_value_signature(&entries[i].value, sig)) {
+                ULOG_WARN_F("skipping the unsupported value of '%s'", key);
+                continue;
+            }
+            dbus_message_iter_open_container(&sub, DBUS_TYPE_DICT_ENTRY,
+                                             NULL, &entry);
+            dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+            dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, sig,
+                                             &variant);
+            _append_value(&variant, &entries[i].value);
+            dbus_message_iter_close_container(&entry, &variant);
+            dbus_message_iter_close_container(&sub, &entry);
+        }
+        dbus_message_iter_close_container(iter, &sub);
+    } else if (a->elem_type == DBUS_TYPE_STRING) {
+        const char * const *strs = a->data;
+
+        dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+                                         DBUS_TYPE_STRING_AS_STRING, &sub);
+        for (i = 0; i < a->len; ++i) {
+            const char *str = strs[i] != NULL ? strs[i] : "";
+
+            dbus_message_iter_append_basic(&sub, DBUS_TYPE_STRING, &str);
+        }
+        dbus_message_iter_close_container(iter, &sub);
+    } else if (_fixed_size(a->elem_type) > 0) {
+        sig[0] = a->elem_type;
+        sig[1] = '\0';
+        dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, sig, &sub);
+        dbus_message_iter_append_fixed_array(&sub, a->elem_type, &a->data,
+                                             a->len);
+        dbus_message_iter_close_container(iter, &sub);
+    } else {
+        ULOG_ERR_F("unsupported element type '%c'", a->elem_type);
+    }
+}
+
+static void _append_value(DBusMessageIter *iter, const osso_rpc_t *val)
+{
+    const char *str;
+
+    switch (val->type) {
+      case DBUS_TYPE_INT32:
+      case DBUS_TYPE_UINT32:
+      case DBUS_TYPE_BOOLEAN:
+      case DBUS_TYPE_DOUBLE:
+      case DBUS_TYPE_UNIX_FD:
+        dbus_message_iter_append_basic(iter, val->type, &val->value);
+        break;
+      case DBUS_TYPE_STRING:
+        str = val->value.s != NULL ? val->value.s : "";
+        dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &str);
+        break;
+      case DBUS_TYPE_ARRAY:
+        _append_array(iter, val->value.a);
+        break;
+      default:
+        break;
+    }
+}
+
+static void _append_args(DBusMessage *msg, DBusConnection *conn, int type,
+                         va_list var_args)
 {
     dprint("");
     while(type != DBUS_TYPE_INVALID) {
@@ -808,6 +1780,8 @@ static void _append_args(DBusMessage *msg, int type, va_list var_args)
 	guint32 u;
 	gdouble d;
 	gboolean b;
+	const osso_rpc_array_t *a;
+	const osso_rpc_bulk_t *bulk;
 	
 	switch(type) {
 	  case DBUS_TYPE_INT32:
@@ -836,6 +1810,24 @@ static void _append_args(DBusMessage *msg, int type, va_list var_args)
 	    else
 		dbus_message_append_args(msg, type, &s, DBUS_TYPE_INVALID);
 	    break;
+	  case DBUS_TYPE_ARRAY:
+	    a = va_arg(var_args, osso_rpc_array_t *);
+	    if (a != NULL) {
+	        DBusMessageIter iter;
+
+	        dbus_message_iter_init_append(msg, &iter);
+	        _append_array(&iter, a);
+	    }
+	    break;
+	  case OSSO_RPC_TYPE_BULK:
+	    bulk = va_arg(var_args, const osso_rpc_bulk_t *);
+	    if (bulk != NULL) {
+	        DBusMessageIter iter;
+
+	        dbus_message_iter_init_append(msg, &iter);
+	        _osso_bulk_append(&iter, conn, bulk->data, bulk->len);
+	    }
+	    break;
 	  default:
 	    break;	    
 	}
@@ -883,6 +1875,20 @@ static void _append_arg(DBusMessage *msg, osso_rpc_t *arg)
 	    dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg->value.s,
 				     DBUS_TYPE_INVALID);
 	break;
+      case DBUS_TYPE_ARRAY:
+	dprint("Appending ARRAY of '%c'",arg->value.a->elem_type);
+	{
+	    DBusMessageIter iter;
+
+	    dbus_message_iter_init_append(msg, &iter);
+	    _append_array(&iter, arg->value.a);
+	}
+	break;
+      case DBUS_TYPE_UNIX_FD:
+	dprint("Appending UNIX_FD:%d",arg->value.i);
+	dbus_message_append_args(msg, DBUS_TYPE_UNIX_FD, &arg->value.i,
+				 DBUS_TYPE_INVALID);
+	break;
       default:
 	break;	    
     }
@@ -890,51 +1896,452 @@ static void _append_arg(DBusMessage *msg, osso_rpc_t *arg)
 
 /************************************************************************/
 
-static void _get_arg(DBusMessageIter *iter, osso_rpc_t *retval)
+/* Reads the array at iter. With borrow, the elements are left in the
+ * message. Returns NULL if the elements are of an unsupported type. */
+static osso_rpc_array_t *_get_array(DBusMessageIter *iter, gboolean borrow)
 {
-    char *str;
+    DBusMessageIter sub;
+    osso_rpc_array_t *a;
+    int elem_type;
+
+    elem_type = dbus_message_iter_get_element_type(iter);
+    dbus_message_iter_recurse(iter, &sub);
+
+    a = g_new0(osso_rpc_array_t, 1);
+    a->elem_type = elem_type;
+    a->borrowed = borrow;
+
+    if (_fixed_size(elem_type) > 0) {
+        gconstpointer data = NULL;
+        int n = 0;
+
+        dbus_message_iter_get_fixed_array(&sub, &data, &n);
+        a->len = n;
+        if (borrow) {
+            a->data = data;
+        } else if (n > 0) {
+            gpointer copy = g_malloc(n * _fixed_size(elem_type));
+
+            memcpy(copy, data, n * _fixed_size(elem_type));
+            a->data = copy;
+        }
+    } else if (elem_type == DBUS_TYPE_STRING) {
+        GPtrArray *strs = g_ptr_array_new();
+
+        while (dbus_message_iter_get_arg_type(&sub) == DBUS_TYPE_STRING) {
+            char *str;
+
+            dbus_message_iter_get_basic(&sub, &str);
+            g_ptr_array_add(strs, borrow ? str : g_strdup(str));
+            dbus_message_iter_next(&sub);
+        }
+        a->len = strs->len;
+        a->data = g_ptr_array_free(strs, FALSE);
+    } else if (elem_type == DBUS_TYPE_DICT_ENTRY) {
+        GArray *entries = g_array_new(FALSE, FALSE,
+                                      sizeof(osso_rpc_dict_entry_t));
+
+        while (dbus_message_iter_get_arg_type(&sub)
+               == DBUS_TYPE_DICT_ENTRY) {
+            DBusMessageIter entry, variant;
+            osso_rpc_dict_entry_t e;
+            char *key;
+
+            /* only string keys and variant values, i.e. a{sv} */
+            dbus_message_iter_recurse(&sub, &entry);
+            if (dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_STRING) {
+                break;
+            }
+            dbus_message_iter_get_basic(&entry, &key);
+            dbus_message_iter_next(&entry);
+            if (dbus_message_iter_get_arg_type(&entry)
+                != DBUS_TYPE_VARIANT) {
+                break;
+            }
+            dbus_message_iter_recurse(&entry, &variant);
+
+            e.key = borrow ? key : g_strdup(key);
+            _get_value(&variant, &e.value, borrow, TRUE);
+            g_array_append_val(entries, e);
+            dbus_message_iter_next(&sub);
+        }
+        a->len = entries->len;
+        a->data = g_array_free(entries, FALSE);
+    } else {
+        g_free(a);
+        return NULL;
+    }
+    return a;
+}
 
-    dprint("");
+/* Reads the value at iter. The strings inside arrays are borrowed with
+ * borrow; a plain string is always copied, because osso_rpc_free_val
+ * frees it. */
+static void _get_value(DBusMessageIter *iter, osso_rpc_t *val,
+                       gboolean borrow, gboolean nested)
+{
+    char *str;
 
-    retval->type = dbus_message_iter_get_arg_type(iter);
-    dprint("before switch");
-    switch(retval->type) {
+    val->type = dbus_message_iter_get_arg_type(iter);
+    switch(val->type) {
       case DBUS_TYPE_INT32:
-        dprint("DBUS_TYPE_INT32");
-	dbus_message_iter_get_basic (iter, &retval->value.i);
-	dprint("got INT32:%d",retval->value.i);
+	dbus_message_iter_get_basic (iter, &val->value.i);
+	dprint("got INT32:%d",val->value.i);
 	break;
       case DBUS_TYPE_UINT32:
-	dbus_message_iter_get_basic (iter, &retval->value.u);
-	dprint("got UINT32:%u",retval->value.u);
+	dbus_message_iter_get_basic (iter, &val->value.u);
+	dprint("got UINT32:%u",val->value.u);
 	break;
       case DBUS_TYPE_BOOLEAN:
-	dbus_message_iter_get_basic (iter, &retval->value.b);
-	dprint("got BOOLEAN:%s",retval->value.s?"TRUE":"FALSE");
+	dbus_message_iter_get_basic (iter, &val->value.b);
+	dprint("got BOOLEAN:%s",val->value.b?"TRUE":"FALSE");
 	break;
       case DBUS_TYPE_DOUBLE:
-	dbus_message_iter_get_basic (iter, &retval->value.d);
-	dprint("got DOUBLE:%f",retval->value.d);
+	dbus_message_iter_get_basic (iter, &val->value.d);
+	dprint("got DOUBLE:%f",val->value.d);
 	break;
       case DBUS_TYPE_STRING:
-        dprint("DBUS_TYPE_STRING");
 	dbus_message_iter_get_basic (iter, &str);
-	retval->value.s = g_strdup (str);
-	if(retval->value.s == NULL) {
-	    retval->type = DBUS_TYPE_INVALID;
-	    retval->value.i = 0;	    
+	val->value.s = (borrow && nested) ? str : g_strdup (str);
+	if(val->value.s == NULL) {
+	    val->type = DBUS_TYPE_INVALID;
+	    val->value.i = 0;	    
+	}
+	dprint("got STRING:'%s'",val->value.s);
+	break;
+      case DBUS_TYPE_ARRAY:
+	val->value.a = _get_array(iter, borrow);
+	if (val->value.a == NULL) {
+	    dprint("got unsupported array");
+	    val->type = DBUS_TYPE_INVALID;
+	    val->value.i = 0;
 	}
-	dprint("got STRING:'%s'",retval->value.s);
+	break;
+      case DBUS_TYPE_UNIX_FD:
+	dbus_message_iter_get_basic (iter, &val->value.i);
+	dprint("got UNIX_FD:%d",val->value.i);
 	break;
       default:
-	retval->type = DBUS_TYPE_INVALID;
-	retval->value.i = 0;	    
-	dprint("got unknown type:'%c'(%d)",retval->type,retval->type);
+	dprint("got unknown type:'%c'(%d)",val->type,val->type);
+	val->type = DBUS_TYPE_INVALID;
+	val->value.i = 0;	    
 	break;	
     }
 }
 
+/* Reads the argument at iter. With borrow, the elements of arrays are
+ * views into the message, which must then outlive retval. */
+static void _get_arg(DBusMessageIter *iter, osso_rpc_t *retval,
+                     gboolean borrow)
+{
+    dprint("");
+    _get_value(iter, retval, borrow, FALSE);
+}
+
 /***********************************************************************/
+/************************************************************************/
+
+osso_rpc_batch_t *osso_rpc_batch_new(osso_context_t *osso)
+{
+    osso_rpc_batch_t *batch;
+
+    if (osso == NULL || osso->conn == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return NULL;
+    }
+
+    batch = calloc(1, sizeof(osso_rpc_batch_t));
+    if (batch == NULL) {
+        ULOG_ERR_F("calloc failed");
+        return NULL;
+    }
+    batch->osso = osso;
+    batch->calls = g_ptr_array_new();
+    return batch;
+}
+
+osso_return_t osso_rpc_batch_add_with_argfill(osso_rpc_batch_t *batch,
+                                              const gchar *service,
+                                              const gchar *object_path,
+                                              const gchar *interface,
+                                              const gchar *method,
+                                              osso_rpc_argfill *argfill,
+                                              gpointer argfill_data)
+{
+    _osso_rpc_batch_call_t *call;
+
+    if (batch == NULL || batch->sent || service == NULL ||
+        object_path == NULL || interface == NULL || method == NULL ||
+        argfill == NULL) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    call = calloc(1, sizeof(_osso_rpc_batch_call_t));
+    if (call == NULL) {
+        ULOG_ERR_F("calloc failed");
+        return OSSO_ERROR;
+    }
+
+    dprint("New method: %s:%s:%s:%s",service,object_path,interface,method);
+    call->msg = dbus_message_new_method_call(service, object_path,
+                                             interface, method);
+    if (call->msg == NULL) {
+        ULOG_ERR_F("dbus_message_new_method_call failed");
+        free(call);
+        return OSSO_ERROR;
+    }
+    dbus_message_set_auto_start(call->msg, TRUE);
+    argfill(call->msg, argfill_data);
+
+    call->batch = batch;
+    call->index = batch->calls->len;
+    g_ptr_array_add(batch->calls, call);
+    return OSSO_OK;
+}
+
+osso_return_t osso_rpc_batch_add(osso_rpc_batch_t *batch,
+                                 const gchar *service,
+                                 const gchar *object_path,
+                                 const gchar *interface,
+                                 const gchar *method,
+                                 int argument_type, ...)
+{
+    fill_from_va_list_data argfill_data;
+    osso_return_t ret;
+
+    argfill_data.argument_type = argument_type;
+    argfill_data.conn = batch != NULL ? batch->osso->conn : NULL;
+    va_start(argfill_data.arg_list, argument_type);
+
+    ret = osso_rpc_batch_add_with_argfill(batch, service, object_path,
+                                          interface, method,
+                                          fill_from_va_list, &argfill_data);
+    va_end(argfill_data.arg_list);
+
+    return ret;
+}
+
+static void _batch_free(osso_rpc_batch_t *batch)
+{
+    guint i;
+
+    for (i = 0; i < batch->calls->len; ++i) {
+        _osso_rpc_batch_call_t *call = g_ptr_array_index(batch->calls, i);
+
+        if (call->pending != NULL) {
+            dbus_pending_call_cancel(call->pending);
+            dbus_pending_call_unref(call->pending);
+        }
+        if (call->msg != NULL) {
+            dbus_message_unref(call->msg);
+        }
+        if (batch->results != NULL) {
+            osso_rpc_free_val(&batch->results[i].retval);
+        }
+        free(call);
+    }
+    g_ptr_array_free(batch->calls, TRUE);
+    free(batch->results);
+    free(batch);
+}
+
+void osso_rpc_batch_free(osso_rpc_batch_t *batch)
+{
+    if (batch == NULL) {
+        return;
+    }
+    if (batch->in_callback) {
+        /* freed when the callback returns */
+        batch->freed = TRUE;
+        return;
+    }
+    _batch_free(batch);
+}
+
+static void _batch_set_error(osso_rpc_batch_result_t *result,
+                             osso_return_t status, const char *message)
+{
+    result->status = status;
+    result->retval.type = DBUS_TYPE_STRING;
+    result->retval.value.s = g_strdup(message);
+}
+
+static void _batch_return_handler(DBusPendingCall *pending, void *data)
+{
+    _osso_rpc_batch_call_t *call = data;
+    osso_rpc_batch_t *batch = call->batch;
+    osso_rpc_batch_result_t *result = &batch->results[call->index];
+    DBusMessage *msg;
+
+    msg = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(call->pending);
+    call->pending = NULL;
+
+    if (msg == NULL) {
+        _batch_set_error(result, OSSO_RPC_ERROR, "No reply");
+    } else if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+        DBusMessageIter iter;
+
+        dbus_message_iter_init(msg, &iter);
+        _get_arg(&iter, &result->retval, FALSE);
+        result->status = OSSO_OK;
+    } else {
+        DBusError err;
+
+        dbus_error_init(&err);
+        dbus_set_error_from_message(&err, msg);
+        _batch_set_error(result, OSSO_RPC_ERROR,
+                         err.message != NULL ? err.message : "Error reply");
+        dbus_error_free(&err);
+    }
+    if (msg != NULL) {
+        dbus_message_unref(msg);
+    }
+
+    if (--batch->outstanding == 0 && batch->func != NULL) {
+        batch->in_callback = TRUE;
+        (batch->func)(batch, batch->results, batch->calls->len,
+                      batch->data);
+        batch->in_callback = FALSE;
+        if (batch->freed) {
+            _batch_free(batch);
+        }
+    }
+}
+
+/* Sends all the calls of the batch and flushes the connection once.
+ * Returns the number of calls sent. */
+static guint _batch_send(osso_rpc_batch_t *batch, gint timeout)
+{
+    osso_context_t *osso = batch->osso;
+    GHashTable *services;
+    guint i;
+
+    batch->sent = TRUE;
+    batch->results = calloc(batch->calls->len,
+                            sizeof(osso_rpc_batch_result_t));
+    if (batch->results == NULL) {
+        ULOG_ERR_F("calloc failed");
+        return 0;
+    }
+
+    _osso_match_flush(osso);
+
+    /* the keys are copied, because the messages are freed in the loop */
+    services = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                     NULL);
+    for (i = 0; i < batch->calls->len; ++i) {
+        _osso_rpc_batch_call_t *call = g_ptr_array_index(batch->calls, i);
+        const char *service = dbus_message_get_destination(call->msg);
+
+        if (!dbus_connection_send_with_reply(osso->conn, call->msg,
+                                             &call->pending, timeout)
+            || call->pending == NULL) {
+            ULOG_ERR_F("dbus_connection_send_with_reply failed");
+            _batch_set_error(&batch->results[i], OSSO_ERROR,
+                             "Could not send the message");
+            call->pending = NULL;
+        } else {
+            batch->results[i].status = OSSO_RPC_PENDING;
+            batch->results[i].retval.type = DBUS_TYPE_INVALID;
+            dbus_pending_call_set_notify(call->pending,
+                                         _batch_return_handler, call,
+                                         NULL);
+            ++batch->outstanding;
+            if (g_hash_table_lookup(services, service) == NULL) {
+                g_hash_table_insert(services, g_strdup(service),
+                                    GINT_TO_POINTER(TRUE));
+                startup_notify(osso, service);
+            }
+        }
+        dbus_message_unref(call->msg);
+        call->msg = NULL;
+    }
+    g_hash_table_destroy(services);
+
+    _osso_flush(osso, osso->conn);
+    return batch->outstanding;
+}
+
+osso_return_t osso_rpc_batch_send(osso_rpc_batch_t *batch,
+                                  osso_rpc_batch_f *batch_cb,
+                                  gpointer data)
+{
+    if (batch == NULL || batch->sent || batch->calls->len == 0) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    batch->func = batch_cb;
+    batch->data = data;
+    if (_batch_send(batch, batch->osso->rpc_timeout) == 0) {
+        return OSSO_ERROR;
+    }
+    return OSSO_OK;
+}
+
+osso_return_t osso_rpc_batch_wait(osso_rpc_batch_t *batch, gint timeout)
+{
+    osso_return_t ret = OSSO_OK;
+    guint i;
+
+    if (batch == NULL || batch->sent || batch->calls->len == 0) {
+        ULOG_ERR_F("invalid arguments");
+        return OSSO_INVALID;
+    }
+
+    if (timeout < 0) {
+        timeout = batch->osso->rpc_timeout;
+    }
+
+    /* every call is sent now with the same timeout, so blocking on them
+     * one after the other takes at most the timeout in total */
+    _batch_send(batch, timeout);
+    if (batch->results == NULL) {
+        return OSSO_ERROR;
+    }
+
+    for (i = 0; i < batch->calls->len; ++i) {
+        _osso_rpc_batch_call_t *call = g_ptr_array_index(batch->calls, i);
+
+        if (call->pending != NULL) {
+            /* completes the call and runs _batch_return_handler, which
+             * drops the reference of the call */
+            DBusPendingCall *pending = dbus_pending_call_ref(call->pending);
+
+            dbus_pending_call_block(pending);
+            dbus_pending_call_unref(pending);
+        }
+    }
+
+    for (i = 0; i < batch->calls->len; ++i) {
+        if (batch->results[i].status == OSSO_ERROR) {
+            ret = OSSO_ERROR;
+        } else if (batch->results[i].status != OSSO_OK && ret == OSSO_OK) {
+            ret = OSSO_RPC_ERROR;
+        }
+    }
+    return ret;
+}
+
+const osso_rpc_batch_result_t *
+osso_rpc_batch_get_results(osso_rpc_batch_t *batch, guint *n_results)
+{
+    if (batch == NULL || batch->results == NULL) {
+        if (n_results != NULL) {
+            *n_results = 0;
+        }
+        return NULL;
+    }
+    if (n_results != NULL) {
+        *n_results = batch->calls->len;
+    }
+    return batch->results;
+}
+
+/************************************************************************/
+
 static void _async_return_handler(DBusPendingCall *pending, void *data)
 {
     DBusMessage *msg;
@@ -955,7 +2362,8 @@ static void _async_return_handler(DBusPendingCall *pending, void *data)
 	dprint("message return");
 	dbus_message_iter_init(msg, &iter);
 
-	_get_arg(&iter, &retval);
+	/* retval is freed before the message */
+	_get_arg(&iter, &retval, TRUE);
 	dprint("message return");
 	(rpc->func)(rpc->interface, rpc->method, &retval,
 			  rpc->data);
@@ -1091,7 +2499,7 @@ static void muali_reply_handler(osso_context_t *osso,
         info.event_type = muali_convert_msgtype(msgtype);
 
         if (dbus_message_iter_init(msg, &iter)) {
-                info.args = _get_muali_args(&iter);
+                info.args = _get_muali_args(osso, &iter);
                 if (info.args != NULL && msgtype == DBUS_MESSAGE_TYPE_ERROR
                     && info.args[0].type == MUALI_TYPE_STRING) {
                         info.error = info.args[0].value.s;
@@ -1104,7 +2512,7 @@ static void muali_reply_handler(osso_context_t *osso,
         (*cb)((muali_context_t*)osso, &info, cb_data->user_data);
 
         if (info.args != NULL) {
-                free(info.args);
+                _free_muali_args(osso, info.args);
                 info.args = NULL;
         }
 }
@@ -1233,6 +2641,8 @@ muali_error_t muali_send_signal(muali_context_t *context,
                 }
         }
 
+        _osso_match_flush((osso_context_t*)context);
+
         if (!dbus_connection_send(conn, msg, NULL)) {
                 ULOG_ERR_F("dbus_connection_send failed");
                 dbus_message_unref(msg);
@@ -1243,7 +2653,8 @@ muali_error_t muali_send_signal(muali_context_t *context,
         return MUALI_ERROR_SUCCESS;
 }
 
-static muali_error_t _muali_append_args(DBusMessage *msg, int type,
+static muali_error_t _muali_append_args(DBusMessage *msg,
+                                        DBusConnection *conn, int type,
                                         va_list var_args)
 {
         muali_error_t rc = MUALI_ERROR_SUCCESS;
@@ -1307,6 +2718,17 @@ static muali_error_t _muali_append_args(DBusMessage *msg, int type,
                                   &s, i, DBUS_TYPE_INVALID);
                         if (!ret) rc = MUALI_ERROR;
                         break;
+                case MUALI_TYPE_BULK:
+                        i = va_arg(var_args, int); /* length of the data */
+                        s = va_arg(var_args, char *);
+                        {
+                                DBusMessageIter iter;
+
+                                dbus_message_iter_init_append(msg, &iter);
+                                ret = _osso_bulk_append(&iter, conn, s, i);
+                        }
+                        if (!ret) rc = MUALI_ERROR;
+                        break;
                 default:
                         ULOG_ERR_F("unknown type %d", type);
                         rc = MUALI_ERROR_INVALID;
@@ -1317,6 +2739,15 @@ static muali_error_t _muali_append_args(DBusMessage *msg, int type,
         return rc;
 }
 
+static
+muali_error_t _muali_send_msg(muali_context_t *context,
+                              muali_handler_t *reply_handler,
+                              const void *user_data,
+                              muali_bus_type bus_type,
+                              DBusConnection *conn,
+                              DBusMessage *msg,
+                              int arg_type, va_list va_args);
+
 static
 muali_error_t _muali_send_helper(muali_context_t *context,
                                  muali_handler_t *reply_handler,
@@ -1326,13 +2757,9 @@ muali_error_t _muali_send_helper(muali_context_t *context,
                                  const char *message_name,
                                  int arg_type, va_list va_args)
 {
-        char service[MAX_SVC_LEN + 1], path[MAX_OP_LEN + 1],
-             interface[MAX_IF_LEN + 1];
-        _osso_callback_data_t *cb_data;
+        const _osso_default_names_t *names;
         DBusMessage *msg;
         DBusConnection *conn;
-        unsigned int msg_serial = 0;
-	int handler_id;
 
         if (context == NULL) {
                 return MUALI_ERROR_INVALID;
@@ -1367,20 +2794,39 @@ muali_error_t _muali_send_helper(muali_context_t *context,
                 return MUALI_ERROR_INVALID;
         }
 
-        make_default_service(destination, service);
-        make_default_object_path(destination, path);
-        make_default_interface(destination, interface);
+        names = _osso_default_names((osso_context_t*)context, destination);
+        if (names == NULL) {
+	        return MUALI_ERROR_OOM;
+        }
 
-        msg = dbus_message_new_method_call(service, path, interface,
-                                           message_name);
+        msg = dbus_message_new_method_call(names->service, names->path,
+                                           names->interface, message_name);
         if (msg == NULL) {
                 ULOG_ERR_F("dbus_message_new_method_call failed");
-	        goto _muali_send_oom;
+	        return MUALI_ERROR_OOM;
         }
 
+        return _muali_send_msg(context, reply_handler, user_data, bus_type,
+                               conn, msg, arg_type, va_args);
+}
+
+/* Appends the arguments to the method call, which has none yet, and
+ * sends it. The message is unreferenced. */
+static
+muali_error_t _muali_send_msg(muali_context_t *context,
+                              muali_handler_t *reply_handler,
+                              const void *user_data,
+                              muali_bus_type bus_type,
+                              DBusConnection *conn,
+                              DBusMessage *msg,
+                              int arg_type, va_list va_args)
+{
+        _osso_callback_data_t *cb_data;
+        dbus_uint32_t msg_serial = 0;
+
         if (arg_type != MUALI_TYPE_INVALID) {
                 muali_error_t rc;
-                rc = _muali_append_args(msg, arg_type, va_args);
+                rc = _muali_append_args(msg, conn, arg_type, va_args);
                 if (rc != MUALI_ERROR_SUCCESS) {
                         dbus_message_unref(msg);
                         return rc;
@@ -1391,6 +2837,8 @@ muali_error_t _muali_send_helper(muali_context_t *context,
                 dbus_message_set_no_reply(msg, TRUE);
         }
 
+        _osso_match_flush((osso_context_t*)context);
+
         if (!dbus_connection_send(conn, msg, &msg_serial)) {
                 ULOG_ERR_F("dbus_connection_send failed");
                 dbus_message_unref(msg);
@@ -1419,21 +2867,20 @@ muali_error_t _muali_send_helper(muali_context_t *context,
         cb_data->bus_type = bus_type;
         cb_data->data = context;
 
+        /* the reply is looked up by its serial only */
         cb_data->service = NULL;
-        cb_data->path = MUALI_PATH_MATCH_ALL;
+        cb_data->path = NULL;
         cb_data->interface = NULL;
-        cb_data->name = MUALI_MEMBER_MATCH_ALL;
+        cb_data->name = NULL;
 
-        /* (muali_filter removes the handler, otherwise this would need
-         * to be saved somewhere) */
-        handler_id = context->next_handler_id++;
-
-        if (_muali_set_handler((_muali_context_t*)context,
-                               muali_reply_handler, cb_data, handler_id,
-                               FALSE)) {
+        /* (muali_filter removes the handler when the reply or error
+         * arrives) */
+        if (_muali_set_reply_handler((_muali_context_t*)context,
+                                     muali_reply_handler, cb_data,
+                                     bus_type, msg_serial)) {
                 return MUALI_ERROR_SUCCESS;
         } else {
-                ULOG_ERR_F("_muali_set_handler failed");
+                ULOG_ERR_F("_muali_set_reply_handler failed");
                 free(cb_data);
                 return MUALI_ERROR;
         }
@@ -1462,6 +2909,97 @@ muali_error_t muali_send_varargs(muali_context_t *context,
         return rc;
 }
 
+struct _muali_template_t {
+        muali_context_t *context;
+        muali_bus_type bus_type;
+        DBusMessage *msg;       /* the method call without arguments */
+};
+
+muali_template_t *muali_template_new(muali_context_t *context,
+                                     muali_bus_type bus_type,
+                                     const char *destination,
+                                     const char *message_name)
+{
+        char service[MAX_SVC_LEN + 1], path[MAX_OP_LEN + 1],
+             interface[MAX_IF_LEN + 1];
+        muali_template_t *tmpl;
+
+        if (context == NULL || destination == NULL || message_name == NULL
+            || (bus_type != MUALI_BUS_SESSION
+                && bus_type != MUALI_BUS_SYSTEM)) {
+                ULOG_ERR_F("invalid arguments");
+                return NULL;
+        }
+
+        tmpl = calloc(1, sizeof(muali_template_t));
+        if (tmpl == NULL) {
+                ULOG_ERR_F("calloc failed");
+                return NULL;
+        }
+
+        /* the names are made and validated here once, the sends copy
+         * the header */
+        make_default_service(destination, service);
+        make_default_object_path(destination, path);
+        make_default_interface(destination, interface);
+        tmpl->msg = dbus_message_new_method_call(service, path, interface,
+                                                 message_name);
+        if (tmpl->msg == NULL) {
+                ULOG_ERR_F("dbus_message_new_method_call failed");
+                free(tmpl);
+                return NULL;
+        }
+        tmpl->context = context;
+        tmpl->bus_type = bus_type;
+        return tmpl;
+}
+
+muali_error_t muali_send_template(const muali_template_t *tmpl,
+                                  muali_handler_t *reply_handler,
+                                  const void *user_data,
+                                  int arg_type, ...)
+{
+        DBusConnection *conn;
+        DBusMessage *msg;
+        va_list va_args;
+        muali_error_t rc;
+
+        if (tmpl == NULL) {
+                return MUALI_ERROR_INVALID;
+        }
+
+        if (tmpl->bus_type == MUALI_BUS_SESSION) {
+                conn = tmpl->context->conn;
+        } else {
+                conn = tmpl->context->sys_conn;
+        }
+        if (!dbus_connection_get_is_connected(conn)) {
+                ULOG_ERR_F("connection %p is not open", conn);
+                return MUALI_ERROR_INVALID;
+        }
+
+        msg = dbus_message_copy(tmpl->msg);
+        if (msg == NULL) {
+                ULOG_ERR_F("dbus_message_copy failed");
+                return MUALI_ERROR_OOM;
+        }
+
+        va_start(va_args, arg_type);
+        rc = _muali_send_msg(tmpl->context, reply_handler, user_data,
+                             tmpl->bus_type, conn, msg, arg_type, va_args);
+        va_end(va_args);
+        return rc;
+}
+
+void muali_template_free(muali_template_t *tmpl)
+{
+        if (tmpl == NULL) {
+                return;
+        }
+        dbus_message_unref(tmpl->msg);
+        free(tmpl);
+}
+
 muali_error_t muali_send_string(muali_context_t *context,
                                 muali_handler_t *reply_handler,
                                 const void *user_data,
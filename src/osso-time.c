@@ -50,13 +50,12 @@ osso_return_t osso_time_set_notification_cb(osso_context_t *osso,
                                             gpointer data) 
 {
   _osso_callback_data_t *ot;
-  DBusError error;
 
   if (osso == NULL || cb == NULL) {
       ULOG_ERR_F("invalid arguments");
       return OSSO_INVALID;
   }
-  if (osso->sys_conn == NULL) {
+  if (_osso_get_sys_conn(osso) == NULL) {
       ULOG_ERR_F("no D-Bus system bus connection");
       return OSSO_INVALID;
   }
@@ -67,11 +66,7 @@ osso_return_t osso_time_set_notification_cb(osso_context_t *osso,
       return OSSO_ERROR;
   }
 
-  dbus_error_init(&error);
-  dbus_bus_add_match(osso->sys_conn, MATCH_RULE, &error);
-  if (dbus_error_is_set(&error)) {
-      ULOG_ERR_F("dbus_bus_add_match() failed: %s", error.message);
-      dbus_error_free(&error);
+  if (!_osso_match_add(osso, osso->sys_conn, MATCH_RULE)) {
       free(ot);
       return OSSO_ERROR;
   }
@@ -80,11 +75,12 @@ osso_return_t osso_time_set_notification_cb(osso_context_t *osso,
   ot->user_data = data;
   ot->data = CHANGED_SIG_NAME;
 
-  _msg_handler_set_cb_f_free_data(osso,
-                                  NULL,
-                                  TIME_PATH,
-                                  TIME_INTERFACE,
-                                  _time_handler, ot, FALSE);
+  _msg_handler_set_member_cb_f_free_data(osso,
+                                         NULL,
+                                         TIME_PATH,
+                                         TIME_INTERFACE,
+                                         CHANGED_SIG_NAME,
+                                         _time_handler, ot, FALSE);
   return OSSO_OK;
 }
 
@@ -96,7 +92,7 @@ osso_return_t osso_time_set(osso_context_t *osso, time_t new_time)
   dbus_bool_t ret = FALSE;
 
   if (_validate_time(new_time) == FALSE || osso == NULL
-      || osso->sys_conn == NULL) {
+      || _osso_get_sys_conn(osso) == NULL) {
       ULOG_ERR_F("invalid arguments");
       return OSSO_INVALID;
   }
@@ -116,6 +112,9 @@ osso_return_t osso_time_set(osso_context_t *osso, time_t new_time)
       return OSSO_ERROR;
   }
 
+  /* so that our own notification callback sees the change */
+  _osso_match_flush(osso);
+
   ret = dbus_connection_send(osso->sys_conn, m, NULL);
   if (!ret) {
       ULOG_ERR_F("dbus_connection_send failed");
@@ -0,0 +1,99 @@
+/**
+ * @file osso-rpc-gen-check.c
+ * This file is run by make check. It is built with the code that
+ * osso-rpc-gen generates from osso-rpc-gen-sample.xml, whose argument
+ * names clash with the names in the generated functions, and checks that
+ * the client stubs and the registration reject invalid arguments.
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2006 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include "sample-rpc.h"
+
+#define CHECK_SERVICE "com.nokia.osso_rpc_gen_check"
+#define CHECK_OBJECT  "/com/nokia/osso_rpc_gen_check"
+
+static gint echo(const sample_skeleton_t *self, const gchar *interface_,
+                 gint32 method_, guint32 args_, gdouble n_args_,
+                 gboolean data_, const gchar *self_, gchar **retval_)
+{
+    *retval_ = g_strdup(interface_);
+    return OSSO_OK;
+}
+
+static gint get_count(const sample_skeleton_t *self, gint32 *ret_)
+{
+    *ret_ = 0;
+    return OSSO_OK;
+}
+
+static gint ping(const sample_skeleton_t *self)
+{
+    return OSSO_OK;
+}
+
+static gint notify(const sample_skeleton_t *self, const gchar *default_,
+                   guint32 arg1)
+{
+    return OSSO_OK;
+}
+
+/* the generated types must match the functions */
+static const sample_skeleton_t skeleton = {
+    echo, get_count, ping, notify
+};
+
+int main(int argc, char *argv[])
+{
+    gchar *s = NULL;
+    gint32 n;
+    int failed = 0;
+
+    if (sample_echo(NULL, CHECK_SERVICE, CHECK_OBJECT, "interface", 1, 2,
+                    3.0, TRUE, "self", &s) != OSSO_INVALID || s != NULL) {
+        fprintf(stderr, "sample_echo accepted a NULL context\n");
+        ++failed;
+    }
+    if (sample_get_count(NULL, CHECK_SERVICE, CHECK_OBJECT, &n)
+        != OSSO_INVALID) {
+        fprintf(stderr, "sample_get_count accepted a NULL context\n");
+        ++failed;
+    }
+    if (sample_get_count(NULL, CHECK_SERVICE, CHECK_OBJECT, NULL)
+        != OSSO_INVALID) {
+        fprintf(stderr, "sample_get_count accepted a NULL out argument\n");
+        ++failed;
+    }
+    if (sample_ping(NULL, CHECK_SERVICE, CHECK_OBJECT) != OSSO_INVALID) {
+        fprintf(stderr, "sample_ping accepted a NULL context\n");
+        ++failed;
+    }
+    if (sample_notify(NULL, CHECK_SERVICE, CHECK_OBJECT, NULL, 1)
+        != OSSO_INVALID) {
+        fprintf(stderr, "sample_notify accepted a NULL context\n");
+        ++failed;
+    }
+    if (sample_register(NULL, CHECK_SERVICE, CHECK_OBJECT, &skeleton)
+        != OSSO_INVALID) {
+        fprintf(stderr, "sample_register accepted a NULL context\n");
+        ++failed;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,608 @@
+/**
+ * @file osso-rpc-gen.c
+ * This file implements osso-rpc-gen, which generates typed client stubs
+ * and server skeletons for the libosso RPC functions from D-Bus
+ * introspection XML.
+ *
+ * The client stubs fill the method call with osso_rpc_run_with_argfill
+ * and the server skeletons are osso_rpc_borrowed_cb_f callbacks, so that
+ * the arguments are neither described with type tags at run time nor
+ * collected in a GArray. Each argument is appended or checked by code
+ * written for its type, and the application functions have C types, so
+ * a wrong argument is a compile error.
+ *
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2006 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#define NO_REPLY_ANNOTATION "org.freedesktop.DBus.Method.NoReply"
+
+#define USAGE \
+    "Usage: osso-rpc-gen [--interface=NAME] PREFIX FILE.xml OUTPUT\n" \
+    "Writes OUTPUT.h and OUTPUT.c with the client stubs and the server\n" \
+    "skeleton of the interface NAME (by default the first one) in\n" \
+    "FILE.xml. The generated names start with PREFIX.\n"
+
+/* the D-Bus types that an osso_rpc_t can hold */
+typedef struct {
+    char code;              /* D-Bus type code */
+    const char *in_type;    /* C type of an in argument */
+    const char *out_type;   /* C type of an out argument */
+    const char *fill_type;  /* C type given to dbus_message_iter */
+    const char *dbus_type;  /* DBUS_TYPE_* */
+    const char *member;     /* member of osso_rpc_t.value */
+} type_t;
+
+static const type_t types[] = {
+    {'b', "gboolean", "gboolean", "dbus_bool_t", "DBUS_TYPE_BOOLEAN", "b"},
+    {'i', "gint32", "gint32", "dbus_int32_t", "DBUS_TYPE_INT32", "i"},
+    {'u', "guint32", "guint32", "dbus_uint32_t", "DBUS_TYPE_UINT32", "u"},
+    {'d', "gdouble", "gdouble", "double", "DBUS_TYPE_DOUBLE", "d"},
+    {'s', "const gchar *", "gchar *", "const char *", "DBUS_TYPE_STRING",
+     "s"},
+    {0, NULL, NULL, NULL, NULL, NULL}
+};
+
+typedef struct {
+    gchar *name;            /* C name */
+    const type_t *type;
+} arg_t;
+
+typedef struct {
+    gchar *name;            /* D-Bus name */
+    gchar *c_name;
+    GPtrArray *in;          /* arg_t */
+    arg_t *out;             /* NULL if the method returns nothing */
+    gboolean no_reply;
+} method_t;
+
+typedef struct {
+    const gchar *wanted;    /* interface to generate, or NULL */
+    gchar *interface;       /* the interface found */
+    gboolean in_interface;
+    gboolean done;          /* the interface has been read */
+    method_t *method;       /* method being read */
+    GPtrArray *methods;     /* method_t */
+} parser_t;
+
+/* Converts a D-Bus name like GetFooBar to get_foo_bar. */
+static gchar *c_name(const gchar *name)
+{
+    GString *s = g_string_new(NULL);
+    const gchar *p;
+
+    for (p = name; *p != '\0'; ++p) {
+        if (g_ascii_isupper(*p) && p != name
+            && (g_ascii_islower(p[-1]) || g_ascii_isdigit(p[-1])
+                || (g_ascii_isupper(p[-1]) && g_ascii_islower(p[1])))) {
+            g_string_append_c(s, '_');
+        }
+        if (g_ascii_isalnum(*p)) {
+            g_string_append_c(s, g_ascii_tolower(*p));
+        } else {
+            g_string_append_c(s, '_');
+        }
+    }
+    return g_string_free(s, FALSE);
+}
+
+/* Returns a C name for an argument that does not clash with the other
+ * parameters and the locals of the generated functions, nor with a C
+ * keyword. */
+static gchar *arg_name(const gchar *name, guint index)
+{
+    static const char *reserved[] = {
+        /* client stubs */
+        "osso", "service", "object_path", "ret", "retval", "a", "msg",
+        "iter", "raw",
+        /* skeleton and dispatch function */
+        "self", "interface", "method", "args", "n_args", "data",
+        /* C keywords */
+        "auto", "break", "case", "char", "const", "continue", "default",
+        "do", "double", "else", "enum", "extern", "float", "for", "goto",
+        "if", "inline", "int", "long", "register", "restrict", "return",
+        "short", "signed", "sizeof", "static", "struct", "switch",
+        "typedef", "union", "unsigned", "void", "volatile", "while", NULL
+    };
+    gchar *s;
+    int i;
+
+    if (name == NULL || *name == '\0' || g_ascii_isdigit(*name)) {
+        return g_strdup_printf("arg%u", index);
+    }
+    s = c_name(name);
+    for (i = 0; reserved[i] != NULL; ++i) {
+        if (strcmp(s, reserved[i]) == 0) {
+            gchar *t = g_strconcat(s, "_", NULL);
+
+            g_free(s);
+            return t;
+        }
+    }
+    return s;
+}
+
+static const type_t *find_type(const gchar *signature)
+{
+    int i;
+
+    if (signature == NULL || strlen(signature) != 1) {
+        return NULL;
+    }
+    for (i = 0; types[i].code != 0; ++i) {
+        if (types[i].code == *signature) {
+            return &types[i];
+        }
+    }
+    return NULL;
+}
+
+static const gchar *attribute(const gchar **names, const gchar **values,
+                              const gchar *name)
+{
+    int i;
+
+    for (i = 0; names[i] != NULL; ++i) {
+        if (strcmp(names[i], name) == 0) {
+            return values[i];
+        }
+    }
+    return NULL;
+}
+
+static void start_element(GMarkupParseContext *context,
+                          const gchar *element, const gchar **names,
+                          const gchar **values, gpointer data,
+                          GError **error)
+{
+    parser_t *p = data;
+    const gchar *name = attribute(names, values, "name");
+
+    if (strcmp(element, "interface") == 0) {
+        if (!p->done && name != NULL
+            && (p->wanted == NULL || strcmp(name, p->wanted) == 0)) {
+            p->interface = g_strdup(name);
+            p->in_interface = TRUE;
+        }
+    } else if (!p->in_interface) {
+        return;
+    } else if (strcmp(element, "method") == 0) {
+        if (name == NULL) {
+            g_set_error(error, G_MARKUP_ERROR,
+                        G_MARKUP_ERROR_MISSING_ATTRIBUTE,
+                        "a method has no name");
+            return;
+        }
+        p->method = g_new0(method_t, 1);
+        p->method->name = g_strdup(name);
+        p->method->c_name = c_name(name);
+        p->method->in = g_ptr_array_new();
+        g_ptr_array_add(p->methods, p->method);
+    } else if (strcmp(element, "arg") == 0 && p->method != NULL) {
+        const gchar *type = attribute(names, values, "type");
+        const gchar *direction = attribute(names, values, "direction");
+        arg_t *arg;
+
+        arg = g_new0(arg_t, 1);
+        arg->type = find_type(type);
+        if (arg->type == NULL) {
+            g_set_error(error, G_MARKUP_ERROR,
+                        G_MARKUP_ERROR_INVALID_CONTENT,
+                        "%s: the type '%s' is not supported",
+                        p->method->name, type != NULL ? type : "");
+            g_free(arg);
+            return;
+        }
+        if (direction != NULL && strcmp(direction, "out") == 0) {
+            if (p->method->out != NULL) {
+                g_set_error(error, G_MARKUP_ERROR,
+                            G_MARKUP_ERROR_INVALID_CONTENT,
+                            "%s: only one out argument is supported",
+                            p->method->name);
+                g_free(arg);
+                return;
+            }
+            arg->name = arg_name(name, 0);
+            p->method->out = arg;
+        } else {
+            arg->name = arg_name(name, p->method->in->len);
+            g_ptr_array_add(p->method->in, arg);
+        }
+    } else if (strcmp(element, "annotation") == 0 && p->method != NULL) {
+        const gchar *value = attribute(names, values, "value");
+
+        if (name != NULL && strcmp(name, NO_REPLY_ANNOTATION) == 0
+            && value != NULL && strcmp(value, "true") == 0) {
+            p->method->no_reply = TRUE;
+        }
+    }
+}
+
+static void end_element(GMarkupParseContext *context, const gchar *element,
+                        gpointer data, GError **error)
+{
+    parser_t *p = data;
+
+    if (!p->in_interface) {
+        return;
+    }
+    if (strcmp(element, "interface") == 0) {
+        p->in_interface = FALSE;
+        p->done = TRUE;
+    } else if (strcmp(element, "method") == 0) {
+        if (p->method->no_reply && p->method->out != NULL) {
+            g_set_error(error, G_MARKUP_ERROR,
+                        G_MARKUP_ERROR_INVALID_CONTENT,
+                        "%s: a method without a reply has an out argument",
+                        p->method->name);
+        }
+        p->method = NULL;
+    }
+}
+
+/************************************************************************/
+
+/* the parameters of the client stub or of the skeleton function */
+static void write_params(FILE *f, const method_t *m)
+{
+    guint i;
+
+    for (i = 0; i < m->in->len; ++i) {
+        const arg_t *arg = g_ptr_array_index(m->in, i);
+
+        fprintf(f, ",\n        %s%s%s", arg->type->in_type,
+                arg->type->code == 's' ? "" : " ", arg->name);
+    }
+    if (m->out != NULL) {
+        fprintf(f, ",\n        %s%s*%s", m->out->type->out_type,
+                m->out->type->code == 's' ? "" : " ", m->out->name);
+    }
+}
+
+static void write_header(FILE *f, const gchar *prefix, const gchar *guard,
+                         const gchar *source, const parser_t *p)
+{
+    gchar *upper = g_ascii_strup(prefix, -1);
+    guint i;
+
+    fprintf(f, "/* Generated by osso-rpc-gen from %s, do not edit. */\n\n"
+            "#ifndef %s\n#define %s\n\n#include <libosso.h>\n\n"
+            "G_BEGIN_DECLS\n\n#define %s_INTERFACE \"%s\"\n\n",
+            source, guard, guard, upper, p->interface);
+
+    fprintf(f, "/* Client stubs. The string returned in an out argument "
+            "is freed with g_free. */\n\n");
+    for (i = 0; i < p->methods->len; ++i) {
+        const method_t *m = g_ptr_array_index(p->methods, i);
+
+        fprintf(f, "osso_return_t %s_%s(osso_context_t *osso,\n"
+                "        const gchar *service,\n"
+                "        const gchar *object_path", prefix, m->c_name);
+        write_params(f, m);
+        fprintf(f, ");\n\n");
+    }
+
+    fprintf(f, "/* Server skeleton. A function returns OSSO_OK, OSSO_ERROR "
+            "or\n * OSSO_RPC_PENDING like an osso_rpc_cb_f, and a string "
+            "that it\n * returns is freed with g_free. self can be the "
+            "first member of a\n * larger structure. */\n\n"
+            "typedef struct _%s_skeleton_t %s_skeleton_t;\n\n"
+            "struct _%s_skeleton_t {\n", prefix, prefix, prefix);
+    for (i = 0; i < p->methods->len; ++i) {
+        const method_t *m = g_ptr_array_index(p->methods, i);
+
+        fprintf(f, "    gint (*%s)(const %s_skeleton_t *self", m->c_name,
+                prefix);
+        write_params(f, m);
+        fprintf(f, ");\n");
+    }
+    fprintf(f, "};\n\n"
+            "osso_return_t %s_register(osso_context_t *osso,\n"
+            "        const gchar *service,\n"
+            "        const gchar *object_path,\n"
+            "        const %s_skeleton_t *self);\n\n"
+            "osso_return_t %s_unregister(osso_context_t *osso,\n"
+            "        const gchar *service,\n"
+            "        const gchar *object_path,\n"
+            "        const %s_skeleton_t *self);\n\n"
+            "G_END_DECLS\n\n#endif /* %s */\n",
+            prefix, prefix, prefix, prefix, guard);
+    g_free(upper);
+}
+
+static void write_client(FILE *f, const gchar *prefix, const gchar *upper,
+                         const method_t *m)
+{
+    guint i;
+
+    /* the arguments are passed to the argfill function in a struct */
+    if (m->in->len > 0) {
+        fprintf(f, "typedef struct {\n");
+        for (i = 0; i < m->in->len; ++i) {
+            const arg_t *arg = g_ptr_array_index(m->in, i);
+
+            fprintf(f, "    %s%s%s;\n", arg->type->fill_type,
+                    arg->type->code == 's' ? "" : " ", arg->name);
+        }
+        fprintf(f, "} %s_%s_args_t;\n\n", prefix, m->c_name);
+    }
+
+    fprintf(f, "static void %s_%s_fill(DBusMessage *msg, void *raw)\n{\n",
+            prefix, m->c_name);
+    if (m->in->len > 0) {
+        fprintf(f, "    const %s_%s_args_t *a = raw;\n"
+                "    DBusMessageIter iter;\n\n"
+                "    dbus_message_iter_init_append(msg, &iter);\n",
+                prefix, m->c_name);
+        for (i = 0; i < m->in->len; ++i) {
+            const arg_t *arg = g_ptr_array_index(m->in, i);
+
+            fprintf(f, "    dbus_message_iter_append_basic(&iter, %s, "
+                    "&a->%s);\n", arg->type->dbus_type, arg->name);
+        }
+    }
+    fprintf(f, "}\n\n");
+
+    fprintf(f, "osso_return_t %s_%s(osso_context_t *osso,\n"
+            "        const gchar *service,\n"
+            "        const gchar *object_path", prefix, m->c_name);
+    write_params(f, m);
+    fprintf(f, ")\n{\n");
+    if (m->in->len > 0) {
+        fprintf(f, "    %s_%s_args_t a;\n", prefix, m->c_name);
+    }
+    if (!m->no_reply) {
+        fprintf(f, "    osso_rpc_t retval;\n");
+    }
+    fprintf(f, "    osso_return_t ret;\n\n");
+    if (!m->no_reply) {
+        /* it is not set if the arguments are invalid */
+        fprintf(f, "    retval.type = DBUS_TYPE_INVALID;\n");
+    }
+
+    for (i = 0; i < m->in->len; ++i) {
+        const arg_t *arg = g_ptr_array_index(m->in, i);
+
+        if (arg->type->code == 's') {
+            fprintf(f, "    a.%s = %s != NULL ? %s : \"\";\n", arg->name,
+                    arg->name, arg->name);
+        } else {
+            fprintf(f, "    a.%s = %s;\n", arg->name, arg->name);
+        }
+    }
+    if (m->out != NULL) {
+        fprintf(f, "    if (%s == NULL) {\n"
+                "        return OSSO_INVALID;\n    }\n", m->out->name);
+    }
+
+    fprintf(f, "    ret = osso_rpc_run_with_argfill(osso, service, "
+            "object_path,\n"
+            "            %s_INTERFACE, \"%s\", %s,\n"
+            "            %s_%s_fill, %s);\n",
+            upper, m->name, m->no_reply ? "NULL" : "&retval", prefix,
+            m->c_name, m->in->len > 0 ? "&a" : "NULL");
+    if (m->no_reply) {
+        fprintf(f, "    return ret;\n}\n\n");
+        return;
+    }
+
+    if (m->out == NULL) {
+        fprintf(f, "    osso_rpc_free_val(&retval);\n    return ret;\n"
+                "}\n\n");
+        return;
+    }
+    fprintf(f, "    if (ret != OSSO_OK) {\n"
+            "        osso_rpc_free_val(&retval);\n"
+            "        return ret;\n    }\n"
+            "    if (retval.type != %s) {\n"
+            "        osso_rpc_free_val(&retval);\n"
+            "        return OSSO_RPC_ERROR;\n    }\n"
+            "    *%s = retval.value.%s;\n"
+            "    return OSSO_OK;\n}\n\n",
+            m->out->type->dbus_type, m->out->name, m->out->type->member);
+}
+
+static void write_dispatch(FILE *f, const gchar *prefix, const method_t *m)
+{
+    guint i;
+
+    fprintf(f, "    if (strcmp(method, \"%s\") == 0) {\n", m->name);
+    if (m->out != NULL) {
+        fprintf(f, "        %s%s%s = %s;\n", m->out->type->out_type,
+                m->out->type->code == 's' ? "" : " ", m->out->name,
+                m->out->type->code == 's' ? "NULL"
+                : m->out->type->code == 'b' ? "FALSE" : "0");
+    }
+    fprintf(f, "        gint ret;\n\n");
+
+    fprintf(f, "        if (self->%s == NULL || n_args != %u", m->c_name,
+            m->in->len);
+    for (i = 0; i < m->in->len; ++i) {
+        const arg_t *arg = g_ptr_array_index(m->in, i);
+
+        fprintf(f, "\n            || args[%u].type != %s", i,
+                arg->type->dbus_type);
+    }
+    fprintf(f, ") {\n"
+            "            return %s_error(retval, \"invalid arguments\");\n"
+            "        }\n", prefix);
+
+    fprintf(f, "        ret = self->%s(self", m->c_name);
+    for (i = 0; i < m->in->len; ++i) {
+        const arg_t *arg = g_ptr_array_index(m->in, i);
+
+        fprintf(f, ", args[%u].value.%s", i, arg->type->member);
+    }
+    if (m->out != NULL) {
+        fprintf(f, ", &%s", m->out->name);
+    }
+    fprintf(f, ");\n");
+
+    if (m->out != NULL) {
+        fprintf(f, "        if (ret == OSSO_OK) {\n"
+                "            retval->type = %s;\n"
+                "            retval->value.%s = %s;\n"
+                "            return OSSO_OK;\n        }\n",
+                m->out->type->dbus_type, m->out->type->member,
+                m->out->name);
+        if (m->out->type->code == 's') {
+            fprintf(f, "        g_free(%s);\n", m->out->name);
+        }
+    }
+    fprintf(f, "        if (ret == OSSO_ERROR) {\n"
+            "            return %s_error(retval, \"%s failed\");\n"
+            "        }\n"
+            "        return ret;\n    }\n", prefix, m->name);
+}
+
+static void write_source(FILE *f, const gchar *prefix, const gchar *header,
+                         const gchar *source, const parser_t *p)
+{
+    gchar *upper = g_ascii_strup(prefix, -1);
+    guint i;
+
+    fprintf(f, "/* Generated by osso-rpc-gen from %s, do not edit. */\n\n"
+            "#include <string.h>\n#include \"%s\"\n\n", source, header);
+
+    for (i = 0; i < p->methods->len; ++i) {
+        write_client(f, prefix, upper, g_ptr_array_index(p->methods, i));
+    }
+
+    fprintf(f, "static gint %s_error(osso_rpc_t *retval, const gchar "
+            "*message)\n{\n"
+            "    retval->type = DBUS_TYPE_STRING;\n"
+            "    retval->value.s = g_strdup(message);\n"
+            "    return OSSO_ERROR;\n}\n\n", prefix);
+
+    fprintf(f, "static gint %s_dispatch(const gchar *interface, "
+            "const gchar *method,\n"
+            "        const osso_rpc_t *args, guint n_args, gpointer data,\n"
+            "        osso_rpc_t *retval)\n{\n"
+            "    const %s_skeleton_t *self = data;\n\n"
+            "    retval->type = DBUS_TYPE_INVALID;\n", prefix, prefix);
+    for (i = 0; i < p->methods->len; ++i) {
+        write_dispatch(f, prefix, g_ptr_array_index(p->methods, i));
+    }
+    fprintf(f, "    return %s_error(retval, \"unknown method\");\n}\n\n",
+            prefix);
+
+    fprintf(f, "osso_return_t %s_register(osso_context_t *osso,\n"
+            "        const gchar *service,\n"
+            "        const gchar *object_path,\n"
+            "        const %s_skeleton_t *self)\n{\n"
+            "    return osso_rpc_set_borrowed_cb_f(osso, service, "
+            "object_path,\n"
+            "            %s_INTERFACE, %s_dispatch, (gpointer)self,\n"
+            "            osso_rpc_free_val);\n}\n\n"
+            "osso_return_t %s_unregister(osso_context_t *osso,\n"
+            "        const gchar *service,\n"
+            "        const gchar *object_path,\n"
+            "        const %s_skeleton_t *self)\n{\n"
+            "    return osso_rpc_unset_borrowed_cb_f(osso, service, "
+            "object_path,\n"
+            "            %s_INTERFACE, %s_dispatch, (gpointer)self);\n}\n",
+            prefix, prefix, upper, prefix, prefix, prefix, upper, prefix);
+    g_free(upper);
+}
+
+static gboolean write_file(const gchar *path, const gchar *prefix,
+                           const gchar *header, const gchar *guard,
+                           const gchar *source, const parser_t *p,
+                           gboolean is_header)
+{
+    FILE *f;
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return FALSE;
+    }
+    if (is_header) {
+        write_header(f, prefix, guard, source, p);
+    } else {
+        write_source(f, prefix, header, source, p);
+    }
+    if (fclose(f) != 0) {
+        perror(path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    GMarkupParser callbacks = { start_element, end_element, NULL, NULL,
+                                NULL };
+    GMarkupParseContext *context;
+    GError *error = NULL;
+    parser_t p;
+    gchar *xml, *header, *source, *base, *guard;
+    gsize len;
+    const gchar *prefix, *input, *output;
+    int i = 1;
+    gboolean ok;
+
+    memset(&p, 0, sizeof(p));
+    if (argc > 1 && strncmp(argv[1], "--interface=", 12) == 0) {
+        p.wanted = argv[1] + 12;
+        ++i;
+    }
+    if (argc - i != 3) {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+    prefix = argv[i];
+    input = argv[i + 1];
+    output = argv[i + 2];
+
+    if (!g_file_get_contents(input, &xml, &len, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        return 1;
+    }
+
+    p.methods = g_ptr_array_new();
+    context = g_markup_parse_context_new(&callbacks, 0, &p, NULL);
+    ok = g_markup_parse_context_parse(context, xml, len, &error)
+         && g_markup_parse_context_end_parse(context, &error);
+    g_markup_parse_context_free(context);
+    g_free(xml);
+    if (!ok) {
+        fprintf(stderr, "%s: %s\n", input, error->message);
+        return 1;
+    }
+    if (p.interface == NULL) {
+        fprintf(stderr, "%s: interface %s not found\n", input,
+                p.wanted != NULL ? p.wanted : "");
+        return 1;
+    }
+
+    header = g_strconcat(output, ".h", NULL);
+    source = g_strconcat(output, ".c", NULL);
+    base = g_path_get_basename(header);
+    guard = g_strcanon(g_ascii_strup(base, -1),
+                       "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789", '_');
+
+    ok = write_file(header, prefix, base, guard, input, &p, TRUE)
+         && write_file(source, prefix, base, guard, input, &p, FALSE);
+    return ok ? 0 : 1;
+}
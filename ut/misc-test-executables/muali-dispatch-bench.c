@@ -0,0 +1,120 @@
+/* Measures how many signals per second the muali dispatcher delivers
+ * with 10, 100 and 1000 handlers registered on the session bus, and how
+ * long setting and unsetting the handlers takes.
+ *
+ * Build against the libosso to be measured, e.g.:
+ *   gcc -o muali-dispatch-bench muali-dispatch-bench.c \
+ *       `pkg-config --cflags --libs libosso`
+ * and run it inside a session bus (dbus-launch ./muali-dispatch-bench).
+ * The handlers are typed MUALI_EVENT_SIGNAL handlers, so each of them is
+ * called for every signal; only the first one counts the signals.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libosso.h>
+#include <muali.h>
+
+#define BENCH_NAME "muali_dispatch_bench"
+#define BENCH_PATH "/com/nokia/" BENCH_NAME
+#define BENCH_IF "com.nokia." BENCH_NAME
+#define N_SIGNALS 20000
+
+static GMainLoop *loop;
+static int received;
+
+static int is_bench_signal(const muali_event_info_t *info)
+{
+        return info->name != NULL && strcmp(info->name, "bench") == 0
+               && info->path != NULL && strcmp(info->path, BENCH_PATH) == 0;
+}
+
+static void handler(muali_context_t *context,
+                    const muali_event_info_t *info,
+                    void *user_data)
+{
+        if (is_bench_signal(info) && ++received == N_SIGNALS) {
+                g_main_loop_quit(loop);
+        }
+}
+
+static void dummy_handler(muali_context_t *context,
+                          const muali_event_info_t *info,
+                          void *user_data)
+{
+        ++*(int*)user_data;
+}
+
+static int dummy_calls;
+
+static int set_handlers(muali_context_t *context, int n_handlers,
+                        int *ids)
+{
+        int i;
+
+        for (i = 0; i < n_handlers; ++i) {
+                if (muali_set_event_handler(context, MUALI_EVENT_SIGNAL,
+                        i == 0 ? handler : dummy_handler, &dummy_calls,
+                        &ids[i]) != MUALI_ERROR_SUCCESS) {
+                        fprintf(stderr, "could not set handler %d\n", i);
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+static void run(muali_context_t *context, int n_handlers)
+{
+        int *ids, i;
+        GTimer *timer;
+        gdouble secs, set_secs, unset_secs;
+
+        timer = g_timer_new();
+        ids = calloc(n_handlers, sizeof(int));
+        if (ids == NULL || !set_handlers(context, n_handlers, ids)) {
+                exit(1);
+        }
+        set_secs = g_timer_elapsed(timer, NULL);
+
+        received = 0;
+        g_timer_start(timer);
+        for (i = 0; i < N_SIGNALS; ++i) {
+                muali_send_signal(context, MUALI_BUS_SESSION, "bench",
+                                  NULL);
+        }
+        g_main_loop_run(loop);
+        secs = g_timer_elapsed(timer, NULL);
+
+        g_timer_start(timer);
+        for (i = 0; i < n_handlers; ++i) {
+                muali_unset_event_handler(context, ids[i]);
+        }
+        unset_secs = g_timer_elapsed(timer, NULL);
+        g_timer_destroy(timer);
+        free(ids);
+
+        printf("%5d handlers: %d signals in %.3f s, %.0f signals/s, "
+               "set %.3f ms, unset %.3f ms\n",
+               n_handlers, N_SIGNALS, secs, N_SIGNALS / secs,
+               set_secs * 1000, unset_secs * 1000);
+}
+
+int main(int argc, char *argv[])
+{
+        muali_context_t *context;
+
+        loop = g_main_loop_new(NULL, FALSE);
+        context = muali_init(BENCH_NAME, "0.1", NULL);
+        if (context == NULL) {
+                fprintf(stderr, "muali_init failed\n");
+                return 1;
+        }
+
+        run(context, 10);
+        run(context, 100);
+        run(context, 1000);
+
+        return 0;
+}
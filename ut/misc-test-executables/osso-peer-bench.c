@@ -0,0 +1,144 @@
+/* Compares the RPC latency and throughput through the D-Bus daemon with
+ * those of a direct connection (osso_rpc_peer_listen and
+ * osso_rpc_peer_connect). A child process serves the calls.
+ *
+ * Build against the libosso to be measured, e.g.:
+ *   gcc -o osso-peer-bench osso-peer-bench.c \
+ *       `pkg-config --cflags --libs libosso`
+ * and run it inside a session bus:
+ *   dbus-launch ./osso-peer-bench [calls]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <libosso.h>
+
+#define SERVER_NAME "osso_peer_bench"
+#define CLIENT_NAME "osso_peer_bench_client"
+#define BENCH_SERVICE "com.nokia."SERVER_NAME
+#define BENCH_OBJECT  "/com/nokia/"SERVER_NAME
+#define BENCH_IFACE   "com.nokia."SERVER_NAME
+#define N_CALLS 10000
+
+static GMainLoop *loop;
+static int replies;
+static int n_calls = N_CALLS;
+
+static gint serve_cb(const gchar *interface, const gchar *method,
+                     GArray *arguments, gpointer data, osso_rpc_t *retval)
+{
+        retval->type = DBUS_TYPE_INT32;
+        retval->value.i = 1;
+        return OSSO_OK;
+}
+
+static void serve(void)
+{
+        osso_context_t *osso;
+
+        loop = g_main_loop_new(NULL, FALSE);
+        osso = osso_initialize(SERVER_NAME, "0.1", FALSE, NULL);
+        if (osso == NULL || osso_rpc_peer_listen(osso) != OSSO_OK) {
+                _exit(1);
+        }
+        osso_rpc_set_cb_f(osso, BENCH_SERVICE, BENCH_OBJECT, BENCH_IFACE,
+                          serve_cb, NULL);
+        g_main_loop_run(loop);
+        _exit(0);
+}
+
+static void reply_cb(const gchar *interface, const gchar *method,
+                     osso_rpc_t *retval, gpointer data)
+{
+        if (++replies == n_calls) {
+                g_main_loop_quit(loop);
+        }
+}
+
+static void run(osso_context_t *osso, const char *label)
+{
+        osso_rpc_t retval;
+        GTimer *timer;
+        gdouble secs;
+        int i;
+
+        /* latency: one call at a time */
+        timer = g_timer_new();
+        for (i = 0; i < n_calls; ++i) {
+                if (osso_rpc_run(osso, BENCH_SERVICE, BENCH_OBJECT,
+                                 BENCH_IFACE, "ping", &retval,
+                                 DBUS_TYPE_INVALID) != OSSO_OK) {
+                        fprintf(stderr, "%s: call %d failed\n", label, i);
+                        exit(1);
+                }
+                osso_rpc_free_val(&retval);
+        }
+        secs = g_timer_elapsed(timer, NULL);
+        printf("%-4s sync:  mean %7.1f us per call\n", label,
+               secs * 1000000 / n_calls);
+
+        /* throughput: all calls at once */
+        replies = 0;
+        g_timer_start(timer);
+        for (i = 0; i < n_calls; ++i) {
+                osso_rpc_async_run(osso, BENCH_SERVICE, BENCH_OBJECT,
+                                   BENCH_IFACE, "ping", reply_cb, NULL,
+                                   DBUS_TYPE_INVALID);
+        }
+        g_main_loop_run(loop);
+        secs = g_timer_elapsed(timer, NULL);
+        g_timer_destroy(timer);
+        printf("%-4s async: %7.0f calls/s\n", label, n_calls / secs);
+}
+
+int main(int argc, char *argv[])
+{
+        osso_context_t *osso;
+        osso_rpc_t retval;
+        pid_t pid;
+
+        if (argc > 1) {
+                n_calls = atoi(argv[1]);
+        }
+
+        pid = fork();
+        if (pid < 0) {
+                perror("fork");
+                return 1;
+        }
+        if (pid == 0) {
+                serve();
+        }
+
+        loop = g_main_loop_new(NULL, FALSE);
+        osso = osso_initialize(CLIENT_NAME, "0.1", FALSE, NULL);
+        if (osso == NULL) {
+                fprintf(stderr, "could not initialize libosso\n");
+                return 1;
+        }
+        /* wait for the server */
+        while (osso_rpc_run(osso, BENCH_SERVICE, BENCH_OBJECT, BENCH_IFACE,
+                            "ping", &retval, DBUS_TYPE_INVALID) != OSSO_OK) {
+                osso_rpc_free_val(&retval);
+                usleep(10000);
+        }
+        osso_rpc_free_val(&retval);
+
+        run(osso, "bus");
+        if (osso_rpc_peer_connect(osso, BENCH_SERVICE) != OSSO_OK) {
+                fprintf(stderr, "could not connect to the server\n");
+                return 1;
+        }
+        run(osso, "p2p");
+
+        osso_deinitialize(osso);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return 0;
+}
@@ -0,0 +1,100 @@
+/* Measures how long osso_initialize_with_flags takes with the system bus
+ * connected eagerly (OSSO_INIT_DEFAULT) and lazily
+ * (OSSO_INIT_LAZY_SYSTEM_BUS).
+ *
+ * Build against the libosso to be measured, e.g.:
+ *   gcc -o osso-startup-bench osso-startup-bench.c \
+ *       `pkg-config --cflags --libs libosso`
+ * and run it against a local dbus-daemon, for example one that serves as
+ * both the session and the system bus:
+ *   eval `dbus-launch --sh-syntax`
+ *   DBUS_SYSTEM_BUS_ADDRESS=$DBUS_SESSION_BUS_ADDRESS ./osso-startup-bench
+ * D-Bus connections are shared within a process, so every measurement is
+ * made in a new child process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <libosso.h>
+
+#define BENCH_NAME "osso_startup_bench"
+#define N_ROUNDS 50
+
+/* runs in the child, returns the time in microseconds or -1 */
+static long measure_once(osso_init_flags_t flags)
+{
+        osso_context_t *osso;
+        GTimer *timer;
+        long usecs;
+
+        timer = g_timer_new();
+        osso = osso_initialize_with_flags(BENCH_NAME, "0.1", flags, NULL);
+        usecs = (long)(g_timer_elapsed(timer, NULL) * 1000000);
+        g_timer_destroy(timer);
+
+        if (osso == NULL) {
+                return -1;
+        }
+        osso_deinitialize(osso);
+        return usecs;
+}
+
+static int compare_long(const void *a, const void *b)
+{
+        long x = *(const long*)a, y = *(const long*)b;
+        return x < y ? -1 : x > y;
+}
+
+static void run(const char *label, osso_init_flags_t flags)
+{
+        long results[N_ROUNDS], sum = 0;
+        int i;
+
+        for (i = 0; i < N_ROUNDS; ++i) {
+                int fds[2];
+                pid_t pid;
+
+                if (pipe(fds) != 0) {
+                        perror("pipe");
+                        exit(1);
+                }
+                pid = fork();
+                if (pid < 0) {
+                        perror("fork");
+                        exit(1);
+                }
+                if (pid == 0) {
+                        long usecs = measure_once(flags);
+
+                        write(fds[1], &usecs, sizeof(usecs));
+                        _exit(0);
+                }
+                close(fds[1]);
+                if (read(fds[0], &results[i], sizeof(results[i]))
+                    != sizeof(results[i]) || results[i] < 0) {
+                        fprintf(stderr, "%s: initialization failed\n",
+                                label);
+                        exit(1);
+                }
+                close(fds[0]);
+                waitpid(pid, NULL, 0);
+                sum += results[i];
+        }
+
+        qsort(results, N_ROUNDS, sizeof(results[0]), compare_long);
+        printf("%-6s mean %6ld us, median %6ld us, min %6ld us, "
+               "max %6ld us\n", label, sum / N_ROUNDS,
+               results[N_ROUNDS / 2], results[0], results[N_ROUNDS - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+        run("eager", OSSO_INIT_DEFAULT);
+        run("lazy", OSSO_INIT_LAZY_SYSTEM_BUS);
+        return 0;
+}
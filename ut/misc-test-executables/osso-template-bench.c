@@ -0,0 +1,164 @@
+/* Measures what a prepared method call saves on each send. First only
+ * the message is built, with dbus_message_new_method_call and with
+ * dbus_message_copy of a template, then whole sends are timed with
+ * osso_rpc_run against osso_rpc_template_run and with muali_send_varargs
+ * against muali_send_template. The calls are sent to this process
+ * without waiting for replies.
+ *
+ * Build against the libosso to be measured, e.g.:
+ *   gcc -o osso-template-bench osso-template-bench.c \
+ *       `pkg-config --cflags --libs libosso`
+ * and run it inside a session bus:
+ *   dbus-launch ./osso-template-bench [sends]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <libosso.h>
+#include <muali.h>
+
+#define BENCH_NAME "osso_template_bench"
+#define BENCH_SERVICE "com.nokia." BENCH_NAME
+#define BENCH_OBJECT "/com/nokia/" BENCH_NAME
+#define BENCH_IFACE "com.nokia." BENCH_NAME
+#define BENCH_METHOD "set_value"
+#define N_SENDS 20000
+
+static int n_sends = N_SENDS;
+
+static void report(const char *label, GTimer *timer)
+{
+        printf("%-28s %7.3f us per send\n", label,
+               g_timer_elapsed(timer, NULL) * 1000000 / n_sends);
+}
+
+static void append(DBusMessage *msg, dbus_int32_t i)
+{
+        const char *s = "key";
+
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &s,
+                                 DBUS_TYPE_INT32, &i, DBUS_TYPE_INVALID);
+}
+
+static void build_only(void)
+{
+        DBusMessage *tmpl, *msg;
+        GTimer *timer;
+        int i;
+
+        timer = g_timer_new();
+        for (i = 0; i < n_sends; ++i) {
+                msg = dbus_message_new_method_call(BENCH_SERVICE,
+                                                   BENCH_OBJECT, BENCH_IFACE,
+                                                   BENCH_METHOD);
+                append(msg, i);
+                dbus_message_unref(msg);
+        }
+        report("build: new_method_call", timer);
+
+        tmpl = dbus_message_new_method_call(BENCH_SERVICE, BENCH_OBJECT,
+                                            BENCH_IFACE, BENCH_METHOD);
+        g_timer_start(timer);
+        for (i = 0; i < n_sends; ++i) {
+                msg = dbus_message_copy(tmpl);
+                append(msg, i);
+                dbus_message_unref(msg);
+        }
+        report("build: copy of template", timer);
+        dbus_message_unref(tmpl);
+        g_timer_destroy(timer);
+}
+
+static void drain(void)
+{
+        while (g_main_context_iteration(NULL, FALSE))
+                ;
+}
+
+static void send_osso(osso_context_t *osso)
+{
+        osso_rpc_template_t *tmpl;
+        const char *s = "key";
+        GTimer *timer;
+        int i;
+
+        timer = g_timer_new();
+        for (i = 0; i < n_sends; ++i) {
+                osso_rpc_run(osso, BENCH_SERVICE, BENCH_OBJECT, BENCH_IFACE,
+                             BENCH_METHOD, NULL, DBUS_TYPE_STRING, s,
+                             DBUS_TYPE_INT32, i, DBUS_TYPE_INVALID);
+        }
+        report("osso_rpc_run", timer);
+        drain();
+
+        tmpl = osso_rpc_template_new(osso, BENCH_SERVICE, BENCH_OBJECT,
+                                     BENCH_IFACE, BENCH_METHOD, FALSE);
+        g_timer_start(timer);
+        for (i = 0; i < n_sends; ++i) {
+                osso_rpc_template_run(tmpl, NULL, DBUS_TYPE_STRING, s,
+                                      DBUS_TYPE_INT32, i, DBUS_TYPE_INVALID);
+        }
+        report("osso_rpc_template_run", timer);
+        drain();
+        osso_rpc_template_free(tmpl);
+        g_timer_destroy(timer);
+}
+
+static void send_muali(muali_context_t *muali)
+{
+        muali_template_t *tmpl;
+        GTimer *timer;
+        int i;
+
+        timer = g_timer_new();
+        for (i = 0; i < n_sends; ++i) {
+                muali_send_varargs(muali, NULL, NULL, MUALI_BUS_SESSION,
+                                   BENCH_NAME, BENCH_METHOD,
+                                   MUALI_TYPE_STRING, "key",
+                                   MUALI_TYPE_INT, i, MUALI_TYPE_INVALID);
+        }
+        report("muali_send_varargs", timer);
+        drain();
+
+        tmpl = muali_template_new(muali, MUALI_BUS_SESSION, BENCH_NAME,
+                                  BENCH_METHOD);
+        g_timer_start(timer);
+        for (i = 0; i < n_sends; ++i) {
+                muali_send_template(tmpl, NULL, NULL,
+                                    MUALI_TYPE_STRING, "key",
+                                    MUALI_TYPE_INT, i, MUALI_TYPE_INVALID);
+        }
+        report("muali_send_template", timer);
+        drain();
+        muali_template_free(tmpl);
+        g_timer_destroy(timer);
+}
+
+int main(int argc, char *argv[])
+{
+        osso_context_t *osso;
+        muali_context_t *muali;
+
+        if (argc > 1) {
+                n_sends = atoi(argv[1]);
+        }
+
+        build_only();
+
+        osso = osso_initialize(BENCH_NAME, "0.1", FALSE, NULL);
+        if (osso == NULL) {
+                fprintf(stderr, "could not initialize libosso\n");
+                return 1;
+        }
+        send_osso(osso);
+        osso_deinitialize(osso);
+
+        muali = muali_init(BENCH_NAME, "0.1", NULL);
+        if (muali == NULL) {
+                fprintf(stderr, "could not initialize muali\n");
+                return 1;
+        }
+        send_muali(muali);
+        return 0;
+}
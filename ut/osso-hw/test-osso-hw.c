@@ -25,6 +25,8 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
 
 #include <fcntl.h>
 
@@ -32,6 +34,7 @@
 #include <outo.h>
 
 #include "osso-internal.h"
+#include "osso-hw.h"
 
 void hw_cb(osso_hw_state_t *state, gpointer data);
 
@@ -43,6 +46,15 @@ int test_unset_event_invalid_osso(void);
 int test_unset_event_without_set(void);
 int test_unset_event(void);
 int raising_signal(void);
+int test_state_publish(void);
+int test_state_publisher_killed(void);
+int test_state_publish_private_file(void);
+int test_add_event(void);
+int test_state_snapshot(void);
+int test_set_coalescing(void);
+int test_display_other_path(void);
+int test_deinit_pending_removals(void);
+int test_custom_handler_invalid_rule(void);
 
 testcase *get_tests(void);
 
@@ -259,6 +271,443 @@ int raising_signal(void)
     }
 }
 
+int test_state_publish(void)
+{
+    osso_context_t *osso, *reader;
+    osso_hw_state_t state;
+    osso_display_state_t display;
+    int ret = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VERSION, FALSE, NULL);
+    assert(osso != NULL);
+    reader = osso_initialize("unit_test_reader", APP_VERSION, FALSE, NULL);
+    assert(reader != NULL);
+
+    if (osso_hw_state_read(reader, NULL, NULL) != OSSO_INVALID) {
+        ret = 0;
+    }
+    if (osso_hw_state_publish(osso) != OSSO_OK) {
+        ret = 0;
+    }
+    /* only one publisher at a time */
+    if (osso_hw_state_publish(reader) != OSSO_ERROR) {
+        ret = 0;
+    }
+    if (osso_hw_state_read(reader, &state, &display) != OSSO_OK
+        || state.save_unsaved_data_ind
+        || state.sig_device_mode_ind > OSSO_DEVMODE_INVALID
+        || display > OSSO_DISPLAY_DIMMED) {
+        ret = 0;
+    }
+    osso_deinitialize(osso);
+
+    /* the readers see that the publisher has gone */
+    if (osso_hw_state_read(reader, &state, NULL) != OSSO_ERROR) {
+        ret = 0;
+    }
+    osso_deinitialize(reader);
+    return ret;
+}
+
+int test_state_publisher_killed(void)
+{
+    osso_context_t *reader;
+    osso_hw_state_t state;
+    osso_hw_snapshot_t snapshot;
+    int fds[2], i, ret = 1;
+    char c = 0;
+    pid_t pid;
+
+    assert(pipe(fds) == 0);
+    pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        osso_context_t *osso;
+
+        /* a publisher that dies without clearing the segment */
+        close(fds[0]);
+        osso = osso_initialize("unit_test_publisher", APP_VERSION, FALSE,
+                               NULL);
+        if (osso != NULL && osso_hw_state_publish(osso) == OSSO_OK) {
+            c = 1;
+        }
+        if (write(fds[1], &c, 1) != 1) {
+            _exit(1);
+        }
+        pause();
+        _exit(0);
+    }
+    close(fds[1]);
+    if (read(fds[0], &c, 1) != 1 || c != 1) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return 0;
+    }
+    close(fds[0]);
+
+    reader = osso_initialize("unit_test_reader", APP_VERSION, FALSE, NULL);
+    assert(reader != NULL);
+    if (osso_hw_state_read(reader, &state, NULL) != OSSO_OK
+        || osso_hw_get_state_snapshot(reader, &snapshot) != OSSO_OK
+        || !snapshot.info[OSSO_HW_FIELD_DEVICE_MODE].live
+        || snapshot.info[OSSO_HW_FIELD_DEVICE_MODE].updated == 0) {
+        ret = 0;
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    /* longer than the interval of the publisher checks */
+    sleep(1);
+
+    /* the valid flag is still set, but the lock is gone */
+    if (osso_hw_state_read(reader, &state, NULL) != OSSO_ERROR
+        || reader->hw_segment != NULL) {
+        ret = 0;
+    }
+    if (osso_hw_get_state_snapshot(reader, &snapshot) != OSSO_OK) {
+        ret = 0;
+    }
+    for (i = 0; i < OSSO_HW_N_FIELDS; ++i) {
+        if (snapshot.info[i].live) {
+            ret = 0;
+        }
+    }
+    osso_deinitialize(reader);
+    return ret;
+}
+
+/* the segment file is not used if another user could have planted it */
+int test_state_publish_private_file(void)
+{
+    osso_context_t *osso;
+    char dir[] = "/tmp/test_osso_hw.XXXXXX";
+    char seg[100], target[100], *old_dir;
+    struct stat st;
+    int fd, ret = 1;
+
+    if (mkdtemp(dir) == NULL) {
+        return 0;
+    }
+    old_dir = getenv("XDG_RUNTIME_DIR");
+    if (old_dir != NULL) {
+        old_dir = strdup(old_dir);
+    }
+    snprintf(seg, sizeof(seg), "%s/%s-%d", dir, OSSO_HW_SEGMENT_FILE,
+             geteuid());
+    snprintf(target, sizeof(target), "%s/target", dir);
+    setenv("XDG_RUNTIME_DIR", dir, 1);
+
+    osso = osso_initialize(APP_NAME, APP_VERSION, FALSE, NULL);
+    assert(osso != NULL);
+
+    /* a symbolic link is not followed, the target is not truncated */
+    fd = open(target, O_WRONLY | O_CREAT, 0600);
+    assert(fd != -1);
+    if (write(fd, "data", 4) != 4) {
+        ret = 0;
+    }
+    close(fd);
+    assert(symlink(target, seg) == 0);
+    if (osso_hw_state_publish(osso) != OSSO_ERROR
+        || stat(target, &st) != 0 || st.st_size != 4) {
+        ret = 0;
+    }
+    unlink(seg);
+
+    /* nor is a file that others can write */
+    fd = open(seg, O_WRONLY | O_CREAT, 0600);
+    assert(fd != -1);
+    fchmod(fd, 0666);
+    close(fd);
+    if (osso_hw_state_publish(osso) != OSSO_ERROR) {
+        ret = 0;
+    }
+    unlink(seg);
+
+    /* the publisher creates a private file */
+    if (osso_hw_state_publish(osso) != OSSO_OK
+        || stat(seg, &st) != 0 || (st.st_mode & 0777) != 0600) {
+        ret = 0;
+    }
+    osso_deinitialize(osso);
+
+    unlink(seg);
+    unlink(target);
+    rmdir(dir);
+    if (old_dir != NULL) {
+        setenv("XDG_RUNTIME_DIR", old_dir, 1);
+        free(old_dir);
+    } else {
+        unsetenv("XDG_RUNTIME_DIR");
+    }
+    return ret;
+}
+
+int test_add_event(void)
+{
+    osso_hw_state_t mask = {TRUE,FALSE,FALSE,FALSE,FALSE};
+    osso_hw_state_t state = {TRUE,FALSE,FALSE,FALSE,FALSE};
+    osso_context_t *osso;
+    guint id1, id2;
+    int ret = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VERSION, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_hw_add_event_cb(NULL, NULL, hw_cb, NULL) != 0
+        || osso_hw_add_event_cb(osso, NULL, NULL, NULL) != 0) {
+        ret = 0;
+    }
+
+    /* the callbacks do not replace each other or the one set with
+     * osso_hw_set_event_cb */
+    osso_hw_set_event_cb(osso, &state, hw_cb, NULL);
+    id1 = osso_hw_add_event_cb(osso, &mask, hw_cb, NULL);
+    id2 = osso_hw_add_event_cb(osso, NULL, hw_cb, &ret);
+    if (id1 == 0 || id2 == 0 || id1 == id2
+        || osso->hw_cbs.shutdown_ind.cb != hw_cb
+        || g_slist_length(osso->hw_cbs.shutdown_ind.subscribers) != 2
+        || g_slist_length(osso->hw_cbs.memory_low_ind.subscribers) != 1) {
+        ret = 0;
+    }
+
+    if (osso_hw_remove_event_cb(osso, id1) != OSSO_OK
+        || osso_hw_remove_event_cb(osso, id1) != OSSO_INVALID
+        || g_slist_length(osso->hw_cbs.shutdown_ind.subscribers) != 1) {
+        ret = 0;
+    }
+    /* ids are not reused */
+    if (osso_hw_add_event_cb(osso, &mask, hw_cb, NULL) == id1) {
+        ret = 0;
+    }
+
+    osso_hw_unset_event_cb(osso, NULL);
+    if (!osso->hw_cbs.handlers_set) {
+        /* the added callbacks still need the signals */
+        ret = 0;
+    }
+    osso_deinitialize(osso);
+    return ret;
+}
+
+int test_state_snapshot(void)
+{
+    osso_hw_state_t state = {TRUE,FALSE,TRUE,FALSE,FALSE};
+    osso_hw_snapshot_t snapshot;
+    osso_context_t *osso;
+    int ret = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VERSION, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_hw_get_state_snapshot(NULL, &snapshot) != OSSO_INVALID
+        || osso_hw_get_state_snapshot(osso, NULL) != OSSO_INVALID) {
+        ret = 0;
+    }
+
+    osso_hw_set_event_cb(osso, &state, hw_cb, NULL);
+    if (osso_hw_get_state_snapshot(osso, &snapshot) != OSSO_OK
+        || !snapshot.info[OSSO_HW_FIELD_SHUTDOWN].live
+        || !snapshot.info[OSSO_HW_FIELD_MEMORY_LOW].live
+        || snapshot.info[OSSO_HW_FIELD_MEMORY_LOW].updated == 0
+        || snapshot.info[OSSO_HW_FIELD_INACTIVITY].live
+        || snapshot.info[OSSO_HW_FIELD_DISPLAY].live
+        || snapshot.state.save_unsaved_data_ind) {
+        ret = 0;
+    }
+
+    osso_hw_unset_event_cb(osso, &state);
+    if (osso_hw_get_state_snapshot(osso, &snapshot) != OSSO_OK
+        || snapshot.info[OSSO_HW_FIELD_SHUTDOWN].live) {
+        ret = 0;
+    }
+    osso_deinitialize(osso);
+    return ret;
+}
+
+int test_set_coalescing(void)
+{
+    osso_context_t *osso;
+    int ret = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VERSION, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_hw_set_coalescing(NULL, OSSO_HW_FIELD_DISPLAY,
+                               OSSO_COALESCE_LATEST, 100) != OSSO_INVALID
+        || osso_hw_set_coalescing(osso, OSSO_HW_N_FIELDS,
+                                  OSSO_COALESCE_LATEST, 100) != OSSO_INVALID) {
+        ret = 0;
+    }
+
+    /* nothing is allocated for the default policy */
+    if (osso_hw_set_coalescing(osso, OSSO_HW_FIELD_INACTIVITY,
+                               OSSO_COALESCE_NONE, 0) != OSSO_OK
+        || osso->hw_cbs.coalesce != NULL) {
+        ret = 0;
+    }
+
+    if (osso_hw_set_coalescing(osso, OSSO_HW_FIELD_DISPLAY,
+                               OSSO_COALESCE_LATEST, 100) != OSSO_OK
+        || osso_hw_set_coalescing(osso, OSSO_HW_FIELD_INACTIVITY,
+                                  OSSO_COALESCE_ON_CHANGE, 0) != OSSO_OK
+        || osso->hw_cbs.coalesce == NULL
+        || osso->hw_cbs.coalesce[OSSO_HW_FIELD_DISPLAY].window != 100
+        || osso->hw_cbs.coalesce[OSSO_HW_FIELD_SHUTDOWN].policy
+           != OSSO_COALESCE_NONE) {
+        ret = 0;
+    }
+    osso_deinitialize(osso);
+    return ret;
+}
+
+struct display_count {
+    int calls;
+    osso_display_state_t state;
+};
+
+static void display_cb(osso_display_state_t state, gpointer data)
+{
+    struct display_count *count = data;
+
+    count->calls++;
+    count->state = state;
+}
+
+/* the display signal is dispatched by interface and member, so it is
+ * received on any object path as before */
+int test_display_other_path(void)
+{
+    osso_context_t *osso;
+    struct display_count count = {0, OSSO_DISPLAY_ON};
+    DBusMessage *msg;
+    const char *arg = "dimmed";
+    int i, calls;
+
+    osso = osso_initialize(APP_NAME, APP_VERSION, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_hw_set_display_event_cb(osso, display_cb, &count) != OSSO_OK) {
+        osso_deinitialize(osso);
+        return 0;
+    }
+    /* the match rule is added from the main loop */
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+    calls = count.calls;
+
+    msg = dbus_message_new_signal("/com/nokia/mce/signal/other",
+                                  "com.nokia.mce.signal",
+                                  "display_status_ind");
+    assert(msg != NULL);
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg,
+                             DBUS_TYPE_INVALID);
+    dbus_connection_send(osso->sys_conn, msg, NULL);
+    dbus_message_unref(msg);
+
+    for (i = 0; i < 50 && count.calls == calls; ++i) {
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+        usleep(100000);
+    }
+    osso_deinitialize(osso);
+
+    return count.calls == calls + 1 && count.state == OSSO_DISPLAY_DIMMED;
+}
+
+static void count_log(const gchar *domain, GLogLevelFlags level,
+                      const gchar *message, gpointer data)
+{
+    ++*(int*)data;
+}
+
+/* the match rules removed just before osso_deinitialize are sent
+ * without a GLib critical */
+int test_deinit_pending_removals(void)
+{
+    osso_context_t *osso;
+    GSList *l;
+    guint log_id;
+    int criticals = 0, queued = 0;
+
+    osso = osso_initialize(APP_NAME, APP_VERSION, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_hw_set_event_cb(osso, NULL, hw_cb, NULL) != OSSO_OK) {
+        osso_deinitialize(osso);
+        return 0;
+    }
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+    osso_hw_unset_event_cb(osso, NULL);
+
+    for (l = osso->match_queue; l != NULL; l = l->next) {
+        _osso_match_t *m = l->data;
+
+        if (m->refcount == 0) {
+            queued = 1;
+        }
+    }
+
+    log_id = g_log_set_handler("GLib", G_LOG_LEVEL_CRITICAL
+                               | G_LOG_LEVEL_WARNING, count_log,
+                               &criticals);
+    osso_deinitialize(osso);
+    g_log_remove_handler("GLib", log_id);
+
+    return queued && criticals == 0;
+}
+
+/* the bus daemon's reply to AddMatch is not waited for, so a rule with
+ * bad names is refused right away */
+int test_custom_handler_invalid_rule(void)
+{
+    muali_context_t *muali;
+    muali_event_info_t info;
+    int id = -1, ret = 1;
+
+    muali = muali_init(APP_NAME, APP_VERSION, NULL);
+    assert(muali != NULL);
+
+    memset(&info, 0, sizeof(info));
+    info.bus_type = MUALI_BUS_SESSION;
+    info.path = "no/leading/slash";
+    info.name = "changed";
+    if (muali_set_event_handler_custom(muali, &info,
+                                       (muali_handler_t*)hw_cb, NULL,
+                                       &id) != MUALI_ERROR_INVALID
+        || id != 0) {
+        ret = 0;
+    }
+
+    info.path = "/com/nokia/test";
+    info.interface = "com.nokia.test'";
+    if (muali_set_event_handler_custom(muali, &info,
+                                       (muali_handler_t*)hw_cb, NULL,
+                                       &id) != MUALI_ERROR_INVALID) {
+        ret = 0;
+    }
+
+    info.interface = "com.nokia.test";
+    if (muali_set_event_handler_custom(muali, &info,
+                                       (muali_handler_t*)hw_cb, NULL,
+                                       &id) != MUALI_ERROR_SUCCESS
+        || muali_unset_event_handler(muali, id) != MUALI_ERROR_SUCCESS) {
+        ret = 0;
+    }
+
+    /* the rule of a handler for the system bus only */
+    info.bus_type = MUALI_BUS_SYSTEM;
+    if (muali_set_event_handler_custom(muali, &info,
+                                       (muali_handler_t*)hw_cb, NULL,
+                                       &id) != MUALI_ERROR_SUCCESS
+        || muali_unset_event_handler(muali, id) != MUALI_ERROR_SUCCESS) {
+        ret = 0;
+    }
+    /* there is no deinitialisation for a muali context */
+    return ret;
+}
+
 testcase cases[] = {
     {*test_set_event_invalid_osso,
     "Set event cb invalid osso",
@@ -284,6 +733,33 @@ testcase cases[] = {
     {*raising_signal,
     "Raising a HW signal",
     EXPECT_OK},    
+    {*test_state_publish,
+    "Publish and read the shared device state",
+    EXPECT_OK},
+    {*test_state_publisher_killed,
+    "Stop reading the state of a killed publisher",
+    EXPECT_OK},
+    {*test_state_publish_private_file,
+    "Refuse a device state file that others can write",
+    EXPECT_OK},
+    {*test_add_event,
+    "Add and remove several event cbs",
+    EXPECT_OK},
+    {*test_state_snapshot,
+    "Get a device state snapshot",
+    EXPECT_OK},
+    {*test_set_coalescing,
+    "Set the coalescing of hw signals",
+    EXPECT_OK},
+    {*test_display_other_path,
+    "Display signal on another object path",
+    EXPECT_OK},
+    {*test_deinit_pending_removals,
+    "Deinitialize with match rules being removed",
+    EXPECT_OK},
+    {*test_custom_handler_invalid_rule,
+    "Custom muali handler with invalid names",
+    EXPECT_OK},
     {0}	/* remember the terminating null */
 };
 
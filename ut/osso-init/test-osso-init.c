@@ -41,6 +41,7 @@ int init_daemon_with_null_name( void );
 int init_daemon_with_null_version( void );
 int init_daemon_with_correct_params( void );
 int system_bus_init( void );
+int lazy_system_bus_init( void );
 int init_app( void );
 int deinit_with_invalid_osso( void );
 int deinit( void );
@@ -130,6 +131,26 @@ int system_bus_init( void )
     return 1;
 }
 
+int lazy_system_bus_init( void )
+{
+    osso_context_t *osso;
+    int ok;
+
+    osso = osso_initialize_with_flags(APP_NAME, APP_VER,
+                                      OSSO_INIT_LAZY_SYSTEM_BUS, NULL);
+    if(osso == NULL)
+	return 0;
+
+    /* not connected before it is needed */
+    ok = osso->conn != NULL && osso->sys_conn == NULL;
+    if(ok)
+	ok = osso_get_sys_dbus_connection(osso) != NULL
+	     && osso->sys_conn != NULL;
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
 int init_app( void )
 {
     unsigned int activation_result;
@@ -328,6 +349,9 @@ testcase cases[] = {
     {*system_bus_init,
             "System bus",
             EXPECT_OK},
+    {*lazy_system_bus_init,
+            "Lazy system bus",
+            EXPECT_OK},
     {0} /* remember the terminating null */
 };
 
@@ -0,0 +1,124 @@
+/**
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2009 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Runs osso_mem_saw_enable in a process of its own, so that the test can
+ * start it with and without libosso-saw.so preloaded. The exit code is
+ * MEM_PROG_OK, MEM_PROG_FAILED or MEM_PROG_NOSYS. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "osso-mem.h"
+
+#define MEM_PROG_OK     0
+#define MEM_PROG_FAILED 1
+#define MEM_PROG_NOSYS  2
+
+static int oom_calls;
+
+static void oom_cb(size_t current_sz, size_t max_sz, void *context)
+{
+    ++oom_calls;
+}
+
+/* threshold 0 enables with all the available memory, a threshold above
+ * it can not be honoured */
+static int check_enable(void)
+{
+    int ret;
+
+    ret = osso_mem_saw_enable(0, 0, oom_cb, NULL);
+    if (ret == -ENOSYS) {
+        return MEM_PROG_NOSYS;
+    }
+    if (ret != 0) {
+        fprintf(stderr, "enable(0) returned %d\n", ret);
+        return MEM_PROG_FAILED;
+    }
+    ret = osso_mem_saw_enable(SIZE_MAX, 0, oom_cb, NULL);
+    osso_mem_saw_disable();
+    if (ret != -EINVAL) {
+        fprintf(stderr, "enable(SIZE_MAX) returned %d\n", ret);
+        return MEM_PROG_FAILED;
+    }
+    return MEM_PROG_OK;
+}
+
+/* an allocation bigger than the whole memory must fail through SAW */
+static int check_alloc(void)
+{
+    osso_mem_usage_t usage;
+    size_t size;
+    char *p;
+    int ret;
+
+    if (osso_mem_get_usage(&usage) != 0) {
+        fprintf(stderr, "osso_mem_get_usage failed\n");
+        return MEM_PROG_FAILED;
+    }
+    size = usage.total < SIZE_MAX / 2 ? usage.total + (64 << 20)
+                                      : SIZE_MAX / 2;
+
+    ret = osso_mem_saw_enable(0, 0, oom_cb, NULL);
+    if (ret == -ENOSYS) {
+        return MEM_PROG_NOSYS;
+    }
+    if (ret != 0) {
+        fprintf(stderr, "enable(0) returned %d\n", ret);
+        return MEM_PROG_FAILED;
+    }
+
+    errno = 0;
+    p = malloc(size);
+    if (p != NULL || errno != ENOMEM || oom_calls != 1) {
+        fprintf(stderr, "malloc(%zu) = %p, errno %d, oom calls %d\n",
+                size, (void *)p, errno, oom_calls);
+        free(p);
+        osso_mem_saw_disable();
+        return MEM_PROG_FAILED;
+    }
+
+    /* small allocations still pass */
+    p = malloc(64);
+    osso_mem_saw_disable();
+    if (p == NULL || oom_calls != 1) {
+        fprintf(stderr, "small malloc = %p, oom calls %d\n",
+                (void *)p, oom_calls);
+        free(p);
+        return MEM_PROG_FAILED;
+    }
+    free(p);
+    return MEM_PROG_OK;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "enable") == 0) {
+        return check_enable();
+    }
+    if (argc == 2 && strcmp(argv[1], "alloc") == 0) {
+        return check_alloc();
+    }
+    fprintf(stderr, "usage: %s enable|alloc\n", argv[0]);
+    return MEM_PROG_FAILED;
+}
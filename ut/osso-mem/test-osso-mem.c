@@ -0,0 +1,142 @@
+/**
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2009 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <outo.h>
+
+#include "osso-mem.h"
+
+#define MEM_PROG PREFIX "/lib/outo/ossomembin"
+#define SAW_LIB LIBDIR "/libosso-saw.so.0"
+
+/* exit codes of ossomembin */
+#define MEM_PROG_OK     0
+#define MEM_PROG_FAILED 1
+#define MEM_PROG_NOSYS  2
+
+static int run_prog(const char *mode, int preload);
+
+int test_saw_enable_not_preloaded(void);
+int test_saw_enable_preloaded(void);
+int test_saw_enable_here(void);
+int test_saw_large_alloc(void);
+
+/* runs ossomembin in the given mode and returns its exit code */
+static int run_prog(const char *mode, int preload)
+{
+    pid_t pid;
+    int status;
+
+    pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        if (preload) {
+            setenv("LD_PRELOAD", SAW_LIB, 1);
+        } else {
+            unsetenv("LD_PRELOAD");
+        }
+        execl(MEM_PROG, MEM_PROG, mode, (char *)NULL);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+int test_saw_enable_not_preloaded(void)
+{
+    int ret;
+
+    ret = run_prog("enable", 0);
+    if (ret != MEM_PROG_NOSYS) {
+        printf("expected -ENOSYS, ossomembin exited with %d\n", ret);
+        return 0;
+    }
+    return 1;
+}
+
+int test_saw_enable_preloaded(void)
+{
+    int ret;
+
+    ret = run_prog("enable", 1);
+    if (ret != MEM_PROG_OK) {
+        printf("ossomembin exited with %d\n", ret);
+        return 0;
+    }
+    return 1;
+}
+
+/* the test module itself runs without the interposer */
+int test_saw_enable_here(void)
+{
+    int ret;
+
+    ret = osso_mem_saw_enable(0, 0, NULL, NULL);
+    if (ret != -ENOSYS) {
+        printf("osso_mem_saw_enable returned %d\n", ret);
+        osso_mem_saw_disable();
+        return 0;
+    }
+    /* disabling a SAW that was never enabled is harmless */
+    osso_mem_saw_disable();
+    return 1;
+}
+
+int test_saw_large_alloc(void)
+{
+    int ret;
+
+    ret = run_prog("alloc", 1);
+    if (ret != MEM_PROG_OK) {
+        printf("ossomembin exited with %d\n", ret);
+        return 0;
+    }
+    return 1;
+}
+
+testcase cases[] = {
+    {*test_saw_enable_not_preloaded,
+    "Enable SAW without libosso-saw.so preloaded",
+    EXPECT_OK},
+    {*test_saw_enable_preloaded,
+    "Enable SAW with libosso-saw.so preloaded",
+    EXPECT_OK},
+    {*test_saw_enable_here,
+    "Enable SAW in a process without the interposer",
+    EXPECT_OK},
+    {*test_saw_large_alloc,
+    "Fail an allocation bigger than the memory",
+    EXPECT_OK},
+    {0}	/* remember the terminating null */
+};
+
+testcase *get_tests(void)
+{
+    return cases;
+}
@@ -0,0 +1,176 @@
+/**
+ * This file is part of libosso
+ *
+ * Copyright (C) 2005-2006 Nokia Corporation. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/* Measures how fast an osso_rpc_cb_f answers a burst of method calls with
+ * each of the flush policies. A child process serves the calls and the
+ * parent sends them all at once and waits for the replies. Run it inside
+ * a session bus: dbus-launch ./osso-rpc-burst-bench [calls]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <libosso.h>
+
+#define BENCH_NAME    "osso_rpc_burst_bench"
+#define BENCH_SERVICE "com.nokia."BENCH_NAME
+#define BENCH_OBJECT  "/com/nokia/"BENCH_NAME
+#define BENCH_IFACE   "com.nokia."BENCH_NAME
+#define N_CALLS 10000
+
+static gint cb(const gchar *interface, const gchar *method,
+               GArray *arguments, gpointer data, osso_rpc_t *retval)
+{
+    retval->type = DBUS_TYPE_INT32;
+    retval->value.i = 1;
+    if (strcmp(method, "quit") == 0) {
+        g_main_loop_quit((GMainLoop*)data);
+    }
+    return OSSO_OK;
+}
+
+static void serve(osso_flush_policy_t policy)
+{
+    GMainLoop *loop;
+    osso_context_t *osso;
+
+    loop = g_main_loop_new(NULL, FALSE);
+    osso = osso_initialize(BENCH_NAME, "0.1", FALSE, NULL);
+    if (osso == NULL) {
+        _exit(1);
+    }
+    osso_set_flush_policy(osso, policy);
+    osso_rpc_set_cb_f(osso, BENCH_SERVICE, BENCH_OBJECT, BENCH_IFACE,
+                      cb, loop);
+    g_main_loop_run(loop);
+    osso_deinitialize(osso);
+    _exit(0);
+}
+
+static void send_call(DBusConnection *conn, const char *method)
+{
+    DBusMessage *msg;
+
+    msg = dbus_message_new_method_call(BENCH_SERVICE, BENCH_OBJECT,
+                                       BENCH_IFACE, method);
+    if (msg == NULL || !dbus_connection_send(conn, msg, NULL)) {
+        fprintf(stderr, "could not send '%s'\n", method);
+        exit(1);
+    }
+    dbus_message_unref(msg);
+}
+
+/* waits for the reply, so that it is not counted in the next run */
+static void quit(DBusConnection *conn)
+{
+    DBusMessage *msg, *reply;
+
+    msg = dbus_message_new_method_call(BENCH_SERVICE, BENCH_OBJECT,
+                                       BENCH_IFACE, "quit");
+    if (msg == NULL) {
+        fprintf(stderr, "could not send 'quit'\n");
+        exit(1);
+    }
+    reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, NULL);
+    if (reply != NULL) {
+        dbus_message_unref(reply);
+    }
+    dbus_message_unref(msg);
+}
+
+static void run(DBusConnection *conn, const char *label,
+                osso_flush_policy_t policy, int n_calls)
+{
+    GTimer *timer;
+    gdouble secs;
+    pid_t pid;
+    int i, replies = 0;
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        serve(policy);
+    }
+
+    while (!dbus_bus_name_has_owner(conn, BENCH_SERVICE, NULL)) {
+        usleep(10000);
+    }
+
+    timer = g_timer_new();
+    for (i = 0; i < n_calls; ++i) {
+        send_call(conn, "ping");
+    }
+    dbus_connection_flush(conn);
+
+    while (replies < n_calls && dbus_connection_read_write(conn, -1)) {
+        DBusMessage *msg;
+
+        while ((msg = dbus_connection_pop_message(conn)) != NULL) {
+            if (dbus_message_get_type(msg)
+                == DBUS_MESSAGE_TYPE_METHOD_RETURN) {
+                ++replies;
+            }
+            dbus_message_unref(msg);
+        }
+    }
+    secs = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+
+    quit(conn);
+    waitpid(pid, NULL, 0);
+    /* the next server takes the same name */
+    while (dbus_bus_name_has_owner(conn, BENCH_SERVICE, NULL)) {
+        usleep(10000);
+    }
+
+    printf("%-16s %d replies in %.3f s, %.0f replies/s\n", label,
+           replies, secs, replies / secs);
+}
+
+int main(int argc, char *argv[])
+{
+    DBusConnection *conn;
+    int n_calls = N_CALLS;
+
+    if (argc > 1) {
+        n_calls = atoi(argv[1]);
+    }
+
+    conn = dbus_bus_get_private(DBUS_BUS_SESSION, NULL);
+    if (conn == NULL) {
+        fprintf(stderr, "could not connect to the session bus\n");
+        return 1;
+    }
+    dbus_connection_set_exit_on_disconnect(conn, FALSE);
+
+    run(conn, "immediate", OSSO_FLUSH_IMMEDIATE, n_calls);
+    run(conn, "end-of-dispatch", OSSO_FLUSH_END_OF_DISPATCH, n_calls);
+    run(conn, "idle", OSSO_FLUSH_IDLE, n_calls);
+
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+    return 0;
+}
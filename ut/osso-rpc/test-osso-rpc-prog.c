@@ -34,14 +34,23 @@
 #define TEST_OBJECT  "/com/nokia/rpc_test"
 #define TEST_IFACE   "com.nokia.rpc_test"
 
+#define DEFERRED_VALUE 4711
+
+#define BORROWED_OBJECT "/com/nokia/test_osso_rpc/borrowed"
+#define BORROWED_IFACE  "com.nokia.test_osso_rpc.borrowed"
+
 gint cb(const gchar *interface, const gchar *method,
 	GArray *arguments, gpointer data, osso_rpc_t *retval);
+static gint borrowed_cb(const gchar *interface, const gchar *method,
+			const osso_rpc_t *args, guint n_args,
+			gpointer data, osso_rpc_t *retval);
+
+static osso_context_t *osso;
 
 int main(int nargs, char *argv[])
 {
     FILE *f;
     GMainLoop *loop;
-    osso_context_t *osso;
 
     f = fopen(LOGFILE, "a");
 
@@ -57,12 +66,91 @@ int main(int nargs, char *argv[])
     dprint("cb = %p",cb);
     osso_rpc_set_cb_f(osso, TEST_SERVICE, TEST_OBJECT, TEST_IFACE,
 		      (osso_rpc_cb_f*)cb,(gpointer)loop);
+    osso_rpc_set_borrowed_cb_f(osso, "com.nokia."APP_NAME, BORROWED_OBJECT,
+			       BORROWED_IFACE, borrowed_cb, NULL, NULL);
+    osso_rpc_peer_listen(osso);
     g_main_loop_run(loop);
     osso_deinitialize(osso);
 
     return 0;
 }
 
+/* sends the reply of the "defer" method from the main loop */
+static gboolean complete_deferred(gpointer data)
+{
+    osso_rpc_t val;
+
+    val.type = DBUS_TYPE_INT32;
+    val.value.i = DEFERRED_VALUE;
+    osso_rpc_complete_reply((osso_rpc_reply_token_t*)data, &val);
+    return FALSE;
+}
+
+/* the number of byte arrays summed by borrowed_cb */
+static gint borrowed_calls = 0;
+/* the number of bulk arguments that borrowed_cb got in a memfd */
+static gint bulk_mapped = 0;
+
+/* "sum" returns the sum of a byte array that is still in the message,
+ * "calls" the number of sums, "bulk" the sum of bulk data, "mapped"
+ * the number of bulk arguments that were mapped, and "via_peer" whether
+ * the call came over a direct connection */
+static gint borrowed_cb(const gchar *interface, const gchar *method,
+			const osso_rpc_t *args, guint n_args,
+			gpointer data, osso_rpc_t *retval)
+{
+    if (strcmp(method, "sum") == 0 && n_args == 1
+	&& args[0].type == DBUS_TYPE_ARRAY
+	&& args[0].value.a->elem_type == DBUS_TYPE_BYTE
+	&& args[0].value.a->borrowed) {
+	const guchar *bytes = args[0].value.a->data;
+	guint i;
+
+	++borrowed_calls;
+	retval->type = DBUS_TYPE_INT32;
+	retval->value.i = 0;
+	for (i = 0; i < args[0].value.a->len; ++i)
+	    retval->value.i += bytes[i];
+	return OSSO_OK;
+    }
+    else if (strcmp(method, "calls") == 0) {
+	retval->type = DBUS_TYPE_INT32;
+	retval->value.i = borrowed_calls;
+	return OSSO_OK;
+    }
+    else if (strcmp(method, "bulk") == 0 && n_args == 1) {
+	osso_rpc_bulk_t bulk;
+	const guchar *bytes;
+	gsize i;
+
+	if (osso_rpc_bulk_map(&args[0], &bulk) == OSSO_OK) {
+	    if (bulk.mapped)
+		++bulk_mapped;
+	    bytes = bulk.data;
+	    retval->type = DBUS_TYPE_INT32;
+	    retval->value.i = 0;
+	    for (i = 0; i < bulk.len; ++i)
+		retval->value.i += bytes[i];
+	    osso_rpc_bulk_unmap(&bulk);
+	    return OSSO_OK;
+	}
+    }
+    else if (strcmp(method, "mapped") == 0) {
+	retval->type = DBUS_TYPE_INT32;
+	retval->value.i = bulk_mapped;
+	return OSSO_OK;
+    }
+    else if (strcmp(method, "via_peer") == 0) {
+	retval->type = DBUS_TYPE_INT32;
+	retval->value.i = g_slist_find(osso->peer_conns, osso->cur_conn)
+	    != NULL;
+	return OSSO_OK;
+    }
+    retval->type = DBUS_TYPE_STRING;
+    retval->value.s = "unexpected arguments";
+    return OSSO_ERROR;
+}
+
 gint cb(const gchar *interface, const gchar *method,
 	GArray *arguments, gpointer data, osso_rpc_t *retval)
 {
@@ -128,7 +216,27 @@ gint cb(const gchar *interface, const gchar *method,
     fprintf(f, ")\n");
     fprintf(f, "stop = %s\n",stop?"TRUE":"FALSE");
     fclose(f);
-    if(strcmp(method,"echo")==0) {
+    if(strcmp(method,"defer")==0) {
+	osso_rpc_reply_token_t *token;
+
+	dprint("defer method");
+	token = osso_rpc_defer_reply(osso);
+	if (token != NULL) {
+	    g_timeout_add(100, complete_deferred, token);
+	    return OSSO_RPC_PENDING;
+	}
+	retval->type = DBUS_TYPE_STRING;
+	retval->value.s = "could not defer";
+	return OSSO_ERROR;
+    }
+    else if(strcmp(method,"flush_policy")==0) {
+	osso_rpc_t *arg;
+	dprint("flush_policy method");
+	arg = &g_array_index(arguments, osso_rpc_t, 0);
+	retval->type = DBUS_TYPE_INT32;
+	retval->value.i = osso_set_flush_policy(osso, arg->value.i);
+    }
+    else if(strcmp(method,"echo")==0) {
 	osso_rpc_t *arg;
 	dprint("echo method");
 	arg = &g_array_index(arguments, osso_rpc_t, 0);
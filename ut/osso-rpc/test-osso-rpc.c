@@ -47,6 +47,7 @@ int test_osso_rpc_unset_default_cb_invalid_osso (void);
 int test_osso_rpc_unset_default_cb_invalid_cb (void);
 int test_osso_rpc_unset_default_cb (void);
 int test_osso_rpc_run_and_return_default (void);
+int test_osso_rpc_default_names_eviction (void);
 gboolean rpc_run_ret_cb (gpointer data);
 int test_osso_rpc_set_cb_with_invalid_osso (void);
 int test_osso_rpc_set_cb_with_invalid_service (void);
@@ -60,6 +61,7 @@ int test_osso_rpc_unset_cb_with_invalid_object (void);
 int test_osso_rpc_unset_cb_with_invalid_if (void);
 int test_osso_rpc_unset_cb_with_invalid_cb (void);
 int test_osso_rpc_unset_cb (void);
+int test_osso_rpc_cb_after_member_miss (void);
 int test_osso_rpc_run_and_return (void);
 int test_sending_all_types (void);
 gboolean rpc_run_ret_cb2 (gpointer data);
@@ -75,6 +77,27 @@ int test_osso_rpc_async_run_with_empty_args (void);
 int test_osso_rpc_async_run (void);
 int test_osso_rpc_async_run_and_return (void);
 int test_osso_rpc_run_multiple_args (void);
+int test_osso_rpc_defer_reply_outside_cb (void);
+int test_osso_rpc_defer_reply (void);
+int test_osso_rpc_defer_reply_flush_idle (void);
+int test_osso_rpc_batch_invalid (void);
+int test_osso_rpc_batch_same_service (void);
+int test_osso_rpc_async_call_cancel (void);
+int test_osso_rpc_async_call_cancel_done (void);
+int test_osso_name_owner_cache (void);
+int test_osso_rpc_set_array (void);
+int test_osso_rpc_set_borrowed_cb_f (void);
+int test_osso_rpc_borrowed_call (void);
+int test_osso_rpc_bulk_map_inline (void);
+int test_osso_rpc_bulk_call (void);
+int test_osso_rpc_peer_listen (void);
+int test_osso_rpc_peer_call (void);
+int test_osso_rpc_cache (void);
+int test_osso_rpc_cache_hit (void);
+int test_osso_rpc_template (void);
+int test_muali_send_reply (void);
+int test_muali_send_error (void);
+int test_muali_nested_args (void);
 void async_ret_handler (const gchar * interface, const gchar * method,
                         osso_rpc_t * retval, gpointer data);
 
@@ -94,6 +117,9 @@ testcase *get_tests(void);
 #define TOP_IFACE   "com.nokia."TOP_NAME
 #define LAUNCH_METHOD  OSSO_BUS_ACTIVATE
 
+#define BORROWED_OBJECT TOP_OBJECT"/borrowed"
+#define BORROWED_IFACE  TOP_IFACE".borrowed"
+
 #define TESTFILE "/tmp/"TOP_NAME".tmp"
 
 
@@ -415,6 +441,58 @@ int test_osso_rpc_run_and_return_default( void )
 
 }
 
+/* the default names of an application are made again after the table
+ * of the context has been emptied */
+int test_osso_rpc_default_names_eviction( void )
+{
+    osso_context_t *osso;
+    const _osso_default_names_t *names;
+    osso_rpc_t retval;
+    gchar app[32];
+    gint r, i;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    retval.type = DBUS_TYPE_INVALID;
+    r = osso_rpc_run_with_defaults(osso, TEST_APP_NAME, "echo", &retval,
+				   DBUS_TYPE_INT32, 1, DBUS_TYPE_INVALID);
+    if (r != OSSO_OK || retval.type != DBUS_TYPE_INT32
+	|| retval.value.i != 1)
+	ok = 0;
+    osso_rpc_free_val(&retval);
+
+    /* more applications than the table holds */
+    for (i = 0; i < 40; ++i) {
+	g_snprintf(app, sizeof(app), "unit_test_names_%d", i);
+	if (osso_rpc_async_run_with_defaults(osso, app, "none", NULL, NULL,
+					     DBUS_TYPE_INVALID) != OSSO_OK)
+	    ok = 0;
+    }
+    if (g_hash_table_size(osso->default_names) > 32
+	|| g_hash_table_lookup(osso->default_names, TEST_APP_NAME) != NULL)
+	ok = 0;
+
+    retval.type = DBUS_TYPE_INVALID;
+    r = osso_rpc_run_with_defaults(osso, TEST_APP_NAME, "echo", &retval,
+				   DBUS_TYPE_INT32, 2, DBUS_TYPE_INVALID);
+    if (r != OSSO_OK || retval.type != DBUS_TYPE_INT32
+	|| retval.value.i != 2)
+	ok = 0;
+    osso_rpc_free_val(&retval);
+
+    names = g_hash_table_lookup(osso->default_names, TEST_APP_NAME);
+    if (names == NULL
+	|| strcmp(names->service, "com.nokia."TEST_APP_NAME) != 0
+	|| strcmp(names->path, "/com/nokia/"TEST_APP_NAME) != 0
+	|| strcmp(names->interface, "com.nokia."TEST_APP_NAME) != 0)
+	ok = 0;
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
 gboolean rpc_run_ret_cb(gpointer data)
 {
     struct foo *foobar;
@@ -638,6 +716,84 @@ int test_osso_rpc_unset_cb( void )
 	return 0;
 }
 
+/* the interface and object path of osso_rpc_peer_listen, which registers
+ * a handler for the "GetAddress" member only */
+#define PEER_OBJECT "/com/nokia/libosso/peer"
+#define PEER_IFACE  "com.nokia.libosso.peer"
+
+struct member_miss {
+    GMainLoop *loop;
+    gint calls;
+    gint value;
+};
+
+static gint member_miss_cb(const gchar *interface, const gchar *method,
+			   GArray *arguments, gpointer data,
+			   osso_rpc_t *retval)
+{
+    if (strcmp(method, "Other") == 0)
+	++((struct member_miss*)data)->calls;
+    retval->type = DBUS_TYPE_INT32;
+    retval->value.i = 4242;
+    return OSSO_OK;
+}
+
+static void member_miss_reply(const gchar *interface, const gchar *method,
+			      osso_rpc_t *retval, gpointer data)
+{
+    struct member_miss *miss = data;
+
+    if (retval->type == DBUS_TYPE_INT32)
+	miss->value = retval->value.i;
+    g_main_loop_quit(miss->loop);
+}
+
+static gboolean member_miss_timeout(gpointer data)
+{
+    g_main_loop_quit(((struct member_miss*)data)->loop);
+    return FALSE;
+}
+
+/* a handler set without a member is called for a member that has no
+ * handler of its own on the same interface and object path */
+int test_osso_rpc_cb_after_member_miss( void )
+{
+    osso_context_t *osso;
+    struct member_miss miss;
+    guint to;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_rpc_peer_listen(osso) != OSSO_OK)
+	ok = 0;
+    if (osso_rpc_set_cb_f(osso, "com.nokia."APP_NAME, PEER_OBJECT,
+			  PEER_IFACE, member_miss_cb, &miss) != OSSO_OK)
+	ok = 0;
+    /* an interned member is looked up, and not found, among the
+     * handlers for exact members */
+    g_quark_from_static_string("Other");
+
+    miss.loop = g_main_loop_new(NULL, FALSE);
+    miss.calls = 0;
+    miss.value = 0;
+    if (osso_rpc_async_run(osso, "com.nokia."APP_NAME, PEER_OBJECT,
+			   PEER_IFACE, "Other", member_miss_reply, &miss,
+			   DBUS_TYPE_INVALID) != OSSO_OK)
+	ok = 0;
+    to = g_timeout_add(5000, member_miss_timeout, &miss);
+    g_main_loop_run(miss.loop);
+    g_source_remove(to);
+
+    if (miss.calls != 1 || miss.value != 4242)
+	ok = 0;
+
+    g_main_loop_unref(miss.loop);
+    osso_deinitialize(osso);
+    return ok;
+}
+
 /***/
 int test_osso_rpc_run_and_return( void )
 {
@@ -1167,6 +1323,948 @@ void async_ret_handler(const gchar *interface, const gchar *method,
     return;
 }
 
+int test_osso_rpc_defer_reply_outside_cb( void )
+{
+    osso_context_t *osso;
+    osso_rpc_reply_token_t *token;
+    gint r;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    /* there is no call to reply to outside an RPC callback */
+    token = osso_rpc_defer_reply(osso);
+    r = osso_rpc_complete_reply(NULL, NULL);
+    osso_deinitialize(osso);
+
+    if(token == NULL && r == OSSO_INVALID)
+	return 1;
+    else
+	return 0;
+}
+
+/* the handler of the test program replies to "defer" from a timeout */
+int test_osso_rpc_defer_reply( void )
+{
+    osso_context_t *osso;
+    osso_rpc_t retval;
+    gint r;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    retval.type = DBUS_TYPE_INVALID;
+    r = osso_rpc_run(osso, TOP_SERVICE, TOP_OBJECT, TOP_IFACE, "defer",
+		     &retval, DBUS_TYPE_INVALID);
+    if (r != OSSO_OK || retval.type != DBUS_TYPE_INT32
+	|| retval.value.i != 4711)
+	ok = 0;
+    osso_rpc_free_val(&retval);
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+/* a deferred reply is sent outside of a dispatch, so with
+ * OSSO_FLUSH_IDLE only the idle flush of the test program writes it */
+int test_osso_rpc_defer_reply_flush_idle( void )
+{
+    osso_context_t *osso;
+    osso_rpc_t retval;
+    gint r;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    retval.type = DBUS_TYPE_INVALID;
+    r = osso_rpc_run(osso, TOP_SERVICE, TOP_OBJECT, TOP_IFACE,
+		     "flush_policy", &retval, DBUS_TYPE_INT32,
+		     OSSO_FLUSH_IDLE, DBUS_TYPE_INVALID);
+    if (r != OSSO_OK || retval.type != DBUS_TYPE_INT32
+	|| retval.value.i != OSSO_OK)
+	ok = 0;
+    osso_rpc_free_val(&retval);
+
+    retval.type = DBUS_TYPE_INVALID;
+    r = osso_rpc_run(osso, TOP_SERVICE, TOP_OBJECT, TOP_IFACE, "defer",
+		     &retval, DBUS_TYPE_INVALID);
+    if (r != OSSO_OK || retval.type != DBUS_TYPE_INT32
+	|| retval.value.i != 4711)
+	ok = 0;
+    osso_rpc_free_val(&retval);
+
+    retval.type = DBUS_TYPE_INVALID;
+    r = osso_rpc_run(osso, TOP_SERVICE, TOP_OBJECT, TOP_IFACE,
+		     "flush_policy", &retval, DBUS_TYPE_INT32,
+		     OSSO_FLUSH_IMMEDIATE, DBUS_TYPE_INVALID);
+    if (r != OSSO_OK)
+	ok = 0;
+    osso_rpc_free_val(&retval);
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_rpc_batch_invalid( void )
+{
+    osso_context_t *osso;
+    osso_rpc_batch_t *batch;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_rpc_batch_new(NULL) != NULL)
+	ok = 0;
+    batch = osso_rpc_batch_new(osso);
+    assert(batch != NULL);
+
+    /* an empty batch can not be sent */
+    if (osso_rpc_batch_send(batch, NULL, NULL) != OSSO_INVALID)
+	ok = 0;
+    if (osso_rpc_batch_add(batch, TOP_SERVICE, NULL, TOP_IFACE, "print",
+			   DBUS_TYPE_INVALID) != OSSO_INVALID)
+	ok = 0;
+    if (osso_rpc_batch_add(batch, TOP_SERVICE, TOP_OBJECT, TOP_IFACE,
+			   "print", DBUS_TYPE_INVALID) != OSSO_OK)
+	ok = 0;
+    /* no results before sending */
+    if (osso_rpc_batch_get_results(batch, NULL) != NULL)
+	ok = 0;
+
+    osso_rpc_batch_free(batch);
+    osso_deinitialize(osso);
+    return ok;
+}
+
+/* the calls to one service are notified about once, and every reply
+ * gets to its own result */
+int test_osso_rpc_batch_same_service( void )
+{
+    osso_context_t *osso;
+    osso_rpc_batch_t *batch;
+    const osso_rpc_batch_result_t *results;
+    guint n = 0, i;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+    batch = osso_rpc_batch_new(osso);
+    assert(batch != NULL);
+
+    for (i = 0; i < 3; ++i) {
+	if (osso_rpc_batch_add(batch, TOP_SERVICE, TOP_OBJECT, TOP_IFACE,
+			       "echo", DBUS_TYPE_INT32, 100 + i,
+			       DBUS_TYPE_INVALID) != OSSO_OK)
+	    ok = 0;
+    }
+    if (osso_rpc_batch_wait(batch, -1) != OSSO_OK)
+	ok = 0;
+
+    results = osso_rpc_batch_get_results(batch, &n);
+    if (results == NULL || n != 3) {
+	ok = 0;
+    } else {
+	for (i = 0; i < n; ++i) {
+	    if (results[i].status != OSSO_OK
+		|| results[i].retval.type != DBUS_TYPE_INT32
+		|| results[i].retval.value.i != 100 + (gint)i)
+		ok = 0;
+	}
+    }
+
+    osso_rpc_batch_free(batch);
+    osso_deinitialize(osso);
+    return ok;
+}
+
+static void count_destroy(gpointer data)
+{
+    ++*(int*)data;
+}
+
+int test_osso_rpc_async_call_cancel( void )
+{
+    osso_context_t *osso;
+    osso_rpc_call_t *call;
+    int destroyed = 0;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    /* async_cb is required */
+    if (osso_rpc_async_call(osso, TOP_SERVICE, TOP_OBJECT, TOP_IFACE,
+			    "echo", 1000, NULL, NULL, NULL,
+			    DBUS_TYPE_INVALID) != NULL) {
+	osso_deinitialize(osso);
+	return 0;
+    }
+
+    call = osso_rpc_async_call(osso, TOP_SERVICE, TOP_OBJECT, TOP_IFACE,
+			       "echo", 1000, async_ret_handler, &destroyed,
+			       count_destroy, DBUS_TYPE_INVALID);
+    assert(call != NULL);
+
+    /* the data is released right away, the handler is never called */
+    osso_rpc_call_cancel(call);
+    osso_deinitialize(osso);
+
+    if(destroyed == 1)
+	return 1;
+    else
+	return 0;
+}
+
+struct done_call {
+    GMainLoop *loop;
+    gint value;
+    int destroyed;
+};
+
+static void done_call_cb(const gchar *interface, const gchar *method,
+			 osso_rpc_t *retval, gpointer data)
+{
+    struct done_call *done = data;
+
+    if (retval->type == DBUS_TYPE_INT32)
+	done->value = retval->value.i;
+    g_main_loop_quit(done->loop);
+}
+
+static void done_call_destroy(gpointer data)
+{
+    ++((struct done_call*)data)->destroyed;
+}
+
+static gboolean done_call_timeout(gpointer data)
+{
+    g_main_loop_quit(((struct done_call*)data)->loop);
+    return FALSE;
+}
+
+int test_osso_rpc_async_call_cancel_done( void )
+{
+    osso_context_t *osso;
+    osso_rpc_call_t *call;
+    struct done_call done;
+    guint to;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    done.loop = g_main_loop_new(NULL, FALSE);
+    done.value = 0;
+    done.destroyed = 0;
+
+    call = osso_rpc_async_call(osso, TOP_SERVICE, TOP_OBJECT, TOP_IFACE,
+			       "echo", 5000, done_call_cb, &done,
+			       done_call_destroy, DBUS_TYPE_INT32, 4242,
+			       DBUS_TYPE_INVALID);
+    assert(call != NULL);
+    to = g_timeout_add(10000, done_call_timeout, &done);
+    g_main_loop_run(done.loop);
+    g_source_remove(to);
+
+    /* the data goes with the reply, the handle stays valid */
+    if (done.value != 4242 || done.destroyed != 1)
+	ok = 0;
+
+    /* releasing the handle of a completed call is a no-op otherwise */
+    osso_rpc_call_cancel(call);
+    if (done.destroyed != 1)
+	ok = 0;
+
+    g_main_loop_unref(done.loop);
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_name_owner_cache( void )
+{
+    osso_context_t *osso;
+    const gchar *owner;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    /* the context owns its own service name */
+    if (osso_name_watch(osso, "com.nokia."APP_NAME, FALSE) != OSSO_OK)
+	ok = 0;
+    if (!osso_name_has_owner(osso, "com.nokia."APP_NAME, FALSE))
+	ok = 0;
+    owner = osso_name_get_owner(osso, "com.nokia."APP_NAME, FALSE);
+    if (owner == NULL
+	|| strcmp(owner, dbus_bus_get_unique_name(osso->conn)) != 0)
+	ok = 0;
+    if (osso_name_unwatch(osso, "com.nokia."APP_NAME, FALSE) != OSSO_OK)
+	ok = 0;
+    if (osso_name_unwatch(osso, "com.nokia."APP_NAME, FALSE)
+	!= OSSO_INVALID)
+	ok = 0;
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_rpc_set_array( void )
+{
+    const guchar bytes[] = { 0, 1, 2, 255 };
+    const gchar *strs[] = { "foo", "bar" };
+    osso_rpc_dict_entry_t entries[2];
+    osso_rpc_t val;
+    int ok = 1;
+
+    if (osso_rpc_set_byte_array(&val, bytes, sizeof(bytes)) != OSSO_OK)
+	return 0;
+    if (val.type != DBUS_TYPE_ARRAY || val.value.a->len != sizeof(bytes)
+	|| val.value.a->borrowed
+	|| memcmp(val.value.a->data, bytes, sizeof(bytes)) != 0)
+	ok = 0;
+    osso_rpc_free_val(&val);
+
+    /* the dictionary is copied deeply */
+    if (osso_rpc_set_array(&val, DBUS_TYPE_STRING, strs, 2) != OSSO_OK)
+	return 0;
+    entries[0].key = "strings";
+    entries[0].value = val;
+    entries[1].key = "number";
+    entries[1].value.type = DBUS_TYPE_INT32;
+    entries[1].value.value.i = 42;
+    if (osso_rpc_set_array(&val, DBUS_TYPE_DICT_ENTRY, entries, 2)
+	!= OSSO_OK)
+	return 0;
+    osso_rpc_free_val(&entries[0].value);
+    {
+	const osso_rpc_dict_entry_t *e = val.value.a->data;
+	const gchar * const *s = e[0].value.value.a->data;
+
+	if (strcmp(e[0].key, "strings") != 0 || strcmp(s[1], "bar") != 0
+	    || e[1].value.value.i != 42)
+	    ok = 0;
+    }
+    osso_rpc_free_val(&val);
+
+    /* nested arrays other than dictionaries are not supported */
+    if (osso_rpc_set_array(&val, DBUS_TYPE_ARRAY, NULL, 0) != OSSO_INVALID)
+	ok = 0;
+    return ok;
+}
+
+static gint borrowed_cb(const gchar *interface, const gchar *method,
+                        const osso_rpc_t *args, guint n_args,
+                        gpointer data, osso_rpc_t *retval)
+{
+    retval->type = DBUS_TYPE_INVALID;
+    return OSSO_OK;
+}
+
+int test_osso_rpc_set_borrowed_cb_f( void )
+{
+    osso_context_t *osso;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_rpc_set_borrowed_cb_f(osso, TEST_SERVICE, TEST_OBJECT,
+				   TEST_IFACE, NULL, NULL, NULL)
+	!= OSSO_INVALID)
+	ok = 0;
+    if (osso_rpc_set_borrowed_cb_f(osso, TEST_SERVICE, TEST_OBJECT,
+				   TEST_IFACE, borrowed_cb, NULL, NULL)
+	!= OSSO_OK)
+	ok = 0;
+    if (osso_rpc_unset_borrowed_cb_f(osso, TEST_SERVICE, TEST_OBJECT,
+				     TEST_IFACE, borrowed_cb, NULL)
+	!= OSSO_OK)
+	ok = 0;
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+/* calls the borrowed_cb of test-osso-rpc-prog, returns -1 on error */
+static gint borrowed_call(osso_context_t *osso, const gchar *method,
+			  const guchar *bytes, guint len)
+{
+    osso_rpc_t arg, ret;
+    osso_return_t r;
+    gint value = -1;
+
+    ret.type = DBUS_TYPE_INVALID;
+    if (bytes != NULL) {
+	if (osso_rpc_set_byte_array(&arg, bytes, len) != OSSO_OK)
+	    return -1;
+	r = osso_rpc_run(osso, TOP_SERVICE, BORROWED_OBJECT, BORROWED_IFACE,
+			 method, &ret, DBUS_TYPE_ARRAY, arg.value.a,
+			 DBUS_TYPE_INVALID);
+	osso_rpc_free_val(&arg);
+    } else {
+	r = osso_rpc_run(osso, TOP_SERVICE, BORROWED_OBJECT, BORROWED_IFACE,
+			 method, &ret, DBUS_TYPE_INVALID);
+    }
+    if (r == OSSO_OK && ret.type == DBUS_TYPE_INT32)
+	value = ret.value.i;
+    osso_rpc_free_val(&ret);
+    return value;
+}
+
+int test_osso_rpc_borrowed_call( void )
+{
+    const guchar small[] = { 1, 2, 3 };
+    guchar large[4096];
+    osso_context_t *osso;
+    gint calls, sum = 0;
+    guint i;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    for (i = 0; i < sizeof(large); ++i) {
+	large[i] = i % 7;
+	sum += large[i];
+    }
+
+    /* the prog may be running from an earlier test */
+    calls = borrowed_call(osso, "calls", NULL, 0);
+    if (calls < 0)
+	ok = 0;
+    if (borrowed_call(osso, "sum", small, sizeof(small)) != 6)
+	ok = 0;
+    if (borrowed_call(osso, "sum", large, sizeof(large)) != sum)
+	ok = 0;
+    if (borrowed_call(osso, "calls", NULL, 0) != calls + 2)
+	ok = 0;
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_rpc_bulk_map_inline( void )
+{
+    const guchar bytes[] = { 1, 2, 3 };
+    osso_rpc_bulk_t bulk;
+    osso_rpc_t val;
+    int ok = 1;
+
+    /* inline bulk data arrives as a byte array and is not copied */
+    if (osso_rpc_set_byte_array(&val, bytes, sizeof(bytes)) != OSSO_OK)
+	return 0;
+    if (osso_rpc_bulk_map(&val, &bulk) != OSSO_OK
+	|| bulk.mapped || bulk.len != sizeof(bytes)
+	|| bulk.data != val.value.a->data)
+	ok = 0;
+    osso_rpc_bulk_unmap(&bulk);
+    osso_rpc_free_val(&val);
+
+    val.type = DBUS_TYPE_INT32;
+    val.value.i = 0;
+    if (osso_rpc_bulk_map(&val, &bulk) != OSSO_INVALID)
+	ok = 0;
+    return ok;
+}
+
+/* sends bulk data to the borrowed_cb of test-osso-rpc-prog */
+static gint bulk_call(osso_context_t *osso, const guchar *bytes, gsize len)
+{
+    osso_rpc_bulk_t bulk;
+    osso_rpc_t ret;
+    gint value = -1;
+
+    bulk.data = bytes;
+    bulk.len = len;
+    bulk.mapped = FALSE;
+    ret.type = DBUS_TYPE_INVALID;
+    if (osso_rpc_run(osso, TOP_SERVICE, BORROWED_OBJECT, BORROWED_IFACE,
+		     "bulk", &ret, OSSO_RPC_TYPE_BULK, &bulk,
+		     DBUS_TYPE_INVALID) == OSSO_OK
+	&& ret.type == DBUS_TYPE_INT32)
+	value = ret.value.i;
+    osso_rpc_free_val(&ret);
+    return value;
+}
+
+int test_osso_rpc_bulk_call( void )
+{
+    const guchar small[] = { 1, 2, 3 };
+    static guchar large[64 * 1024];
+    osso_context_t *osso;
+    gint mapped, sum = 0;
+    gsize i;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    for (i = 0; i < sizeof(large); ++i) {
+	large[i] = i % 251;
+	sum += large[i];
+    }
+
+    mapped = borrowed_call(osso, "mapped", NULL, 0);
+    if (mapped < 0)
+	ok = 0;
+
+    /* small data goes inline */
+    if (bulk_call(osso, small, sizeof(small)) != 6)
+	ok = 0;
+    if (borrowed_call(osso, "mapped", NULL, 0) != mapped)
+	ok = 0;
+
+    /* large data goes in a memfd when the bus passes fds */
+    if (bulk_call(osso, large, sizeof(large)) != sum)
+	ok = 0;
+#ifdef HAVE_MEMFD_CREATE
+    if (dbus_connection_can_send_type(osso->conn, DBUS_TYPE_UNIX_FD)) {
+	if (borrowed_call(osso, "mapped", NULL, 0) != mapped + 1)
+	    ok = 0;
+    }
+#endif
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_rpc_peer_listen( void )
+{
+    osso_context_t *osso;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_rpc_peer_listen(osso) != OSSO_OK)
+	ok = 0;
+    /* listening again is a no-op */
+    if (osso_rpc_peer_listen(osso) != OSSO_OK)
+	ok = 0;
+    if (osso_rpc_peer_connect(osso, NULL) != OSSO_INVALID)
+	ok = 0;
+    if (osso_rpc_peer_disconnect(osso, TEST_SERVICE) != OSSO_INVALID)
+	ok = 0;
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_rpc_peer_call( void )
+{
+    const guchar bytes[] = { 4, 5, 6 };
+    osso_context_t *osso;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    /* this also starts the prog */
+    if (borrowed_call(osso, "via_peer", NULL, 0) != 0)
+	ok = 0;
+
+    if (osso_rpc_peer_connect(osso, TOP_SERVICE) != OSSO_OK)
+	ok = 0;
+    if (osso->peers == NULL
+	|| g_hash_table_lookup(osso->peers, TOP_SERVICE) == NULL)
+	ok = 0;
+    /* connecting again is a no-op */
+    if (osso_rpc_peer_connect(osso, TOP_SERVICE) != OSSO_OK)
+	ok = 0;
+    if (borrowed_call(osso, "via_peer", NULL, 0) != 1)
+	ok = 0;
+    if (borrowed_call(osso, "sum", bytes, sizeof(bytes)) != 15)
+	ok = 0;
+
+    /* the calls go through the bus again */
+    if (osso_rpc_peer_disconnect(osso, TOP_SERVICE) != OSSO_OK)
+	ok = 0;
+    if (borrowed_call(osso, "via_peer", NULL, 0) != 0)
+	ok = 0;
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_rpc_cache( void )
+{
+    osso_context_t *osso;
+    osso_rpc_cache_t *cache;
+    guint hits = 1, misses = 1;
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_rpc_cache_new(osso, NULL, TEST_OBJECT, TEST_IFACE, "get",
+			   0, FALSE) != NULL)
+	ok = 0;
+    cache = osso_rpc_cache_new(osso, TEST_SERVICE, TEST_OBJECT, TEST_IFACE,
+			       "get", 1000, FALSE);
+    if (cache == NULL)
+	return 0;
+    /* a method has only one cache */
+    if (osso_rpc_cache_new(osso, TEST_SERVICE, TEST_OBJECT, TEST_IFACE,
+			   "get", 0, FALSE) != NULL)
+	ok = 0;
+    if (osso_rpc_cache_invalidate_on(cache, TEST_OBJECT, TEST_IFACE,
+				     NULL) != OSSO_INVALID)
+	ok = 0;
+    if (osso_rpc_cache_invalidate_on(cache, TEST_OBJECT, TEST_IFACE,
+				     "changed") != OSSO_OK)
+	ok = 0;
+    osso_rpc_cache_get_stats(cache, &hits, &misses);
+    if (hits != 0 || misses != 0)
+	ok = 0;
+    osso_rpc_cache_clear(cache);
+    osso_rpc_cache_free(cache);
+
+    /* the method can be cached again, and the cache is freed with the
+     * context */
+    cache = osso_rpc_cache_new(osso, TEST_SERVICE, TEST_OBJECT, TEST_IFACE,
+			       "get", 0, FALSE);
+    if (cache == NULL)
+	ok = 0;
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_rpc_cache_hit( void )
+{
+    const guchar bytes[] = { 1, 2, 3 };
+    const guchar other[] = { 3, 4 };
+    osso_context_t *osso;
+    osso_rpc_cache_t *cache;
+    DBusMessage *signal;
+    guint hits = 0, misses = 0;
+    gint calls;
+    int i, ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    calls = borrowed_call(osso, "calls", NULL, 0);
+    if (calls < 0)
+	ok = 0;
+
+    cache = osso_rpc_cache_new(osso, TOP_SERVICE, BORROWED_OBJECT,
+			       BORROWED_IFACE, "sum", 0, FALSE);
+    assert(cache != NULL);
+    if (osso_rpc_cache_invalidate_on(cache, BORROWED_OBJECT,
+				     BORROWED_IFACE, "changed") != OSSO_OK)
+	ok = 0;
+
+    /* the second call is answered from the cache, a call with other
+     * arguments is sent */
+    if (borrowed_call(osso, "sum", bytes, sizeof(bytes)) != 6
+	|| borrowed_call(osso, "sum", bytes, sizeof(bytes)) != 6
+	|| borrowed_call(osso, "sum", other, sizeof(other)) != 7)
+	ok = 0;
+    osso_rpc_cache_get_stats(cache, &hits, &misses);
+    if (hits != 1 || misses != 2)
+	ok = 0;
+    if (borrowed_call(osso, "calls", NULL, 0) != calls + 2)
+	ok = 0;
+
+    /* the signal drops the replies */
+    signal = dbus_message_new_signal(BORROWED_OBJECT, BORROWED_IFACE,
+				     "changed");
+    assert(signal != NULL);
+    dbus_connection_send(osso->conn, signal, NULL);
+    dbus_message_unref(signal);
+    dbus_connection_flush(osso->conn);
+    for (i = 0; i < 50; ++i) {
+	while (g_main_context_iteration(NULL, FALSE))
+	    ;
+	usleep(10000);
+    }
+    if (borrowed_call(osso, "sum", bytes, sizeof(bytes)) != 6)
+	ok = 0;
+    osso_rpc_cache_get_stats(cache, &hits, &misses);
+    if (hits != 1 || misses != 3)
+	ok = 0;
+    if (borrowed_call(osso, "calls", NULL, 0) != calls + 3)
+	ok = 0;
+
+    osso_rpc_cache_free(cache);
+    osso_deinitialize(osso);
+    return ok;
+}
+
+int test_osso_rpc_template( void )
+{
+    osso_context_t *osso;
+    osso_rpc_template_t *tmpl;
+    const char* s = "print This is a test";
+    int ok = 1;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    assert(osso != NULL);
+
+    if (osso_rpc_template_new(osso, TOP_SERVICE, NULL, TOP_IFACE,
+			      LAUNCH_METHOD, FALSE) != NULL)
+	ok = 0;
+    if (osso_rpc_template_run(NULL, NULL, DBUS_TYPE_INVALID) != OSSO_INVALID)
+	ok = 0;
+
+    tmpl = osso_rpc_template_new(osso, TOP_SERVICE, TOP_OBJECT, TOP_IFACE,
+				 LAUNCH_METHOD, FALSE);
+    if (tmpl == NULL)
+	return 0;
+    /* the template can be sent more than once */
+    if (osso_rpc_template_run(tmpl, NULL, DBUS_TYPE_STRING, s,
+			      DBUS_TYPE_INVALID) != OSSO_OK)
+	ok = 0;
+    if (osso_rpc_template_run(tmpl, NULL, DBUS_TYPE_STRING, s,
+			      DBUS_TYPE_INVALID) != OSSO_OK)
+	ok = 0;
+    osso_rpc_template_free(tmpl);
+
+    osso_deinitialize(osso);
+    return ok;
+}
+
+struct muali_reply {
+    GMainLoop *loop;
+    int calls;
+    int event_type;
+    gchar *value;	/* the string of the reply, or the error */
+};
+
+static void muali_reply_cb(muali_context_t *context,
+			   const muali_event_info_t *info, void *data)
+{
+    struct muali_reply *reply = data;
+
+    ++reply->calls;
+    reply->event_type = info->event_type;
+    g_free(reply->value);
+    if (info->error != NULL)
+	reply->value = g_strdup(info->error);
+    else if (info->args != NULL && info->args[0].type == MUALI_TYPE_STRING)
+	reply->value = g_strdup(info->args[0].value.s);
+    else
+	reply->value = NULL;
+    g_main_loop_quit(reply->loop);
+}
+
+static gboolean muali_reply_timeout(gpointer data)
+{
+    g_main_loop_quit(((struct muali_reply*)data)->loop);
+    return FALSE;
+}
+
+/* Calls method of the test program with muali_send_varargs and waits for
+ * the reply, and then a while longer in case the handler is called
+ * again. Returns the number of reply handlers left in the context, or
+ * -1 if the call could not be sent. */
+static int muali_round_trip(const char *name, const char *method,
+			    struct muali_reply *reply)
+{
+    muali_context_t *muali;
+    guint to;
+    int i, pending = -1;
+
+    muali = muali_init(name, APP_VER, NULL);
+    assert(muali != NULL);
+
+    reply->loop = g_main_loop_new(NULL, FALSE);
+    reply->calls = 0;
+    reply->event_type = MUALI_EVENT_NONE;
+    reply->value = NULL;
+
+    if (muali_send_varargs(muali, muali_reply_cb, reply, MUALI_BUS_SESSION,
+			   TOP_NAME, method, MUALI_TYPE_STRING, "hello",
+			   MUALI_TYPE_INVALID) == MUALI_ERROR_SUCCESS) {
+	to = g_timeout_add(5000, muali_reply_timeout, reply);
+	g_main_loop_run(reply->loop);
+	g_source_remove(to);
+	for (i = 0; i < 20; ++i) {
+	    while (g_main_context_iteration(NULL, FALSE))
+		;
+	    usleep(10000);
+	}
+	pending = g_hash_table_size(((osso_context_t*)muali)->reply_hash);
+    }
+
+    g_main_loop_unref(reply->loop);
+    /* there is no deinitialisation for a muali context */
+    return pending;
+}
+
+int test_muali_send_reply( void )
+{
+    struct muali_reply reply;
+    int ok = 1;
+
+    if (muali_round_trip("unit_test_muali_reply", "echo", &reply) != 0)
+	ok = 0;
+    if (reply.calls != 1 || reply.event_type != MUALI_EVENT_REPLY
+	|| reply.value == NULL || strcmp(reply.value, "hello") != 0)
+	ok = 0;
+    g_free(reply.value);
+    return ok;
+}
+
+/* the "error" method of the test program answers with an error */
+int test_muali_send_error( void )
+{
+    struct muali_reply reply;
+    int ok = 1;
+
+    if (muali_round_trip("unit_test_muali_error", "error", &reply) != 0)
+	ok = 0;
+    if (reply.calls != 1 || reply.event_type != MUALI_EVENT_ERROR
+	|| reply.value == NULL || strcmp(reply.value, "error") != 0)
+	ok = 0;
+    g_free(reply.value);
+    return ok;
+}
+
+#define NESTED_OBJECT "/com/nokia/unit_test/nested"
+#define NESTED_IFACE  "com.nokia.unit_test.nested"
+
+struct nested {
+    GMainLoop *loop;
+    int inner_calls;
+    int inner_in_arena;	/* the inner arguments were in the arena */
+    int outer_calls;
+    int outer_ok;	/* the outer arguments outlived the inner events */
+};
+
+/* sends a signal with a string and n_ints copies of value */
+static int send_nested(DBusConnection *conn, const char *member,
+		       const char *s, dbus_int32_t value, int n_ints)
+{
+    DBusMessage *msg;
+    int i, ok;
+
+    msg = dbus_message_new_signal(NESTED_OBJECT, NESTED_IFACE, member);
+    assert(msg != NULL);
+    ok = dbus_message_append_args(msg, DBUS_TYPE_STRING, &s,
+				  DBUS_TYPE_INVALID);
+    for (i = 0; i < n_ints; ++i)
+	ok = ok && dbus_message_append_args(msg, DBUS_TYPE_INT32, &value,
+					    DBUS_TYPE_INVALID);
+    ok = ok && dbus_connection_send(conn, msg, NULL);
+    dbus_message_unref(msg);
+    dbus_connection_flush(conn);
+    return ok;
+}
+
+static int wait_inner(struct nested *nested, int calls)
+{
+    int i;
+
+    for (i = 0; i < 500 && nested->inner_calls < calls; ++i) {
+	while (g_main_context_iteration(NULL, FALSE))
+	    ;
+	if (nested->inner_calls < calls)
+	    usleep(10000);
+    }
+    return nested->inner_calls == calls;
+}
+
+static void nested_inner(muali_context_t *context,
+			 const muali_event_info_t *info, void *data)
+{
+    struct nested *nested = data;
+    osso_context_t *osso = (osso_context_t*)context;
+
+    if (info->bus_type != MUALI_BUS_SYSTEM
+	|| strcmp(info->name, "inner") != 0)
+	return;
+    ++nested->inner_calls;
+    nested->inner_in_arena = info->args >= osso->arg_arena
+	&& info->args < osso->arg_arena + osso->arg_arena_size;
+}
+
+/* receives two events on the system bus while its own arguments, from
+ * the session bus, are in use */
+static void nested_outer(muali_context_t *context,
+			 const muali_event_info_t *info, void *data)
+{
+    struct nested *nested = data;
+    const muali_arg_t *args = info->args;
+    int i;
+
+    if (info->bus_type != MUALI_BUS_SESSION
+	|| strcmp(info->name, "outer") != 0)
+	return;
+    ++nested->outer_calls;
+    nested->outer_ok = 1;
+    for (i = 1; i <= 2; ++i) {
+	nested->inner_in_arena = 0;
+	if (!send_nested(((osso_context_t*)context)->sys_conn, "inner",
+			 "inner", -i, 1)
+	    || !wait_inner(nested, 1 + i) || !nested->inner_in_arena)
+	    nested->outer_ok = 0;
+    }
+
+    if (info->args != args || args[0].type != MUALI_TYPE_STRING
+	|| strcmp(args[0].value.s, "outer") != 0
+	|| args[1].type != MUALI_TYPE_INT || args[1].value.i != 42
+	|| args[2].type != MUALI_TYPE_INVALID)
+	nested->outer_ok = 0;
+    g_main_loop_quit(nested->loop);
+}
+
+static gboolean nested_timeout(gpointer data)
+{
+    g_main_loop_quit(((struct nested*)data)->loop);
+    return FALSE;
+}
+
+int test_muali_nested_args( void )
+{
+    muali_context_t *muali;
+    struct nested nested;
+    int id, ok = 1;
+    guint to;
+
+    muali = muali_init("unit_test_muali_nested", APP_VER, NULL);
+    assert(muali != NULL);
+
+    memset(&nested, 0, sizeof(nested));
+    nested.loop = g_main_loop_new(NULL, FALSE);
+
+    /* both are called for every signal on both buses */
+    if (muali_set_event_handler(muali, MUALI_EVENT_SIGNAL, nested_inner,
+				&nested, &id) != MUALI_ERROR_SUCCESS
+	|| muali_set_event_handler(muali, MUALI_EVENT_SIGNAL, nested_outer,
+				   &nested, &id) != MUALI_ERROR_SUCCESS)
+	ok = 0;
+
+    /* the match rules are added from the main loop */
+    while (g_main_context_iteration(NULL, FALSE))
+	;
+
+    /* with many arguments, so that the arena has room for the outer and
+     * the inner arguments afterwards */
+    if (!send_nested(((osso_context_t*)muali)->sys_conn, "inner", "warm",
+		     0, 6)
+	|| !wait_inner(&nested, 1))
+	ok = 0;
+
+    if (!send_nested(((osso_context_t*)muali)->conn, "outer", "outer",
+		     42, 1))
+	ok = 0;
+    to = g_timeout_add(10000, nested_timeout, &nested);
+    g_main_loop_run(nested.loop);
+    g_source_remove(to);
+
+    if (nested.outer_calls != 1 || !nested.outer_ok
+	|| nested.inner_calls != 3)
+	ok = 0;
+
+    g_main_loop_unref(nested.loop);
+    /* there is no deinitialisation for a muali context */
+    return ok;
+}
+
 testcase cases[] = {
     {*test_osso_rpc_run_with_invalid_osso,
 	    "osso_rpc_run with invalid osso",
@@ -1201,6 +2299,9 @@ testcase cases[] = {
     {*test_osso_rpc_run_and_return_default,
 	    "testing return value",
 	    EXPECT_OK},
+    {*test_osso_rpc_default_names_eviction,
+	    "default names made again after the table is emptied",
+	    EXPECT_OK},
     {*test_osso_rpc_set_cb_with_invalid_osso,
 	    "osso_rpc_set_cb_f with invalid osso",
 	    EXPECT_OK},
@@ -1246,6 +2347,9 @@ testcase cases[] = {
     {*test_osso_rpc_unset_cb,
 	    "osso_rpc_unset_cb_f",
 	    EXPECT_OK},
+    {*test_osso_rpc_cb_after_member_miss,
+	    "osso_rpc_set_cb_f for a member without its own handler",
+	    EXPECT_OK},
     {*test_osso_rpc_run_and_return,
 	    "testing return value with non-default",
 	    EXPECT_OK},
@@ -1279,6 +2383,69 @@ testcase cases[] = {
     {*test_osso_rpc_run_multiple_args,
 	"osso_rpc_run multiplea args",
 	EXPECT_OK},
+    {*test_osso_rpc_defer_reply_outside_cb,
+	"osso_rpc_defer_reply outside a callback",
+	EXPECT_OK},
+    {*test_osso_rpc_defer_reply,
+	"osso_rpc_defer_reply and osso_rpc_complete_reply",
+	EXPECT_OK},
+    {*test_osso_rpc_defer_reply_flush_idle,
+	"osso_rpc_complete_reply with OSSO_FLUSH_IDLE",
+	EXPECT_OK},
+    {*test_osso_rpc_batch_invalid,
+	"osso_rpc_batch with invalid arguments",
+	EXPECT_OK},
+    {*test_osso_rpc_batch_same_service,
+	"osso_rpc_batch with several calls to one service",
+	EXPECT_OK},
+    {*test_osso_rpc_async_call_cancel,
+	"osso_rpc_async_call and cancel",
+	EXPECT_OK},
+    {*test_osso_rpc_async_call_cancel_done,
+	"osso_rpc_call_cancel after the reply",
+	EXPECT_OK},
+    {*test_osso_name_owner_cache,
+	"osso_name_watch and the owner cache",
+	EXPECT_OK},
+    {*test_osso_rpc_set_array,
+	"osso_rpc_set_array and osso_rpc_free_val",
+	EXPECT_OK},
+    {*test_osso_rpc_set_borrowed_cb_f,
+	"osso_rpc_set_borrowed_cb_f and unset",
+	EXPECT_OK},
+    {*test_osso_rpc_borrowed_call,
+	"osso_rpc_set_borrowed_cb_f through a real call",
+	EXPECT_OK},
+    {*test_osso_rpc_bulk_map_inline,
+	"osso_rpc_bulk_map with inline data",
+	EXPECT_OK},
+    {*test_osso_rpc_bulk_call,
+	"OSSO_RPC_TYPE_BULK inline and in a memfd",
+	EXPECT_OK},
+    {*test_osso_rpc_peer_listen,
+	"osso_rpc_peer_listen and invalid peer arguments",
+	EXPECT_OK},
+    {*test_osso_rpc_peer_call,
+	"osso_rpc_peer_connect and a call over the connection",
+	EXPECT_OK},
+    {*test_osso_rpc_cache,
+	"osso_rpc_cache_new, invalidation and counters",
+	EXPECT_OK},
+    {*test_osso_rpc_cache_hit,
+	"osso_rpc_cache hits, misses and invalidation by a signal",
+	EXPECT_OK},
+    {*test_osso_rpc_template,
+	"osso_rpc_template_run twice",
+	EXPECT_OK},
+    {*test_muali_send_reply,
+	"muali_send_varargs and its reply",
+	EXPECT_OK},
+    {*test_muali_send_error,
+	"muali_send_varargs and an error reply",
+	EXPECT_OK},
+    {*test_muali_nested_args,
+	"muali event arguments during a nested event",
+	EXPECT_OK},
     {0} /* remember the terminating null */
 };
 
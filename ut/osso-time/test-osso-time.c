@@ -54,6 +54,8 @@ int osso_time_set_notification_cb_invalid(void);
 int osso_time_set_notification_cb_invalid_func(void);
 int osso_time_set_notification_cb_valid(void);
 int osso_time_set_notification_and_time(void);
+int osso_time_set_notification_cb_shares_match(void);
+int osso_time_set_notification_other_path(void);
 
 testcase *get_tests(void);
 
@@ -245,6 +247,85 @@ int osso_time_set_notification_and_time(void)
         return 0;
 }
 
+/* two callbacks must share the match rule on the system bus */
+int osso_time_set_notification_cb_shares_match(void)
+{
+    osso_context_t *osso = NULL;
+    _osso_match_t *m;
+    int ok = 0;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    if (osso == NULL) {
+        dprint("Could not initialize osso");
+        return 0;
+    }
+    if (osso_time_set_notification_cb(osso, time_changed_callback,
+                                      NULL) != OSSO_OK
+        || osso_time_set_notification_cb(osso, time_changed_callback,
+                                         osso) != OSSO_OK) {
+        dprint("Could not set the callbacks");
+        osso_deinitialize(osso);
+        return 0;
+    }
+
+    if (osso->sys_match_rules != NULL
+        && g_hash_table_size(osso->sys_match_rules) == 1) {
+        m = g_hash_table_lookup(osso->sys_match_rules,
+                                "type='signal',interface='com.nokia.time',"
+                                "member='changed'");
+        ok = m != NULL && m->refcount == 2;
+    }
+    osso_deinitialize(osso);
+    return ok;
+}
+
+static void count_callback(gpointer data)
+{
+    ++*(int*)data;
+}
+
+/* the time signal is dispatched by interface and member, so it is
+ * received on any object path as before */
+int osso_time_set_notification_other_path(void)
+{
+    osso_context_t *osso = NULL;
+    DBusMessage *msg;
+    dbus_int64_t t = OK_TIME;
+    int count = 0, i;
+
+    osso = osso_initialize(APP_NAME, APP_VER, FALSE, NULL);
+    if (osso == NULL) {
+        dprint("Could not initialize osso");
+        return 0;
+    }
+    if (osso_time_set_notification_cb(osso, count_callback,
+                                      &count) != OSSO_OK) {
+        osso_deinitialize(osso);
+        return 0;
+    }
+    /* the match rule is added from the main loop */
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+
+    msg = dbus_message_new_signal("/com/nokia/time/other",
+                                  "com.nokia.time", "changed");
+    if (msg == NULL) {
+        osso_deinitialize(osso);
+        return 0;
+    }
+    dbus_message_append_args(msg, DBUS_TYPE_INT64, &t, DBUS_TYPE_INVALID);
+    dbus_connection_send(osso->sys_conn, msg, NULL);
+    dbus_message_unref(msg);
+
+    for (i = 0; i < 50 && count == 0; ++i) {
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+        usleep(100000);
+    }
+    osso_deinitialize(osso);
+    return count == 1;
+}
+
 testcase cases[] = {
     {*osso_time_set_invalid_osso,
     "time_set NULL osso",
@@ -273,6 +354,12 @@ testcase cases[] = {
     {*osso_time_set_notification_and_time,
      "time_set notification_cb and time",
      EXPECT_OK},
+    {*osso_time_set_notification_cb_shares_match,
+     "time_set notification_cb twice shares the match rule",
+     EXPECT_OK},
+    {*osso_time_set_notification_other_path,
+     "time_set notification_cb on another object path",
+     EXPECT_OK},
     
     {0}				/* remember the terminating null */
 };